@@ -0,0 +1,378 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "assetloader.h"
+#include "framescheduler.h"
+
+using namespace std;
+
+// Staging allocations start on this boundary
+static const size_t STAGING_ALIGNMENT = 64;
+
+// How long one wait for an upload fence may take before trying again
+static const GLuint64 FENCE_TIMEOUT_NS = 100000000;
+
+
+void initAssetLoader(AssetLoader& loader, unsigned int threads, size_t stagingBytes)
+{
+    loader.pending = 0;
+    loader.startTime = schedulerClock();
+    loader.doneTime = 0.0;
+    loader.workerSeconds = 0.0;
+    loader.uploadSeconds = 0.0;
+    loader.uploadedBytes = 0;
+
+    // Mid grey until the real image is there
+    ImageData grey;
+    grey.width = grey.height = 2;
+    grey.format = GL_BGR;
+    grey.pixels.assign(2 * 2 * 3, 128);
+    GLint alignment;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    loader.placeholder = createImageTexture(grey, grey.pixels.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+
+    loader.stagingBuffer = 0;
+    loader.staging = NULL;
+    loader.stagingSize = 0;
+    loader.stagingHead = 0;
+    if (GLEW_ARB_buffer_storage && stagingBytes > 0) {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &loader.stagingBuffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, loader.stagingBuffer);
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, stagingBytes, NULL, flags);
+        loader.staging = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, stagingBytes, flags);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if (loader.staging != NULL) {
+            loader.stagingSize = stagingBytes;
+        }
+        else {
+            printf("Could not map the upload buffer, uploading textures from client memory\n");
+            glDeleteBuffers(1, &loader.stagingBuffer);
+            loader.stagingBuffer = 0;
+        }
+    }
+
+    startThreadPool(loader.pool, threads);
+}
+
+//------------------------------------------------------------
+// Worker side
+//------------------------------------------------------------
+
+// Faults the mapping in on the worker, so the main thread does not wait
+// for the disk while streaming from it
+static bool TouchPages(const MappedFile& file)
+{
+    volatile unsigned char sum = 0;
+    for (size_t i = 0; i < file.size; i += 4096)
+        sum += (unsigned char)file.data[i];
+    (void)sum;
+    return true;
+}
+
+static void LoadOnWorker(AssetLoader* loader, Asset* asset)
+{
+    double start = schedulerClock();
+    bool ok;
+    if (asset->type == ASSET_TEXTURE) {
+        ok = decodeBMP(asset->path.c_str(), asset->image);
+        if (ok)
+            generateMipmaps(asset->image);
+    }
+    else if (asset->type == ASSET_DDS)
+        ok = openDDS(asset->path.c_str(), asset->dds) && TouchPages(asset->dds.file);
+    else
+        ok = loadMeshCached(asset->path.c_str(), asset->cache, asset->lodLevels);
+    double seconds = schedulerClock() - start;
+
+    lock_guard<mutex> lock(loader->mutex);
+    asset->seconds = seconds;
+    asset->state = ok ? ASSET_DECODED : ASSET_FAILED;
+    loader->decoded.push_back(asset);
+}
+
+static int AddAsset(AssetLoader& loader, Asset* asset)
+{
+    asset->state = ASSET_LOADING;
+    asset->seconds = 0.0;
+
+    int handle;
+    {
+        lock_guard<mutex> lock(loader.mutex);
+        handle = (int)loader.assets.size();
+        loader.assets.push_back(asset);
+    }
+    loader.pending++;
+    loader.doneTime = 0.0;
+
+    AssetLoader* l = &loader;
+    submitTask(loader.pool, [l, asset]() { LoadOnWorker(l, asset); });
+    return handle;
+}
+
+int requestTexture(AssetLoader& loader, const char* path, GLuint* texture)
+{
+    Asset* asset = new Asset();
+    asset->type = ASSET_TEXTURE;
+    asset->path = path;
+    asset->texture = texture;
+    *texture = loader.placeholder;
+    return AddAsset(loader, asset);
+}
+
+int requestDDSTexture(AssetLoader& loader, const char* path, GLuint* texture)
+{
+    Asset* asset = new Asset();
+    asset->type = ASSET_DDS;
+    asset->path = path;
+    asset->texture = texture;
+    *texture = loader.placeholder;
+    return AddAsset(loader, asset);
+}
+
+int requestMesh(AssetLoader& loader, const char* objPath, unsigned int lodLevels, MeshReadyCallback ready, int slot)
+{
+    Asset* asset = new Asset();
+    asset->type = ASSET_MESH;
+    asset->path = objPath;
+    asset->lodLevels = lodLevels;
+    asset->ready = ready;
+    asset->slot = slot;
+    return AddAsset(loader, asset);
+}
+
+AssetState assetState(AssetLoader& loader, int handle)
+{
+    lock_guard<mutex> lock(loader.mutex);
+    if (handle < 0 || handle >= (int)loader.assets.size())
+        return ASSET_FAILED;
+    return loader.assets[handle]->state;
+}
+
+//------------------------------------------------------------
+// Upload ring: returns where size bytes may be written, after
+// waiting for the GPU to finish reading anything in the way.
+// NULL when there is no ring or the data is bigger than it.
+//------------------------------------------------------------
+
+static unsigned char* AllocateStaging(AssetLoader& loader, size_t size, size_t& offset)
+{
+    if (loader.staging == NULL || size > loader.stagingSize)
+        return NULL;
+
+    size_t begin = (loader.stagingHead + STAGING_ALIGNMENT - 1) / STAGING_ALIGNMENT * STAGING_ALIGNMENT;
+    if (begin + size > loader.stagingSize)
+        begin = 0;
+    size_t end = begin + size;
+
+    // Regions are handed out in ring order, so the oldest ones are the
+    // first to be overwritten
+    for (;;) {
+        bool overlaps = false;
+        for (const StagingRegion& region : loader.inFlight)
+            overlaps = overlaps || (region.begin < end && begin < region.end);
+        if (!overlaps)
+            break;
+
+        StagingRegion& oldest = loader.inFlight.front();
+        while (glClientWaitSync(oldest.fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS) == GL_TIMEOUT_EXPIRED)
+            ;
+        glDeleteSync(oldest.fence);
+        loader.inFlight.pop_front();
+    }
+
+    loader.stagingHead = end;
+    offset = begin;
+    return loader.staging + begin;
+}
+
+// Forgets regions the GPU is done with, without waiting
+static void RetireStaging(AssetLoader& loader)
+{
+    while (!loader.inFlight.empty()) {
+        GLenum status = glClientWaitSync(loader.inFlight.front().fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            break;
+        glDeleteSync(loader.inFlight.front().fence);
+        loader.inFlight.pop_front();
+    }
+}
+
+//------------------------------------------------------------
+// Main thread side
+//------------------------------------------------------------
+
+static void UploadTexture(AssetLoader& loader, Asset* asset)
+{
+    const ImageData& image = asset->image;
+    size_t bytes = image.pixels.size();
+
+    size_t offset;
+    unsigned char* staging = AllocateStaging(loader, bytes, offset);
+    GLuint texture;
+    if (staging != NULL) {
+        memcpy(staging, image.pixels.data(), bytes);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, loader.stagingBuffer);
+        texture = createImageTexture(image, (const void*)offset);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        StagingRegion region;
+        region.begin = offset;
+        region.end = offset + bytes;
+        region.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        loader.inFlight.push_back(region);
+    }
+    else {
+        texture = createImageTexture(image, image.pixels.data());
+    }
+
+    *asset->texture = texture;
+    loader.uploadedBytes += bytes;
+
+    // GL has the pixels now
+    vector<unsigned char>().swap(asset->image.pixels);
+    vector<MipLevel>().swap(asset->image.levels);
+}
+
+static void FinishAsset(AssetLoader& loader, Asset* asset, AssetState state)
+{
+    {
+        lock_guard<mutex> lock(loader.mutex);
+        asset->state = state;
+    }
+    asset->readyTime = schedulerClock();
+    loader.pending--;
+    if (loader.pending == 0)
+        loader.doneTime = asset->readyTime;
+}
+
+unsigned int pumpAssetLoader(AssetLoader& loader, double budgetSeconds, size_t budgetBytes)
+{
+    RetireStaging(loader);
+
+    double start = schedulerClock();
+    unsigned int uploads = 0;
+    for (;;) {
+        Asset* asset;
+        {
+            lock_guard<mutex> lock(loader.mutex);
+            if (loader.decoded.empty())
+                break;
+            asset = loader.decoded.front();
+            loader.decoded.pop_front();
+        }
+        loader.workerSeconds += asset->seconds;
+        uploads++;
+
+        if (asset->state == ASSET_FAILED) {
+            printf("Could not load %s\n", asset->path.c_str());
+            FinishAsset(loader, asset, ASSET_FAILED);
+        }
+        else if (asset->type == ASSET_TEXTURE) {
+            UploadTexture(loader, asset);
+            asset->usableTime = schedulerClock();
+            FinishAsset(loader, asset, ASSET_READY);
+        }
+        else if (asset->type == ASSET_DDS) {
+            // Sampled from now on, the levels follow below
+            *asset->texture = beginDDSStream(asset->dds, asset->stream);
+            asset->usableTime = schedulerClock();
+            loader.streaming.push_back(asset);
+        }
+        else {
+            asset->ready(asset->slot, asset->cache);
+            closeMeshCache(asset->cache);
+            asset->usableTime = schedulerClock();
+            FinishAsset(loader, asset, ASSET_READY);
+        }
+
+        if (schedulerClock() - start >= budgetSeconds)
+            break;
+    }
+
+    // Oldest streams first, each call uploads at least one level
+    size_t remaining = budgetBytes;
+    for (size_t i = 0; i < loader.streaming.size() && remaining > 0;) {
+        Asset* asset = loader.streaming[i];
+        size_t bytes = streamDDS(asset->stream, remaining);
+        remaining -= min(bytes, remaining);
+        loader.uploadedBytes += bytes;
+        uploads++;
+
+        if (asset->stream.nextLevel < 0) {
+            FinishAsset(loader, asset, ASSET_READY);
+            loader.streaming.erase(loader.streaming.begin() + i);
+        }
+        else {
+            i++;
+        }
+    }
+
+    loader.uploadSeconds += schedulerClock() - start;
+    return uploads;
+}
+
+void finishAssetLoader(AssetLoader& loader)
+{
+    while (loader.pending > 0) {
+        waitThreadPool(loader.pool);
+        pumpAssetLoader(loader, 1e30, (size_t)-1);
+    }
+}
+
+bool assetsPending(const AssetLoader& loader)
+{
+    return loader.pending > 0;
+}
+
+void printAssetLoaderStats(const AssetLoader& loader)
+{
+    double total = (loader.doneTime > 0.0 ? loader.doneTime : schedulerClock()) - loader.startTime;
+    printf("Assets: %u of %u loaded in %.1f ms on %u threads (%.1f ms decoding, %.1f ms on the main thread, %.1f MB %s)\n",
+        (unsigned int)(loader.assets.size() - loader.pending), (unsigned int)loader.assets.size(),
+        1000.0 * total, (unsigned int)loader.pool.workers.size(),
+        1000.0 * loader.workerSeconds, 1000.0 * loader.uploadSeconds,
+        loader.uploadedBytes / (1024.0 * 1024.0),
+        loader.staging != NULL ? "through the staging ring" : "from client memory");
+
+    for (const Asset* asset : loader.assets) {
+        if (asset->type == ASSET_DDS && asset->state == ASSET_READY)
+            printf("  %s: usable after %.1f ms, all %u mip levels after %.1f ms\n", asset->path.c_str(),
+                1000.0 * (asset->usableTime - loader.startTime), asset->stream.image.levelCount,
+                1000.0 * (asset->readyTime - loader.startTime));
+    }
+}
+
+void shutdownAssetLoader(AssetLoader& loader)
+{
+    stopThreadPool(loader.pool);
+
+    for (Asset* asset : loader.assets) {
+        if (asset->type == ASSET_MESH && asset->state == ASSET_DECODED)
+            closeMeshCache(asset->cache);
+        // Mapping of a DDS not yet or not completely streamed
+        if (asset->type == ASSET_DDS && asset->state == ASSET_DECODED) {
+            closeDDS(asset->dds);
+            closeDDS(asset->stream.image);
+        }
+        delete asset;
+    }
+    loader.assets.clear();
+    loader.decoded.clear();
+    loader.streaming.clear();
+
+    for (const StagingRegion& region : loader.inFlight)
+        glDeleteSync(region.fence);
+    loader.inFlight.clear();
+    if (loader.stagingBuffer != 0) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, loader.stagingBuffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &loader.stagingBuffer);
+        loader.stagingBuffer = 0;
+        loader.staging = NULL;
+    }
+}
@@ -0,0 +1,131 @@
+#ifndef ASSETLOADER_H
+#define ASSETLOADER_H
+
+#include <stddef.h>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "meshcache.h"
+#include "texture.h"
+#include "threadpool.h"
+
+// Loads meshes and textures on a worker pool while the main thread keeps
+// rendering. Workers read the files, parse or convert OBJs and decode
+// images. pumpAssetLoader does the GL half on the main thread: decoded
+// pixels are copied into a persistently mapped pixel unpack buffer and the
+// texture is filled from there, loaded meshes go to a callback that
+// uploads them. Until its image arrives a texture slot holds a placeholder.
+// DDS textures are streamed: the coarsest mip levels are there right away,
+// finer ones follow within a per-frame byte budget.
+
+// Upload ring size; images that do not fit are uploaded from client memory
+#define ASSET_STAGING_SIZE (8 * 1024 * 1024)
+
+// Compressed mip data uploaded per pump, at least one level
+#define ASSET_STREAM_BYTES (64 * 1024)
+
+enum AssetState
+{
+	ASSET_LOADING,      // queued or on a worker
+	ASSET_DECODED,      // waiting for the main thread
+	ASSET_READY,
+	ASSET_FAILED
+};
+
+enum AssetType
+{
+	ASSET_TEXTURE,
+	ASSET_DDS,
+	ASSET_MESH
+};
+
+// Runs on the main thread when a mesh has loaded; the cache is closed
+// after the call returns
+typedef void (*MeshReadyCallback)(int slot, MeshCache & cache);
+
+struct Asset
+{
+	AssetType type;
+	std::string path;
+	AssetState state;           // changed under AssetLoader::mutex
+	double seconds;             // time spent on the worker
+
+	// ASSET_TEXTURE and ASSET_DDS
+	ImageData image;
+	DDSImage dds;               // mapped by the worker
+	DDSStream stream;
+	GLuint * texture;           // receives the texture once it can be sampled
+	double usableTime, readyTime;
+
+	// ASSET_MESH
+	MeshCache cache;
+	unsigned int lodLevels;
+	MeshReadyCallback ready;
+	int slot;
+};
+
+// Part of the upload ring the GPU may still be reading from
+struct StagingRegion
+{
+	size_t begin, end;
+	GLsync fence;
+};
+
+struct AssetLoader
+{
+	ThreadPool pool;
+	std::mutex mutex;
+	std::vector<Asset *> assets;            // by handle
+	std::deque<Asset *> decoded;            // finished on a worker, oldest first
+	std::vector<Asset *> streaming;         // DDS textures still missing levels
+	unsigned int pending;                   // requested but not ready or failed
+	GLuint placeholder;
+
+	// Persistently mapped upload ring, NULL without ARB_buffer_storage
+	GLuint stagingBuffer;
+	unsigned char * staging;
+	size_t stagingSize;
+	size_t stagingHead;
+	std::deque<StagingRegion> inFlight;
+
+	// schedulerClock() times and totals
+	double startTime;
+	double doneTime;                        // 0 while anything is pending
+	double workerSeconds;
+	double uploadSeconds;
+	size_t uploadedBytes;
+};
+
+// Needs the GL context. threads 0 picks a count from the core count.
+void initAssetLoader(AssetLoader & loader, unsigned int threads = 0, size_t stagingBytes = ASSET_STAGING_SIZE);
+
+// Both return a handle for assetState. *texture is set to the placeholder
+// right away and replaced once the image is uploaded.
+int requestTexture(AssetLoader & loader, const char * path, GLuint * texture);
+int requestDDSTexture(AssetLoader & loader, const char * path, GLuint * texture);
+int requestMesh(AssetLoader & loader, const char * objPath, unsigned int lodLevels, MeshReadyCallback ready, int slot);
+
+AssetState assetState(AssetLoader & loader, int handle);
+
+// Main thread, once per frame: finishes decoded assets until budgetSeconds
+// are used up (always at least one), then streams up to budgetBytes of DDS
+// mip levels. Returns how many uploads it made; GL bindings are changed
+// behind the glstate cache when it is not 0.
+unsigned int pumpAssetLoader(AssetLoader & loader, double budgetSeconds, size_t budgetBytes = ASSET_STREAM_BYTES);
+
+// Pumps until every requested asset is ready or failed
+void finishAssetLoader(AssetLoader & loader);
+
+bool assetsPending(const AssetLoader & loader);
+
+void printAssetLoaderStats(const AssetLoader & loader);
+
+// Waits for the workers and frees the upload ring. Textures handed out,
+// the placeholder of failed ones included, stay alive.
+void shutdownAssetLoader(AssetLoader & loader);
+
+#endif
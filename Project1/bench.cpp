@@ -0,0 +1,1301 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "bench.h"
+#include "culling.h"
+#include "filewatcher.h"
+#include "jobpool.h"
+#include "lightclusters.h"
+#include "meshcache.h"
+#include "meshoptimize.h"
+#include "meshsimplify.h"
+#include "mipmap.h"
+#include "objloader.h"
+#include "profiler.h"
+#include "renderqueue.h"
+#include "softraster.h"
+#include "texcompress.h"
+#include "texture.h"
+#include "transforms.h"
+#include "vertexformat.h"
+
+using namespace std;
+
+
+//--------------------------------------------------------------------------------
+// Helpers
+//--------------------------------------------------------------------------------
+
+static double Seconds(chrono::high_resolution_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+}
+
+static long FileSize(const char* path)
+{
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL)
+        return -1;
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fclose(fp);
+    return size;
+}
+
+
+//------------------------------------------------------------
+// bool loadOBJReference(...)
+// The original fscanf based loader, kept as the baseline for
+// speed and as the reference output the fast loader must match
+//------------------------------------------------------------
+
+static bool loadOBJReference(
+    const char* path,
+    vector<glm::vec3>& out_vertices,
+    vector<glm::vec2>& out_uvs,
+    vector<glm::vec3>& out_normals)
+{
+    vector<unsigned int> vertexIndices, uvIndices, normalIndices;
+    vector<glm::vec3> temp_vertices;
+    vector<glm::vec2> temp_uvs;
+    vector<glm::vec3> temp_normals;
+
+    FILE* file = fopen(path, "r");
+    if (file == NULL)
+        return false;
+
+    while (1) {
+        char lineHeader[128];
+        int res = fscanf(file, "%127s", lineHeader);
+        if (res == EOF)
+            break;
+
+        if (strcmp(lineHeader, "v") == 0) {
+            glm::vec3 vertex;
+            fscanf(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z);
+            temp_vertices.push_back(vertex);
+        }
+        else if (strcmp(lineHeader, "vt") == 0) {
+            glm::vec2 uv;
+            fscanf(file, "%f %f\n", &uv.x, &uv.y);
+            uv.y = -uv.y;
+            temp_uvs.push_back(uv);
+        }
+        else if (strcmp(lineHeader, "vn") == 0) {
+            glm::vec3 normal;
+            fscanf(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z);
+            temp_normals.push_back(normal);
+        }
+        else if (strcmp(lineHeader, "f") == 0) {
+            unsigned int v[3], t[3], n[3];
+            int matches = fscanf(file, "%d/%d/%d %d/%d/%d %d/%d/%d\n", &v[0], &t[0], &n[0], &v[1], &t[1], &n[1], &v[2], &t[2], &n[2]);
+            if (matches != 9) {
+                fclose(file);
+                return false;
+            }
+            for (int i = 0; i < 3; i++) {
+                vertexIndices.push_back(v[i]);
+                uvIndices.push_back(t[i]);
+                normalIndices.push_back(n[i]);
+            }
+        }
+        else {
+            char stupidBuffer[1000];
+            fgets(stupidBuffer, 1000, file);
+        }
+    }
+    fclose(file);
+
+    for (unsigned int i = 0; i < vertexIndices.size(); i++) {
+        out_vertices.push_back(temp_vertices[vertexIndices[i] - 1]);
+        out_uvs.push_back(temp_uvs[uvIndices[i] - 1]);
+        out_normals.push_back(temp_normals[normalIndices[i] - 1]);
+    }
+    return true;
+}
+
+
+//------------------------------------------------------------
+// void WriteSyntheticOBJ(const char* path, int segments)
+// Writes a UV sphere with segments^2 quads in the same layout
+// as the 3ds Max exports shipped with the project
+//------------------------------------------------------------
+
+static void WriteSyntheticOBJ(const char* path, int segments)
+{
+    FILE* fp = fopen(path, "w");
+    fprintf(fp, "# Synthetic benchmark mesh\n\ng Sphere\n");
+
+    for (int y = 0; y <= segments; y++) {
+        float v = (float)y / segments;
+        float phi = v * 3.14159265f;
+        for (int x = 0; x <= segments; x++) {
+            float u = (float)x / segments;
+            float theta = u * 6.28318531f;
+            fprintf(fp, "v  %.6f %.6f %.6f\n", cos(theta) * sin(phi), cos(phi), sin(theta) * sin(phi));
+        }
+    }
+    for (int y = 0; y <= segments; y++)
+        for (int x = 0; x <= segments; x++)
+            fprintf(fp, "vn %.6f %.6f %.6f\n", 0.0f, 1.0f, 0.0f);
+    for (int y = 0; y <= segments; y++)
+        for (int x = 0; x <= segments; x++)
+            fprintf(fp, "vt %.6f %.6f 0.000000\n", (float)x / segments, (float)y / segments);
+
+    for (int y = 0; y < segments; y++) {
+        for (int x = 0; x < segments; x++) {
+            int a = y * (segments + 1) + x + 1;
+            int b = a + 1;
+            int c = a + segments + 1;
+            int d = c + 1;
+            fprintf(fp, "f %d/%d/%d %d/%d/%d %d/%d/%d \n", a, a, a, c, c, c, b, b, b);
+            fprintf(fp, "f %d/%d/%d %d/%d/%d %d/%d/%d \n", b, b, b, c, c, c, d, d, d);
+        }
+    }
+    fclose(fp);
+}
+
+
+//------------------------------------------------------------
+// void BenchObjLoader()
+// Reports MB/s of the fscanf loader and loadOBJ and checks
+// that both produce bit-identical vectors
+//------------------------------------------------------------
+
+static void BenchObjFile(const char* path, int repeats)
+{
+    long size = FileSize(path);
+    if (size < 0) {
+        printf("%-22s missing\n", path);
+        return;
+    }
+    double mb = size / (1024.0 * 1024.0);
+
+    vector<glm::vec3> refVertices, refNormals, vertices, normals;
+    vector<glm::vec2> refUvs, uvs;
+
+    auto start = chrono::high_resolution_clock::now();
+    for (int i = 0; i < repeats; i++) {
+        refVertices.clear(); refUvs.clear(); refNormals.clear();
+        loadOBJReference(path, refVertices, refUvs, refNormals);
+    }
+    double refTime = Seconds(start) / repeats;
+
+    start = chrono::high_resolution_clock::now();
+    for (int i = 0; i < repeats; i++) {
+        vertices.clear(); uvs.clear(); normals.clear();
+        loadOBJ(path, vertices, uvs, normals);
+    }
+    double time = Seconds(start) / repeats;
+
+    bool same = vertices.size() == refVertices.size()
+        && uvs.size() == refUvs.size()
+        && normals.size() == refNormals.size()
+        && memcmp(vertices.data(), refVertices.data(), vertices.size() * sizeof(glm::vec3)) == 0
+        && memcmp(uvs.data(), refUvs.data(), uvs.size() * sizeof(glm::vec2)) == 0
+        && memcmp(normals.data(), refNormals.data(), normals.size() * sizeof(glm::vec3)) == 0;
+
+    printf("%-22s %8.2f MB  fscanf %8.1f MB/s  loadOBJ %8.1f MB/s  (%5.1fx)  %s\n",
+        path, mb, mb / refTime, mb / time, refTime / time, same ? "identical" : "MISMATCH");
+}
+
+static void BenchObjLoader()
+{
+    const char* synthetic = "bench_synthetic.obj";
+    WriteSyntheticOBJ(synthetic, 600);
+
+    printf("OBJ loader throughput\n");
+    BenchObjFile("teapot.obj", 5);
+    BenchObjFile("sphere.obj", 20);
+    BenchObjFile(synthetic, 1);
+
+    remove(synthetic);
+}
+
+
+//------------------------------------------------------------
+// void BenchObjStreaming(int segments, size_t budget)
+// streamOBJ against loadOBJ on a synthetic mesh: throughput,
+// the loader's own peak and the process peak RSS after each.
+// Streaming runs first since the peak never goes down. Both
+// have to produce the same corners.
+//------------------------------------------------------------
+
+struct StreamChecksum
+{
+    unsigned long long hash;
+    size_t corners;
+};
+
+static void HashCorner(StreamChecksum& sum, const glm::vec3& position, const glm::vec2& uv, const glm::vec3& normal)
+{
+    const float values[8] = { position.x, position.y, position.z, uv.x, uv.y, normal.x, normal.y, normal.z };
+    const unsigned char* bytes = (const unsigned char*)values;
+    for (size_t i = 0; i < sizeof(values); i++)
+        sum.hash = (sum.hash ^ bytes[i]) * 1099511628211ull;
+    sum.corners++;
+}
+
+static bool HashBatch(const ObjStreamBatch& batch, void* user)
+{
+    StreamChecksum& sum = *(StreamChecksum*)user;
+    for (size_t i = 0; i < batch.count; i++)
+        HashCorner(sum, batch.positions[i], batch.uvs[i], batch.normals[i]);
+    return true;
+}
+
+static void BenchObjStreaming(int segments, size_t budget)
+{
+    const char* path = "bench_stream.obj";
+    WriteSyntheticOBJ(path, segments);
+    double mb = FileSize(path) / (1024.0 * 1024.0);
+    double start_rss = profilerResidentBytes() / (1024.0 * 1024.0);
+    printf("%s: %.1f MB, %d x %d segments, process at %.1f MB resident\n", path, mb, segments, segments, start_rss);
+
+    StreamChecksum streamed = { 14695981039346656037ull, 0 };
+    ObjStreamStats stats;
+    if (!streamOBJ(path, budget, HashBatch, &streamed, stats)) {
+        remove(path);
+        return;
+    }
+    double stream_peak = profilerPeakResidentBytes() / (1024.0 * 1024.0);
+    printf("streamOBJ, budget %.1f MB: %8.1f MB/s  %6.2f M triangles/s  %u batches of %u corners, read buffer %.1f MB\n",
+        budget / (1024.0 * 1024.0), mb / stats.seconds, stats.triangles / stats.seconds / 1e6,
+        (unsigned int)stats.batches, (unsigned int)stats.batchCorners, stats.readBuffer / (1024.0 * 1024.0));
+    printf("  loader peak %.1f MB, process peak RSS %.1f MB\n", stats.peakBytes / (1024.0 * 1024.0), stream_peak);
+
+    StreamChecksum loaded = { 14695981039346656037ull, 0 };
+    {
+        vector<glm::vec3> vertices, normals;
+        vector<glm::vec2> uvs;
+        auto start = chrono::high_resolution_clock::now();
+        if (!loadOBJ(path, vertices, uvs, normals)) {
+            remove(path);
+            return;
+        }
+        double seconds = Seconds(start);
+        for (size_t i = 0; i < vertices.size(); i++)
+            HashCorner(loaded, vertices[i], uvs[i], normals[i]);
+        double result = vertices.size() * (2 * sizeof(glm::vec3) + sizeof(glm::vec2)) / (1024.0 * 1024.0);
+        printf("loadOBJ:                  %8.1f MB/s  %6.2f M triangles/s  result %.1f MB\n",
+            mb / seconds, vertices.size() / 3 / seconds / 1e6, result);
+        printf("  process peak RSS %.1f MB\n", profilerPeakResidentBytes() / (1024.0 * 1024.0));
+    }
+
+    printf("%u corners streamed, %u loaded: %s\n", (unsigned int)streamed.corners, (unsigned int)loaded.corners,
+        streamed.corners == loaded.corners && streamed.hash == loaded.hash ? "identical" : "MISMATCH");
+    remove(path);
+}
+
+
+//------------------------------------------------------------
+// void BenchIndexedMeshes()
+// Reports how many vertices loadOBJIndexed saves over the
+// expanded loadOBJ output for every bundled model
+//------------------------------------------------------------
+
+static const char* bundled_objs[] = {
+    "box.obj", "cylinder18.obj", "cylinder32.obj", "sphere.obj", "teapot.obj", "torus.obj"
+};
+
+static void BenchIndexedMeshes()
+{
+    const size_t vertex_size = sizeof(glm::vec3) * 2 + sizeof(glm::vec2);
+
+    printf("%-16s %8s %8s %7s %12s %12s %7s\n",
+        "mesh", "corners", "unique", "ratio", "arrays (B)", "indexed (B)", "saved");
+
+    for (const char* path : bundled_objs) {
+        vector<glm::vec3> vertices, normals;
+        vector<glm::vec2> uvs;
+        vector<unsigned int> indices;
+        if (!loadOBJIndexed(path, indices, vertices, uvs, normals))
+            continue;
+
+        size_t corners = indices.size();
+        size_t unique = vertices.size();
+        size_t index_size = unique <= 0x10000 ? sizeof(unsigned short) : sizeof(unsigned int);
+        size_t array_bytes = corners * vertex_size;
+        size_t indexed_bytes = unique * vertex_size + corners * index_size;
+
+        printf("%-16s %8u %8u %6.2fx %12u %12u %6.1f%%\n",
+            path, (unsigned int)corners, (unsigned int)unique, (double)corners / unique,
+            (unsigned int)array_bytes, (unsigned int)indexed_bytes,
+            100.0 * (1.0 - (double)indexed_bytes / array_bytes));
+    }
+}
+
+
+//------------------------------------------------------------
+// void BenchMeshCache()
+// Compares startup cost of parsing the OBJ with opening the
+// mesh cache, and with a plain read of the cache file
+//------------------------------------------------------------
+
+static unsigned int TouchBytes(const void* data, size_t size)
+{
+    // Stands in for glBufferData reading the mapping
+    const unsigned char* p = (const unsigned char*)data;
+    unsigned int sum = 0;
+    for (size_t i = 0; i < size; i += 64)
+        sum += p[i];
+    return sum;
+}
+
+static void BenchMeshCacheFile(const char* path, int repeats)
+{
+    // Scratch file, the scene's own cache keeps its detail levels
+    string cache_path = "bench_" + meshCachePath(path);
+    if (!convertOBJToMeshCache(path, cache_path.c_str()))
+        return;
+    long cache_size = FileSize(cache_path.c_str());
+
+    auto start = chrono::high_resolution_clock::now();
+    for (int i = 0; i < repeats; i++) {
+        vector<unsigned int> indices;
+        vector<glm::vec3> vertices, normals;
+        vector<glm::vec2> uvs;
+        loadOBJIndexed(path, indices, vertices, uvs, normals);
+    }
+    double parse_time = Seconds(start) / repeats;
+
+    unsigned int sum = 0;
+    start = chrono::high_resolution_clock::now();
+    for (int i = 0; i < repeats; i++) {
+        MeshCache cache;
+        if (openMeshCache(cache_path.c_str(), cache)) {
+            sum += TouchBytes(cache.file.data, cache.file.size);
+            closeMeshCache(cache);
+        }
+    }
+    double cache_time = Seconds(start) / repeats;
+
+    vector<char> buffer(cache_size);
+    start = chrono::high_resolution_clock::now();
+    for (int i = 0; i < repeats; i++) {
+        FILE* fp = fopen(cache_path.c_str(), "rb");
+        fread(&buffer[0], 1, buffer.size(), fp);
+        fclose(fp);
+        sum += TouchBytes(&buffer[0], buffer.size());
+    }
+    double read_time = Seconds(start) / repeats;
+
+    printf("%-12s parse %8.3f ms  cache %8.3f ms  fread %8.3f ms  (%.0fx faster than parsing) [%u]\n",
+        path, parse_time * 1000.0, cache_time * 1000.0, read_time * 1000.0, parse_time / cache_time, sum & 1);
+    remove(cache_path.c_str());
+}
+
+static void BenchMeshCache()
+{
+    printf("Mesh startup cost\n");
+    BenchMeshCacheFile("teapot.obj", 20);
+    BenchMeshCacheFile("torus.obj", 100);
+}
+
+
+//------------------------------------------------------------
+// void BenchMeshOptimizer()
+// ACMR/ATVR for FIFO and LRU caches before and after each pass
+//------------------------------------------------------------
+
+static void PrintCacheStats(const char* stage, const vector<unsigned int>& indices, size_t vertex_count)
+{
+    VertexCacheStats fifo = analyzeVertexCacheFIFO(indices, vertex_count);
+    VertexCacheStats lru = analyzeVertexCacheLRU(indices, vertex_count);
+    printf("  %-10s FIFO acmr %.3f atvr %.3f   LRU acmr %.3f atvr %.3f\n",
+        stage, fifo.acmr, fifo.atvr, lru.acmr, lru.atvr);
+}
+
+static void BenchMeshOptimizer()
+{
+    for (const char* path : bundled_objs) {
+        vector<unsigned int> indices;
+        vector<glm::vec3> vertices, normals;
+        vector<glm::vec2> uvs;
+        if (!loadOBJIndexed(path, indices, vertices, uvs, normals))
+            continue;
+
+        printf("%s (%u triangles, cache size %d)\n", path, (unsigned int)indices.size() / 3, VERTEX_CACHE_SIZE);
+        PrintCacheStats("input", indices, vertices.size());
+
+        auto start = chrono::high_resolution_clock::now();
+        optimizeVertexCache(indices, vertices.size());
+        double cache_time = Seconds(start);
+        PrintCacheStats("cache", indices, vertices.size());
+
+        start = chrono::high_resolution_clock::now();
+        optimizeOverdraw(indices, vertices);
+        double overdraw_time = Seconds(start);
+        PrintCacheStats("overdraw", indices, vertices.size());
+
+        start = chrono::high_resolution_clock::now();
+        optimizeVertexFetch(indices, vertices, uvs, normals);
+        double fetch_time = Seconds(start);
+
+        printf("  time: cache %.3f ms, overdraw %.3f ms, fetch %.3f ms\n",
+            cache_time * 1000.0, overdraw_time * 1000.0, fetch_time * 1000.0);
+    }
+}
+
+
+//------------------------------------------------------------
+// void BenchVertexFormats()
+// Vertex size and worst-case quantization error per format
+//------------------------------------------------------------
+
+static void BenchVertexFormats()
+{
+    struct Format { const char* name; unsigned int flags; };
+    const Format formats[] = {
+        { "float", 0 },
+        { "packed normal", VERTEX_NORMAL_PACKED },
+        { "+ half uv", VERTEX_NORMAL_PACKED | VERTEX_UV_HALF },
+        { "+ short uv", VERTEX_NORMAL_PACKED | VERTEX_UV_SHORT },
+        { "+ short pos", VERTEX_NORMAL_PACKED | VERTEX_UV_SHORT | VERTEX_POSITION_SHORT },
+    };
+
+    for (const char* path : bundled_objs) {
+        vector<unsigned int> indices;
+        vector<glm::vec3> vertices, normals;
+        vector<glm::vec2> uvs;
+        if (!loadOBJIndexed(path, indices, vertices, uvs, normals))
+            continue;
+
+        MeshData mesh;
+        mesh.vertices = &vertices[0];
+        mesh.normals = &normals[0];
+        mesh.uvs = &uvs[0];
+        mesh.indices = &indices[0];
+        mesh.vertexCount = (unsigned int)vertices.size();
+        mesh.indexCount = (unsigned int)indices.size();
+        mesh.indexSize = sizeof(unsigned int);
+        mesh.lods = NULL;
+        mesh.lodCount = 0;
+        mesh.boundsMin = mesh.boundsMax = vertices[0];
+        for (size_t i = 1; i < vertices.size(); i++) {
+            mesh.boundsMin = glm::min(mesh.boundsMin, vertices[i]);
+            mesh.boundsMax = glm::max(mesh.boundsMax, vertices[i]);
+        }
+
+        printf("%s (%u vertices)\n", path, mesh.vertexCount);
+        for (const Format& format : formats) {
+            VertexLayout layout;
+            buildVertexLayout(mesh, format.flags, layout);
+            vector<unsigned char> packed((size_t)mesh.vertexCount * layout.stride);
+            packVertices(mesh, layout, &packed[0]);
+            VertexErrorReport error = measureVertexError(mesh, layout, &packed[0]);
+
+            printf("  %-14s %2d B/vertex %8u B  position %.6f  normal %.3f deg  uv %.6f%s\n",
+                format.name, layout.stride, (unsigned int)packed.size(),
+                error.maxPositionError, error.maxNormalError, error.maxUvError,
+                layout.flags != format.flags ? "  (uv range needs half)" : "");
+        }
+    }
+}
+
+
+//------------------------------------------------------------
+// void BenchLods()
+// LOD chain of every bundled mesh, plus the generated level of
+// cylinder32 closest to the hand-made cylinder18
+//------------------------------------------------------------
+
+static void BenchLods()
+{
+    for (const char* path : bundled_objs) {
+        vector<unsigned int> indices;
+        vector<glm::vec3> vertices, normals;
+        vector<glm::vec2> uvs;
+        if (!loadOBJIndexed(path, indices, vertices, uvs, normals))
+            continue;
+        optimizeMesh(indices, vertices, uvs, normals);
+
+        glm::vec3 boundsMin = vertices[0], boundsMax = vertices[0];
+        for (size_t i = 1; i < vertices.size(); i++) {
+            boundsMin = glm::min(boundsMin, vertices[i]);
+            boundsMax = glm::max(boundsMax, vertices[i]);
+        }
+        float diagonal = glm::length(boundsMax - boundsMin);
+
+        auto start = chrono::high_resolution_clock::now();
+        vector<unsigned int> lodIndices;
+        vector<MeshLod> lods;
+        generateMeshLods(indices, vertices, MESHLOD_MAX_LEVELS, 0.5f, diagonal * 0.05f, lodIndices, lods);
+        double seconds = Seconds(start);
+
+        printf("%s: %u levels in %.2f ms\n", path, (unsigned int)lods.size(), seconds * 1000.0);
+        for (size_t i = 0; i < lods.size(); i++)
+            printf("  LOD %u: %6u triangles (%5.1f%%)  error %.5f (%.3f%% of diagonal)\n", (unsigned int)i,
+                lods[i].indexCount / 3, 100.0 * lods[i].indexCount / lods[0].indexCount,
+                lods[i].error, 100.0 * lods[i].error / diagonal);
+    }
+
+    // The hand-made cylinder18 has 216 triangles
+    vector<unsigned int> indices;
+    vector<glm::vec3> vertices, normals;
+    vector<glm::vec2> uvs;
+    if (loadOBJIndexed("cylinder32.obj", indices, vertices, uvs, normals)) {
+        float error = simplifyMesh(indices, vertices, 216 * 3, 1e30f);
+        printf("cylinder32.obj simplified to %u triangles (cylinder18.obj has 216), error %.5f\n",
+            (unsigned int)indices.size() / 3, error);
+    }
+}
+
+
+//------------------------------------------------------------
+// void BenchCulling()
+// Random objects around the camera of the scene, culled by
+// the scalar loop, the SIMD loop and the threaded SIMD loop
+//------------------------------------------------------------
+
+static void BenchCulling()
+{
+    glm::mat4 view = glm::lookAt(glm::vec3(2.0f, 2.0f, 7.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 20.0f);
+    Frustum frustum;
+    extractFrustum(projection * view, frustum);
+
+    // Roughly the teapot
+    MeshBounds mesh;
+    mesh.center = glm::vec3(0.0f, 0.5f, 0.0f);
+    mesh.extents = glm::vec3(1.5f, 0.9f, 1.0f);
+    mesh.radius = 1.8f;
+
+    const size_t counts[] = { 1000, 100000, 1000000 };
+    for (size_t count : counts) {
+        CullBounds bounds;
+        resizeCullBounds(bounds, count);
+        srand(1);
+        for (size_t i = 0; i < count; i++) {
+            glm::vec3 position(
+                rand() * 80.0f / RAND_MAX - 40.0f,
+                rand() * 80.0f / RAND_MAX - 40.0f,
+                rand() * 80.0f / RAND_MAX - 40.0f);
+            glm::mat4 model = glm::rotate(glm::translate(glm::mat4(1.0f), position),
+                rand() * 6.28f / RAND_MAX, glm::vec3(0.0f, 1.0f, 0.0f));
+            setCullBounds(bounds, i, model, mesh);
+        }
+
+        vector<unsigned char> reference(count), simd(count), threaded(count);
+        int repeats = (int)max((size_t)1, 10000000 / count);
+        size_t visible = 0;
+
+        auto start = chrono::high_resolution_clock::now();
+        for (int r = 0; r < repeats; r++)
+            visible = cullFrustumScalar(bounds, frustum, &reference[0]);
+        double scalar_time = Seconds(start) / repeats;
+
+        start = chrono::high_resolution_clock::now();
+        for (int r = 0; r < repeats; r++)
+            cullFrustum(bounds, frustum, &simd[0], 1);
+        double simd_time = Seconds(start) / repeats;
+
+        start = chrono::high_resolution_clock::now();
+        for (int r = 0; r < repeats; r++)
+            cullFrustum(bounds, frustum, &threaded[0]);
+        double threaded_time = Seconds(start) / repeats;
+
+        printf("%7u objects, %6u visible: scalar %8.3f ms  %s %8.3f ms  threaded %8.3f ms  (%.0f M objects/s)%s\n",
+            (unsigned int)count, (unsigned int)visible,
+            scalar_time * 1000.0, cullSimdName(), simd_time * 1000.0, threaded_time * 1000.0,
+            count / threaded_time / 1e6,
+            reference == simd && reference == threaded ? "" : "  MISMATCH");
+    }
+}
+
+
+//------------------------------------------------------------
+// void BenchRenderQueue()
+// Radix sort of render keys against std::stable_sort, and the
+// state changes of random draws in submission order against
+// sorted order for a few amounts of distinct state
+//------------------------------------------------------------
+
+struct StateChanges
+{
+    unsigned int programs, textures, materials, vaos;
+};
+
+static StateChanges CountStateChanges(const vector<RenderItem>& items)
+{
+    StateChanges changes = { 0, 0, 0, 0 };
+    for (size_t i = 0; i < items.size(); i++) {
+        uint64_t a = i == 0 ? ~items[0].key : items[i - 1].key;
+        uint64_t b = items[i].key;
+        changes.programs += renderKeyField(a, RENDERKEY_PROGRAM_SHIFT, RENDERKEY_PROGRAM_BITS)
+            != renderKeyField(b, RENDERKEY_PROGRAM_SHIFT, RENDERKEY_PROGRAM_BITS);
+        changes.textures += renderKeyField(a, RENDERKEY_TEXTURE_SHIFT, RENDERKEY_TEXTURE_BITS)
+            != renderKeyField(b, RENDERKEY_TEXTURE_SHIFT, RENDERKEY_TEXTURE_BITS);
+        changes.materials += renderKeyField(a, RENDERKEY_MATERIAL_SHIFT, RENDERKEY_MATERIAL_BITS)
+            != renderKeyField(b, RENDERKEY_MATERIAL_SHIFT, RENDERKEY_MATERIAL_BITS);
+        changes.vaos += renderKeyField(a, RENDERKEY_VAO_SHIFT, RENDERKEY_VAO_BITS)
+            != renderKeyField(b, RENDERKEY_VAO_SHIFT, RENDERKEY_VAO_BITS);
+    }
+    return changes;
+}
+
+// Draws of kinds distinct combinations of state, like instances of a
+// few meshes, submitted in random order at random depths
+static void FillRenderQueue(RenderQueue& queue, size_t count, unsigned int kinds)
+{
+    vector<uint64_t> states(kinds);
+    for (unsigned int k = 0; k < kinds; k++)
+        states[k] = makeRenderKey(rand() % 8, 1 + rand() % 256, rand() % 64, 1 + rand() % 1024, 0.0f);
+
+    clearRenderQueue(queue);
+    for (size_t i = 0; i < count; i++) {
+        uint64_t depth = makeRenderKey(0, 0, 0, 0, (float)rand() / RAND_MAX);
+        pushRenderItem(queue, states[rand() % kinds] | depth, (uint32_t)i);
+    }
+}
+
+static void BenchRenderQueue()
+{
+    RenderQueue queue;
+    srand(1);
+
+    const size_t counts[] = { 1000, 10000, 100000 };
+    for (size_t count : counts) {
+        FillRenderQueue(queue, count, 100);
+        vector<RenderItem> submitted = queue.items;
+        vector<RenderItem> reference;
+        int repeats = (int)max((size_t)1, 2000000 / count);
+
+        auto start = chrono::high_resolution_clock::now();
+        for (int r = 0; r < repeats; r++) {
+            reference = submitted;
+            stable_sort(reference.begin(), reference.end(),
+                [](const RenderItem& a, const RenderItem& b) { return a.key < b.key; });
+        }
+        double std_time = Seconds(start) / repeats;
+
+        start = chrono::high_resolution_clock::now();
+        for (int r = 0; r < repeats; r++) {
+            queue.items = submitted;
+            sortRenderQueue(queue);
+        }
+        double radix_time = Seconds(start) / repeats;
+
+        bool same = true;
+        for (size_t i = 0; i < count; i++)
+            same = same && queue.items[i].key == reference[i].key && queue.items[i].index == reference[i].index;
+        printf("%6u keys: std::stable_sort %8.1f us  radix %8.1f us  (%.1fx)%s\n", (unsigned int)count,
+            std_time * 1e6, radix_time * 1e6, std_time / radix_time, same ? "" : "  MISMATCH");
+    }
+
+    const unsigned int kinds[] = { 1, 10, 100, 1000 };
+    const size_t draws = 10000;
+    printf("State changes for %u draws, submitted -> sorted:\n", (unsigned int)draws);
+    for (unsigned int k : kinds) {
+        FillRenderQueue(queue, draws, k);
+        StateChanges before = CountStateChanges(queue.items);
+        sortRenderQueue(queue);
+        StateChanges after = CountStateChanges(queue.items);
+        printf("%4u states: programs %5u -> %4u  textures %5u -> %4u"
+            "  materials %5u -> %4u  vaos %5u -> %4u  batches %4u\n", k,
+            before.programs, after.programs, before.textures, after.textures,
+            before.materials, after.materials, before.vaos, after.vaos, queue.batches);
+    }
+}
+
+
+//------------------------------------------------------------
+// void BenchLightClusters()
+// Random point lights in front of the scene camera assigned
+// to clusters by the scalar loop, the SIMD loop and the
+// threaded SIMD loop
+//------------------------------------------------------------
+
+static void BenchLightClusters()
+{
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+    ClusterGrid scalar, simd, threaded;
+    setupClusterGrid(scalar, projection, 0.1f, 100.0f);
+    setupClusterGrid(simd, projection, 0.1f, 100.0f);
+    setupClusterGrid(threaded, projection, 0.1f, 100.0f);
+
+    const size_t counts[] = { 1, 64, 1024, 10000, 100000 };
+    for (size_t count : counts) {
+        vector<PointLight> lights(count);
+        srand(1);
+        for (PointLight& light : lights) {
+            // View space, mostly inside the frustum
+            float depth = 0.5f + rand() * 80.0f / RAND_MAX;
+            light.positionRadius = glm::vec4(
+                (rand() * 2.0f / RAND_MAX - 1.0f) * depth * 0.6f,
+                (rand() * 2.0f / RAND_MAX - 1.0f) * depth * 0.45f,
+                -depth, 1.0f);
+            light.color = glm::vec4(1.0f);
+        }
+
+        int repeats = (int)max((size_t)1, 200000 / count);
+        size_t references = 0;
+
+        auto start = chrono::high_resolution_clock::now();
+        for (int r = 0; r < repeats; r++)
+            references = assignLightsScalar(scalar, &lights[0], count);
+        double scalar_time = Seconds(start) / repeats;
+
+        start = chrono::high_resolution_clock::now();
+        for (int r = 0; r < repeats; r++)
+            assignLights(simd, &lights[0], count, 1);
+        double simd_time = Seconds(start) / repeats;
+
+        start = chrono::high_resolution_clock::now();
+        for (int r = 0; r < repeats; r++)
+            assignLights(threaded, &lights[0], count);
+        double threaded_time = Seconds(start) / repeats;
+
+        bool same = scalar.clusters == simd.clusters && scalar.indices == simd.indices
+            && scalar.clusters == threaded.clusters && scalar.indices == threaded.indices;
+        printf("%6u lights: %7u references (%.1f per cluster, longest %u, %u dropped)  scalar %8.3f ms  %s %8.3f ms"
+            "  %d threads %8.3f ms%s\n",
+            (unsigned int)count, (unsigned int)references, (double)references / CLUSTER_COUNT, scalar.maxCount,
+            (unsigned int)scalar.dropped, scalar_time * 1000.0, clusterSimdName(), simd_time * 1000.0,
+            threaded.threads, threaded_time * 1000.0, same ? "" : "  MISMATCH");
+    }
+}
+
+//------------------------------------------------------------
+// void BenchSoftRaster()
+// The software rasterizer on a grid of small teapots and on a
+// stack of screen-sized quads, at 1 thread up to one per core.
+// Every thread count has to produce the 1 thread image.
+//------------------------------------------------------------
+
+static void SoftRasterScene(SoftRenderer& renderer, int scene, const SoftMesh& teapot, const SoftMesh& quad,
+    const ImageData& texture)
+{
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 12.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+    beginSoftFrame(renderer, view, projection, glm::vec3(4.0f, 4.0f, 4.0f), glm::vec3(0.0f));
+
+    SoftDraw draw;
+    draw.material.ambient = glm::vec4(0.2f, 0.2f, 0.1f, 0.0f);
+    draw.material.diffuse = glm::vec4(1.0f, 1.0f, 1.0f, 0.0f);
+    draw.material.specular = glm::vec4(0.7f, 0.7f, 0.7f, 1024.0f);
+    draw.texture = &texture;
+    if (scene == 0) {
+        draw.mesh = &teapot;
+        for (int y = 0; y < 12; y++)
+            for (int x = 0; x < 16; x++) {
+                glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(x - 7.5f, y - 5.5f, 0.0f) * 0.6f);
+                model = glm::rotate(model, 0.3f * (x + y), glm::vec3(0.0f, 1.0f, 0.0f));
+                draw.model = glm::scale(model, glm::vec3(0.2f));
+                submitSoftDraw(renderer, draw);
+            }
+    }
+    else {
+        // Back to front, so every layer passes the depth test
+        draw.mesh = &quad;
+        for (int layer = 0; layer < 8; layer++) {
+            draw.model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, layer * 0.1f));
+            draw.model = glm::rotate(draw.model, 0.1f * layer, glm::vec3(0.0f, 0.0f, 1.0f));
+            draw.model = glm::scale(draw.model, glm::vec3(8.0f));
+            submitSoftDraw(renderer, draw);
+        }
+    }
+    endSoftFrame(renderer);
+}
+
+static void BenchSoftRaster()
+{
+    vector<unsigned int> indices;
+    vector<glm::vec3> vertices, normals;
+    vector<glm::vec2> uvs;
+    ImageData texture;
+    if (!loadOBJIndexed("teapot.obj", indices, vertices, uvs, normals) || !decodeBMP("uvtemplate.bmp", texture))
+        return;
+    generateMipmaps(texture);
+    SoftMesh teapot = { &vertices[0], &normals[0], &uvs[0], &indices[0], vertices.size(), indices.size() };
+
+    // Two triangles facing the camera
+    const glm::vec3 quad_positions[4] = { glm::vec3(-1, -1, 0), glm::vec3(1, -1, 0), glm::vec3(1, 1, 0), glm::vec3(-1, 1, 0) };
+    const glm::vec3 quad_normals[4] = { glm::vec3(0, 0, 1), glm::vec3(0, 0, 1), glm::vec3(0, 0, 1), glm::vec3(0, 0, 1) };
+    const glm::vec2 quad_uvs[4] = { glm::vec2(0, 0), glm::vec2(4, 0), glm::vec2(4, 4), glm::vec2(0, 4) };
+    const unsigned int quad_indices[6] = { 0, 1, 2, 0, 2, 3 };
+    SoftMesh quad = { quad_positions, quad_normals, quad_uvs, quad_indices, 4, 6 };
+
+    unsigned int cores = max(1u, thread::hardware_concurrency());
+    vector<unsigned int> thread_counts;
+    for (unsigned int t = 1; t < cores; t *= 2)
+        thread_counts.push_back(t);
+    thread_counts.push_back(cores);
+
+    const char* scene_names[2] = { "192 teapots, small triangles", "8 full screen quads, large triangles" };
+    printf("Software rasterizer at 800x600, %s edge functions\n", softRasterSimdName());
+    for (int scene = 0; scene < 2; scene++) {
+        printf("%s\n", scene_names[scene]);
+        vector<unsigned char> reference;
+        for (unsigned int threads : thread_counts) {
+            SoftRenderer renderer;
+            initSoftRenderer(renderer, 800, 600, threads);
+            SoftRasterScene(renderer, scene, teapot, quad, texture);
+
+            const int frames = 10;
+            double vertex_ms = 0.0, bin_ms = 0.0, tile_ms = 0.0;
+            auto start = chrono::high_resolution_clock::now();
+            for (int f = 0; f < frames; f++) {
+                SoftRasterScene(renderer, scene, teapot, quad, texture);
+                vertex_ms += renderer.stats.vertexMs;
+                bin_ms += renderer.stats.binMs;
+                tile_ms += renderer.stats.tileMs;
+            }
+            double seconds = Seconds(start) / frames;
+
+            if (reference.empty())
+                reference = renderer.color;
+            const SoftRasterStats& stats = renderer.stats;
+            printf("  %2u threads: %8.2f ms/frame (vertices %.2f, binning %.2f, tiles %.2f)  %7.2f M triangles/s"
+                "  %7.2f M pixels/s%s\n",
+                threads, seconds * 1000.0, vertex_ms / frames, bin_ms / frames, tile_ms / frames,
+                stats.triangles / seconds / 1e6, stats.pixels / seconds / 1e6,
+                renderer.color == reference ? "" : "  MISMATCH");
+            destroySoftRenderer(renderer);
+        }
+    }
+}
+
+//------------------------------------------------------------
+// void BenchTransforms(size_t count)
+// A forest of count nodes, three children per node, in random
+// order. The per-object glm loop against the SoA hierarchy on
+// one thread and on the job pool, then again with 1% of the
+// nodes moved. Every result has to match the glm loop.
+//------------------------------------------------------------
+
+static float MaxTransformDifference(const vector<glm::mat4>& a, const vector<glm::mat4>& b)
+{
+    float worst = 0.0f;
+    for (size_t i = 0; i < a.size(); i++)
+        for (int c = 0; c < 4; c++)
+            for (int r = 0; r < 4; r++)
+                worst = max(worst, fabsf(a[i][c][r] - b[i][c][r]));
+    return worst;
+}
+
+static void BenchTransforms(size_t count)
+{
+    // Node ids shuffled so the hierarchy really has to sort them
+    size_t roots = max((size_t)1, count / 100);
+    vector<unsigned int> order(count);
+    for (size_t i = 0; i < count; i++)
+        order[i] = (unsigned int)i;
+    srand(1);
+    for (size_t i = count - 1; i > 0; i--)
+        swap(order[i], order[rand() % (i + 1)]);
+    vector<int> parents(count);
+    vector<glm::mat4> locals(count);
+    for (size_t n = 0; n < count; n++) {
+        parents[order[n]] = n < roots ? -1 : (int)order[(n - roots) / 3];
+        glm::mat4 m = glm::translate(glm::mat4(1.0f), glm::vec3(rand() % 7 - 3.0f, 1.0f, rand() % 5 - 2.0f) * 0.5f);
+        locals[order[n]] = glm::rotate(m, rand() * 6.28f / RAND_MAX, glm::vec3(0.0f, 1.0f, 0.0f));
+    }
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 20.0f, 60.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+    TransformHierarchy reference, simd, threaded;
+    vector<unsigned int> slots;
+    if (!buildTransformHierarchy(reference, &parents[0], &locals[0], count, slots))
+        return;
+    buildTransformHierarchy(simd, &parents[0], &locals[0], count, slots);
+    buildTransformHierarchy(threaded, &parents[0], &locals[0], count, slots);
+    JobPool pool;
+    startJobPool(pool);
+
+    // Slots of the 1% that move every frame
+    vector<unsigned int> moving;
+    for (size_t i = 0; i < count; i += 100)
+        moving.push_back(slots[order[i]]);
+
+    printf("%u nodes in %u levels, %s, job pool of %u threads\n", (unsigned int)count, reference.stats.levels,
+        transformSimdName(), (unsigned int)pool.queues.size());
+    const int frames = 20;
+    for (int partial = 0; partial < 2; partial++) {
+        double times[3] = { 0.0, 0.0, 0.0 };
+        size_t steals = pool.steals;
+        size_t updated = 0;
+        for (int f = 0; f < frames; f++) {
+            float angle = 0.01f * (f + 1);
+            for (size_t k = 0; k < (partial ? moving.size() : count); k++) {
+                unsigned int slot = partial ? moving[k] : (unsigned int)k;
+                glm::mat4 local = glm::rotate(reference.local[slot], angle, glm::vec3(0.0f, 1.0f, 0.0f));
+                setLocalTransform(reference, slot, local);
+                setLocalTransform(simd, slot, local);
+                setLocalTransform(threaded, slot, local);
+            }
+
+            auto start = chrono::high_resolution_clock::now();
+            updateTransformsReference(reference, &view);
+            times[0] += Seconds(start);
+            start = chrono::high_resolution_clock::now();
+            updateTransforms(simd, &view, NULL);
+            times[1] += Seconds(start);
+            start = chrono::high_resolution_clock::now();
+            updateTransforms(threaded, &view, &pool);
+            times[2] += Seconds(start);
+            updated += threaded.stats.updated;
+        }
+
+        float difference = max(MaxTransformDifference(reference.world, threaded.world),
+            max(MaxTransformDifference(reference.modelView, threaded.modelView),
+                MaxTransformDifference(reference.modelView, simd.modelView)));
+        printf("%s: %u nodes rebuilt per frame\n", partial ? "1% of the nodes moving" : "every node moving",
+            (unsigned int)(updated / frames));
+        printf("  per-object glm %8.3f ms  SoA %s %8.3f ms  SoA + job pool %8.3f ms (%u steals)  max difference %g%s\n",
+            times[0] * 1000.0 / frames, transformSimdName(), times[1] * 1000.0 / frames, times[2] * 1000.0 / frames,
+            (unsigned int)(pool.steals - steals), difference, difference > 1e-4f ? "  MISMATCH" : "");
+    }
+    stopJobPool(pool);
+}
+
+//------------------------------------------------------------
+// void BenchMipmaps()
+// Mip chains of the bundled BMPs and a large synthetic image
+// for every filter, linear and sRGB, SIMD against scalar.
+// MPix/s counts level 0 pixels.
+//------------------------------------------------------------
+
+static void BenchMipmapImage(const char* name, const ImageData& image)
+{
+    const MipFilter filters[] = { MIP_FILTER_BOX, MIP_FILTER_KAISER, MIP_FILTER_LANCZOS };
+    double pixels = (double)image.width * image.height;
+    int repeats = (int)max(1.0, 4e6 / pixels);
+
+    printf("%s: %ux%u, %d repeats\n", name, image.width, image.height, repeats);
+    for (MipFilter filter : filters) {
+        for (int srgb = 0; srgb < 2; srgb++) {
+            vector<unsigned char> simd, scalar;
+            vector<MipLevel> simdLevels, scalarLevels;
+
+            auto start = chrono::high_resolution_clock::now();
+            for (int r = 0; r < repeats; r++) {
+                simd = image.pixels;
+                simdLevels = image.levels;
+                buildMipChain(simd, simdLevels, filter, srgb != 0);
+            }
+            double simd_time = Seconds(start) / repeats;
+
+            start = chrono::high_resolution_clock::now();
+            for (int r = 0; r < repeats; r++) {
+                scalar = image.pixels;
+                scalarLevels = image.levels;
+                buildMipChainScalar(scalar, scalarLevels, filter, srgb != 0);
+            }
+            double scalar_time = Seconds(start) / repeats;
+
+            int difference = 0;
+            for (size_t i = 0; i < simd.size() && i < scalar.size(); i++)
+                difference = max(difference, abs((int)simd[i] - (int)scalar[i]));
+
+            printf("  %-7s %-6s %2u levels: scalar %8.3f ms (%6.1f MPix/s)  %s %8.3f ms (%6.1f MPix/s)  max diff %d%s\n",
+                mipFilterName(filter), srgb ? "sRGB" : "linear", (unsigned int)simdLevels.size(),
+                scalar_time * 1000.0, pixels / scalar_time / 1e6,
+                mipSimdName(), simd_time * 1000.0, pixels / simd_time / 1e6, difference,
+                simd.size() == scalar.size() ? "" : "  SIZE MISMATCH");
+        }
+    }
+}
+
+static void BenchMipmaps()
+{
+    const char* bmps[] = { "uvtemplate.bmp", "Yellobrk.bmp" };
+    for (const char* path : bmps) {
+        ImageData image;
+        if (decodeBMP(path, image))
+            BenchMipmapImage(path, image);
+    }
+
+    // Odd sized so every level has a 1 pixel remainder somewhere
+    ImageData image;
+    image.width = 2047;
+    image.height = 1023;
+    image.format = GL_BGR;
+    MipLevel base;
+    base.width = image.width;
+    base.height = image.height;
+    base.offset = 0;
+    base.stride = mipRowStride(image.width);
+    image.levels.assign(1, base);
+    image.pixels.resize(base.stride * base.height);
+    srand(1);
+    for (unsigned int y = 0; y < image.height; y++)
+        for (unsigned int x = 0; x < image.width * 3; x++)
+            image.pixels[y * base.stride + x] = (unsigned char)(((x / 3) ^ y) + rand() % 16);
+    BenchMipmapImage("synthetic", image);
+}
+
+
+//------------------------------------------------------------
+// void BenchCompression()
+// Level 0 of the bundled BMPs in BC1 and BC3 at every quality,
+// on one thread and on all of them, with the PSNR of the result
+//------------------------------------------------------------
+
+static void BenchCompression()
+{
+    const char* bmps[] = { "uvtemplate.bmp", "Yellobrk.bmp" };
+    const BCFormat formats[] = { BC_FORMAT_BC1, BC_FORMAT_BC3 };
+    for (const char* path : bmps) {
+        ImageData image;
+        if (!decodeBMP(path, image))
+            continue;
+        const MipLevel& base = image.levels[0];
+        double pixels = (double)base.width * base.height;
+        int repeats = (int)max(1.0, 1e6 / pixels);
+        printf("%s: %ux%u, %s, %d repeats\n", path, base.width, base.height, bcSimdName(), repeats);
+
+        for (BCFormat format : formats) {
+            for (int q = BC_QUALITY_FAST; q <= BC_QUALITY_HIGH; q++) {
+                BCQuality quality = (BCQuality)q;
+                vector<unsigned char> single, threaded;
+
+                auto start = chrono::high_resolution_clock::now();
+                for (int r = 0; r < repeats; r++) {
+                    single.clear();
+                    compressBC(&image.pixels[0], base.width, base.height, base.stride, 3, format, quality, single, 1);
+                }
+                double single_time = Seconds(start) / repeats;
+
+                start = chrono::high_resolution_clock::now();
+                for (int r = 0; r < repeats; r++) {
+                    threaded.clear();
+                    compressBC(&image.pixels[0], base.width, base.height, base.stride, 3, format, quality, threaded);
+                }
+                double threaded_time = Seconds(start) / repeats;
+
+                vector<unsigned char> decoded(image.pixels.size());
+                decompressBC(&threaded[0], base.width, base.height, format, &decoded[0], base.stride);
+                double psnr = measurePSNR(&image.pixels[0], &decoded[0], base.width, base.height, base.stride);
+
+                printf("  %s %-6s: 1 thread %7.2f ms (%6.1f MPix/s)  threaded %7.2f ms (%6.1f MPix/s)  %6.1f KB  PSNR %.2f dB%s\n",
+                    bcFormatName(format), bcQualityName(quality),
+                    single_time * 1000.0, pixels / single_time / 1e6, threaded_time * 1000.0, pixels / threaded_time / 1e6,
+                    threaded.size() / 1024.0, psnr, single == threaded ? "" : "  MISMATCH");
+            }
+        }
+    }
+}
+
+
+//------------------------------------------------------------
+// void BenchFileWatcher()
+// Runs the shader file watcher against a temporary directory:
+// in-place writes, saves by rename, unrelated files, repeated
+// writes and files created later must each be reported right,
+// and an idle poll has to be cheap enough for every frame
+//------------------------------------------------------------
+
+static bool MakeTempDir(string& dir)
+{
+#ifdef _WIN32
+    const char* base = getenv("TEMP");
+    dir = string(base != NULL ? base : ".") + "\\filewatch" + to_string(_getpid());
+    return _mkdir(dir.c_str()) == 0;
+#else
+    char name[] = "/tmp/filewatchXXXXXX";
+    if (mkdtemp(name) == NULL)
+        return false;
+    dir = name;
+    return true;
+#endif
+}
+
+static void RemoveTempDir(const string& dir, const char* const* names, int count)
+{
+    for (int i = 0; i < count; i++)
+        remove((dir + "/" + names[i]).c_str());
+#ifdef _WIN32
+    _rmdir(dir.c_str());
+#else
+    rmdir(dir.c_str());
+#endif
+}
+
+// Every write has a different length, so even a watcher comparing
+// modification times of one second resolution sees it
+static void WriteText(const string& path, int version)
+{
+    FILE* fp = fopen(path.c_str(), "wb");
+    if (fp == NULL)
+        return;
+    for (int i = 0; i <= version; i++)
+        fputs("// edit\n", fp);
+    fclose(fp);
+}
+
+// Polls until something shows up or timeout seconds pass; latency is
+// how long that took
+static vector<string> WaitForChanges(FileWatcher& watcher, double timeout, double* latency = NULL)
+{
+    vector<string> changed;
+    auto start = chrono::high_resolution_clock::now();
+    while (pollFileWatcher(watcher, changed) == 0 && Seconds(start) < timeout)
+        this_thread::sleep_for(chrono::milliseconds(1));
+    if (latency != NULL)
+        *latency = Seconds(start);
+    // Anything else belonging to the same edit
+    this_thread::sleep_for(chrono::milliseconds(20));
+    pollFileWatcher(watcher, changed);
+    return changed;
+}
+
+static void BenchFileWatcher(bool polling)
+{
+    string dir;
+    if (!MakeTempDir(dir)) {
+        printf("Cannot create a temporary directory\n");
+        return;
+    }
+    const char* names[] = { "a.vert", "b.frag", "c.txt", "b.frag.tmp", "late.frag" };
+    string a = dir + "/a.vert", b = dir + "/b.frag", c = dir + "/c.txt";
+    string tmp = dir + "/b.frag.tmp", late = dir + "/late.frag";
+    WriteText(a, 0);
+    WriteText(b, 0);
+
+    FileWatcher watcher;
+    initFileWatcher(watcher, polling);
+    watchFile(watcher, a.c_str());
+    watchFile(watcher, b.c_str());
+    watchFile(watcher, late.c_str());
+    printf("Watching %s (%s)\n", dir.c_str(), watcher.fd >= 0 ? "inotify" : "polling");
+
+    // Modification times may have a one second resolution
+    double timeout = watcher.fd >= 0 ? 1.0 : 3.0;
+    int failed = 0;
+    auto check = [&](const char* what, const vector<string>& changed, const vector<string>& expected) {
+        bool ok = changed == expected;
+        failed += !ok;
+        printf("  %-32s %s", what, ok ? "ok" : "FAILED, got");
+        if (!ok)
+            for (const string& file : changed)
+                printf(" %s", file.c_str());
+        printf("\n");
+    };
+
+    // A new second, so the first write shows up even when polling
+    this_thread::sleep_for(chrono::milliseconds(polling ? 1000 : 0));
+    double latency = 0.0;
+    WriteText(a, 1);
+    check("write in place", WaitForChanges(watcher, timeout, &latency), { a });
+
+    WriteText(c, 1);
+    check("unwatched file", WaitForChanges(watcher, 0.1), {});
+
+    WriteText(b, 1);
+    WriteText(b, 2);
+    WriteText(b, 3);
+    check("three writes, one report", WaitForChanges(watcher, timeout), { b });
+
+    WriteText(tmp, 4);
+    remove(b.c_str());
+    rename(tmp.c_str(), b.c_str());
+    check("save by rename", WaitForChanges(watcher, timeout), { b });
+
+    WriteText(late, 0);
+    check("file created after watching", WaitForChanges(watcher, timeout), { late });
+
+    check("nothing changed", WaitForChanges(watcher, 0.1), {});
+
+    const int polls = polling ? 10000 : 100000;
+    vector<string> changed;
+    auto start = chrono::high_resolution_clock::now();
+    for (int i = 0; i < polls; i++) {
+        changed.clear();
+        pollFileWatcher(watcher, changed);
+    }
+    double poll_time = Seconds(start) / polls;
+
+    closeFileWatcher(watcher);
+    RemoveTempDir(dir, names, 5);
+    printf("%s, edit seen after %.2f ms, idle poll %.2f us\n", failed == 0 ? "All checks passed" : "Checks FAILED",
+        latency * 1000.0, poll_time * 1e6);
+}
+
+
+bool RunBenchmark(int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bench-obj") == 0) {
+            BenchObjLoader();
+            return true;
+        }
+        if (strcmp(argv[i], "--bench-stream") == 0) {
+            int segments = i + 1 < argc ? max(atoi(argv[i + 1]), 1) : 1000;
+            size_t budget = i + 2 < argc ? (size_t)max(atoi(argv[i + 2]), 1) << 20 : (size_t)64 << 20;
+            BenchObjStreaming(segments, budget);
+            return true;
+        }
+        if (strcmp(argv[i], "--bench-index") == 0) {
+            BenchIndexedMeshes();
+            return true;
+        }
+        if (strcmp(argv[i], "--bench-cache") == 0) {
+            BenchMeshCache();
+            return true;
+        }
+        if (strcmp(argv[i], "--bench-optimize") == 0) {
+            BenchMeshOptimizer();
+            return true;
+        }
+        if (strcmp(argv[i], "--bench-quantize") == 0) {
+            BenchVertexFormats();
+            return true;
+        }
+        if (strcmp(argv[i], "--bench-lod") == 0) {
+            BenchLods();
+            return true;
+        }
+        if (strcmp(argv[i], "--bench-cull") == 0) {
+            BenchCulling();
+            return true;
+        }
+        if (strcmp(argv[i], "--bench-sort") == 0) {
+            BenchRenderQueue();
+            return true;
+        }
+        if (strcmp(argv[i], "--bench-clusters") == 0) {
+            BenchLightClusters();
+            return true;
+        }
+        if (strcmp(argv[i], "--bench-raster") == 0) {
+            BenchSoftRaster();
+            return true;
+        }
+        if (strcmp(argv[i], "--bench-transforms") == 0) {
+            BenchTransforms(i + 1 < argc ? max(atoi(argv[i + 1]), 1) : 200000);
+            return true;
+        }
+        if (strcmp(argv[i], "--bench-mipmap") == 0) {
+            BenchMipmaps();
+            return true;
+        }
+        if (strcmp(argv[i], "--bench-compress") == 0) {
+            BenchCompression();
+            return true;
+        }
+        if (strcmp(argv[i], "--bench-watch") == 0) {
+            BenchFileWatcher(false);
+            BenchFileWatcher(true);
+            return true;
+        }
+    }
+    return false;
+}
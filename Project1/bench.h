@@ -0,0 +1,8 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// Command-line benchmarks. Returns true when argv named a benchmark,
+// in which case it has already run and the program should exit.
+bool RunBenchmark(int argc, char** argv);
+
+#endif
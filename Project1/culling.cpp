@@ -0,0 +1,259 @@
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define CULL_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CULL_SSE2
+#endif
+
+#include "culling.h"
+
+using namespace std;
+
+// Below this many objects per thread the culling itself is cheaper than
+// starting the thread
+static const size_t CULL_OBJECTS_PER_THREAD = 16384;
+
+
+void computeMeshBounds(const MeshData& mesh, MeshBounds& bounds)
+{
+    bounds.center = (mesh.boundsMin + mesh.boundsMax) * 0.5f;
+    bounds.extents = (mesh.boundsMax - mesh.boundsMin) * 0.5f;
+
+    float max_distance = 0.0f;
+    for (unsigned int i = 0; i < mesh.vertexCount; i++) {
+        glm::vec3 d = mesh.vertices[i] - bounds.center;
+        max_distance = max(max_distance, glm::dot(d, d));
+    }
+    bounds.radius = sqrtf(max_distance);
+}
+
+void extractFrustum(const glm::mat4& m, Frustum& frustum)
+{
+    // glm is column major: row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+    glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+    glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+    glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+    glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+    frustum.planes[0] = row3 + row0;    // left
+    frustum.planes[1] = row3 - row0;    // right
+    frustum.planes[2] = row3 + row1;    // bottom
+    frustum.planes[3] = row3 - row1;    // top
+    frustum.planes[4] = row3 + row2;    // near
+    frustum.planes[5] = row3 - row2;    // far
+
+    for (int i = 0; i < 6; i++) {
+        glm::vec4& p = frustum.planes[i];
+        float length = sqrtf(p.x * p.x + p.y * p.y + p.z * p.z);
+        p /= length;
+    }
+}
+
+void resizeCullBounds(CullBounds& bounds, size_t count)
+{
+    size_t padded = (count + CULL_BATCH - 1) / CULL_BATCH * CULL_BATCH;
+    bounds.count = count;
+    bounds.cx.resize(padded, 0.0f);
+    bounds.cy.resize(padded, 0.0f);
+    bounds.cz.resize(padded, 0.0f);
+    bounds.ex.resize(padded, 0.0f);
+    bounds.ey.resize(padded, 0.0f);
+    bounds.ez.resize(padded, 0.0f);
+    bounds.radius.resize(padded, 0.0f);
+}
+
+void setCullBounds(CullBounds& bounds, size_t index, const glm::mat4& model, const MeshBounds& mesh)
+{
+    glm::vec4 c = model * glm::vec4(mesh.center, 1.0f);
+    bounds.cx[index] = c.x;
+    bounds.cy[index] = c.y;
+    bounds.cz[index] = c.z;
+
+    // Extents of the rotated box along the world axes
+    const glm::vec3& e = mesh.extents;
+    bounds.ex[index] = fabsf(model[0][0]) * e.x + fabsf(model[1][0]) * e.y + fabsf(model[2][0]) * e.z;
+    bounds.ey[index] = fabsf(model[0][1]) * e.x + fabsf(model[1][1]) * e.y + fabsf(model[2][1]) * e.z;
+    bounds.ez[index] = fabsf(model[0][2]) * e.x + fabsf(model[1][2]) * e.y + fabsf(model[2][2]) * e.z;
+
+    float scale = max(glm::length(glm::vec3(model[0])),
+        max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+    bounds.radius[index] = mesh.radius * scale;
+}
+
+//------------------------------------------------------------
+// Scalar test of objects [begin, end)
+//------------------------------------------------------------
+
+static size_t CullRangeScalar(const CullBounds& b, const Frustum& frustum, unsigned char* visible, size_t begin, size_t end)
+{
+    size_t count = 0;
+    for (size_t i = begin; i < end; i++) {
+        bool inside = true;
+        for (int p = 0; p < 6 && inside; p++) {
+            const glm::vec4& plane = frustum.planes[p];
+            // Same summation order as the SIMD path, so results match exactly
+            float d = (plane.x * b.cx[i] + plane.y * b.cy[i]) + (plane.z * b.cz[i] + plane.w);
+            float box = (fabsf(plane.x) * b.ex[i] + fabsf(plane.y) * b.ey[i]) + fabsf(plane.z) * b.ez[i];
+            inside = d >= -min(b.radius[i], box);
+        }
+        visible[i] = inside;
+        count += inside;
+    }
+    return count;
+}
+
+//------------------------------------------------------------
+// SIMD test of objects [begin, end), begin is a multiple of
+// CULL_BATCH; reads may run into the padding past end
+//------------------------------------------------------------
+
+#if defined(CULL_AVX)
+
+static size_t CullRangeSimd(const CullBounds& b, const Frustum& frustum, unsigned char* visible, size_t begin, size_t end)
+{
+    __m256 nx[6], ny[6], nz[6], nw[6], ax[6], ay[6], az[6];
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    for (int p = 0; p < 6; p++) {
+        nx[p] = _mm256_set1_ps(frustum.planes[p].x);
+        ny[p] = _mm256_set1_ps(frustum.planes[p].y);
+        nz[p] = _mm256_set1_ps(frustum.planes[p].z);
+        nw[p] = _mm256_set1_ps(frustum.planes[p].w);
+        ax[p] = _mm256_andnot_ps(sign, nx[p]);
+        ay[p] = _mm256_andnot_ps(sign, ny[p]);
+        az[p] = _mm256_andnot_ps(sign, nz[p]);
+    }
+
+    size_t count = 0;
+    for (size_t i = begin; i < end; i += 8) {
+        __m256 cx = _mm256_loadu_ps(&b.cx[i]), cy = _mm256_loadu_ps(&b.cy[i]), cz = _mm256_loadu_ps(&b.cz[i]);
+        __m256 ex = _mm256_loadu_ps(&b.ex[i]), ey = _mm256_loadu_ps(&b.ey[i]), ez = _mm256_loadu_ps(&b.ez[i]);
+        __m256 r = _mm256_loadu_ps(&b.radius[i]);
+
+        __m256 outside = _mm256_setzero_ps();
+        for (int p = 0; p < 6; p++) {
+            __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx[p], cx), _mm256_mul_ps(ny[p], cy)),
+                _mm256_add_ps(_mm256_mul_ps(nz[p], cz), nw[p]));
+            __m256 box = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax[p], ex), _mm256_mul_ps(ay[p], ey)),
+                _mm256_mul_ps(az[p], ez));
+            __m256 limit = _mm256_xor_ps(_mm256_min_ps(r, box), sign);
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(d, limit, _CMP_LT_OQ));
+        }
+
+        int mask = ~_mm256_movemask_ps(outside) & 0xFF;
+        size_t n = min((size_t)8, end - i);
+        for (size_t k = 0; k < n; k++) {
+            visible[i + k] = (mask >> k) & 1;
+            count += (mask >> k) & 1;
+        }
+    }
+    return count;
+}
+
+#elif defined(CULL_SSE2)
+
+static size_t CullRangeSimd(const CullBounds& b, const Frustum& frustum, unsigned char* visible, size_t begin, size_t end)
+{
+    __m128 nx[6], ny[6], nz[6], nw[6], ax[6], ay[6], az[6];
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    for (int p = 0; p < 6; p++) {
+        nx[p] = _mm_set1_ps(frustum.planes[p].x);
+        ny[p] = _mm_set1_ps(frustum.planes[p].y);
+        nz[p] = _mm_set1_ps(frustum.planes[p].z);
+        nw[p] = _mm_set1_ps(frustum.planes[p].w);
+        ax[p] = _mm_andnot_ps(sign, nx[p]);
+        ay[p] = _mm_andnot_ps(sign, ny[p]);
+        az[p] = _mm_andnot_ps(sign, nz[p]);
+    }
+
+    size_t count = 0;
+    for (size_t i = begin; i < end; i += 4) {
+        __m128 cx = _mm_loadu_ps(&b.cx[i]), cy = _mm_loadu_ps(&b.cy[i]), cz = _mm_loadu_ps(&b.cz[i]);
+        __m128 ex = _mm_loadu_ps(&b.ex[i]), ey = _mm_loadu_ps(&b.ey[i]), ez = _mm_loadu_ps(&b.ez[i]);
+        __m128 r = _mm_loadu_ps(&b.radius[i]);
+
+        __m128 outside = _mm_setzero_ps();
+        for (int p = 0; p < 6; p++) {
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p], cx), _mm_mul_ps(ny[p], cy)),
+                _mm_add_ps(_mm_mul_ps(nz[p], cz), nw[p]));
+            __m128 box = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax[p], ex), _mm_mul_ps(ay[p], ey)),
+                _mm_mul_ps(az[p], ez));
+            __m128 limit = _mm_xor_ps(_mm_min_ps(r, box), sign);
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(d, limit));
+        }
+
+        int mask = ~_mm_movemask_ps(outside) & 0xF;
+        size_t n = min((size_t)4, end - i);
+        for (size_t k = 0; k < n; k++) {
+            visible[i + k] = (mask >> k) & 1;
+            count += (mask >> k) & 1;
+        }
+    }
+    return count;
+}
+
+#else
+
+static size_t CullRangeSimd(const CullBounds& b, const Frustum& frustum, unsigned char* visible, size_t begin, size_t end)
+{
+    return CullRangeScalar(b, frustum, visible, begin, end);
+}
+
+#endif
+
+const char* cullSimdName()
+{
+#if defined(CULL_AVX)
+    return "AVX";
+#elif defined(CULL_SSE2)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
+
+size_t cullFrustumScalar(const CullBounds& bounds, const Frustum& frustum, unsigned char* visible)
+{
+    return CullRangeScalar(bounds, frustum, visible, 0, bounds.count);
+}
+
+size_t cullFrustum(const CullBounds& bounds, const Frustum& frustum, unsigned char* visible, int threads)
+{
+    size_t count = bounds.count;
+    if (threads <= 0) {
+        size_t wanted = count / CULL_OBJECTS_PER_THREAD;
+        size_t available = thread::hardware_concurrency();
+        threads = (int)max((size_t)1, min(wanted, available));
+    }
+    if (threads == 1 || count < (size_t)threads * CULL_BATCH)
+        return CullRangeSimd(bounds, frustum, visible, 0, count);
+
+    // Batch aligned slices, the calling thread takes the first one
+    size_t batches = (count + CULL_BATCH - 1) / CULL_BATCH;
+    size_t per_thread = (batches + threads - 1) / threads * CULL_BATCH;
+
+    vector<size_t> counts(threads, 0);
+    vector<thread> workers;
+    for (int t = 1; t < threads; t++) {
+        size_t begin = t * per_thread;
+        size_t end = min(count, begin + per_thread);
+        if (begin >= end)
+            break;
+        workers.push_back(thread([&, t, begin, end]() {
+            counts[t] = CullRangeSimd(bounds, frustum, visible, begin, end);
+        }));
+    }
+    counts[0] = CullRangeSimd(bounds, frustum, visible, 0, min(count, per_thread));
+    for (thread& worker : workers)
+        worker.join();
+
+    size_t total = 0;
+    for (size_t c : counts)
+        total += c;
+    return total;
+}
@@ -0,0 +1,70 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <stddef.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "meshcache.h"
+
+// CPU view frustum culling. World-space bounds are kept structure-of-arrays
+// so the SIMD path tests 4 (SSE) or 8 (AVX) objects per instruction; an
+// object is culled when its bounding sphere or its AABB lies completely
+// behind one of the six planes, whichever is tighter for that plane.
+// Large sets are split over threads.
+
+// Object space bounds of a mesh: AABB and a sphere around the AABB center
+struct MeshBounds
+{
+	glm::vec3 center;
+	glm::vec3 extents;		// half size of the AABB
+	float radius;			// farthest vertex from center
+};
+
+// Inward facing planes (xyz normal, w distance) of a view-projection
+struct Frustum
+{
+	glm::vec4 planes[6];
+};
+
+// World-space bounds of many objects. Arrays are padded to a multiple of
+// CULL_BATCH with empty entries so the SIMD loops need no tail handling.
+#define CULL_BATCH 8
+
+struct CullBounds
+{
+	size_t count;
+	std::vector<float> cx, cy, cz;
+	std::vector<float> ex, ey, ez;
+	std::vector<float> radius;
+};
+
+struct CullStats
+{
+	size_t tested;
+	size_t visible;
+	double milliseconds;
+};
+
+void computeMeshBounds(const MeshData & mesh, MeshBounds & bounds);
+
+// Gribb/Hartmann plane extraction, planes are normalized
+void extractFrustum(const glm::mat4 & viewProjection, Frustum & frustum);
+
+void resizeCullBounds(CullBounds & bounds, size_t count);
+
+// Transforms mesh bounds by a model matrix into slot index
+void setCullBounds(CullBounds & bounds, size_t index, const glm::mat4 & model, const MeshBounds & mesh);
+
+// Writes 1/0 per object to visible (bounds.count entries) and returns the
+// visible count. threads 0 picks a count from the object count.
+size_t cullFrustum(const CullBounds & bounds, const Frustum & frustum, unsigned char * visible, int threads = 0);
+
+// Plain loop over the same test, the reference for the SIMD path
+size_t cullFrustumScalar(const CullBounds & bounds, const Frustum & frustum, unsigned char * visible);
+
+// Name of the compiled SIMD path: "AVX", "SSE2" or "scalar"
+const char * cullSimdName();
+
+#endif
@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "filewatcher.h"
+
+using namespace std;
+
+// Modification time and size folded into one value, 0 if missing
+static long long FileStamp(const string& path)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+        return 0;
+    return (long long)info.st_mtime * 1000003 + (long long)info.st_size;
+}
+
+static void AddChanged(vector<string>& changed, size_t first, const string& file)
+{
+    if (find(changed.begin() + first, changed.end(), file) == changed.end())
+        changed.push_back(file);
+}
+
+bool initFileWatcher(FileWatcher& watcher, bool polling)
+{
+    watcher.fd = -1;
+    watcher.dirs.clear();
+    watcher.dirWatches.clear();
+    watcher.files.clear();
+    watcher.names.clear();
+    watcher.fileDirs.clear();
+    watcher.stamps.clear();
+#ifdef __linux__
+    if (!polling) {
+        watcher.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (watcher.fd < 0)
+            printf("inotify unavailable, polling watched files instead\n");
+    }
+#else
+    (void)polling;
+#endif
+    return true;
+}
+
+bool watchFile(FileWatcher& watcher, const char* path)
+{
+    string file(path);
+    size_t slash = file.find_last_of("/\\");
+    string dir = slash == string::npos ? "." : file.substr(0, slash);
+    string name = slash == string::npos ? file : file.substr(slash + 1);
+    if (dir.empty())
+        dir = "/";
+
+    size_t d = find(watcher.dirs.begin(), watcher.dirs.end(), dir) - watcher.dirs.begin();
+    if (d == watcher.dirs.size()) {
+        int watch = -1;
+#ifdef __linux__
+        if (watcher.fd >= 0) {
+            watch = inotify_add_watch(watcher.fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+            if (watch < 0) {
+                printf("Cannot watch directory %s\n", dir.c_str());
+                return false;
+            }
+        }
+#endif
+        watcher.dirs.push_back(dir);
+        watcher.dirWatches.push_back(watch);
+    }
+
+    watcher.files.push_back(file);
+    watcher.names.push_back(name);
+    watcher.fileDirs.push_back(d);
+    watcher.stamps.push_back(FileStamp(file));
+    return true;
+}
+
+size_t pollFileWatcher(FileWatcher& watcher, vector<string>& changed)
+{
+    size_t first = changed.size();
+
+#ifdef __linux__
+    if (watcher.fd >= 0) {
+        char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        for (;;) {
+            ssize_t length = read(watcher.fd, buffer, sizeof(buffer));
+            if (length <= 0)
+                break;
+            for (char* p = buffer; p < buffer + length; ) {
+                const struct inotify_event* event = (const struct inotify_event*)p;
+                p += sizeof(struct inotify_event) + event->len;
+                if (event->len == 0)
+                    continue;
+                for (size_t i = 0; i < watcher.files.size(); i++)
+                    if (watcher.dirWatches[watcher.fileDirs[i]] == event->wd && watcher.names[i] == event->name)
+                        AddChanged(changed, first, watcher.files[i]);
+            }
+        }
+        return changed.size() - first;
+    }
+#endif
+
+    for (size_t i = 0; i < watcher.files.size(); i++) {
+        long long stamp = FileStamp(watcher.files[i]);
+        if (stamp != watcher.stamps[i]) {
+            watcher.stamps[i] = stamp;
+            // A file being replaced is briefly missing, wait for the new one
+            if (stamp != 0)
+                AddChanged(changed, first, watcher.files[i]);
+        }
+    }
+    return changed.size() - first;
+}
+
+void closeFileWatcher(FileWatcher& watcher)
+{
+#ifdef __linux__
+    if (watcher.fd >= 0)
+        close(watcher.fd);
+#endif
+    watcher.fd = -1;
+    watcher.dirs.clear();
+    watcher.dirWatches.clear();
+    watcher.files.clear();
+    watcher.names.clear();
+    watcher.fileDirs.clear();
+    watcher.stamps.clear();
+}
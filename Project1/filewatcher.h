@@ -0,0 +1,41 @@
+#ifndef FILEWATCHER_H
+#define FILEWATCHER_H
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// Reports edits of a set of files without blocking, for hot reloading.
+//
+// The directories are watched rather than the files themselves: editors
+// often save by writing a new file and renaming it over the old one,
+// which would end a watch on the file. On Linux changes come from
+// inotify (a write that was closed, or a rename into place). Elsewhere,
+// or when inotify is unavailable, every poll compares modification time
+// and size. Nothing here touches GL.
+
+struct FileWatcher
+{
+	int fd;                             // inotify descriptor, -1 when polling
+	std::vector<std::string> dirs;
+	std::vector<int> dirWatches;        // inotify watch per directory
+	std::vector<std::string> files;     // as passed to watchFile
+	std::vector<std::string> names;     // file name without directory
+	std::vector<size_t> fileDirs;       // index into dirs per file
+	std::vector<long long> stamps;      // polling: mtime and size per file
+};
+
+// polling skips inotify, as on other platforms
+bool initFileWatcher(FileWatcher & watcher, bool polling = false);
+
+// False if the file's directory cannot be watched. The file itself does
+// not have to exist yet.
+bool watchFile(FileWatcher & watcher, const char * path);
+
+// Appends the watched files changed since the last poll, each once and
+// as passed to watchFile. Returns how many were appended.
+size_t pollFileWatcher(FileWatcher & watcher, std::vector<std::string> & changed);
+
+void closeFileWatcher(FileWatcher & watcher);
+
+#endif
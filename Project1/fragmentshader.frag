@@ -1,5 +1,15 @@
 #version 430 core
 
+// Built in variants, see shadervariants.h. Without any feature only the
+// ambient color is written.
+// DIFFUSE        Lambert term with the material's diffuse color
+// TEXTURED       diffuse color multiplied by texsampler
+// TEXTURE_ARRAY  texsampler is an array, sampled at texture_layer
+// SPECULAR       Phong highlight
+// INSTANCED      material from the vertex shader instead of material_index
+// CLUSTERED      adds the point lights of the fragment's cluster, see
+//                lightclusters.h
+
 // Input from vertex shader
 in VS_OUT
 {
@@ -8,33 +18,133 @@ in VS_OUT
     vec3 V;
 } fs_in;
 
-// Material properties
-uniform vec3 mat_ambient;
-uniform vec3 mat_diffuse;
-uniform vec3 mat_specular;
-uniform float mat_power;
+#ifdef INSTANCED
+// Material properties of the instance
+flat in vec3 mat_ambient;
+flat in vec3 mat_diffuse;
+flat in vec4 mat_specular;
+#else
+// Material properties, selected by material_index
+struct Material
+{
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;      // w = power
+};
+
+layout(std140, binding = 1) uniform MaterialData
+{
+    Material materials[64];
+};
+
+uniform int material_index;
+#endif
 
+#ifdef TEXTURED
 in vec2 UV;
+#ifdef TEXTURE_ARRAY
+uniform sampler2DArray texsampler;
+uniform int texture_layer;
+#else
 uniform sampler2D texsampler;
+#endif
+#endif
+
+#ifdef CLUSTERED
+struct PointLight
+{
+    vec4 position_radius;   // view space, w = radius
+    vec4 color;
+};
+
+layout(std140, binding = 2) uniform ClusterData
+{
+    uvec4 cluster_size;     // x, y, z, light count
+    vec4 cluster_depth;     // near, far, slice scale, slice bias
+    vec4 cluster_tile;      // tiles per pixel
+};
+
+layout(std430, binding = 1) readonly buffer Lights
+{
+    PointLight lights[];
+};
+
+layout(std430, binding = 2) readonly buffer Clusters
+{
+    uvec2 clusters[];       // offset, count
+};
+
+layout(std430, binding = 3) readonly buffer LightIndices
+{
+    uint light_indices[];
+};
+#endif
+
+// gl_FragColor does not exist in core profile shaders
+out vec4 frag_color;
 
 void main()
 {
-    // Normalize the incoming N, L and V vectors
+#ifndef INSTANCED
+    Material material = materials[material_index];
+    vec3 mat_ambient = material.ambient.rgb;
+    vec3 mat_diffuse = material.diffuse.rgb;
+    vec4 mat_specular = material.specular;
+#endif
+
+    vec3 color = mat_ambient;
+
+#if defined(DIFFUSE) || defined(SPECULAR)
+    // Normalize the incoming N and L vectors
     vec3 N = normalize(fs_in.N);
     vec3 L = normalize(fs_in.L);
-    vec3 V = normalize(fs_in.V);
+#endif
+
+#ifdef DIFFUSE
+    vec3 diffuse_color = mat_diffuse;
+#if defined(TEXTURE_ARRAY)
+    diffuse_color *= texture(texsampler, vec3(UV, texture_layer)).rgb;
+#elif defined(TEXTURED)
+    diffuse_color *= texture(texsampler, UV).rgb;
+#endif
+    color += max(dot(N, L), 0.0) * diffuse_color;
+#endif
 
-    // Calculate R locally
+#ifdef SPECULAR
+    // Calculate V and R locally
+    vec3 V = normalize(fs_in.V);
     vec3 R = reflect(-L, N);
+    color += pow(max(dot(R, V), 0.0), mat_specular.w) * mat_specular.rgb;
+#endif
 
-    // Compute the diffuse and specular components for each fragment
-    //vec3 diffuse = max(dot(N, L), 0.0) * mat_diffuse;
-    vec3 specular = pow(max(dot(R, V), 0.0), mat_power) * mat_specular;
-    
-    vec3 diffuse = max(dot(N, L), 0.0) * texture2D(texsampler, UV).rgb;
+#ifdef CLUSTERED
+    // Slices are spaced exponentially in view depth, tiles evenly on screen
+    vec3 P = -fs_in.V;
+    uint slice = uint(max(log(-P.z) * cluster_depth.z + cluster_depth.w, 0.0));
+    uvec3 cell = min(uvec3(uvec2(gl_FragCoord.xy * cluster_tile.xy), slice), cluster_size.xyz - 1);
+    uvec2 range = clusters[(cell.z * cluster_size.y + cell.y) * cluster_size.x + cell.x];
+#ifdef SPECULAR
+    vec3 V_point = normalize(fs_in.V);
+#endif
 
-    // Write final color to the framebuffer
-    gl_FragColor = vec4(mat_ambient + diffuse + specular, 1.0);
-    //gl_FragColor = vec4(mat_ambient + diffuse, 1.0);
+    for (uint n = 0; n < range.y; n++) {
+        PointLight light = lights[light_indices[range.x + n]];
+        vec3 to_light = light.position_radius.xyz - P;
+        float distance2 = dot(to_light, to_light);
+        // Falls to exactly 0 at the radius, so culling loses nothing
+        float falloff = clamp(1.0 - distance2 / (light.position_radius.w * light.position_radius.w), 0.0, 1.0);
+        falloff *= falloff;
+        vec3 L_point = to_light * inversesqrt(distance2);
+#ifdef DIFFUSE
+        color += falloff * max(dot(N, L_point), 0.0) * diffuse_color * light.color.rgb;
+#endif
+#ifdef SPECULAR
+        vec3 R_point = reflect(-L_point, N);
+        color += falloff * pow(max(dot(R_point, V_point), 0.0), mat_specular.w) * mat_specular.rgb * light.color.rgb;
+#endif
+    }
+#endif
 
+    // Write final color to the framebuffer
+    frag_color = vec4(color, 1.0);
 }
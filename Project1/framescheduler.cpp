@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+
+#include <GL/glew.h>
+#ifdef _WIN32
+#include <GL/wglew.h>
+#else
+#include <GL/glx.h>
+#endif
+
+#include "framescheduler.h"
+
+using namespace std;
+
+// Sleeping is only accurate to about a millisecond (worse on Windows),
+// the rest of the wait for a frame deadline is spent spinning
+static const double SPIN_SECONDS = 0.002;
+
+
+double schedulerClock()
+{
+    static const chrono::steady_clock::time_point origin = chrono::steady_clock::now();
+    return chrono::duration<double>(chrono::steady_clock::now() - origin).count();
+}
+
+//------------------------------------------------------------
+// Swap interval of the current context, false when the driver
+// has no extension for it
+//------------------------------------------------------------
+
+static bool SetSwapInterval(int interval)
+{
+#ifdef _WIN32
+    if (!WGLEW_EXT_swap_control)
+        return false;
+    return wglSwapIntervalEXT(interval) == TRUE;
+#else
+    typedef int (*SwapIntervalProc)(unsigned int);
+    SwapIntervalProc mesa = (SwapIntervalProc)glXGetProcAddressARB((const GLubyte*)"glXSwapIntervalMESA");
+    if (mesa != NULL)
+        return mesa(interval) == 0;
+    typedef int (*SwapIntervalSGIProc)(int);
+    SwapIntervalSGIProc sgi = (SwapIntervalSGIProc)glXGetProcAddressARB((const GLubyte*)"glXSwapIntervalSGI");
+    // SGI cannot turn vsync off
+    if (sgi != NULL && interval > 0)
+        return sgi(interval) == 0;
+    return false;
+#endif
+}
+
+void initFrameScheduler(FrameScheduler& scheduler, double step,
+    void (*update)(double dt), void (*render)(double alpha))
+{
+    memset(&scheduler, 0, sizeof(scheduler));
+    scheduler.step = step;
+    scheduler.maxFrameTime = 0.25;
+    scheduler.pacing = PACING_UNCAPPED;
+    scheduler.targetFps = 60.0;
+    scheduler.update = update;
+    scheduler.render = render;
+    scheduler.previous = schedulerClock();
+    scheduler.nextFrame = scheduler.previous;
+    scheduler.startTime = scheduler.previous;
+}
+
+void setFramePacing(FrameScheduler& scheduler, FramePacing pacing, double targetFps)
+{
+    if (pacing == PACING_VSYNC && !SetSwapInterval(1)) {
+        printf("Swap interval not supported, pacing to 60 fps instead of vsync\n");
+        pacing = PACING_TARGET_FPS;
+        targetFps = 60.0;
+    }
+    else if (pacing != PACING_VSYNC) {
+        SetSwapInterval(0);
+    }
+
+    scheduler.pacing = pacing;
+    if (targetFps > 0.0)
+        scheduler.targetFps = targetFps;
+    scheduler.nextFrame = schedulerClock();
+}
+
+bool parseFramePacing(const char* text, FramePacing& pacing, double& targetFps)
+{
+    if (strcmp(text, "vsync") == 0) {
+        pacing = PACING_VSYNC;
+        return true;
+    }
+    if (strcmp(text, "uncapped") == 0) {
+        pacing = PACING_UNCAPPED;
+        return true;
+    }
+
+    char* end;
+    double fps = strtod(text, &end);
+    if (end == text || *end != '\0' || fps <= 0.0)
+        return false;
+    pacing = PACING_TARGET_FPS;
+    targetFps = fps;
+    return true;
+}
+
+//------------------------------------------------------------
+// Blocks until the frame deadline of PACING_TARGET_FPS
+//------------------------------------------------------------
+
+static void WaitForDeadline(FrameScheduler& scheduler)
+{
+    double now = schedulerClock();
+    double remaining = scheduler.nextFrame - now;
+    if (remaining > SPIN_SECONDS)
+        this_thread::sleep_for(chrono::duration<double>(remaining - SPIN_SECONDS));
+    while (schedulerClock() < scheduler.nextFrame)
+        ;
+
+    // Deadlines stay on a fixed grid; after a missed frame restart from now
+    // instead of rendering a burst of frames to catch up
+    scheduler.nextFrame += 1.0 / scheduler.targetFps;
+    if (scheduler.nextFrame < now)
+        scheduler.nextFrame = now + 1.0 / scheduler.targetFps;
+}
+
+void tickFrameScheduler(FrameScheduler& scheduler)
+{
+    if (scheduler.pacing == PACING_TARGET_FPS)
+        WaitForDeadline(scheduler);
+
+    double now = schedulerClock();
+    double frameTime = now - scheduler.previous;
+    scheduler.previous = now;
+    if (frameTime > scheduler.maxFrameTime)
+        frameTime = scheduler.maxFrameTime;
+    scheduler.accumulator += frameTime;
+
+    double updateStart = now;
+    while (scheduler.accumulator >= scheduler.step) {
+        scheduler.update(scheduler.step);
+        scheduler.accumulator -= scheduler.step;
+        scheduler.updates++;
+    }
+    double renderStart = schedulerClock();
+    scheduler.updateSeconds += renderStart - updateStart;
+
+    scheduler.alpha = scheduler.accumulator / scheduler.step;
+    scheduler.render(scheduler.alpha);
+    scheduler.frames++;
+    scheduler.renderSeconds += schedulerClock() - renderStart;
+}
+
+void printFrameSchedulerStats(const FrameScheduler& scheduler)
+{
+    double elapsed = schedulerClock() - scheduler.startTime;
+    if (elapsed <= 0.0 || scheduler.frames == 0)
+        return;
+
+    static const char* names[] = { "vsync", "uncapped", "target" };
+    printf("Pacing %s, %.1f s: %.1f updates/s, %.1f frames/s\n",
+        names[scheduler.pacing], elapsed, scheduler.updates / elapsed, scheduler.frames / elapsed);
+    printf("update %.3f ms/step, render %.3f ms/frame\n",
+        scheduler.updates > 0 ? 1000.0 * scheduler.updateSeconds / scheduler.updates : 0.0,
+        1000.0 * scheduler.renderSeconds / scheduler.frames);
+}
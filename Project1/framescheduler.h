@@ -0,0 +1,58 @@
+#ifndef FRAMESCHEDULER_H
+#define FRAMESCHEDULER_H
+
+// Fixed-timestep simulation decoupled from rendering. The simulation
+// advances in constant steps of `step` seconds, as many as wall time
+// requires; every rendered frame gets alpha in [0,1) telling how far it
+// lies between the last two simulation states, so motion stays smooth
+// and runs at the same speed at any frame rate.
+
+enum FramePacing
+{
+	PACING_VSYNC,		// one frame per display refresh (swap interval 1)
+	PACING_UNCAPPED,	// render as fast as possible (swap interval 0)
+	PACING_TARGET_FPS	// sleep/spin until the next frame deadline
+};
+
+struct FrameScheduler
+{
+	double step;			// simulation step in seconds
+	double maxFrameTime;	// longer frames are clamped, avoids a spiral of death
+	FramePacing pacing;
+	double targetFps;
+
+	void (*update)(double dt);
+	void (*render)(double alpha);
+
+	double previous;		// clock at the previous tick
+	double accumulator;		// unsimulated time
+	double nextFrame;		// deadline for PACING_TARGET_FPS
+	double alpha;			// alpha of the last rendered frame
+
+	// Statistics since initFrameScheduler
+	double startTime;
+	long long updates, frames;
+	double updateSeconds, renderSeconds;
+};
+
+// High resolution monotonic clock in seconds
+double schedulerClock();
+
+void initFrameScheduler(FrameScheduler & scheduler, double step,
+	void (*update)(double dt), void (*render)(double alpha));
+
+// Switches pacing; sets the swap interval of the current context, so call
+// it after the window exists. Falls back to PACING_TARGET_FPS at 60 fps
+// when vsync is requested but the driver cannot control the interval.
+void setFramePacing(FrameScheduler & scheduler, FramePacing pacing, double targetFps);
+
+// Parses "vsync", "uncapped" or a frame rate like "144"
+bool parseFramePacing(const char * text, FramePacing & pacing, double & targetFps);
+
+// Runs all due simulation steps and renders one frame
+void tickFrameScheduler(FrameScheduler & scheduler);
+
+// Prints update/render rates and average cost per call
+void printFrameSchedulerStats(const FrameScheduler & scheduler);
+
+#endif
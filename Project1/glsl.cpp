@@ -1,25 +1,29 @@
+#include <stdio.h>
+#include <string.h>
+
 #include "glsl.h"
 
 char* glsl::contents;
 
 char* glsl::readFile(const char* filename)
 {
-    // Open the file
-    FILE* fp = fopen(filename, "r");
+    // Open the file, binary so the length below is the length read
+    FILE* fp = fopen(filename, "rb");
+    if (fp == NULL) {
+        printf("Cannot open shader %s\n", filename);
+        return NULL;
+    }
     // Move the file pointer to the end of the file and determing the length
     fseek(fp, 0, SEEK_END);
     long file_length = ftell(fp);
     fseek(fp, 0, SEEK_SET);
+    if (file_length < 0)
+        file_length = 0;
     char* contents = new char[file_length + 1];
-    // zero out memory
-    for (int i = 0; i < file_length + 1; i++) 
-    {
-        contents[i] = 0;
-    }
     // Here's the actual read
-    fread(contents, 1, file_length, fp);
+    size_t read = fread(contents, 1, file_length, fp);
     // This is how you denote the end of a string in C
-    contents[file_length + 1] = '\0';
+    contents[read] = '\0';
     fclose(fp);
     return contents;
 }
@@ -37,42 +41,111 @@ bool glsl::compiledStatus(GLint shaderID)
         char* msgBuffer = new char[logLength];
         glGetShaderInfoLog(shaderID, logLength, NULL, msgBuffer);
         printf("%s\n", msgBuffer);
-        delete (msgBuffer);
+        delete[] msgBuffer;
         return false;
     }
 }
 
-GLuint glsl::makeVertexShader(const char* shaderSource)
+bool glsl::linkedStatus(GLuint programID)
+{
+    GLint linked = 0;
+    glGetProgramiv(programID, GL_LINK_STATUS, &linked);
+    if (linked) {
+        return true;
+    }
+    else {
+        GLint logLength = 0;
+        glGetProgramiv(programID, GL_INFO_LOG_LENGTH, &logLength);
+        if (logLength > 0) {
+            char* msgBuffer = new char[logLength];
+            glGetProgramInfoLog(programID, logLength, NULL, msgBuffer);
+            printf("%s\n", msgBuffer);
+            delete[] msgBuffer;
+        }
+        return false;
+    }
+}
+
+GLuint glsl::compileShader(GLenum type, const char* shaderSource, const char* defines)
 {
-    GLuint vertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShaderID, 1, (const GLchar**)&shaderSource, NULL);
-    glCompileShader(vertexShaderID);
-    bool compiledCorrectly = compiledStatus(vertexShaderID);
-    if (compiledCorrectly)
-    {
-        return vertexShaderID;
+    // Defines have to follow the #version line, so the source is handed
+    // over in three parts: up to and including that line, the defines,
+    // and the rest
+    const GLchar* parts[3];
+    GLint lengths[3];
+    GLsizei count = 1;
+    parts[0] = shaderSource;
+    lengths[0] = -1;
+    if (defines != NULL && defines[0] != '\0') {
+        const char* version = strstr(shaderSource, "#version");
+        const char* body = shaderSource;
+        if (version != NULL) {
+            body = strchr(version, '\n');
+            body = body != NULL ? body + 1 : version + strlen(version);
+        }
+        lengths[0] = (GLint)(body - shaderSource);
+        parts[1] = defines;
+        lengths[1] = -1;
+        parts[2] = body;
+        lengths[2] = -1;
+        count = 3;
     }
-    return -1;
+
+    GLuint shaderID = glCreateShader(type);
+    glShaderSource(shaderID, count, parts, lengths);
+    glCompileShader(shaderID);
+    return shaderID;
 }
 
-GLuint glsl::makeFragmentShader(const char* shaderSource)
+GLuint glsl::makeShader(GLenum type, const char* shaderSource, const char* defines)
 {
-    GLuint fragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShaderID, 1, (const GLchar**)&shaderSource, NULL);
-    glCompileShader(fragmentShaderID);
-    //delete[] source;
-    bool compiledCorrectly = compiledStatus(fragmentShaderID);
+    GLuint shaderID = compileShader(type, shaderSource, defines);
+    bool compiledCorrectly = compiledStatus(shaderID);
     if (compiledCorrectly) {
-        return fragmentShaderID;
+        return shaderID;
     }
-    return -1;
+    glDeleteShader(shaderID);
+    return 0;
+}
+
+GLuint glsl::makeVertexShader(const char* shaderSource)
+{
+    return makeShader(GL_VERTEX_SHADER, shaderSource, NULL);
+}
+
+GLuint glsl::makeFragmentShader(const char* shaderSource)
+{
+    return makeShader(GL_FRAGMENT_SHADER, shaderSource, NULL);
 }
 
-GLuint glsl::makeShaderProgram(GLuint vertexShaderID, GLuint fragmentShaderID)
+GLuint glsl::makeShaderProgram(GLuint vertexShaderID, GLuint fragmentShaderID, bool retrievable)
 {
+    if (vertexShaderID == 0 || fragmentShaderID == 0)
+        return 0;
     GLuint shaderID = glCreateProgram();
     glAttachShader(shaderID, vertexShaderID);
     glAttachShader(shaderID, fragmentShaderID);
+    // Has to be set before linking for glGetProgramBinary to work afterwards
+    if (retrievable)
+        glProgramParameteri(shaderID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(shaderID);
+    if (!linkedStatus(shaderID)) {
+        glDeleteProgram(shaderID);
+        return 0;
+    }
+    return shaderID;
+}
+
+GLuint glsl::makeComputeProgram(GLuint computeShaderID)
+{
+    if (computeShaderID == 0)
+        return 0;
+    GLuint shaderID = glCreateProgram();
+    glAttachShader(shaderID, computeShaderID);
     glLinkProgram(shaderID);
+    if (!linkedStatus(shaderID)) {
+        glDeleteProgram(shaderID);
+        return 0;
+    }
     return shaderID;
-}
\ No newline at end of file
+}
@@ -13,10 +13,20 @@ private:
 public:
 	glsl();
 	~glsl();
+	// NULL if the file cannot be opened, otherwise free with delete[]
 	static char* readFile(const char* filename);
 	static bool compiledStatus(GLint shaderID);
+	static bool linkedStatus(GLuint programID);
+	// defines ("#define NAME value" lines) go right after #version, may be
+	// NULL. Shaders and programs are 0 when they fail to compile or link.
+	static GLuint makeShader(GLenum type, const char* shaderSource, const char* defines);
+	// Like makeShader, but returns without asking whether it compiled, so
+	// the driver may still be working on it (KHR_parallel_shader_compile)
+	static GLuint compileShader(GLenum type, const char* shaderSource, const char* defines);
 	static GLuint makeVertexShader(const char* shaderSource);
 	static GLuint makeFragmentShader(const char* shaderSource);
-	static GLuint makeShaderProgram(GLuint vertexShaderID, GLuint fragmentShaderID);
+	// retrievable lets glGetProgramBinary read the linked program back
+	static GLuint makeShaderProgram(GLuint vertexShaderID, GLuint fragmentShaderID, bool retrievable = false);
+	static GLuint makeComputeProgram(GLuint computeShaderID);
 };
 
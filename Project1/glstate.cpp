@@ -0,0 +1,174 @@
+#include <string.h>
+#include <stdint.h>
+#include <unordered_map>
+
+#include "glstate.h"
+
+using namespace std;
+
+// Largest uniform the cache handles is a mat4
+struct UniformValue
+{
+    int count;
+    uint32_t bits[16];
+};
+
+static GLuint current_program;
+static GLuint current_vao;
+static GLuint active_unit;
+static GLuint textures[GLSTATE_TEXTURE_UNITS];
+static GLenum texture_targets[GLSTATE_TEXTURE_UNITS];
+static GLuint uniform_buffers[GLSTATE_BUFFER_BINDINGS];
+static GLuint storage_buffers[GLSTATE_BUFFER_BINDINGS];
+
+// After a reset every binding is unknown, so the next call always differs
+static const GLuint UNKNOWN = 0xFFFFFFFF;
+
+// Keyed by program << 32 | location, cleared on reset
+static unordered_map<uint64_t, UniformValue> uniforms;
+
+static GLStateStats frame_stats, last_frame_stats, total_stats;
+
+// Nothing is known before the first reset either
+static struct InitialReset { InitialReset() { glstateReset(); } } initial_reset;
+
+
+void glstateReset()
+{
+    current_program = UNKNOWN;
+    current_vao = UNKNOWN;
+    active_unit = UNKNOWN;
+    memset(textures, 0xFF, sizeof(textures));
+    memset(texture_targets, 0xFF, sizeof(texture_targets));
+    memset(uniform_buffers, 0xFF, sizeof(uniform_buffers));
+    memset(storage_buffers, 0xFF, sizeof(storage_buffers));
+    uniforms.clear();
+}
+
+void glstateBeginFrame()
+{
+    last_frame_stats = frame_stats;
+    frame_stats.calls = 0;
+    frame_stats.saved = 0;
+}
+
+GLStateStats glstateLastFrame()
+{
+    return last_frame_stats;
+}
+
+GLStateStats glstateTotal()
+{
+    return total_stats;
+}
+
+//------------------------------------------------------------
+// Counts a request; true when it has to reach GL
+//------------------------------------------------------------
+
+static bool Changed(bool differs)
+{
+    frame_stats.calls++;
+    total_stats.calls++;
+    if (differs)
+        return true;
+    frame_stats.saved++;
+    total_stats.saved++;
+    return false;
+}
+
+void glstateUseProgram(GLuint program)
+{
+    if (Changed(program != current_program)) {
+        glUseProgram(program);
+        current_program = program;
+    }
+}
+
+void glstateBindVertexArray(GLuint vao)
+{
+    if (Changed(vao != current_vao)) {
+        glBindVertexArray(vao);
+        current_vao = vao;
+    }
+}
+
+void glstateBindTexture(GLuint unit, GLenum target, GLuint texture)
+{
+    if (unit >= GLSTATE_TEXTURE_UNITS) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(target, texture);
+        active_unit = unit;
+        return;
+    }
+
+    if (Changed(textures[unit] != texture || texture_targets[unit] != target)) {
+        if (unit != active_unit) {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            active_unit = unit;
+        }
+        glBindTexture(target, texture);
+        textures[unit] = texture;
+        texture_targets[unit] = target;
+    }
+}
+
+void glstateBindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+    GLuint* bindings = target == GL_UNIFORM_BUFFER ? uniform_buffers
+        : target == GL_SHADER_STORAGE_BUFFER ? storage_buffers : NULL;
+    if (bindings == NULL || index >= GLSTATE_BUFFER_BINDINGS) {
+        glBindBufferBase(target, index, buffer);
+        return;
+    }
+
+    if (Changed(bindings[index] != buffer)) {
+        glBindBufferBase(target, index, buffer);
+        bindings[index] = buffer;
+    }
+}
+
+//------------------------------------------------------------
+// Compares a uniform value with the cached one for the current
+// program and stores it; true when it changed
+//------------------------------------------------------------
+
+static bool UniformChanged(GLint location, const void* value, int count)
+{
+    if (location < 0)
+        return false;
+
+    uint64_t key = (uint64_t)current_program << 32 | (uint32_t)location;
+    UniformValue& cached = uniforms[key];
+    bool differs = cached.count != count || memcmp(cached.bits, value, count * 4) != 0;
+    if (!Changed(differs))
+        return false;
+
+    cached.count = count;
+    memcpy(cached.bits, value, count * 4);
+    return true;
+}
+
+void glstateUniform1i(GLint location, GLint value)
+{
+    if (UniformChanged(location, &value, 1))
+        glUniform1i(location, value);
+}
+
+void glstateUniform1f(GLint location, GLfloat value)
+{
+    if (UniformChanged(location, &value, 1))
+        glUniform1f(location, value);
+}
+
+void glstateUniform3fv(GLint location, const GLfloat* value)
+{
+    if (UniformChanged(location, value, 3))
+        glUniform3fv(location, 1, value);
+}
+
+void glstateUniformMatrix4fv(GLint location, const GLfloat* value)
+{
+    if (UniformChanged(location, value, 16))
+        glUniformMatrix4fv(location, 1, GL_FALSE, value);
+}
@@ -0,0 +1,42 @@
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include <GL/glew.h>
+
+// Thin shadow of the GL bindings the render loops change most. Every call
+// compares against the last value set through this layer and only reaches
+// the driver when something actually changes. Code that binds these
+// objects directly must call glstateReset() before the next cached call.
+
+#define GLSTATE_TEXTURE_UNITS 16
+#define GLSTATE_BUFFER_BINDINGS 16
+
+struct GLStateStats
+{
+	unsigned int calls;		// state changes requested
+	unsigned int saved;		// of which filtered as redundant
+};
+
+// Forgets all cached state; the next call of each kind always goes through
+void glstateReset();
+
+// Per-frame counters. Begin moves the running counts into the last frame
+// stats and restarts them; the cached state itself is kept across frames.
+void glstateBeginFrame();
+GLStateStats glstateLastFrame();
+GLStateStats glstateTotal();
+
+void glstateUseProgram(GLuint program);
+void glstateBindVertexArray(GLuint vao);
+void glstateBindTexture(GLuint unit, GLenum target, GLuint texture);
+
+// Indexed GL_UNIFORM_BUFFER / GL_SHADER_STORAGE_BUFFER bindings
+void glstateBindBufferBase(GLenum target, GLuint index, GLuint buffer);
+
+// Uniforms of the current program, cached per program and location
+void glstateUniform1i(GLint location, GLint value);
+void glstateUniform1f(GLint location, GLfloat value);
+void glstateUniform3fv(GLint location, const GLfloat * value);
+void glstateUniformMatrix4fv(GLint location, const GLfloat * value);
+
+#endif
@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include <GL/glew.h>
+#ifdef _WIN32
+#include <GL/freeglut.h>
+#else
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include "headless.h"
+#include "profiler.h"
+
+using namespace std;
+
+static GLuint fbo, color_rb, depth_rb;
+static int fbo_width, fbo_height;
+
+#ifdef _WIN32
+static int window_id;
+#else
+static EGLDisplay egl_display = EGL_NO_DISPLAY;
+static EGLContext egl_context = EGL_NO_CONTEXT;
+#endif
+
+
+//------------------------------------------------------------
+// Context creation
+//------------------------------------------------------------
+
+#ifdef _WIN32
+
+static bool CreateContext(int argc, char** argv)
+{
+    // freeglut has no windowless mode, so hide the window it makes
+    glutInit(&argc, argv);
+    glutInitDisplayMode(GLUT_RGBA | GLUT_DEPTH);
+#ifdef _DEBUG
+    glutInitContextFlags(GLUT_DEBUG);
+#endif
+    glutInitWindowSize(1, 1);
+    window_id = glutCreateWindow("headless");
+    glutHideWindow();
+    return glewInit() == GLEW_OK;
+}
+
+static void DestroyContext()
+{
+    glutDestroyWindow(window_id);
+}
+
+#else
+
+// argc and argv are only for glutInit
+static bool CreateContext(int, char**)
+{
+    // Surfaceless display: no X server or GBM device needed
+    egl_display = eglGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    if (egl_display == EGL_NO_DISPLAY)
+        egl_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    EGLint major, minor;
+    if (egl_display == EGL_NO_DISPLAY || !eglInitialize(egl_display, &major, &minor)) {
+        printf("Could not initialize EGL\n");
+        return false;
+    }
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        printf("EGL has no desktop OpenGL\n");
+        return false;
+    }
+
+    // Same version the shaders ask for
+    const EGLint attributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+#ifdef _DEBUG
+        EGL_CONTEXT_OPENGL_DEBUG, EGL_TRUE,
+#endif
+        EGL_NONE
+    };
+    egl_context = eglCreateContext(egl_display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attributes);
+    if (egl_context == EGL_NO_CONTEXT) {
+        printf("Could not create an OpenGL 4.3 context (EGL error %x)\n", eglGetError());
+        return false;
+    }
+    if (!eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, egl_context)) {
+        printf("Could not make the EGL context current\n");
+        return false;
+    }
+
+    // glewInit wants a GLX display; only load the entry points
+    glewExperimental = GL_TRUE;
+    return glewContextInit() == GLEW_OK;
+}
+
+static void DestroyContext()
+{
+    eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(egl_display, egl_context);
+    eglTerminate(egl_display);
+    egl_context = EGL_NO_CONTEXT;
+    egl_display = EGL_NO_DISPLAY;
+}
+
+#endif
+
+bool CreateHeadlessContext(int argc, char** argv, int width, int height)
+{
+    if (!CreateContext(argc, argv))
+        return false;
+
+    printf("Headless: %s, OpenGL %s\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+    installDebugCallback();
+
+    // Offscreen color and depth targets
+    glGenRenderbuffers(1, &color_rb);
+    glBindRenderbuffer(GL_RENDERBUFFER, color_rb);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glGenRenderbuffers(1, &depth_rb);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth_rb);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_rb);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_rb);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        printf("Offscreen framebuffer is incomplete\n");
+        return false;
+    }
+
+    glViewport(0, 0, width, height);
+    fbo_width = width;
+    fbo_height = height;
+    return true;
+}
+
+void DestroyHeadlessContext()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteRenderbuffers(1, &color_rb);
+    glDeleteRenderbuffers(1, &depth_rb);
+    DestroyContext();
+}
+
+
+//------------------------------------------------------------
+// Benchmark
+//------------------------------------------------------------
+
+bool WriteFramebufferPPM(const char* path, int width, int height)
+{
+    vector<unsigned char> pixels((size_t)width * height * 3);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+
+    FILE* fp = fopen(path, "wb");
+    if (fp == NULL)
+        return false;
+
+    // GL rows start at the bottom, PPM rows at the top
+    fprintf(fp, "P6\n%d %d\n255\n", width, height);
+    for (int y = height - 1; y >= 0; y--)
+        fwrite(&pixels[(size_t)y * width * 3], 1, (size_t)width * 3, fp);
+    return fclose(fp) == 0;
+}
+
+double RunHeadlessBenchmark(int frames, int (*drawFrame)(), const char* dumpPath)
+{
+    if (frames < 1)
+        frames = 1;
+
+    vector<double> times(frames);
+    long long draws = 0;
+
+    auto begin = chrono::high_resolution_clock::now();
+    for (int i = 0; i < frames; i++) {
+        auto start = chrono::high_resolution_clock::now();
+        draws += drawFrame();
+        // Without a swap nothing else waits for the GPU
+        glFinish();
+        times[i] = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+    }
+    double total = chrono::duration<double>(chrono::high_resolution_clock::now() - begin).count();
+
+    vector<double> sorted(times);
+    sort(sorted.begin(), sorted.end());
+    double sum = 0.0;
+    for (int i = 0; i < frames; i++)
+        sum += times[i];
+
+    printf("%d frames at %dx%d in %.3f s\n", frames, fbo_width, fbo_height, total);
+    printf("frame time (ms): min %.3f  avg %.3f  p50 %.3f  p99 %.3f  max %.3f\n",
+        sorted[0], sum / frames, sorted[(frames - 1) / 2], sorted[(frames - 1) * 99 / 100], sorted[frames - 1]);
+    printf("%.1f fps, %.0f draws/s\n", frames / total, draws / total);
+
+    if (dumpPath != NULL) {
+        if (WriteFramebufferPPM(dumpPath, fbo_width, fbo_height))
+            printf("Last frame written to %s\n", dumpPath);
+        else
+            printf("Could not write %s\n", dumpPath);
+    }
+
+    return frames / total;
+}
@@ -0,0 +1,23 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+// Offscreen rendering without a visible window. On Linux this is an EGL
+// context without any surface (runs on Mesa llvmpipe without a GPU), on
+// Windows a hidden freeglut window. Either way the scene is drawn into
+// an FBO of the requested size.
+
+bool CreateHeadlessContext(int argc, char** argv, int width, int height);
+
+void DestroyHeadlessContext();
+
+// Draws `frames` frames back to back, as fast as possible, and prints
+// min/avg/p50/p99/max frame time and draws per second. drawFrame renders
+// one frame into the bound framebuffer and returns its number of draws.
+// When dumpPath is set the last frame is written to it as binary PPM.
+// Returns the average frames per second.
+double RunHeadlessBenchmark(int frames, int (*drawFrame)(), const char* dumpPath);
+
+// Writes the bound framebuffer as a binary PPM (P6)
+bool WriteFramebufferPPM(const char* path, int width, int height);
+
+#endif
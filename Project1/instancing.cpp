@@ -0,0 +1,108 @@
+#include <stdio.h>
+
+#include "glstate.h"
+#include "instancing.h"
+#include "vertexformat.h"
+
+
+bool createInstancedMesh(const MeshData& mesh, unsigned int vertexFormat, InstancedMesh& instanced)
+{
+    instanced = InstancedMesh();
+    if (mesh.vertexCount == 0 || mesh.indexCount == 0) {
+        printf("Instanced mesh without triangles\n");
+        return false;
+    }
+
+    VertexLayout layout;
+    buildVertexLayout(mesh, vertexFormat, layout);
+    instanced.dequantize = layout.dequantize;
+
+    GLsizeiptr vertex_bytes = (GLsizeiptr)mesh.vertexCount * layout.stride;
+    glGenBuffers(1, &instanced.vbo_vertices);
+    glBindBuffer(GL_ARRAY_BUFFER, instanced.vbo_vertices);
+    glBufferData(GL_ARRAY_BUFFER, vertex_bytes, NULL, GL_STATIC_DRAW);
+    void* vertex_data = glMapBufferRange(GL_ARRAY_BUFFER, 0, vertex_bytes,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    packVertices(mesh, layout, vertex_data);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+
+    instanced.indexType = mesh.indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    instanced.indexSize = mesh.indexSize;
+    instanced.lodCount = mesh.lodCount > 0 ? mesh.lodCount : 1;
+    if (instanced.lodCount > MESHLOD_MAX_LEVELS)
+        instanced.lodCount = MESHLOD_MAX_LEVELS;
+    for (unsigned int i = 0; i < instanced.lodCount; i++)
+        instanced.lods[i] = meshLod(mesh, i);
+
+    glGenVertexArrays(1, &instanced.vao);
+    glBindVertexArray(instanced.vao);
+    setVertexAttributes(layout);
+
+    glGenBuffers(1, &instanced.vbo_indices);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, instanced.vbo_indices);
+    // Every detail level, back to back
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)mesh.indexCount * mesh.indexSize,
+        mesh.indices, GL_STATIC_DRAW);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    glGenBuffers(1, &instanced.instanceBuffer);
+    return true;
+}
+
+void destroyInstancedMesh(InstancedMesh& instanced)
+{
+    glDeleteVertexArrays(1, &instanced.vao);
+    glDeleteBuffers(1, &instanced.vbo_vertices);
+    glDeleteBuffers(1, &instanced.vbo_indices);
+    glDeleteBuffers(1, &instanced.instanceBuffer);
+    instanced = InstancedMesh();
+}
+
+void uploadInstances(InstancedMesh& instanced, const InstanceData* instances, GLsizei count)
+{
+    GLsizeiptr bytes = (GLsizeiptr)count * sizeof(InstanceData);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanced.instanceBuffer);
+    if (bytes > instanced.instanceCapacity) {
+        glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, instances, GL_STREAM_DRAW);
+        instanced.instanceCapacity = bytes;
+    }
+    else {
+        // Orphan: the driver hands out fresh storage if the old one is in use
+        glBufferData(GL_SHADER_STORAGE_BUFFER, instanced.instanceCapacity, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, bytes, instances);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    instanced.instanceCount = count;
+}
+
+void drawInstances(const InstancedMesh& instanced)
+{
+    if (instanced.instanceCount == 0)
+        return;
+
+    const MeshLod& lod = instanced.lods[0];
+    glstateBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_BUFFER_BINDING, instanced.instanceBuffer);
+    glstateBindVertexArray(instanced.vao);
+    glDrawElementsInstanced(GL_TRIANGLES, lod.indexCount, instanced.indexType,
+        (const void*)((size_t)lod.indexOffset * instanced.indexSize), instanced.instanceCount);
+}
+
+void drawInstanceRange(const InstancedMesh& instanced, unsigned int level, GLint first, GLsizei count, GLint offsetLocation)
+{
+    if (count <= 0)
+        return;
+    if (level >= instanced.lodCount)
+        level = instanced.lodCount - 1;
+
+    const MeshLod& lod = instanced.lods[level];
+    glstateBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_BUFFER_BINDING, instanced.instanceBuffer);
+    glstateBindVertexArray(instanced.vao);
+    glstateUniform1i(offsetLocation, first);
+    glDrawElementsInstanced(GL_TRIANGLES, lod.indexCount, instanced.indexType,
+        (const void*)((size_t)lod.indexOffset * instanced.indexSize), count);
+}
@@ -0,0 +1,62 @@
+#ifndef INSTANCING_H
+#define INSTANCING_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "meshcache.h"
+#include "meshsimplify.h"
+
+// Many copies of one mesh in a single glDrawElementsInstanced call. The
+// per-instance transform and material live in a shader storage buffer
+// (binding INSTANCE_BUFFER_BINDING) that the instanced shaders index with
+// gl_InstanceID, so instance count is only limited by buffer size.
+// Instances can be drawn in ranges, each with its own detail level; the
+// `instance_offset` uniform tells the shader where a range starts.
+
+#define INSTANCE_BUFFER_BINDING 0
+
+// std430 layout of `Instance` in vertexshader.vert (INSTANCED variants)
+struct InstanceData
+{
+	glm::mat4 modelView;	// view * model * the mesh's dequantize
+	glm::vec4 ambient;
+	glm::vec4 diffuse;
+	glm::vec4 specular;		// w = specular power
+};
+
+struct InstancedMesh
+{
+	GLuint vao;
+	GLuint vbo_vertices;
+	GLuint vbo_indices;
+	GLenum indexType;
+	GLsizei indexSize;
+	MeshLod lods[MESHLOD_MAX_LEVELS];
+	unsigned int lodCount;
+	glm::mat4 dequantize;	// see VertexLayout
+
+	GLuint instanceBuffer;
+	GLsizeiptr instanceCapacity;	// bytes allocated
+	GLsizei instanceCount;
+};
+
+// Uploads the mesh with the given VERTEX_* format at the fixed attribute
+// locations. The mesh data is not needed afterwards.
+bool createInstancedMesh(const MeshData & mesh, unsigned int vertexFormat, InstancedMesh & instanced);
+
+void destroyInstancedMesh(InstancedMesh & instanced);
+
+// Replaces the instance data; the old buffer contents are orphaned so the
+// upload does not wait on draws still reading them
+void uploadInstances(InstancedMesh & instanced, const InstanceData * instances, GLsizei count);
+
+// Draws every uploaded instance at full detail with the bound program;
+// binds through the glstate cache
+void drawInstances(const InstancedMesh & instanced);
+
+// Draws count instances starting at first with one detail level.
+// offsetLocation is the `instance_offset` uniform of the bound program.
+void drawInstanceRange(const InstancedMesh & instanced, unsigned int level, GLint first, GLsizei count, GLint offsetLocation);
+
+#endif
@@ -0,0 +1,128 @@
+#include <algorithm>
+
+#include "jobpool.h"
+
+using namespace std;
+
+
+//------------------------------------------------------------
+// Front of the own queue first, keeping the run contiguous;
+// otherwise the back of the next non-empty queue
+//------------------------------------------------------------
+
+static bool TakeRange(JobPool* pool, size_t self, JobRange& range)
+{
+    size_t count = pool->queues.size();
+    {
+        JobQueue* own = pool->queues[self];
+        lock_guard<mutex> lock(own->mutex);
+        if (!own->ranges.empty()) {
+            range = own->ranges.front();
+            own->ranges.pop_front();
+            return true;
+        }
+    }
+    for (size_t k = 1; k < count; k++) {
+        JobQueue* victim = pool->queues[(self + k) % count];
+        lock_guard<mutex> lock(victim->mutex);
+        if (!victim->ranges.empty()) {
+            range = victim->ranges.back();
+            victim->ranges.pop_back();
+            pool->steals++;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void RunRanges(JobPool* pool, size_t self)
+{
+    JobRange range;
+    while (TakeRange(pool, self, range)) {
+        (*pool->job)(range.begin, range.end);
+        pool->remaining--;
+    }
+}
+
+static void WorkerLoop(JobPool* pool, size_t self)
+{
+    unsigned int seen = 0;
+    for (;;) {
+        {
+            unique_lock<mutex> lock(pool->mutex);
+            pool->wake.wait(lock, [pool, seen]() { return pool->stopping || pool->generation != seen; });
+            if (pool->stopping)
+                return;
+            seen = pool->generation;
+        }
+        RunRanges(pool, self);
+    }
+}
+
+void startJobPool(JobPool& pool, unsigned int threads)
+{
+    if (threads == 0) {
+        unsigned int cores = thread::hardware_concurrency();
+        threads = max(cores, 1u) - 1;
+    }
+
+    pool.job = NULL;
+    pool.remaining = 0;
+    pool.steals = 0;
+    pool.generation = 0;
+    pool.stopping = false;
+    for (unsigned int i = 0; i <= threads; i++)
+        pool.queues.push_back(new JobQueue());
+    for (unsigned int i = 0; i < threads; i++)
+        pool.workers.push_back(thread(WorkerLoop, &pool, (size_t)i));
+}
+
+void stopJobPool(JobPool& pool)
+{
+    {
+        lock_guard<mutex> lock(pool.mutex);
+        pool.stopping = true;
+    }
+    pool.wake.notify_all();
+    for (thread& worker : pool.workers)
+        worker.join();
+    pool.workers.clear();
+    for (JobQueue* queue : pool.queues)
+        delete queue;
+    pool.queues.clear();
+}
+
+void parallelFor(JobPool& pool, size_t count, size_t batch, const function<void(size_t, size_t)>& job)
+{
+    if (count == 0)
+        return;
+    batch = max(batch, (size_t)1);
+    size_t batches = (count + batch - 1) / batch;
+    if (batches == 1 || pool.workers.empty()) {
+        job(0, count);
+        return;
+    }
+
+    // Contiguous runs of batches per participant, the caller's last
+    size_t participants = pool.queues.size();
+    size_t per_queue = (batches + participants - 1) / participants;
+    pool.job = &job;
+    pool.remaining = batches;
+    for (size_t p = 0; p < participants; p++) {
+        JobQueue* queue = pool.queues[p];
+        lock_guard<mutex> lock(queue->mutex);
+        for (size_t b = p * per_queue; b < min(batches, (p + 1) * per_queue); b++)
+            queue->ranges.push_back({ b * batch, min(count, (b + 1) * batch) });
+    }
+    {
+        lock_guard<mutex> lock(pool.mutex);
+        pool.generation++;
+    }
+    pool.wake.notify_all();
+
+    RunRanges(&pool, participants - 1);
+    // Whatever is left is running on a worker right now
+    while (pool.remaining != 0)
+        this_thread::yield();
+    pool.job = NULL;
+}
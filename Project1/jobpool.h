@@ -0,0 +1,57 @@
+#ifndef JOBPOOL_H
+#define JOBPOOL_H
+
+#include <stddef.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing pool for fine-grained data parallel loops, unlike the
+// ThreadPool's single queue meant for coarse jobs. parallelFor() cuts a
+// range into batches and deals contiguous runs of them to one deque per
+// participant (the workers and the calling thread). Everyone takes batches
+// from the front of its own deque and, once that is empty, steals from the
+// back of another one, so uneven batches still keep all threads busy.
+// One loop runs at a time; the loop body must not call parallelFor.
+
+struct JobRange
+{
+	size_t begin, end;
+};
+
+struct JobQueue
+{
+	std::mutex mutex;
+	std::deque<JobRange> ranges;
+};
+
+struct JobPool
+{
+	std::vector<std::thread> workers;
+	std::vector<JobQueue *> queues;             // workers first, the caller last
+	const std::function<void(size_t, size_t)> * job;
+	std::atomic<size_t> remaining;              // batches of the running loop not done yet
+	std::atomic<size_t> steals;                 // batches taken from another queue, ever
+
+	std::mutex mutex;
+	std::condition_variable wake;               // a loop started or the pool stops
+	unsigned int generation;                    // loops started
+	bool stopping;
+};
+
+// threads 0 uses one less than the number of cores; the caller is the
+// last participant, so 0 worker threads is a serial loop
+void startJobPool(JobPool & pool, unsigned int threads = 0);
+
+void stopJobPool(JobPool & pool);
+
+// Calls job(begin, end) for consecutive ranges of at most batch items
+// covering [0, count) and returns once all have finished. A single batch
+// runs on the calling thread without waking anyone.
+void parallelFor(JobPool & pool, size_t count, size_t batch, const std::function<void(size_t, size_t)> & job);
+
+#endif
@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "glsl.h"
+#include "glstate.h"
+#include "lightbuffers.h"
+#include "uniformbuffers.h"
+
+using namespace std;
+
+static const char* ASSIGN_SHADER = "lightclusters.comp";
+
+static GLuint CreateStorageBuffer(GLsizeiptr size, const void* data, GLenum usage)
+{
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, data, usage);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    return buffer;
+}
+
+//------------------------------------------------------------
+// Replaces the contents, growing the buffer if needed; the
+// old storage is orphaned like in uploadInstances
+//------------------------------------------------------------
+
+static void UploadStorage(GLuint buffer, GLsizeiptr& capacity, const void* data, GLsizeiptr bytes)
+{
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    if (bytes > capacity) {
+        glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, data, GL_STREAM_DRAW);
+        capacity = bytes;
+    }
+    else {
+        glBufferData(GL_SHADER_STORAGE_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, bytes, data);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+static GLuint BuildAssignProgram()
+{
+    char* source = glsl::readFile(ASSIGN_SHADER);
+    if (source == NULL)
+        return 0;
+    char defines[64];
+    snprintf(defines, sizeof(defines), "#define CLUSTER_MAX_LIGHTS %d\n", CLUSTER_MAX_LIGHTS);
+    GLuint shader = glsl::makeShader(GL_COMPUTE_SHADER, source, defines);
+    delete[] source;
+    GLuint program = glsl::makeComputeProgram(shader);
+    glDeleteShader(shader);
+    return program;
+}
+
+bool initLightBuffers(LightBuffers& buffers, const ClusterGrid& grid, LightAssignment assignment, int width, int height)
+{
+    buffers = LightBuffers();
+    buffers.assignment = assignment;
+
+    if (assignment == LIGHTS_CLUSTERED_GPU) {
+        buffers.assignProgram = BuildAssignProgram();
+        if (buffers.assignProgram == 0) {
+            printf("Cannot build %s, no GPU light assignment\n", ASSIGN_SHADER);
+            return false;
+        }
+
+        // Bounds never change, the lists are written by the GPU only
+        vector<glm::vec4> bounds(2 * CLUSTER_COUNT);
+        for (size_t c = 0; c < CLUSTER_COUNT; c++) {
+            bounds[2 * c] = glm::vec4(grid.minX[c], grid.minY[c], grid.minZ[c], 0.0f);
+            bounds[2 * c + 1] = glm::vec4(grid.maxX[c], grid.maxY[c], grid.maxZ[c], 0.0f);
+        }
+        buffers.bounds = CreateStorageBuffer(bounds.size() * sizeof(glm::vec4), &bounds[0], GL_STATIC_DRAW);
+        buffers.indexCapacity = (GLsizeiptr)CLUSTER_COUNT * CLUSTER_MAX_LIGHTS * sizeof(unsigned int);
+        buffers.indices = CreateStorageBuffer(buffers.indexCapacity, NULL, GL_DYNAMIC_COPY);
+        buffers.clusters = CreateStorageBuffer(2 * CLUSTER_COUNT * sizeof(unsigned int), NULL, GL_DYNAMIC_COPY);
+    }
+    else {
+        buffers.indexCapacity = sizeof(unsigned int);
+        buffers.indices = CreateStorageBuffer(buffers.indexCapacity, NULL, GL_STREAM_DRAW);
+        buffers.clusters = CreateStorageBuffer(2 * CLUSTER_COUNT * sizeof(unsigned int), NULL, GL_STREAM_DRAW);
+    }
+    buffers.lightCapacity = sizeof(PointLight);
+    buffers.lights = CreateStorageBuffer(buffers.lightCapacity, NULL, GL_STREAM_DRAW);
+
+    buffers.data.size[0] = CLUSTER_X;
+    buffers.data.size[1] = CLUSTER_Y;
+    buffers.data.size[2] = CLUSTER_Z;
+    buffers.data.size[3] = 0;
+    buffers.data.depth = glm::vec4(grid.nearZ, grid.farZ, grid.sliceScale, grid.sliceBias);
+    buffers.data.tile = glm::vec4((float)CLUSTER_X / width, (float)CLUSTER_Y / height, 0.0f, 0.0f);
+    buffers.uniforms = createUniformBuffer(sizeof(ClusterUniforms));
+    updateUniformBuffer(buffers.uniforms, &buffers.data, sizeof(ClusterUniforms), sizeof(ClusterUniforms));
+    return true;
+}
+
+void destroyLightBuffers(LightBuffers& buffers)
+{
+    glDeleteBuffers(1, &buffers.lights);
+    glDeleteBuffers(1, &buffers.clusters);
+    glDeleteBuffers(1, &buffers.indices);
+    if (buffers.bounds != 0)
+        glDeleteBuffers(1, &buffers.bounds);
+    glDeleteBuffers(1, &buffers.uniforms);
+    if (buffers.assignProgram != 0)
+        glDeleteProgram(buffers.assignProgram);
+    buffers = LightBuffers();
+}
+
+void updateLightBuffers(LightBuffers& buffers, ClusterGrid& grid, const PointLight* lights, size_t count)
+{
+    if (count > 0)
+        UploadStorage(buffers.lights, buffers.lightCapacity, lights, count * sizeof(PointLight));
+    if (buffers.data.size[3] != count) {
+        buffers.data.size[3] = (unsigned int)count;
+        updateUniformBuffer(buffers.uniforms, &buffers.data, sizeof(ClusterUniforms), sizeof(ClusterUniforms));
+    }
+
+    if (buffers.assignment == LIGHTS_CLUSTERED_GPU) {
+        glstateUseProgram(buffers.assignProgram);
+        glstateBindBufferBase(GL_UNIFORM_BUFFER, CLUSTER_UBO_BINDING, buffers.uniforms);
+        glstateBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHT_BUFFER_BINDING, buffers.lights);
+        glstateBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_BUFFER_BINDING, buffers.clusters);
+        glstateBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_INDEX_BINDING, buffers.indices);
+        glstateBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_BOUNDS_BINDING, buffers.bounds);
+        glDispatchCompute(CLUSTER_COUNT, 1, 1);
+        // The lists are read by fragment shaders of the same frame
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        grid.lights = count;
+        return;
+    }
+
+    if (buffers.assignment == LIGHTS_NAIVE)
+        assignAllLights(grid, count);
+    else
+        assignLights(grid, lights, count);
+    GLsizeiptr capacity = 2 * CLUSTER_COUNT * sizeof(unsigned int);
+    UploadStorage(buffers.clusters, capacity, &grid.clusters[0], capacity);
+    if (!grid.indices.empty())
+        UploadStorage(buffers.indices, buffers.indexCapacity, &grid.indices[0], grid.indices.size() * sizeof(unsigned int));
+}
+
+void bindLightBuffers(const LightBuffers& buffers)
+{
+    glstateBindBufferBase(GL_UNIFORM_BUFFER, CLUSTER_UBO_BINDING, buffers.uniforms);
+    glstateBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHT_BUFFER_BINDING, buffers.lights);
+    glstateBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_BUFFER_BINDING, buffers.clusters);
+    glstateBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_INDEX_BINDING, buffers.indices);
+}
+
+const char* lightAssignmentName(LightAssignment assignment)
+{
+    switch (assignment) {
+    case LIGHTS_NAIVE:
+        return "naive";
+    case LIGHTS_CLUSTERED_CPU:
+        return "clustered, CPU";
+    case LIGHTS_CLUSTERED_GPU:
+        return "clustered, compute shader";
+    }
+    return "?";
+}
+
+bool parseLightAssignment(const char* name, LightAssignment& assignment)
+{
+    if (strcmp(name, "naive") == 0)
+        assignment = LIGHTS_NAIVE;
+    else if (strcmp(name, "cpu") == 0)
+        assignment = LIGHTS_CLUSTERED_CPU;
+    else if (strcmp(name, "gpu") == 0)
+        assignment = LIGHTS_CLUSTERED_GPU;
+    else
+        return false;
+    return true;
+}
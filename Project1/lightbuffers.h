@@ -0,0 +1,73 @@
+#ifndef LIGHTBUFFERS_H
+#define LIGHTBUFFERS_H
+
+#include <stddef.h>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "lightclusters.h"
+
+// Point lights and their cluster lists on the GPU, read by the CLUSTERED
+// shader variants (see lightclusters.h for the grid). Three ways to fill
+// the lists:
+//   naive  every cluster lists every light, a plain forward loop
+//   cpu    assignLights() on the CPU, the compact lists are uploaded
+//   gpu    lightclusters.comp, one work group per cluster; lists have a
+//          fixed CLUSTER_MAX_LIGHTS slots so nothing is read back
+// Light positions are uploaded in view space every frame in all modes.
+
+#define LIGHT_BUFFER_BINDING 1          // PointLight lights[]
+#define CLUSTER_BUFFER_BINDING 2        // uvec2 offset and count per cluster
+#define CLUSTER_INDEX_BINDING 3         // uint light indices
+#define CLUSTER_BOUNDS_BINDING 4        // vec4 min and max per cluster, compute only
+#define CLUSTER_UBO_BINDING 2
+
+enum LightAssignment
+{
+	LIGHTS_NAIVE,
+	LIGHTS_CLUSTERED_CPU,
+	LIGHTS_CLUSTERED_GPU
+};
+
+// std140 ClusterData in the shaders
+struct ClusterUniforms
+{
+	unsigned int size[4];       // CLUSTER_X, CLUSTER_Y, CLUSTER_Z, light count
+	glm::vec4 depth;            // near, far, slice scale, slice bias
+	glm::vec4 tile;             // tiles per pixel in x and y
+};
+
+struct LightBuffers
+{
+	LightAssignment assignment;
+	GLuint lights;
+	GLuint clusters;
+	GLuint indices;
+	GLuint bounds;
+	GLuint uniforms;
+	GLsizeiptr lightCapacity;   // bytes allocated
+	GLsizeiptr indexCapacity;
+	GLuint assignProgram;       // gpu mode
+	ClusterUniforms data;
+};
+
+// Buffers for grid at a width x height viewport. False if the gpu mode's
+// compute shader does not build.
+bool initLightBuffers(LightBuffers & buffers, const ClusterGrid & grid, LightAssignment assignment, int width, int height);
+
+void destroyLightBuffers(LightBuffers & buffers);
+
+// Fills the cluster lists of count view-space lights as the mode says and
+// uploads them. CPU statistics end up in grid.
+void updateLightBuffers(LightBuffers & buffers, ClusterGrid & grid, const PointLight * lights, size_t count);
+
+// Binds everything the CLUSTERED variants read, through the glstate cache
+void bindLightBuffers(const LightBuffers & buffers);
+
+const char * lightAssignmentName(LightAssignment assignment);
+
+// "naive", "cpu" or "gpu"
+bool parseLightAssignment(const char * name, LightAssignment & assignment);
+
+#endif
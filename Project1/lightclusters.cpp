@@ -0,0 +1,352 @@
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define CLUSTER_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CLUSTER_SSE2
+#endif
+
+#include "lightclusters.h"
+
+using namespace std;
+
+// Below this many lights per thread the assignment is cheaper than
+// starting the thread
+static const size_t CLUSTER_LIGHTS_PER_THREAD = 1024;
+
+// Clusters a light can touch: tiles [x0, x1], [y0, y1], slices [s0, s1]
+struct LightRange
+{
+    int x0, x1, y0, y1, s0, s1;
+};
+
+void setupClusterGrid(ClusterGrid& grid, const glm::mat4& projection, float nearZ, float farZ)
+{
+    grid.nearZ = nearZ;
+    grid.farZ = farZ;
+    grid.sliceScale = CLUSTER_Z / logf(farZ / nearZ);
+    grid.sliceBias = -logf(nearZ) * grid.sliceScale;
+    grid.tileX = 2.0f / CLUSTER_X;
+    grid.tileY = 2.0f / CLUSTER_Y;
+    grid.projection = projection;
+
+    grid.minX.resize(CLUSTER_COUNT);
+    grid.minY.resize(CLUSTER_COUNT);
+    grid.minZ.resize(CLUSTER_COUNT);
+    grid.maxX.resize(CLUSTER_COUNT);
+    grid.maxY.resize(CLUSTER_COUNT);
+    grid.maxZ.resize(CLUSTER_COUNT);
+    grid.clusters.assign(2 * CLUSTER_COUNT, 0);
+    grid.slots.resize((size_t)CLUSTER_COUNT * CLUSTER_MAX_LIGHTS);
+    grid.counts.assign(CLUSTER_COUNT, 0);
+    grid.indices.clear();
+    grid.lights = grid.dropped = 0;
+    grid.maxCount = 0;
+    grid.threads = 1;
+    grid.milliseconds = 0.0;
+
+    // Direction through each tile corner, scaled to a view depth of 1
+    glm::mat4 inverse = glm::inverse(projection);
+    glm::vec3 corners[CLUSTER_Y + 1][CLUSTER_X + 1];
+    for (int y = 0; y <= CLUSTER_Y; y++) {
+        for (int x = 0; x <= CLUSTER_X; x++) {
+            glm::vec4 p = inverse * glm::vec4(-1.0f + x * grid.tileX, -1.0f + y * grid.tileY, -1.0f, 1.0f);
+            glm::vec3 v = glm::vec3(p) / p.w;
+            corners[y][x] = v / -v.z;
+        }
+    }
+
+    for (int s = 0; s < CLUSTER_Z; s++) {
+        float depths[2] = {
+            nearZ * powf(farZ / nearZ, (float)s / CLUSTER_Z),
+            nearZ * powf(farZ / nearZ, (float)(s + 1) / CLUSTER_Z)
+        };
+        for (int y = 0; y < CLUSTER_Y; y++) {
+            for (int x = 0; x < CLUSTER_X; x++) {
+                glm::vec3 lo(1e30f), hi(-1e30f);
+                for (int d = 0; d < 2; d++) {
+                    for (int c = 0; c < 4; c++) {
+                        glm::vec3 p = corners[y + c / 2][x + c % 2] * depths[d];
+                        lo = glm::min(lo, p);
+                        hi = glm::max(hi, p);
+                    }
+                }
+                size_t i = ((size_t)s * CLUSTER_Y + y) * CLUSTER_X + x;
+                grid.minX[i] = lo.x;
+                grid.minY[i] = lo.y;
+                grid.minZ[i] = lo.z;
+                grid.maxX[i] = hi.x;
+                grid.maxY[i] = hi.y;
+                grid.maxZ[i] = hi.z;
+            }
+        }
+    }
+}
+
+//------------------------------------------------------------
+// Clusters the light's sphere can touch, false if it is
+// outside the sliced depth range. The sphere's box is
+// projected at its nearest and farthest depth, which bounds
+// the projection in between.
+//------------------------------------------------------------
+
+static bool LightClusterRange(const ClusterGrid& grid, const PointLight& light, LightRange& range)
+{
+    const glm::vec4& l = light.positionRadius;
+    float nearest = -l.z - l.w, farthest = -l.z + l.w;
+    if (farthest < grid.nearZ || nearest > grid.farZ)
+        return false;
+    nearest = max(nearest, grid.nearZ);
+    farthest = min(farthest, grid.farZ);
+
+    const glm::mat4& p = grid.projection;
+    float lo_x = 1e30f, hi_x = -1e30f, lo_y = 1e30f, hi_y = -1e30f;
+    float depths[2] = { nearest, farthest };
+    for (float depth : depths) {
+        for (int side = -1; side <= 1; side += 2) {
+            float x = (p[0][0] * (l.x + side * l.w) - p[2][0] * depth) / depth;
+            float y = (p[1][1] * (l.y + side * l.w) - p[2][1] * depth) / depth;
+            lo_x = min(lo_x, x);
+            hi_x = max(hi_x, x);
+            lo_y = min(lo_y, y);
+            hi_y = max(hi_y, y);
+        }
+    }
+    if (hi_x < -1.0f || lo_x > 1.0f || hi_y < -1.0f || lo_y > 1.0f)
+        return false;
+
+    range.x0 = max(0, (int)floorf((lo_x + 1.0f) / grid.tileX));
+    range.x1 = min(CLUSTER_X - 1, (int)floorf((hi_x + 1.0f) / grid.tileX));
+    range.y0 = max(0, (int)floorf((lo_y + 1.0f) / grid.tileY));
+    range.y1 = min(CLUSTER_Y - 1, (int)floorf((hi_y + 1.0f) / grid.tileY));
+    range.s0 = max(0, (int)floorf(logf(nearest) * grid.sliceScale + grid.sliceBias));
+    range.s1 = min(CLUSTER_Z - 1, (int)floorf(logf(farthest) * grid.sliceScale + grid.sliceBias));
+    return true;
+}
+
+//------------------------------------------------------------
+// Sphere against the AABBs of one row of CLUSTER_X clusters
+// starting at base, bit x set where they touch
+//------------------------------------------------------------
+
+static unsigned int TestRowScalar(const ClusterGrid& g, size_t base, const glm::vec4& l)
+{
+    unsigned int mask = 0;
+    for (int x = 0; x < CLUSTER_X; x++) {
+        size_t i = base + x;
+        // Same operations in the same order as the SIMD path
+        float dx = max(max(g.minX[i] - l.x, l.x - g.maxX[i]), 0.0f);
+        float dy = max(max(g.minY[i] - l.y, l.y - g.maxY[i]), 0.0f);
+        float dz = max(max(g.minZ[i] - l.z, l.z - g.maxZ[i]), 0.0f);
+        if ((dx * dx + dy * dy) + dz * dz <= l.w * l.w)
+            mask |= 1u << x;
+    }
+    return mask;
+}
+
+#if defined(CLUSTER_AVX)
+
+static unsigned int TestRowSimd(const ClusterGrid& g, size_t base, const glm::vec4& l)
+{
+    __m256 px = _mm256_set1_ps(l.x), py = _mm256_set1_ps(l.y), pz = _mm256_set1_ps(l.z);
+    __m256 r2 = _mm256_set1_ps(l.w * l.w);
+    __m256 zero = _mm256_setzero_ps();
+    unsigned int mask = 0;
+    for (int x = 0; x < CLUSTER_X; x += 8) {
+        size_t i = base + x;
+        __m256 dx = _mm256_max_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_loadu_ps(&g.minX[i]), px),
+            _mm256_sub_ps(px, _mm256_loadu_ps(&g.maxX[i]))), zero);
+        __m256 dy = _mm256_max_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_loadu_ps(&g.minY[i]), py),
+            _mm256_sub_ps(py, _mm256_loadu_ps(&g.maxY[i]))), zero);
+        __m256 dz = _mm256_max_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_loadu_ps(&g.minZ[i]), pz),
+            _mm256_sub_ps(pz, _mm256_loadu_ps(&g.maxZ[i]))), zero);
+        __m256 d2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+        mask |= (unsigned int)_mm256_movemask_ps(_mm256_cmp_ps(d2, r2, _CMP_LE_OQ)) << x;
+    }
+    return mask;
+}
+
+#elif defined(CLUSTER_SSE2)
+
+static unsigned int TestRowSimd(const ClusterGrid& g, size_t base, const glm::vec4& l)
+{
+    __m128 px = _mm_set1_ps(l.x), py = _mm_set1_ps(l.y), pz = _mm_set1_ps(l.z);
+    __m128 r2 = _mm_set1_ps(l.w * l.w);
+    __m128 zero = _mm_setzero_ps();
+    unsigned int mask = 0;
+    for (int x = 0; x < CLUSTER_X; x += 4) {
+        size_t i = base + x;
+        __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&g.minX[i]), px),
+            _mm_sub_ps(px, _mm_loadu_ps(&g.maxX[i]))), zero);
+        __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&g.minY[i]), py),
+            _mm_sub_ps(py, _mm_loadu_ps(&g.maxY[i]))), zero);
+        __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&g.minZ[i]), pz),
+            _mm_sub_ps(pz, _mm_loadu_ps(&g.maxZ[i]))), zero);
+        __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        mask |= (unsigned int)_mm_movemask_ps(_mm_cmple_ps(d2, r2)) << x;
+    }
+    return mask;
+}
+
+#else
+
+static unsigned int TestRowSimd(const ClusterGrid& g, size_t base, const glm::vec4& l)
+{
+    return TestRowScalar(g, base, l);
+}
+
+#endif
+
+const char* clusterSimdName()
+{
+#if defined(CLUSTER_AVX)
+    return "AVX";
+#elif defined(CLUSTER_SSE2)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
+
+//------------------------------------------------------------
+// Appends the lights to the clusters of slices [s0, s1).
+// Returns the references dropped because a list was full.
+//------------------------------------------------------------
+
+template <unsigned int (*TestRow)(const ClusterGrid&, size_t, const glm::vec4&)>
+static size_t AssignSlices(ClusterGrid& grid, const PointLight* lights, const LightRange* ranges,
+    const unsigned char* inside, size_t count, int s0, int s1)
+{
+    size_t dropped = 0;
+    unsigned int* counts = &grid.counts[0];
+    unsigned int* slots = &grid.slots[0];
+    for (size_t n = 0; n < count; n++) {
+        const LightRange& range = ranges[n];
+        if (!inside[n] || range.s1 < s0 || range.s0 >= s1)
+            continue;
+        unsigned int span = ((2u << range.x1) - 1) & ~((1u << range.x0) - 1);
+        int first = max(range.s0, s0), last = min(range.s1, s1 - 1);
+        for (int s = first; s <= last; s++) {
+            for (int y = range.y0; y <= range.y1; y++) {
+                size_t base = ((size_t)s * CLUSTER_Y + y) * CLUSTER_X;
+                unsigned int mask = TestRow(grid, base, lights[n].positionRadius) & span;
+                while (mask != 0) {
+                    int x = 0;
+                    while (!(mask & (1u << x)))
+                        x++;
+                    mask &= mask - 1;
+                    unsigned int& c = counts[base + x];
+                    if (c < CLUSTER_MAX_LIGHTS)
+                        slots[(base + x) * CLUSTER_MAX_LIGHTS + c++] = (unsigned int)n;
+                    else
+                        dropped++;
+                }
+            }
+        }
+    }
+    return dropped;
+}
+
+//------------------------------------------------------------
+// Packs the per-cluster slots into offsets and one index list
+//------------------------------------------------------------
+
+static size_t CompactClusters(ClusterGrid& grid)
+{
+    size_t total = 0;
+    grid.maxCount = 0;
+    for (size_t c = 0; c < CLUSTER_COUNT; c++) {
+        total += grid.counts[c];
+        grid.maxCount = max(grid.maxCount, grid.counts[c]);
+    }
+    grid.indices.resize(total);
+
+    size_t offset = 0;
+    for (size_t c = 0; c < CLUSTER_COUNT; c++) {
+        unsigned int n = grid.counts[c];
+        grid.clusters[2 * c] = (unsigned int)offset;
+        grid.clusters[2 * c + 1] = n;
+        if (n > 0)
+            memcpy(&grid.indices[offset], &grid.slots[c * CLUSTER_MAX_LIGHTS], n * sizeof(unsigned int));
+        offset += n;
+    }
+    return total;
+}
+
+template <unsigned int (*TestRow)(const ClusterGrid&, size_t, const glm::vec4&)>
+static size_t AssignLights(ClusterGrid& grid, const PointLight* lights, size_t count, int threads)
+{
+    auto start = chrono::high_resolution_clock::now();
+
+    vector<LightRange> ranges(count);
+    vector<unsigned char> inside(count);
+    for (size_t n = 0; n < count; n++)
+        inside[n] = LightClusterRange(grid, lights[n], ranges[n]);
+    fill(grid.counts.begin(), grid.counts.end(), 0);
+
+    // Contiguous slices per thread, the calling thread takes the first
+    if (threads <= 0) {
+        size_t wanted = count / CLUSTER_LIGHTS_PER_THREAD;
+        size_t available = thread::hardware_concurrency();
+        threads = (int)max((size_t)1, min(wanted, available));
+    }
+    threads = min(threads, CLUSTER_Z);
+    int per_thread = (CLUSTER_Z + threads - 1) / threads;
+
+    vector<size_t> dropped(threads, 0);
+    vector<thread> workers;
+    for (int t = 1; t < threads; t++) {
+        int s0 = t * per_thread, s1 = min(CLUSTER_Z, s0 + per_thread);
+        if (s0 >= s1)
+            break;
+        workers.push_back(thread([&, t, s0, s1]() {
+            dropped[t] = AssignSlices<TestRow>(grid, lights, ranges.data(), inside.data(), count, s0, s1);
+        }));
+    }
+    dropped[0] = AssignSlices<TestRow>(grid, lights, ranges.data(), inside.data(), count, 0, min(CLUSTER_Z, per_thread));
+    for (thread& worker : workers)
+        worker.join();
+
+    grid.lights = count;
+    grid.threads = threads;
+    grid.dropped = 0;
+    for (size_t d : dropped)
+        grid.dropped += d;
+    size_t total = CompactClusters(grid);
+    grid.milliseconds = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+    return total;
+}
+
+size_t assignLights(ClusterGrid& grid, const PointLight* lights, size_t count, int threads)
+{
+    return AssignLights<TestRowSimd>(grid, lights, count, threads);
+}
+
+size_t assignLightsScalar(ClusterGrid& grid, const PointLight* lights, size_t count)
+{
+    return AssignLights<TestRowScalar>(grid, lights, count, 1);
+}
+
+size_t assignAllLights(ClusterGrid& grid, size_t count)
+{
+    auto start = chrono::high_resolution_clock::now();
+    grid.indices.resize(count);
+    for (size_t n = 0; n < count; n++)
+        grid.indices[n] = (unsigned int)n;
+    for (size_t c = 0; c < CLUSTER_COUNT; c++) {
+        grid.clusters[2 * c] = 0;
+        grid.clusters[2 * c + 1] = (unsigned int)count;
+    }
+    grid.lights = count;
+    grid.dropped = 0;
+    grid.maxCount = (unsigned int)count;
+    grid.threads = 1;
+    grid.milliseconds = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+    return count * CLUSTER_COUNT;
+}
@@ -0,0 +1,83 @@
+#ifndef LIGHTCLUSTERS_H
+#define LIGHTCLUSTERS_H
+
+#include <stddef.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Clustered light assignment. The view frustum is cut into CLUSTER_X by
+// CLUSTER_Y screen tiles and CLUSTER_Z depth slices, spaced exponentially
+// so clusters stay roughly cube shaped. Every cluster gets the list of
+// point lights whose sphere touches its view-space AABB; a fragment then
+// only shades the lights of the cluster it falls in.
+//
+// Assignment walks the lights: the sphere's depth and its projected box
+// give a range of clusters, and each row of CLUSTER_X clusters in that
+// range is tested against the sphere with SSE/AVX, the same way culling.h
+// tests objects. Depth slices are split over threads, so every cluster is
+// written by one thread only and lists come out in light order.
+//
+// The result is what the shaders read: per cluster an offset and count
+// into one array of light indices. Nothing here touches GL.
+
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define CLUSTER_COUNT (CLUSTER_X * CLUSTER_Y * CLUSTER_Z)
+
+// Lights past this many in one cluster are dropped (and counted)
+#define CLUSTER_MAX_LIGHTS 256
+
+// std430 `PointLight` of the shaders; position is in view space when
+// handed to assignLights
+struct PointLight
+{
+	glm::vec4 positionRadius;   // xyz position, w radius where the light ends
+	glm::vec4 color;            // rgb intensity, w unused
+};
+
+struct ClusterGrid
+{
+	float nearZ, farZ;          // view depth range sliced, positive
+	float sliceScale, sliceBias;    // slice = log(depth) * scale + bias
+	float tileX, tileY;         // NDC size of one tile
+	glm::mat4 projection;
+
+	// View-space AABB per cluster, x fastest, then y, then slice
+	std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+
+	// Output of the last assignment: offset and count per cluster into
+	// indices
+	std::vector<unsigned int> clusters;
+	std::vector<unsigned int> indices;
+
+	// Per cluster lists while assigning, CLUSTER_MAX_LIGHTS each
+	std::vector<unsigned int> slots;
+	std::vector<unsigned int> counts;
+
+	size_t lights;              // lights of the last assignment
+	size_t dropped;             // references past CLUSTER_MAX_LIGHTS
+	unsigned int maxCount;      // longest list
+	int threads;
+	double milliseconds;
+};
+
+// Computes the cluster bounds of a perspective projection between view
+// depths nearZ and farZ
+void setupClusterGrid(ClusterGrid & grid, const glm::mat4 & projection, float nearZ, float farZ);
+
+// Lists for count lights; threads 0 picks a count from the light count.
+// Returns the number of references written to indices.
+size_t assignLights(ClusterGrid & grid, const PointLight * lights, size_t count, int threads = 0);
+
+// Plain loop over the same tests, the reference for the SIMD path
+size_t assignLightsScalar(ClusterGrid & grid, const PointLight * lights, size_t count);
+
+// Every cluster lists every light: forward shading without culling
+size_t assignAllLights(ClusterGrid & grid, size_t count);
+
+// Name of the compiled SIMD path: "AVX", "SSE2" or "scalar"
+const char * clusterSimdName();
+
+#endif
@@ -1,4 +1,8 @@
+#include <chrono>
+#include <cstring>
 #include <iostream>
+#include <string>
+#include <thread>
 #include <vector>
 
 #include <GL/glew.h>
@@ -8,10 +12,32 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "assetloader.h"
+#include "bench.h"
+#include "culling.h"
+#include "filewatcher.h"
+#include "framescheduler.h"
 #include "glsl.h"
+#include "glstate.h"
+#include "headless.h"
+#include "instancing.h"
+#include "jobpool.h"
+#include "lightbuffers.h"
+#include "lightclusters.h"
+#include "meshcache.h"
+#include "meshsimplify.h"
 #include "objloader.h"
-
+#include "profiler.h"
+#include "programcache.h"
+#include "renderqueue.h"
+#include "shadervariants.h"
+#include "softraster.h"
+#include "texcompress.h"
 #include "texture.h"
+#include "texturearray.h"
+#include "transforms.h"
+#include "uniformbuffers.h"
+#include "vertexformat.h"
 
 void CheckOpenGLError(const char* stmt, const char* fname, int line)
 {
@@ -24,10 +50,12 @@ void CheckOpenGLError(const char* stmt, const char* fname, int line)
     }
 }
 
+// Polls only when no KHR_debug callback reports errors for us
 #ifdef _DEBUG
 #define GL_CHECK(stmt) do { \
             stmt; \
-            CheckOpenGLError(#stmt, __FILE__, __LINE__); \
+            if (!gl_debug_output) \
+                CheckOpenGLError(#stmt, __FILE__, __LINE__); \
         } while (0)
 #else
 #define GL_CHECK(stmt) stmt
@@ -43,54 +71,128 @@ using namespace std;
 
 const int WIDTH = 800, HEIGHT = 600;
 
+// Every scene program is a variant of this pair, see shadervariants.h
 const char* fragshader_name = "fragmentshader.frag";
 const char* vertexshader_name = "vertexshader.vert";
 
-unsigned const int DELTA_TIME = 10;
+// Simulation runs at a fixed 100 Hz independent of the frame rate
+const double SIMULATION_STEP = 0.01;
+
+// Far plane of the scene camera, also the depth range of the sort keys
+const float FAR_PLANE = 20.0f;
+
+// Radians per second around the y axis
+const float ROTATION_SPEED = 1.0f;
+
+// Quantized interleaved vertices: 16 bytes instead of 32
+unsigned const int VERTEX_FORMAT = VERTEX_POSITION_SHORT | VERTEX_NORMAL_PACKED | VERTEX_UV_SHORT;
 
 constexpr auto NUMBER_OF_OBJECTS = 2;
 
+const char* mesh_names[NUMBER_OF_OBJECTS] = { "teapot.obj", "torus.obj" };
+const char* texture_names[NUMBER_OF_OBJECTS] = { "uvtemplate.bmp", "Yellobrk.bmp" };
+
+// Compressed teapot texture, streamed mip by mip: --dds
+const char* dds_texture_name = "uvmap.DDS";
+
+// Detail levels generated per mesh (1 = full mesh only)
+const unsigned int LOD_LEVELS = 6;
+
+// Longest the main thread spends per frame on finishing loaded assets
+const double ASSET_UPLOAD_BUDGET = 0.004;
+
+// Frame time of the headless loading screen
+const double LOADING_FRAME_TIME = 1.0 / 60.0;
+
 
 //--------------------------------------------------------------------------------
 // Variables
 //--------------------------------------------------------------------------------
 
 // ID's
-GLuint program_id;
 GLuint vao[NUMBER_OF_OBJECTS];
-GLuint vbo_uvs[NUMBER_OF_OBJECTS];
-GLuint vbo_normals[NUMBER_OF_OBJECTS];
+GLuint vbo_indices[NUMBER_OF_OBJECTS];
 GLuint texture_id[NUMBER_OF_OBJECTS];
 
-// Uniform ID's
-GLuint uniform_mv;
-GLuint uniform_proj;
-GLuint uniform_light_pos;
-GLuint uniform_material_ambient;
-GLuint uniform_material_diffuse;
-GLuint uniform_specular;
-GLuint uniform_material_power;
+// Programs, one per feature set in use. Objects draw with the cheapest
+// variant their material and texture allow.
+ShaderVariants scene_shaders;
+unsigned int object_features[NUMBER_OF_OBJECTS];
+
+// Visible objects of the frame, sorted by state (see renderqueue.h)
+RenderQueue render_queue;
+
+// Edited shader files are rebuilt in the background and swapped in once
+// they link: --no-hot-reload turns the watcher off
+FileWatcher shader_watcher;
+bool hot_reload = true;
 
+// Once every texture is loaded they are packed into texture arrays and
+// drawn with TEXTURE_ARRAY variants, objects sharing an array back to back
+TexturePacking texture_packing;
+bool use_texture_arrays = true;
+bool textures_packed = false;
+
+// Texture binds the last frame needed, against the objects it drew
+unsigned int texture_binds, textured_objects;
+
+// Uniform buffers: per-frame data and the material table
+GLuint ubo_frame;
+GLuint ubo_materials;
 
-GLuint position_id;
 GLuint vbo_vertices[NUMBER_OF_OBJECTS];
-glm::vec3 light_position,
-    ambient_color[NUMBER_OF_OBJECTS],
-    diffuse_color[NUMBER_OF_OBJECTS];
+glm::vec3 light_position;
+
+// Material table, uploaded as is; objects refer to an entry by index
+MaterialUniforms materials[MAX_MATERIALS];
+unsigned int material_count;
+unsigned int object_material[NUMBER_OF_OBJECTS];
 
 // Matrices
 glm::mat4 model[NUMBER_OF_OBJECTS], view, projection;
-glm::mat4 mv[NUMBER_OF_OBJECTS];
-glm::vec3 specular[NUMBER_OF_OBJECTS];
-float power[NUMBER_OF_OBJECTS];
+glm::mat4 dequantize[NUMBER_OF_OBJECTS];
+
+// Simulation state, rendered interpolated between the last two steps
+float angle[NUMBER_OF_OBJECTS], previous_angle[NUMBER_OF_OBJECTS];
+
+FrameScheduler scheduler;
 
 //--------------------------------------------------------------------------------
 // Mesh variables
 //--------------------------------------------------------------------------------
 
-vector<glm::vec3> normals[NUMBER_OF_OBJECTS];
-vector<glm::vec3> vertices[NUMBER_OF_OBJECTS];
-vector<glm::vec2> uvs[NUMBER_OF_OBJECTS];
+// Objects are drawn once their mesh is uploaded
+bool mesh_ready[NUMBER_OF_OBJECTS];
+
+GLenum index_type[NUMBER_OF_OBJECTS];
+GLsizei index_size[NUMBER_OF_OBJECTS];
+MeshLod lods[NUMBER_OF_OBJECTS][MESHLOD_MAX_LEVELS];
+unsigned int lod_count[NUMBER_OF_OBJECTS];
+
+// Largest projected simplification error a LOD may have: --lod-threshold <pixels>
+float lod_threshold = 1.0f;
+
+// Triangles drawn last frame, and how many the full meshes would have had
+size_t triangles_drawn, triangles_full;
+
+// Object space bounds per mesh, world space bounds per object
+MeshBounds mesh_bounds[NUMBER_OF_OBJECTS];
+CullBounds cull_bounds;
+vector<unsigned char> object_visible;
+CullStats cull_stats;
+
+//--------------------------------------------------------------------------------
+// Asset loading
+//--------------------------------------------------------------------------------
+
+// Load everything before the first frame instead: --serial-load
+bool serial_load = false;
+AssetLoader asset_loader;
+
+// schedulerClock() times of program start, the first frame and the
+// moment the last asset arrived
+double start_time, first_frame_time, load_done_time;
+bool load_reported = false;
 
 
 
@@ -98,10 +200,37 @@ vector<glm::vec2> uvs[NUMBER_OF_OBJECTS];
 // Keyboard handling
 //--------------------------------------------------------------------------------
 
+// Set by --profile <file.json|file.csv>
+const char* profile_path = NULL;
+
+void PrintFrameStats()
+{
+    GLStateStats frame = glstateLastFrame();
+    printf("GL state changes per frame: %u requested, %u filtered as redundant\n", frame.calls, frame.saved);
+    printf("Culling (%s) last frame: %u visible, %u culled in %.3f ms\n", cullSimdName(),
+        (unsigned int)cull_stats.visible, (unsigned int)(cull_stats.tested - cull_stats.visible),
+        cull_stats.milliseconds);
+    printf("LOD: %u of %u triangles drawn last frame\n", (unsigned int)triangles_drawn, (unsigned int)triangles_full);
+    printf("Texture binds last frame: %u for %u objects (%s)\n", texture_binds, textured_objects,
+        textures_packed ? "texture arrays" : "one texture per object");
+    printf("Render queue last frame: %u draws in %u batches, %u materials, sorted in %.1f us\n",
+        (unsigned int)render_queue.items.size(), render_queue.batches, material_count,
+        render_queue.sortSeconds * 1e6);
+    printShaderVariantStats(scene_shaders);
+}
+
 void keyboardHandler(unsigned char key, int a, int b)
 {
-    if (key == 27)
+    if (key == 27) {
+        if (profile_path != NULL)
+            profilerWrite(profile_path);
+        printFrameSchedulerStats(scheduler);
+        PrintFrameStats();
+        // Workers still loading have to be joined before exit
+        if (!serial_load && !load_reported)
+            shutdownAssetLoader(asset_loader);
         glutExit();
+    }
 }
 
 
@@ -109,51 +238,390 @@ void keyboardHandler(unsigned char key, int a, int b)
 // Rendering
 //--------------------------------------------------------------------------------
 
-void Render()
+//------------------------------------------------------------
+// void CullObjects(...)
+// Frustum culls count objects, bounds[i] transformed by
+// world[i], into visible and fills cull_stats. bounds holds
+// one entry, shared by all objects, or one per object.
+//------------------------------------------------------------
+
+void CullObjects(const glm::mat4* world, size_t count, const MeshBounds* bounds, size_t bounds_count,
+    CullBounds& cull, vector<unsigned char>& visible, const glm::mat4& view_projection)
+{
+    ProfileCpuScope cull_scope("cull");
+    double start = schedulerClock();
+
+    resizeCullBounds(cull, count);
+    visible.resize(count);
+    for (size_t i = 0; i < count; i++)
+        setCullBounds(cull, i, world[i], bounds[bounds_count == 1 ? 0 : i]);
+
+    Frustum frustum;
+    extractFrustum(view_projection, frustum);
+    cull_stats.tested = count;
+    cull_stats.visible = cullFrustum(cull, frustum, &visible[0]);
+    cull_stats.milliseconds = (schedulerClock() - start) * 1000.0;
+}
+
+
+//------------------------------------------------------------
+// unsigned int SelectLod(...)
+// Detail level for object i of a culled set, by the projected
+// error at the distance of its bounding sphere
+//------------------------------------------------------------
+
+unsigned int SelectLod(const CullBounds& cull, size_t i, const MeshLod* mesh_lods, unsigned int count,
+    const glm::vec3& eye, const glm::mat4& proj)
+{
+    glm::vec3 center(cull.cx[i], cull.cy[i], cull.cz[i]);
+    float distance = glm::length(center - eye) - cull.radius[i];
+    float pixels_per_unit = proj[1][1] * HEIGHT * 0.5f;
+    return selectMeshLod(mesh_lods, count, distance, pixels_per_unit, lod_threshold);
+}
+
+
+//------------------------------------------------------------
+// void PackSceneTextures()
+// Moves the loaded object textures into texture arrays
+// (--no-texture-arrays skips it)
+//------------------------------------------------------------
+
+void PackSceneTextures()
+{
+    if (!use_texture_arrays || textures_packed)
+        return;
+
+    packTextures(texture_id, NUMBER_OF_OBJECTS, texture_packing);
+    printTexturePackingStats(texture_packing);
+    textures_packed = true;
+
+    // Packing bound textures and framebuffers behind the state cache
+    glstateReset();
+}
+
+//------------------------------------------------------------
+// void SelectObjectVariants()
+// Picks the cheapest shader variant for each object with what
+// has arrived so far
+//------------------------------------------------------------
+
+void SelectObjectVariants()
+{
+    for (int i = 0; i < NUMBER_OF_OBJECTS; i++) {
+        bool packed = textures_packed && texture_packing.layers[i].array >= 0;
+        object_features[i] = normalizeShaderFeatures(materialShaderFeatures(
+            materials[object_material[i]], packed || texture_id[i] != 0, packed));
+    }
+}
+
+//------------------------------------------------------------
+// GLuint ObjectTexture(int i)
+// The texture object i samples, 0 if it has none yet
+//------------------------------------------------------------
+
+GLuint ObjectTexture(int i)
+{
+    if (!(object_features[i] & SHADER_TEXTURED))
+        return 0;
+    if (object_features[i] & SHADER_TEXTURE_ARRAY)
+        return texture_packing.arrays[texture_packing.layers[i].array].texture;
+    return texture_id[i];
+}
+
+//------------------------------------------------------------
+// void QueueObjects(const glm::mat4* world)
+// Puts the visible, loaded objects in the render queue and
+// sorts them by program, texture, material, vertex array and
+// then front to back
+//------------------------------------------------------------
+
+void QueueObjects(const glm::mat4* world)
+{
+    clearRenderQueue(render_queue);
+    for (int i = 0; i < NUMBER_OF_OBJECTS; i++) {
+        if (!mesh_ready[i] || !object_visible[i])
+            continue;
+        glm::vec4 center = view * world[i] * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        uint64_t key = makeRenderKey(object_features[i], ObjectTexture(i),
+            object_material[i], vao[i], -center.z / FAR_PLANE);
+        pushRenderItem(render_queue, key, i);
+    }
+    sortRenderQueue(render_queue);
+}
+
+//------------------------------------------------------------
+// void PumpShaderReload()
+// Starts rebuilding the shader variants when a shader file
+// changed and swaps them in once they all link
+//------------------------------------------------------------
+
+void PumpShaderReload()
+{
+    if (!hot_reload)
+        return;
+
+    ProfileCpuScope shaders_scope("shaders");
+    vector<string> changed;
+    if (pollFileWatcher(shader_watcher, changed) > 0) {
+        for (const string& file : changed)
+            printf("%s changed, rebuilding shaders\n", file.c_str());
+        reloadShaderVariants(scene_shaders);
+    }
+    // New programs, and the old names may come back for other objects
+    if (pumpShaderVariants(scene_shaders))
+        glstateReset();
+}
+
+//------------------------------------------------------------
+// void PumpAssets()
+// Finishes loaded assets within the per-frame budget and notes
+// when the last one is in
+//------------------------------------------------------------
+
+void PumpAssets()
 {
-    GL_CHECK(glClearColor(0.0, 0.0, 0.0, 1.0));
-    GL_CHECK(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+    if (serial_load || !assetsPending(asset_loader))
+        return;
+
+    ProfileCpuScope assets_scope("assets");
+    // Uploads bind buffers and textures behind the state cache
+    if (pumpAssetLoader(asset_loader, ASSET_UPLOAD_BUDGET) > 0)
+        glstateReset();
+    if (!assetsPending(asset_loader)) {
+        load_done_time = asset_loader.doneTime;
+        PackSceneTextures();
+    }
+}
 
-    // Attach to program_id
-    GL_CHECK(glUseProgram(program_id));
+//------------------------------------------------------------
+// void ReportLoadTimes()
+// Time to first frame and until everything was loaded, both
+// from program start. Stops the loader's workers.
+//------------------------------------------------------------
+
+void ReportLoadTimes()
+{
+    printf("%s loading: first frame after %.1f ms, all assets after %.1f ms\n",
+        serial_load ? "Serial" : "Async",
+        1000.0 * (first_frame_time - start_time), 1000.0 * (load_done_time - start_time));
+    printProgramCacheStats();
+    if (!serial_load) {
+        printAssetLoaderStats(asset_loader);
+        shutdownAssetLoader(asset_loader);
+    }
+    load_reported = true;
+}
+
+//------------------------------------------------------------
+// void UpdateScene(double dt)
+// Advances the simulation by one fixed step
+//------------------------------------------------------------
+
+void UpdateScene(double dt)
+{
+    ProfileCpuScope update_scope("update");
 
     for (int i = 0; i < NUMBER_OF_OBJECTS; i++) {
-        // Send mvp
-        GL_CHECK(glUseProgram(program_id));
-        GL_CHECK(glUniformMatrix4fv(uniform_mv, 1, GL_FALSE, glm::value_ptr(mv[i])));
-        GL_CHECK(glUniformMatrix4fv(uniform_proj, 1, GL_FALSE, glm::value_ptr(projection)));
-        GL_CHECK(glUniform3fv(uniform_light_pos, 1, glm::value_ptr(light_position)));
-        GL_CHECK(glUniform3fv(uniform_material_ambient, 1, glm::value_ptr(ambient_color[i])));
-        GL_CHECK(glUniform3fv(uniform_material_diffuse, 1, glm::value_ptr(diffuse_color[i])));
-        GL_CHECK(glUniform3fv(uniform_specular, 1, glm::value_ptr(specular[i])));
-        GL_CHECK(glUniform1f(uniform_material_power, power[i]));
+        previous_angle[i] = angle[i];
+        angle[i] += ROTATION_SPEED * float(dt);
+    }
+}
+
+
+//------------------------------------------------------------
+// int DrawScene(double alpha)
+// Draws all objects into the bound framebuffer, interpolated
+// alpha of the way from the previous to the current
+// simulation step. Returns the number of draw calls issued
+//------------------------------------------------------------
+
+int DrawScene(double alpha)
+{
+    int draws = 0;
+    profilerBeginFrame();
+    {
+        ProfileScope frame_scope("frame");
+
+        PumpAssets();
+        PumpShaderReload();
+
+        {
+            ProfileScope clear_scope("clear");
+            GL_CHECK(glClearColor(0.0, 0.0, 0.0, 1.0));
+            GL_CHECK(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+        }
+
+        ProfileScope objects_scope("objects");
+        glstateBeginFrame();
+        shaderVariantsBeginFrame(scene_shaders);
+        SelectObjectVariants();
+
+        // Everything shared by all objects, uploaded once
+        FrameUniforms frame;
+        frame.view = view;
+        frame.projection = projection;
+        frame.light_pos = glm::vec4(light_position, 1.0f);
+        updateUniformBuffer(ubo_frame, &frame, sizeof(frame), sizeof(frame));
+        glstateBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UBO_BINDING, ubo_frame);
+        glstateBindBufferBase(GL_UNIFORM_BUFFER, MATERIAL_UBO_BINDING, ubo_materials);
 
         // Do transformation
-        model[i] = glm::rotate(model[i], 0.01f, glm::vec3(0.0f, 1.0f, 0.0f));
-        mv[i] = view * model[i];
+        glm::mat4 world[NUMBER_OF_OBJECTS];
+        for (int i = 0; i < NUMBER_OF_OBJECTS; i++) {
+            float a = previous_angle[i] + (angle[i] - previous_angle[i]) * float(alpha);
+            world[i] = glm::rotate(model[i], a, glm::vec3(0.0f, 1.0f, 0.0f));
+        }
+        CullObjects(world, NUMBER_OF_OBJECTS, mesh_bounds, NUMBER_OF_OBJECTS,
+            cull_bounds, object_visible, projection * view);
+        QueueObjects(world);
+
+        glm::vec3 eye(glm::inverse(view)[3]);
+        triangles_drawn = triangles_full = 0;
+        texture_binds = textured_objects = 0;
+        GLuint last_texture = 0;
+
+        // Program, texture and material are set once per batch of equal
+        // state bits. Each variant's draws are timed as one scope, named
+        // after its features.
+        ShaderVariant* current = NULL;
+        ShaderVariant* variant = NULL;
+        GLuint batch_texture = 0;
+        for (size_t n = 0; n < render_queue.items.size(); n++) {
+            const RenderItem& item = render_queue.items[n];
+            int i = item.index;
+            // Names too large for their key field can end up in one batch
+            GLuint texture = ObjectTexture(i);
+            if (n == 0 || renderStateChanged(render_queue.items[n - 1].key, item.key)
+                || texture != batch_texture || vao[i] != vao[render_queue.items[n - 1].index]) {
+                variant = getShaderVariant(scene_shaders, object_features[i]);
+                if (variant == NULL)
+                    continue;
+                if (variant != current) {
+                    if (current != NULL) {
+                        profilerGpuEnd();
+                        profilerCpuEnd();
+                    }
+                    profilerCpuBegin(variant->name);
+                    profilerGpuBegin(variant->name);
+                    current = variant;
+                }
+                glstateUseProgram(variant->program);
+                glstateUniform1i(variant->materialIndex, object_material[i]);
+
+                batch_texture = texture;
+                if (object_features[i] & SHADER_TEXTURE_ARRAY)
+                    glstateBindTexture(0, GL_TEXTURE_2D_ARRAY, texture);
+                else if (object_features[i] & SHADER_TEXTURED)
+                    glstateBindTexture(0, GL_TEXTURE_2D, texture);
+                if (texture != 0) {
+                    texture_binds += texture != last_texture;
+                    last_texture = texture;
+                }
+                glstateBindVertexArray(vao[i]);
+            }
+            if (variant == NULL)
+                continue;
+
+            ProfileScope object_scope("object", i);
+
+            unsigned int level = SelectLod(cull_bounds, i, lods[i], lod_count[i], eye, projection);
+            const MeshLod& lod = lods[i][level];
+            triangles_drawn += lod.indexCount / 3;
+            triangles_full += lods[i][0].indexCount / 3;
+
+            // Multiplied once here rather than for every vertex
+            glm::mat4 model_view = view * world[i] * dequantize[i];
+            glstateUniformMatrix4fv(variant->modelView, glm::value_ptr(model_view));
+
+            // Packed textures only differ in the layer
+            if (object_features[i] & SHADER_TEXTURE_ARRAY)
+                glstateUniform1i(variant->textureLayer, texture_packing.layers[i].layer);
+            if (object_features[i] & SHADER_TEXTURED)
+                textured_objects++;
+            variant->draws++;
+            draws++;
+            GL_CHECK(glDrawElements(GL_TRIANGLES, lod.indexCount, index_type[i],
+                (const void*)((size_t)lod.indexOffset * index_size[i])));
+        }
+        if (current != NULL) {
+            profilerGpuEnd();
+            profilerCpuEnd();
+        }
+    }
+    profilerEndFrame();
+
+    if (first_frame_time == 0.0)
+        first_frame_time = schedulerClock();
+    if (!load_reported && load_done_time > 0.0)
+        ReportLoadTimes();
+
+    return draws;
+}
+
+//------------------------------------------------------------
+// int HeadlessFrame()
+// One simulation step per frame, so benchmark runs are
+// deterministic regardless of how fast they render
+//------------------------------------------------------------
 
-        // Send mvp
-        GL_CHECK(glUniformMatrix4fv(uniform_mv, 1, GL_FALSE, glm::value_ptr(mv[i])));
+int HeadlessFrame()
+{
+    UpdateScene(SIMULATION_STEP);
+    return DrawScene(1.0);
+}
+
+//------------------------------------------------------------
+// void WaitForAssets()
+// Keeps drawing without advancing the simulation until every
+// asset has arrived, so headless benchmarks always measure
+// the complete scene. Frames are paced like vsync would, the
+// workers need the CPU more than the placeholders do.
+//------------------------------------------------------------
 
-        GL_CHECK(glBindVertexArray(vao[i]));
-        GL_CHECK(glBindTexture(GL_TEXTURE_2D, texture_id[i]));
-        GL_CHECK(glDrawArrays(GL_TRIANGLES, 0, vertices[i].size()));
-        GL_CHECK(glBindVertexArray(0));
+void WaitForAssets()
+{
+    while (!serial_load && assetsPending(asset_loader)) {
+        double start = schedulerClock();
+        DrawScene(1.0);
+        GL_CHECK(glFinish());
+        double remaining = LOADING_FRAME_TIME - (schedulerClock() - start);
+        if (remaining > 0.0)
+            this_thread::sleep_for(chrono::duration<double>(remaining));
     }
+}
+
+
+//------------------------------------------------------------
+// void Render(double alpha)
+// Render callback of the frame scheduler
+//------------------------------------------------------------
 
+void Render(double alpha)
+{
+    DrawScene(alpha);
     GL_CHECK(glutSwapBuffers());
 }
 
 
 //------------------------------------------------------------
-// void Render(int n)
-// Render method that is called by the timer function
+// void Render()
+// Display callback, redraws the last frame on expose
+//------------------------------------------------------------
+
+void Render()
+{
+    Render(scheduler.alpha);
+}
+
+
+//------------------------------------------------------------
+// void Idle()
+// Drives the frame scheduler whenever glut has no events
 //------------------------------------------------------------
 
-void Render(int n)
+void Idle()
 {
-    Render();
-    GL_CHECK(glutTimerFunc(DELTA_TIME, Render, 0));
+    tickFrameScheduler(scheduler);
 }
 
 
@@ -166,34 +634,45 @@ void InitGlutGlew(int argc, char** argv)
 {
     GL_CHECK(glutInit(&argc, argv));
     GL_CHECK(glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA | GLUT_DEPTH));
+#ifdef _DEBUG
+    GL_CHECK(glutInitContextFlags(GLUT_DEBUG));
+#endif
     GL_CHECK(glutInitWindowSize(WIDTH, HEIGHT));
     GL_CHECK(glutCreateWindow("Hello OpenGL"));
     GL_CHECK(glutDisplayFunc(Render));
     GL_CHECK(glutKeyboardFunc(keyboardHandler));
-    GL_CHECK(glutTimerFunc(DELTA_TIME, Render, 0));
+    GL_CHECK(glutIdleFunc(Idle));
 
     GL_CHECK(glewInit());
+    installDebugCallback();
 }
 
 
 //------------------------------------------------------------
-// void InitShaders()
-// Initializes the fragmentshader and vertexshader
+// void WatchShaders()
+// Starts watching the scene's shader files for hot reload
 //------------------------------------------------------------
 
-void InitShaders()
+void WatchShaders()
 {
-    char* vertexshader;
-    GL_CHECK(vertexshader = glsl::readFile(vertexshader_name));
-    GLuint vsh_id;
-    GL_CHECK(vsh_id = glsl::makeVertexShader(vertexshader));
+    if (!hot_reload)
+        return;
+    initFileWatcher(shader_watcher);
+    watchFile(shader_watcher, vertexshader_name);
+    watchFile(shader_watcher, fragshader_name);
+}
 
-    char* fragshader;
-    GL_CHECK(fragshader = glsl::readFile(fragshader_name));
-    GLuint fsh_id;
-    GL_CHECK(fsh_id = glsl::makeFragmentShader(fragshader));
 
-    GL_CHECK(program_id = glsl::makeShaderProgram(vsh_id, fsh_id));
+//------------------------------------------------------------
+// void InitShaders()
+// Sets up the scene's shader variants; each one is compiled
+// the first time an object draws with it
+//------------------------------------------------------------
+
+void InitShaders()
+{
+    initShaderVariants(scene_shaders, vertexshader_name, fragshader_name);
+    WatchShaders();
 }
 
 
@@ -210,124 +689,965 @@ void InitMatrices()
     projection = glm::perspective(
         glm::radians(45.0f),
         1.0f * WIDTH / HEIGHT, 0.1f,
-        20.0f);
+        FAR_PLANE);
 }
 
 
 //------------------------------------------------------------
-// void InitBuffers()
-// Allocates and fills buffers
+// void InitObjectBuffers(int i, MeshCache& cache)
+// Allocates and fills the buffers of object i from its mesh
+// cache, which may be closed afterwards
 //------------------------------------------------------------
 
-void InitBuffers()
+void InitObjectBuffers(int i, MeshCache& cache)
 {
+    // Streams of the mapped cache file
+    const MeshData& mesh = cache.mesh;
+
+    // Loading finishes between draws; element buffer binds below would
+    // otherwise end up in whatever vao the last draw left bound
+    GL_CHECK(glBindVertexArray(0));
+
+    // One interleaved vbo, packed straight into the mapped buffer
+    VertexLayout layout;
+    buildVertexLayout(mesh, VERTEX_FORMAT, layout);
+    dequantize[i] = layout.dequantize;
+
+    GLsizeiptr vertex_bytes = (GLsizeiptr)mesh.vertexCount * layout.stride;
+    GL_CHECK(glGenBuffers(1, &(vbo_vertices[i])));
+    GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, vbo_vertices[i]));
+    GL_CHECK(glBufferData(GL_ARRAY_BUFFER, vertex_bytes, NULL, GL_STATIC_DRAW));
+    void* vertex_data;
+    GL_CHECK(vertex_data = glMapBufferRange(GL_ARRAY_BUFFER, 0, vertex_bytes,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+    packVertices(mesh, layout, vertex_data);
+    GL_CHECK(glUnmapBuffer(GL_ARRAY_BUFFER));
+    GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+
+    // Element buffer, 16-bit whenever the cache could store it that way
+    // All detail levels share the vertices and sit back to back in the element buffer
+    index_type[i] = mesh.indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    index_size[i] = mesh.indexSize;
+    lod_count[i] = min(max(mesh.lodCount, 1u), (unsigned int)MESHLOD_MAX_LEVELS);
+    for (unsigned int level = 0; level < lod_count[i]; level++)
+        lods[i][level] = meshLod(mesh, level);
+    GL_CHECK(glGenBuffers(1, &(vbo_indices[i])));
+    GL_CHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo_indices[i]));
+    GL_CHECK(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+        (GLsizeiptr)mesh.indexCount * mesh.indexSize,
+        mesh.indices, GL_STATIC_DRAW));
+    GL_CHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+
+    // Bounds for culling come from the float positions
+    computeMeshBounds(mesh, mesh_bounds[i]);
+
+    // Allocate memory for vao
+    GL_CHECK(glGenVertexArrays(1, &(vao[i])));
+
+    // Bind to vao
+    GL_CHECK(glBindVertexArray(vao[i]));
+
+    // Bind the interleaved attributes to vao
+    GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, vbo_vertices[i]));
+    GL_CHECK(setVertexAttributes(layout));
+    GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+
+    // Element buffer binding is part of the vao state
+    GL_CHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo_indices[i]));
+
+    // Stop bind to vao
+    GL_CHECK(glBindVertexArray(0));
+
+    mesh_ready[i] = true;
+}
+
+// DDS textures go through their own loader
+bool IsDDS(const char* name)
+{
+    size_t length = strlen(name);
+    if (length < 4)
+        return false;
+    const char* extension = name + length - 4;
+    return strcmp(extension, ".DDS") == 0 || strcmp(extension, ".dds") == 0;
+}
 
-    GL_CHECK(position_id = glGetAttribLocation(program_id, "position"));
+//------------------------------------------------------------
+// void InitObjects()
+// Serial path (--serial-load): everything is loaded and
+// uploaded before the first frame
+//------------------------------------------------------------
 
+void InitObjects() {
     for (int i = 0; i < NUMBER_OF_OBJECTS; i++) {
+        MeshCache cache;
+        if (loadMeshCached(mesh_names[i], cache, LOD_LEVELS)) {
+            InitObjectBuffers(i, cache);
+            // GL has its own copy now
+            closeMeshCache(cache);
+        }
+        if (IsDDS(texture_names[i]))
+            texture_id[i] = loadDDS(texture_names[i]);
+        else
+            texture_id[i] = loadBMP(texture_names[i]); // Heeft GLUT/GLEW nodig!
+    }
+    load_done_time = schedulerClock();
+}
 
-        // vbo for vertices
-        GL_CHECK(glGenBuffers(1, &(vbo_vertices[i])));
-        GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, vbo_vertices[i]));
-        GL_CHECK(glBufferData(GL_ARRAY_BUFFER,
-            vertices[i].size() * sizeof(glm::vec3), &vertices[i][0],
-            GL_STATIC_DRAW));
-        GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
-
-        // vbo for normals
-        GL_CHECK(glGenBuffers(1, &(vbo_normals[i])));
-        GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, vbo_normals[i]));
-        GL_CHECK(glBufferData(GL_ARRAY_BUFFER,
-            normals[i].size() * sizeof(glm::vec3),
-            &normals[i][0], GL_STATIC_DRAW));
-        GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
-
-        GL_CHECK(glGenBuffers(1, &(vbo_uvs[i])));
-        GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, vbo_uvs[i]));
-        GL_CHECK(glBufferData(GL_ARRAY_BUFFER, uvs[i].size() * sizeof(glm::vec2),
-            &uvs[i][0], GL_STATIC_DRAW));
-        GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
-
-
-        // Get vertex attributes
-        GLuint normal_id;
-        GL_CHECK(normal_id = glGetAttribLocation(program_id, "normal"));
-        GLuint uv_id;
-        GL_CHECK(uv_id = glGetAttribLocation(program_id, "uv"));
-
-        // Allocate memory for vao
-        GL_CHECK(glGenVertexArrays(1, &(vao[i])));
-
-        // Bind to vao
-        GL_CHECK(glBindVertexArray(vao[i]));
-
-        // Bind vertices to vao
-        GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, vbo_vertices[i]));
-        GL_CHECK(glVertexAttribPointer(position_id, 3, GL_FLOAT, GL_FALSE, 0, 0));
-        GL_CHECK(glEnableVertexAttribArray(position_id));
-        GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
-
-        // Bind normals to vao
-        GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, vbo_normals[i]));
-        GL_CHECK(glVertexAttribPointer(normal_id, 3, GL_FLOAT, GL_FALSE, 0, 0));
-        GL_CHECK(glEnableVertexAttribArray(normal_id));
-        GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
-
-        // uv maps
-        GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, vbo_uvs[i]));
-        GL_CHECK(glVertexAttribPointer(uv_id, 2, GL_FLOAT, GL_FALSE, 0, 0));
-        GL_CHECK(glEnableVertexAttribArray(uv_id));
-        GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
-
-        // Stop bind to vao
-        GL_CHECK(glBindVertexArray(0));
-    }
-
-    // Make uniform vars
-    GL_CHECK(uniform_mv = glGetUniformLocation(program_id, "mv"));
-    GL_CHECK(uniform_proj = glGetUniformLocation(program_id, "projection"));
-    GL_CHECK(uniform_light_pos = glGetUniformLocation(program_id, "light_pos"));
-    GL_CHECK(uniform_material_ambient = glGetUniformLocation(program_id, "mat_ambient"));
-    GL_CHECK(uniform_material_diffuse = glGetUniformLocation(program_id, "mat_diffuse"));
-    GL_CHECK(uniform_specular = glGetUniformLocation(program_id, "mat_specular"));
-    GL_CHECK(uniform_material_power = glGetUniformLocation(program_id, "mat_power"));
+//------------------------------------------------------------
+// void InitObjectsAsync()
+// Queues all meshes and textures on the asset loader; they
+// show up in the scene as DrawScene pumps the loader
+//------------------------------------------------------------
+
+void MeshLoaded(int slot, MeshCache& cache)
+{
+    InitObjectBuffers(slot, cache);
 }
 
-void InitObjects() {
-    bool res = loadOBJ("teapot.obj", vertices[0], uvs[0], normals[0]);
-    texture_id[0] = loadBMP("uvtemplate.bmp"); // Heeft GLUT/GLEW nodig!
+void InitObjectsAsync() {
+    initAssetLoader(asset_loader);
+    for (int i = 0; i < NUMBER_OF_OBJECTS; i++) {
+        requestMesh(asset_loader, mesh_names[i], LOD_LEVELS, MeshLoaded, i);
+        if (IsDDS(texture_names[i]))
+            requestDDSTexture(asset_loader, texture_names[i], &texture_id[i]);
+        else
+            requestTexture(asset_loader, texture_names[i], &texture_id[i]);
+    }
+}
 
-    bool res2 = loadOBJ("torus.obj", vertices[1], uvs[1], normals[1]);
-    texture_id[1] = loadBMP("Yellobrk.bmp"); // Heeft GLUT/GLEW nodig!
+//------------------------------------------------------------
+// void InitUniformBuffers()
+// Creates the frame and material uniform buffers
+//------------------------------------------------------------
+
+void InitUniformBuffers()
+{
+    ubo_frame = createUniformBuffer(sizeof(FrameUniforms));
+    ubo_materials = createUniformBuffer(MAX_MATERIALS * sizeof(MaterialUniforms));
 }
 
-void InitMaterials() {
+//------------------------------------------------------------
+// unsigned int AddMaterial(const MaterialUniforms& material)
+// Index of material in the table, added if no entry has the
+// same values. Objects that look the same share an entry and
+// so a batch.
+//------------------------------------------------------------
+
+unsigned int AddMaterial(const MaterialUniforms& material)
+{
+    for (unsigned int m = 0; m < material_count; m++)
+        if (memcmp(&materials[m], &material, sizeof(material)) == 0)
+            return m;
+    if (material_count == MAX_MATERIALS) {
+        printf("Material table full, sharing the last entry\n");
+        return MAX_MATERIALS - 1;
+    }
+    materials[material_count] = material;
+    return material_count++;
+}
+
+//------------------------------------------------------------
+// void FillMaterials()
+// The light and material table without touching GL, shared
+// with the software renderer
+//------------------------------------------------------------
+
+void FillMaterials() {
     light_position = glm::vec3(4, 4, 4);
 
-    ambient_color[0] = glm::vec3(0.2, 0.2, 0.1);
-    diffuse_color[0] = glm::vec3(0.5, 0.5, 0.3);
-    specular[0] = glm::vec3(0.7, 0.7, 0.7);
-    power[0] = 1024;
+    // The textures carry the diffuse color, white leaves them as they are
+    MaterialUniforms material;
+    material.ambient = glm::vec4(0.2, 0.2, 0.1, 0.0);
+    material.diffuse = glm::vec4(1.0, 1.0, 1.0, 0.0);
+    material.specular = glm::vec4(0.7, 0.7, 0.7, 1024);
 
-    ambient_color[1] = glm::vec3(0.2, 0.2, 0.1);
-    diffuse_color[1] = glm::vec3(0.5, 0.5, 0.3);
-    specular[1] = glm::vec3(0.7, 0.7, 0.7);
-    power[1] = 1024;
+    material_count = 0;
+    for (int i = 0; i < NUMBER_OF_OBJECTS; i++)
+        object_material[i] = AddMaterial(material);
 }
 
+void InitMaterials() {
+    FillMaterials();
 
-int main(int argc, char** argv)
+    // Materials only change here, the draw loop just picks one by index
+    InitUniformBuffers();
+    updateUniformBuffer(ubo_materials, materials, material_count * sizeof(MaterialUniforms),
+        MAX_MATERIALS * sizeof(MaterialUniforms));
+}
+
+
+//------------------------------------------------------------
+// void InitScene()
+// Everything after context creation, shared by the window and
+// the headless mode
+//------------------------------------------------------------
+
+void InitScene()
 {
-    InitGlutGlew(argc, argv);
     InitShaders();
     InitMatrices();
-    InitObjects();
     InitMaterials();
-    InitBuffers();
+
+    if (serial_load) {
+        InitObjects();
+        PackSceneTextures();
+    }
+    else {
+        InitObjectsAsync();
+    }
+
+    GL_CHECK(glEnable(GL_DEPTH_TEST));
+    GL_CHECK(glDisable(GL_CULL_FACE));
+
+    // Loading bound buffers and textures behind the state cache
+    glstateReset();
+}
+
+
+
+//--------------------------------------------------------------------------------
+// Instanced stress scene
+//--------------------------------------------------------------------------------
+
+// A grid of spinning teapots, all drawn with one instanced call. The
+// instance buffer is rebuilt and uploaded every frame, so the numbers
+// include the CPU side of animating that many objects.
+
+ShaderVariant* stress_variant;
+GLuint stress_texture_id;
+InstancedMesh stress_mesh;
+vector<InstanceData> stress_instances, stress_visible_instances;
+// Every instance is a root of the hierarchy, its slot is its index
+TransformHierarchy stress_transforms;
+JobPool stress_jobs;
+vector<glm::vec3> stress_positions;
+vector<float> stress_speeds;
+float stress_time;
+glm::mat4 stress_view, stress_projection;
+MeshBounds stress_bounds;
+CullBounds stress_cull_bounds;
+vector<unsigned char> stress_visible;
+vector<unsigned char> stress_lod;
+float stress_extent;
+
+// Point lights over the grid, shaded by the CLUSTERED variant when
+// there are any: --lights <count> [--light-assign naive|cpu|gpu]
+int stress_light_count = 0;
+LightAssignment light_assignment = LIGHTS_CLUSTERED_CPU;
+vector<PointLight> stress_lights, stress_view_lights;
+ClusterGrid light_grid;
+LightBuffers light_buffers;
+bool light_buffers_ready = false;
+
+//------------------------------------------------------------
+// bool InitStressLights(int count, LightAssignment assignment)
+// Scatters count lights over the grid, a little above the
+// teapots, and creates the buffers for the assignment mode.
+// Replaces the lights of an earlier call.
+//------------------------------------------------------------
+
+bool InitStressLights(int count, LightAssignment assignment)
+{
+    if (light_buffers_ready)
+        destroyLightBuffers(light_buffers);
+    light_buffers_ready = false;
+
+    stress_lights.resize(count);
+    stress_view_lights.resize(count);
+    srand(7);
+    for (int i = 0; i < count; i++) {
+        glm::vec3 position(
+            (rand() * 1.0f / RAND_MAX - 0.5f) * stress_extent,
+            0.5f + rand() * 2.0f / RAND_MAX,
+            (rand() * 1.0f / RAND_MAX - 0.5f) * stress_extent);
+        float hue = rand() * 6.28f / RAND_MAX;
+        stress_lights[i].positionRadius = glm::vec4(position, 3.0f);
+        stress_lights[i].color = glm::vec4(
+            0.5f + 0.5f * sinf(hue),
+            0.5f + 0.5f * sinf(hue + 2.1f),
+            0.5f + 0.5f * sinf(hue + 4.2f), 0.0f);
+    }
+
+    light_assignment = assignment;
+    setupClusterGrid(light_grid, stress_projection, 0.1f, 2.0f * stress_extent + 20.0f);
+    light_buffers_ready = initLightBuffers(light_buffers, light_grid, assignment, WIDTH, HEIGHT);
+    return light_buffers_ready;
+}
+
+//------------------------------------------------------------
+// void UpdateStressLights()
+// Circles every light around its spot, moves them into view
+// space and fills the cluster lists
+//------------------------------------------------------------
+
+void UpdateStressLights()
+{
+    ProfileScope lights_scope("lights");
+    for (size_t i = 0; i < stress_lights.size(); i++) {
+        float a = stress_time * (0.5f + (i % 5) * 0.2f) + i;
+        glm::vec4 p = stress_lights[i].positionRadius;
+        glm::vec4 world(p.x + cosf(a), p.y, p.z + sinf(a), 1.0f);
+        glm::vec4 view_position = stress_view * world;
+        stress_view_lights[i].positionRadius = glm::vec4(glm::vec3(view_position), p.w);
+        stress_view_lights[i].color = stress_lights[i].color;
+    }
+    updateLightBuffers(light_buffers, light_grid, stress_view_lights.data(), stress_view_lights.size());
+    bindLightBuffers(light_buffers);
+}
+
+void PrintLightStats()
+{
+    if (!light_buffers_ready)
+        return;
+    if (light_assignment != LIGHTS_CLUSTERED_CPU) {
+        printf("Lights: %u (%s), %dx%dx%d clusters\n", (unsigned int)light_grid.lights,
+            lightAssignmentName(light_assignment), CLUSTER_X, CLUSTER_Y, CLUSTER_Z);
+        return;
+    }
+    printf("Lights: %u (%s, %s, %d threads), %u references, longest list %u, %u dropped, assigned in %.3f ms\n",
+        (unsigned int)light_grid.lights, lightAssignmentName(light_assignment), clusterSimdName(),
+        light_grid.threads, (unsigned int)light_grid.indices.size(), light_grid.maxCount,
+        (unsigned int)light_grid.dropped, light_grid.milliseconds);
+}
+
+bool InitStressScene(int count)
+{
+    InitUniformBuffers();
+
+    // Square grid on the xz plane, 4 units apart, seen from just outside
+    // its front edge so the frustum leaves out a good part of it
+    int side = 1;
+    while (side * side < count)
+        side++;
+    const float spacing = 4.0f;
+    float extent = side * spacing;
+    stress_extent = extent;
+
+    stress_instances.resize(count);
+    stress_positions.resize(count);
+    stress_speeds.resize(count);
+    for (int i = 0; i < count; i++) {
+        stress_positions[i] = glm::vec3(
+            (i % side - 0.5f * (side - 1)) * spacing, 0.0f,
+            (i / side - 0.5f * (side - 1)) * spacing);
+        stress_speeds[i] = 0.5f + (i % 7) * 0.25f;
+
+        // Hue cycles along the grid
+        glm::vec3 color(
+            0.5f + 0.5f * sinf(i * 0.37f),
+            0.5f + 0.5f * sinf(i * 0.37f + 2.1f),
+            0.5f + 0.5f * sinf(i * 0.37f + 4.2f));
+        stress_instances[i].ambient = glm::vec4(0.2f * color, 0.0f);
+        stress_instances[i].diffuse = glm::vec4(color, 0.0f);
+        stress_instances[i].specular = glm::vec4(0.7f, 0.7f, 0.7f, 1024.0f);
+    }
+    stress_time = 0.0f;
+
+    vector<int> roots(count, -1);
+    vector<glm::mat4> locals(count);
+    vector<unsigned int> slots;
+    if (!buildTransformHierarchy(stress_transforms, &roots[0], &locals[0], count, slots))
+        return false;
+
+    // One draw covers every instance, so its variant needs what any of
+    // their materials needs
+    unsigned int features = SHADER_INSTANCED;
+    for (const InstanceData& instance : stress_instances) {
+        MaterialUniforms material;
+        material.ambient = instance.ambient;
+        material.diffuse = instance.diffuse;
+        material.specular = instance.specular;
+        features |= materialShaderFeatures(material, true, false);
+    }
+    if (stress_light_count > 0)
+        features |= SHADER_CLUSTERED;
+    initShaderVariants(scene_shaders, vertexshader_name, fragshader_name);
+    WatchShaders();
+    stress_variant = getShaderVariant(scene_shaders, features);
+    if (stress_variant == NULL)
+        return false;
+
+    MeshCache cache;
+    if (!loadMeshCached("teapot.obj", cache, LOD_LEVELS))
+        return false;
+    bool created = createInstancedMesh(cache.mesh, VERTEX_FORMAT, stress_mesh);
+    computeMeshBounds(cache.mesh, stress_bounds);
+    closeMeshCache(cache);
+    if (!created)
+        return false;
+    stress_texture_id = loadBMP("uvtemplate.bmp");
+
+    stress_view = glm::lookAt(
+        glm::vec3(0.0f, 0.15f * extent + 3.0f, 0.5f * extent + 4.0f),
+        glm::vec3(0.0f, 0.0f, 0.0f),
+        glm::vec3(0.0f, 1.0f, 0.0f));
+    stress_projection = glm::perspective(
+        glm::radians(45.0f),
+        1.0f * WIDTH / HEIGHT, 0.1f,
+        2.0f * extent + 20.0f);
+
+    if (stress_light_count > 0 && !InitStressLights(stress_light_count, light_assignment))
+        return false;
 
     GL_CHECK(glEnable(GL_DEPTH_TEST));
     GL_CHECK(glDisable(GL_CULL_FACE));
 
+    // Loading bound buffers and textures behind the state cache
+    glstateReset();
+    startJobPool(stress_jobs);
+    return true;
+}
+
+//------------------------------------------------------------
+// void DestroyStressScene()
+// Releases whatever InitStressScene got to, also after it
+// failed
+//------------------------------------------------------------
+
+void DestroyStressScene()
+{
+    destroyInstancedMesh(stress_mesh);
+    stopJobPool(stress_jobs);
+    if (light_buffers_ready)
+        destroyLightBuffers(light_buffers);
+    light_buffers_ready = false;
+}
+
+int DrawStressScene()
+{
+    int draws = 0;
+    profilerBeginFrame();
+    {
+        ProfileScope frame_scope("frame");
+        PumpShaderReload();
+
+        {
+            ProfileCpuScope update_scope("update");
+            stress_time += float(SIMULATION_STEP);
+            parallelFor(stress_jobs, stress_instances.size(), TRANSFORM_BATCH, [](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    glm::mat4 m = glm::translate(glm::mat4(1.0f), stress_positions[i]);
+                    setLocalTransform(stress_transforms, (unsigned int)i,
+                        glm::rotate(m, stress_time * stress_speeds[i], glm::vec3(0.0f, 1.0f, 0.0f)));
+                }
+            });
+            updateTransforms(stress_transforms, &stress_view, &stress_jobs);
+        }
+
+        // Only visible instances go into the instance buffer
+        const vector<glm::mat4>& stress_world = stress_transforms.world;
+        CullObjects(stress_world.data(), stress_world.size(), &stress_bounds, 1,
+            stress_cull_bounds, stress_visible, stress_projection * stress_view);
+        // Visible instances grouped by detail level, one range per level
+        glm::vec3 eye(glm::inverse(stress_view)[3]);
+        GLint lod_first[MESHLOD_MAX_LEVELS + 1] = {};
+        stress_lod.resize(stress_instances.size());
+        for (size_t i = 0; i < stress_instances.size(); i++) {
+            if (stress_visible[i]) {
+                stress_lod[i] = SelectLod(stress_cull_bounds, i, stress_mesh.lods, stress_mesh.lodCount, eye, stress_projection);
+                lod_first[stress_lod[i] + 1]++;
+            }
+        }
+        triangles_drawn = triangles_full = 0;
+        for (unsigned int level = 0; level < MESHLOD_MAX_LEVELS; level++) {
+            triangles_drawn += (size_t)lod_first[level + 1] * stress_mesh.lods[level].indexCount / 3;
+            triangles_full += (size_t)lod_first[level + 1] * stress_mesh.lods[0].indexCount / 3;
+            lod_first[level + 1] += lod_first[level];
+        }
+
+        stress_visible_instances.resize(lod_first[MESHLOD_MAX_LEVELS]);
+        GLint fill[MESHLOD_MAX_LEVELS];
+        memcpy(fill, lod_first, sizeof(fill));
+        for (size_t i = 0; i < stress_instances.size(); i++) {
+            if (stress_visible[i]) {
+                multiplyTransform(stress_transforms.modelView[i], stress_mesh.dequantize, stress_instances[i].modelView);
+                stress_visible_instances[fill[stress_lod[i]]++] = stress_instances[i];
+            }
+        }
+        uploadInstances(stress_mesh, stress_visible_instances.data(), (GLsizei)stress_visible_instances.size());
+
+        GL_CHECK(glClearColor(0.0, 0.0, 0.0, 1.0));
+        GL_CHECK(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+
+        ProfileScope draw_scope("instances");
+        glstateBeginFrame();
+
+        FrameUniforms frame;
+        frame.view = stress_view;
+        frame.projection = stress_projection;
+        frame.light_pos = glm::vec4(4.0f, 40.0f, 4.0f, 1.0f);
+        updateUniformBuffer(ubo_frame, &frame, sizeof(frame), sizeof(frame));
+        glstateBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UBO_BINDING, ubo_frame);
+        if (light_buffers_ready)
+            UpdateStressLights();
+
+        shaderVariantsBeginFrame(scene_shaders);
+        glstateUseProgram(stress_variant->program);
+        glstateBindTexture(0, GL_TEXTURE_2D, stress_texture_id);
+        for (unsigned int level = 0; level < stress_mesh.lodCount; level++) {
+            drawInstanceRange(stress_mesh, level, lod_first[level], lod_first[level + 1] - lod_first[level],
+                stress_variant->instanceOffset);
+            if (lod_first[level + 1] > lod_first[level]) {
+                stress_variant->draws++;
+                draws++;
+            }
+        }
+    }
+    profilerEndFrame();
+
+    return draws;
+}
+
+
+
+//--------------------------------------------------------------------------------
+// Clustered lighting benchmark
+//--------------------------------------------------------------------------------
+
+// Frame time of the stress scene with 1 to 10000 point lights, shaded by
+// the naive loop over every light and with clustered lists from the CPU
+// and from the compute shader. A mode that takes more than
+// LIGHT_BENCH_LIMIT per frame skips the larger counts.
+
+const double LIGHT_BENCH_LIMIT = 10.0;
+
+double StressFrameTime(int frames)
+{
+    DrawStressScene();
+    glFinish();
+    double start = schedulerClock();
+    for (int f = 0; f < frames; f++)
+        DrawStressScene();
+    glFinish();
+    return (schedulerClock() - start) / frames;
+}
+
+void BenchLights(int frames)
+{
+    const int counts[] = { 1, 64, 1024, 10000 };
+    const LightAssignment modes[] = { LIGHTS_NAIVE, LIGHTS_CLUSTERED_CPU, LIGHTS_CLUSTERED_GPU };
+    bool skip[3] = { false, false, false };
+
+    printf("%d instances at %dx%d, %dx%dx%d clusters, ms per frame (CPU assignment %s)\n",
+        (int)stress_instances.size(), WIDTH, HEIGHT, CLUSTER_X, CLUSTER_Y, CLUSTER_Z, clusterSimdName());
+    printf("  lights       naive   clustered CPU (assign)   clustered GPU\n");
+    for (int count : counts) {
+        double times[3] = { -1.0, -1.0, -1.0 };
+        double assign = 0.0;
+        for (int m = 0; m < 3; m++) {
+            if (skip[m] || !InitStressLights(count, modes[m]))
+                continue;
+            times[m] = StressFrameTime(frames);
+            skip[m] = times[m] > LIGHT_BENCH_LIMIT;
+            if (modes[m] == LIGHTS_CLUSTERED_CPU)
+                assign = light_grid.milliseconds;
+        }
+        printf("  %6d", count);
+        for (int m = 0; m < 3; m++) {
+            if (times[m] < 0.0)
+                printf(m == 1 ? "  %14s         " : "  %14s", "skipped");
+            else if (m == 1)
+                printf("  %14.1f (%6.2f)", times[m] * 1000.0, assign);
+            else
+                printf("  %14.1f", times[m] * 1000.0);
+        }
+        printf("\n");
+    }
+}
+
+
+
+//--------------------------------------------------------------------------------
+// Software rasterizer
+//--------------------------------------------------------------------------------
+
+// The scene of --headless drawn by softraster on the CPU, without any GL
+// context: same matrices, materials, light and simulation steps, full
+// meshes (no LOD) and BMP textures. Its last frame is a golden image for
+// the GL renderer, identical for every thread count.
+
+struct SoftObject
+{
+    vector<unsigned int> indices;
+    vector<glm::vec3> vertices, normals;
+    vector<glm::vec2> uvs;
+    SoftMesh mesh;
+    ImageData texture;
+};
+
+bool LoadSoftObject(int i, SoftObject& object)
+{
+    if (!loadOBJIndexed(mesh_names[i], object.indices, object.vertices, object.uvs, object.normals))
+        return false;
+    object.mesh.positions = &object.vertices[0];
+    object.mesh.normals = &object.normals[0];
+    object.mesh.uvs = object.uvs.empty() ? NULL : &object.uvs[0];
+    object.mesh.indices = &object.indices[0];
+    object.mesh.vertexCount = object.vertices.size();
+    object.mesh.indexCount = object.indices.size();
+
+    if (!decodeBMP(texture_names[i], object.texture))
+        return false;
+    generateMipmaps(object.texture);
+    return true;
+}
+
+int RunSoftRenderer(int frames, const char* dump, unsigned int threads)
+{
+    SoftObject objects[NUMBER_OF_OBJECTS];
+    for (int i = 0; i < NUMBER_OF_OBJECTS; i++)
+        if (!LoadSoftObject(i, objects[i]))
+            return 1;
+    InitMatrices();
+    FillMaterials();
+
+    SoftRenderer renderer;
+    initSoftRenderer(renderer, WIDTH, HEIGHT, threads);
+    SoftRasterStats total = SoftRasterStats();
+    vector<double> times;
+    for (int f = 0; f < frames; f++) {
+        UpdateScene(SIMULATION_STEP);
+        beginSoftFrame(renderer, view, projection, light_position, glm::vec3(0.0f));
+        for (int i = 0; i < NUMBER_OF_OBJECTS; i++) {
+            SoftDraw draw;
+            draw.mesh = &objects[i].mesh;
+            draw.model = glm::rotate(model[i], angle[i], glm::vec3(0.0f, 1.0f, 0.0f));
+            draw.material = materials[object_material[i]];
+            draw.texture = &objects[i].texture;
+            submitSoftDraw(renderer, draw);
+        }
+        endSoftFrame(renderer);
+
+        const SoftRasterStats& stats = renderer.stats;
+        total.triangles += stats.triangles;
+        total.pixels += stats.pixels;
+        total.vertexMs += stats.vertexMs;
+        total.binMs += stats.binMs;
+        total.tileMs += stats.tileMs;
+        total.totalMs += stats.totalMs;
+        times.push_back(stats.totalMs);
+    }
+
+    if (frames > 0) {
+        sort(times.begin(), times.end());
+        double seconds = total.totalMs / 1000.0;
+        printf("Software rasterizer, %d frames at %dx%d on %u threads (%s edge functions)\n",
+            frames, WIDTH, HEIGHT, renderer.threads, softRasterSimdName());
+        printf("  frame ms: avg %.2f, p50 %.2f, max %.2f\n", total.totalMs / frames, times[times.size() / 2], times.back());
+        printf("  stages ms per frame: vertices %.2f, binning %.2f, tiles %.2f\n",
+            total.vertexMs / frames, total.binMs / frames, total.tileMs / frames);
+        printf("  %.2f M triangles/s, %.2f M pixels/s\n", total.triangles / seconds / 1e6, total.pixels / seconds / 1e6);
+        const SoftRasterStats& last = renderer.stats;
+        printf("  last frame: %u triangles, %u rasterized, %u tile bins, %u pixels shaded\n",
+            (unsigned int)last.triangles, (unsigned int)last.rasterized, (unsigned int)last.binned,
+            (unsigned int)last.pixels);
+    }
+    bool written = dump == NULL || writeSoftFramePPM(renderer, dump);
+    destroySoftRenderer(renderer);
+    return written ? 0 : 1;
+}
+
+
+
+//--------------------------------------------------------------------------------
+// Out-of-core mesh upload
+//--------------------------------------------------------------------------------
+
+// streamOBJ hands its batches straight to three GL_STATIC_DRAW buffers
+// (positions, UVs, normals), sized for the whole mesh on the first batch,
+// so the expanded mesh only ever exists on the GPU. With a software driver
+// such as llvmpipe the buffers themselves live in the process, and peak
+// RSS includes them.
+
+GLuint stream_buffers[3];
+
+bool UploadStreamBatch(const ObjStreamBatch& batch, void* user)
+{
+    const GLsizeiptr sizes[3] = { sizeof(glm::vec3), sizeof(glm::vec2), sizeof(glm::vec3) };
+    const void* data[3] = { batch.positions, batch.uvs, batch.normals };
+    for (int i = 0; i < 3; i++) {
+        GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, stream_buffers[i]));
+        if (batch.first == 0) {
+            glBufferData(GL_ARRAY_BUFFER, batch.total * sizes[i], NULL, GL_STATIC_DRAW);
+            if (glGetError() == GL_OUT_OF_MEMORY) {
+                printf("Out of GPU memory for %u vertices\n", (unsigned int)batch.total);
+                return false;
+            }
+        }
+        GL_CHECK(glBufferSubData(GL_ARRAY_BUFFER, batch.first * sizes[i], batch.count * sizes[i], data[i]));
+    }
+    return true;
+}
+
+int StreamOBJToGPU(const char* path, size_t budget)
+{
+    double start_rss = profilerResidentBytes() / (1024.0 * 1024.0);
+    GL_CHECK(glGenBuffers(3, stream_buffers));
+    ObjStreamStats stats;
+    bool ok = streamOBJ(path, budget, UploadStreamBatch, NULL, stats);
+    glFinish();
+    GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+    GL_CHECK(glDeleteBuffers(3, stream_buffers));
+    if (!ok)
+        return 1;
+
+    double mb = stats.bytes / (1024.0 * 1024.0);
+    double uploaded = stats.triangles * 3.0 * (2 * sizeof(glm::vec3) + sizeof(glm::vec2)) / (1024.0 * 1024.0);
+    printf("%.1f MB, %u triangles in %.2f s: %.1f MB/s, %.2f M triangles/s\n", mb, (unsigned int)stats.triangles,
+        stats.seconds, mb / stats.seconds, stats.triangles / stats.seconds / 1e6);
+    printf("%.1f MB uploaded in %u batches of %u vertices, read buffer %.1f MB\n", uploaded,
+        (unsigned int)stats.batches, (unsigned int)stats.batchCorners, stats.readBuffer / (1024.0 * 1024.0));
+    printf("Loader peak %.1f MB of a %.1f MB budget; process resident %.1f MB at start, peak %.1f MB\n",
+        stats.peakBytes / (1024.0 * 1024.0), budget / (1024.0 * 1024.0), start_rss,
+        profilerPeakResidentBytes() / (1024.0 * 1024.0));
+    return 0;
+}
+
+
+
+//--------------------------------------------------------------------------------
+// Shader program startup benchmark
+//--------------------------------------------------------------------------------
+
+// Builds the scene's program in many define variants, the way a renderer
+// with shader permutations would at startup: once compiling everything,
+// once with an empty binary cache (compile and store) and once with a
+// warm one. The defines carry a per-run salt so the driver's own shader
+// cache cannot answer the compiles.
+
+double BuildProgramVariants(int variants, unsigned int salt)
+{
+    double start = schedulerClock();
+    for (int v = 0; v < variants; v++) {
+        char defines[64];
+        snprintf(defines, sizeof(defines), "#define VARIANT %d\n#define VARIANT_SALT %u\n", v, salt);
+        GLuint id = loadCachedProgram(vertexshader_name, fragshader_name, defines);
+        glDeleteProgram(id);
+    }
+    glFinish();
+    return schedulerClock() - start;
+}
+
+void RemoveProgramVariants(int variants, unsigned int salt)
+{
+    for (int v = 0; v < variants; v++) {
+        char defines[64];
+        snprintf(defines, sizeof(defines), "#define VARIANT %d\n#define VARIANT_SALT %u\n", v, salt);
+        remove(programCachePath(vertexshader_name, fragshader_name, defines).c_str());
+    }
+}
+
+void BenchProgramCache(int variants)
+{
+    if (!programCacheSupported())
+        printf("Driver has no program binary formats, every pass compiles\n");
+    unsigned int salt = (unsigned int)(schedulerClock() * 1000.0);
+
+    setProgramCacheEnabled(false);
+    double compiled = BuildProgramVariants(variants, salt);
+    setProgramCacheEnabled(true);
+    RemoveProgramVariants(variants, salt + 1);
+    resetProgramCacheStats();
+    double cold = BuildProgramVariants(variants, salt + 1);
+    ProgramCacheStats coldStats = programCacheStats();
+    resetProgramCacheStats();
+    double warm = BuildProgramVariants(variants, salt + 1);
+    ProgramCacheStats warmStats = programCacheStats();
+    RemoveProgramVariants(variants, salt + 1);
+
+    printf("%d program variants\n", variants);
+    printf("  no cache:   %8.1f ms  %6.2f ms/program\n", 1000.0 * compiled, 1000.0 * compiled / variants);
+    printf("  cold cache: %8.1f ms  %6.2f ms/program  (%u compiled, %u stored)\n",
+        1000.0 * cold, 1000.0 * cold / variants, coldStats.compiled, coldStats.stored);
+    printf("  warm cache: %8.1f ms  %6.2f ms/program  (%u from cache, %u compiled)  %.1fx faster than compiling\n",
+        1000.0 * warm, 1000.0 * warm / variants, warmStats.loaded, warmStats.compiled, warm > 0.0 ? compiled / warm : 0.0);
+}
+
+
+int main(int argc, char** argv)
+{
+    start_time = schedulerClock();
+
+    // Benchmarks run without a window
+    if (RunBenchmark(argc, argv))
+        return 0;
+
+    // Offline OBJ -> mesh cache conversion: --convert in.obj [out.mesh] [--lods N]
+    // Defaults to the scene's detail levels so the cache is used as is
+    if (argc >= 3 && strcmp(argv[1], "--convert") == 0) {
+        string out = argc >= 4 && strncmp(argv[3], "--", 2) != 0 ? argv[3] : meshCachePath(argv[2]);
+        unsigned int levels = LOD_LEVELS;
+        for (int i = 3; i + 1 < argc; i++)
+            if (strcmp(argv[i], "--lods") == 0)
+                levels = (unsigned int)max(atoi(argv[i + 1]), 1);
+        return convertOBJToMeshCache(argv[2], out.c_str(), levels) ? 0 : 1;
+    }
+
+    // Offline BMP -> DDS compression: --compress in.bmp [out.dds] [--bc3] [--quality fast|normal|high]
+    if (argc >= 3 && strcmp(argv[1], "--compress") == 0) {
+        string in = argv[2];
+        string out = argc >= 4 && strncmp(argv[3], "--", 2) != 0 ? argv[3] : in.substr(0, in.find_last_of('.')) + ".DDS";
+        BCFormat format = BC_FORMAT_BC1;
+        BCQuality quality = BC_QUALITY_NORMAL;
+        for (int i = 3; i < argc; i++) {
+            if (strcmp(argv[i], "--bc3") == 0)
+                format = BC_FORMAT_BC3;
+            if (strcmp(argv[i], "--quality") == 0 && i + 1 < argc && !parseBCQuality(argv[i + 1], quality))
+                printf("Unknown quality '%s', using normal\n", argv[i + 1]);
+        }
+        return compressBMPToDDS(argv[2], out.c_str(), format, quality) ? 0 : 1;
+    }
+
+    // CPU rendering of the headless scene: --soft [frames] [last_frame.ppm] [--threads N]
+    if (argc >= 2 && strcmp(argv[1], "--soft") == 0) {
+        int frames = argc >= 3 && strncmp(argv[2], "--", 2) != 0 ? atoi(argv[2]) : 100;
+        const char* dump = argc >= 4 && strncmp(argv[3], "--", 2) != 0 ? argv[3] : NULL;
+        unsigned int threads = 0;
+        for (int i = 2; i + 1 < argc; i++)
+            if (strcmp(argv[i], "--threads") == 0)
+                threads = (unsigned int)max(atoi(argv[i + 1]), 1);
+        return RunSoftRenderer(frames, dump, threads);
+    }
+
+    // CPU/GPU timings of the last frames: --profile <file.json|file.csv>
+    for (int i = 1; i + 1 < argc; i++)
+        if (strcmp(argv[i], "--profile") == 0)
+            profile_path = argv[i + 1];
+
+    // Compile every program from source, never touch binaries: --no-program-cache
+    for (int i = 1; i < argc; i++)
+        if (strcmp(argv[i], "--no-program-cache") == 0)
+            setProgramCacheEnabled(false);
+
+    // Do not watch the shader files: --no-hot-reload
+    for (int i = 1; i < argc; i++)
+        if (strcmp(argv[i], "--no-hot-reload") == 0)
+            hot_reload = false;
+
+    // Largest screen-space error of a LOD, in pixels: --lod-threshold <pixels>
+    for (int i = 1; i + 1 < argc; i++)
+        if (strcmp(argv[i], "--lod-threshold") == 0)
+            lod_threshold = (float)atof(argv[i + 1]);
+
+    // OBJ streamed into GPU buffers within a memory budget: --stream-obj <file.obj> [budget MB]
+    if (argc >= 3 && strcmp(argv[1], "--stream-obj") == 0) {
+        size_t budget = (size_t)(argc >= 4 ? max(atoi(argv[3]), 1) : 64) << 20;
+        if (!CreateHeadlessContext(argc, argv, WIDTH, HEIGHT))
+            return 1;
+        int result = StreamOBJToGPU(argv[2], budget);
+        DestroyHeadlessContext();
+        return result;
+    }
+
+    // Program binary cache with many variants: --bench-programs [variants]
+    if (argc >= 2 && strcmp(argv[1], "--bench-programs") == 0) {
+        int variants = argc >= 3 ? max(atoi(argv[2]), 1) : 64;
+        if (!CreateHeadlessContext(argc, argv, WIDTH, HEIGHT))
+            return 1;
+        BenchProgramCache(variants);
+        DestroyHeadlessContext();
+        return 0;
+    }
+
+    // Point lights in the stress scene: --lights <count> [--light-assign naive|cpu|gpu]
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--lights") == 0)
+            stress_light_count = max(atoi(argv[i + 1]), 0);
+        if (strcmp(argv[i], "--light-assign") == 0 && !parseLightAssignment(argv[i + 1], light_assignment))
+            printf("Unknown light assignment '%s', using cpu\n", argv[i + 1]);
+    }
+
+    // Frame time against light count: --bench-lights [instances] [frames]
+    if (argc >= 2 && strcmp(argv[1], "--bench-lights") == 0) {
+        int count = argc >= 3 ? max(atoi(argv[2]), 1) : 400;
+        int frames = argc >= 4 ? max(atoi(argv[3]), 1) : 5;
+        if (!CreateHeadlessContext(argc, argv, WIDTH, HEIGHT))
+            return 1;
+        stress_light_count = 1;
+        bool ready = InitStressScene(count);
+        if (ready)
+            BenchLights(frames);
+        DestroyStressScene();
+        DestroyHeadlessContext();
+        return ready ? 0 : 1;
+    }
+
+    // Instancing stress test: --stress <instances> [frames] [last_frame.ppm]
+    if (argc >= 3 && strcmp(argv[1], "--stress") == 0) {
+        int count = max(atoi(argv[2]), 1);
+        int frames = argc >= 4 ? atoi(argv[3]) : 200;
+        const char* dump = argc >= 5 && strncmp(argv[4], "--", 2) != 0 ? argv[4] : NULL;
+        if (!CreateHeadlessContext(argc, argv, WIDTH, HEIGHT))
+            return 1;
+        if (!InitStressScene(count)) {
+            DestroyStressScene();
+            DestroyHeadlessContext();
+            return 1;
+        }
+        if (profile_path != NULL)
+            profilerStart();
+        double fps = RunHeadlessBenchmark(frames, DrawStressScene, dump);
+        printf("%d instances, %.0f instances/s\n", count, count * fps);
+        PrintFrameStats();
+        PrintLightStats();
+        if (profile_path != NULL) {
+            profilerWrite(profile_path);
+            profilerPrintSummary();
+        }
+        DestroyStressScene();
+        DestroyHeadlessContext();
+        return 0;
+    }
+
+    // Load assets one after another before the first frame: --serial-load
+    for (int i = 1; i < argc; i++)
+        if (strcmp(argv[i], "--serial-load") == 0)
+            serial_load = true;
+
+    // Keep one GL_TEXTURE_2D per object: --no-texture-arrays
+    for (int i = 1; i < argc; i++)
+        if (strcmp(argv[i], "--no-texture-arrays") == 0)
+            use_texture_arrays = false;
+
+    // Texture the teapot from the DXT3 DDS instead of the BMP: --dds
+    for (int i = 1; i < argc; i++)
+        if (strcmp(argv[i], "--dds") == 0)
+            texture_names[0] = dds_texture_name;
+
+    // Offscreen benchmark: --headless [frames] [last_frame.ppm]
+    if (argc >= 2 && strcmp(argv[1], "--headless") == 0) {
+        int frames = argc >= 3 ? atoi(argv[2]) : 1000;
+        const char* dump = argc >= 4 && strncmp(argv[3], "--", 2) != 0 ? argv[3] : NULL;
+        if (!CreateHeadlessContext(argc, argv, WIDTH, HEIGHT))
+            return 1;
+        InitScene();
+        WaitForAssets();
+        if (profile_path != NULL)
+            profilerStart();
+        RunHeadlessBenchmark(frames, HeadlessFrame, dump);
+        PrintFrameStats();
+        if (profile_path != NULL) {
+            profilerWrite(profile_path);
+            profilerPrintSummary();
+        }
+        DestroyHeadlessContext();
+        return 0;
+    }
+
+    // Frame pacing: --pacing vsync|uncapped|<fps>
+    FramePacing pacing = PACING_VSYNC;
+    double target_fps = 60.0;
+    for (int i = 1; i + 1 < argc; i++)
+        if (strcmp(argv[i], "--pacing") == 0 && !parseFramePacing(argv[i + 1], pacing, target_fps))
+            printf("Unknown pacing '%s', using vsync\n", argv[i + 1]);
+
+    InitGlutGlew(argc, argv);
+    InitScene();
+    initFrameScheduler(scheduler, SIMULATION_STEP, UpdateScene, Render);
+    setFramePacing(scheduler, pacing, target_fps);
+    if (profile_path != NULL)
+        profilerStart();
+
     // Hide console window
     HWND hWnd = GetConsoleWindow();
     ShowWindow(hWnd, SW_SHOW);
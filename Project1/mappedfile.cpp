@@ -0,0 +1,107 @@
+#include <stdio.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mappedfile.h"
+
+bool mapFile(const char * path, MappedFile & file)
+{
+    file.data = NULL;
+    file.size = 0;
+    file.handle = NULL;
+    file.mapping = NULL;
+
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (handle == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle, &size)) {
+        CloseHandle(handle);
+        return false;
+    }
+
+    // An empty file cannot be mapped, but it is still a valid (empty) file
+    if (size.QuadPart == 0) {
+        CloseHandle(handle);
+        return true;
+    }
+
+    HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL) {
+        CloseHandle(handle);
+        return false;
+    }
+
+    void * view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == NULL) {
+        CloseHandle(mapping);
+        CloseHandle(handle);
+        return false;
+    }
+
+    file.data = (const char *)view;
+    file.size = (size_t)size.QuadPart;
+    file.handle = handle;
+    file.mapping = mapping;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+
+    // An empty file cannot be mapped, but it is still a valid (empty) file
+    if (st.st_size == 0) {
+        close(fd);
+        return true;
+    }
+
+    void * view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file
+    close(fd);
+    if (view == MAP_FAILED)
+        return false;
+    madvise(view, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    file.data = (const char *)view;
+    file.size = (size_t)st.st_size;
+#endif
+
+    return true;
+}
+
+void unmapFile(MappedFile & file)
+{
+#ifdef _WIN32
+    if (file.data != NULL)
+        UnmapViewOfFile(file.data);
+    if (file.mapping != NULL)
+        CloseHandle((HANDLE)file.mapping);
+    if (file.handle != NULL)
+        CloseHandle((HANDLE)file.handle);
+#else
+    if (file.data != NULL)
+        munmap((void *)file.data, file.size);
+#endif
+
+    file.data = NULL;
+    file.size = 0;
+    file.handle = NULL;
+    file.mapping = NULL;
+}
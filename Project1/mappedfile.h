@@ -0,0 +1,21 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <stddef.h>
+
+// Read-only view of a whole file, backed by the OS page cache.
+// Nothing is copied: data points straight into the mapping until
+// unmapFile() is called.
+struct MappedFile
+{
+	const char * data;
+	size_t size;
+	void * handle;
+	void * mapping;
+};
+
+bool mapFile(const char * path, MappedFile & file);
+
+void unmapFile(MappedFile & file);
+
+#endif
@@ -0,0 +1,287 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <glm/glm.hpp>
+
+#include "meshcache.h"
+#include "meshoptimize.h"
+#include "meshsimplify.h"
+#include "objloader.h"
+
+// Each level has half the triangles of the previous one, down to a
+// surface deviation of this fraction of the bounding box diagonal
+static const float LOD_RATIO = 0.5f;
+static const float LOD_MAX_ERROR = 0.05f;
+
+static uint64_t alignUp(uint64_t offset)
+{
+    return (offset + MESHCACHE_ALIGNMENT - 1) & ~(uint64_t)(MESHCACHE_ALIGNMENT - 1);
+}
+
+// Serializes an indexed mesh into the on-disk layout. indices holds all
+// detail levels listed in lods.
+static void buildMeshImage(
+    const std::vector<unsigned int> & indices,
+    const std::vector<glm::vec3> & vertices,
+    const std::vector<glm::vec2> & uvs,
+    const std::vector<glm::vec3> & normals,
+    const std::vector<MeshLod> & lods,
+    unsigned int lodRequested,
+    std::vector<char> & image)
+{
+    MeshCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = MESHCACHE_MAGIC;
+    header.version = MESHCACHE_VERSION;
+    header.vertexCount = (uint32_t)vertices.size();
+    header.indexCount = (uint32_t)indices.size();
+    header.indexSize = vertices.size() <= 0x10000 ? 2 : 4;
+    header.lodCount = (uint32_t)lods.size();
+    header.lodRequested = lodRequested;
+
+    glm::vec3 boundsMin(0.0f), boundsMax(0.0f);
+    if (!vertices.empty()) {
+        boundsMin = boundsMax = vertices[0];
+        for (size_t i = 1; i < vertices.size(); i++) {
+            boundsMin = glm::min(boundsMin, vertices[i]);
+            boundsMax = glm::max(boundsMax, vertices[i]);
+        }
+    }
+    memcpy(header.boundsMin, &boundsMin, sizeof(header.boundsMin));
+    memcpy(header.boundsMax, &boundsMax, sizeof(header.boundsMax));
+
+    header.positionOffset = alignUp(sizeof(MeshCacheHeader));
+    header.normalOffset = alignUp(header.positionOffset + vertices.size() * sizeof(glm::vec3));
+    header.uvOffset = alignUp(header.normalOffset + vertices.size() * sizeof(glm::vec3));
+    header.indexOffset = alignUp(header.uvOffset + vertices.size() * sizeof(glm::vec2));
+    header.lodOffset = alignUp(header.indexOffset + (uint64_t)indices.size() * header.indexSize);
+    header.fileSize = alignUp(header.lodOffset + lods.size() * sizeof(MeshLod));
+
+    // Zero-filled, so padding between streams is deterministic
+    image.assign((size_t)header.fileSize, 0);
+    memcpy(&image[0], &header, sizeof(header));
+    if (!vertices.empty()) {
+        memcpy(&image[(size_t)header.positionOffset], &vertices[0], vertices.size() * sizeof(glm::vec3));
+        memcpy(&image[(size_t)header.normalOffset], &normals[0], normals.size() * sizeof(glm::vec3));
+        memcpy(&image[(size_t)header.uvOffset], &uvs[0], uvs.size() * sizeof(glm::vec2));
+    }
+    if (header.indexSize == 2) {
+        unsigned short * out = (unsigned short *)&image[(size_t)header.indexOffset];
+        for (size_t i = 0; i < indices.size(); i++)
+            out[i] = (unsigned short)indices[i];
+    }
+    else if (!indices.empty()) {
+        memcpy(&image[(size_t)header.indexOffset], &indices[0], indices.size() * sizeof(unsigned int));
+    }
+    memcpy(&image[(size_t)header.lodOffset], &lods[0], lods.size() * sizeof(MeshLod));
+}
+
+// A LOD table with only the full mesh
+static std::vector<MeshLod> singleLod(size_t indexCount)
+{
+    MeshLod lod;
+    memset(&lod, 0, sizeof(lod));
+    lod.indexCount = (uint32_t)indexCount;
+    return std::vector<MeshLod>(1, lod);
+}
+
+// Replaces indices by the detail levels built from it
+static void buildLods(
+    std::vector<unsigned int> & indices,
+    const std::vector<glm::vec3> & vertices,
+    unsigned int lodLevels,
+    std::vector<MeshLod> & lods)
+{
+    if (lodLevels <= 1 || vertices.empty()) {
+        lods = singleLod(indices.size());
+        return;
+    }
+
+    glm::vec3 boundsMin = vertices[0], boundsMax = vertices[0];
+    for (size_t i = 1; i < vertices.size(); i++) {
+        boundsMin = glm::min(boundsMin, vertices[i]);
+        boundsMax = glm::max(boundsMax, vertices[i]);
+    }
+    float maxError = glm::length(boundsMax - boundsMin) * LOD_MAX_ERROR;
+
+    std::vector<unsigned int> lodIndices;
+    generateMeshLods(indices, vertices, lodLevels, LOD_RATIO, maxError, lodIndices, lods);
+    indices.swap(lodIndices);
+}
+
+// Checks the header of an image and points mesh at its streams
+static bool bindMeshImage(const char * data, size_t size, MeshData & mesh)
+{
+    if (data == NULL || size < sizeof(MeshCacheHeader))
+        return false;
+
+    const MeshCacheHeader * header = (const MeshCacheHeader *)data;
+    if (header->magic != MESHCACHE_MAGIC || header->version != MESHCACHE_VERSION)
+        return false;
+    if (header->fileSize != size || (header->indexSize != 2 && header->indexSize != 4))
+        return false;
+    if (header->lodCount == 0 || header->lodOffset + (uint64_t)header->lodCount * sizeof(MeshLod) > size)
+        return false;
+
+    uint64_t vertexCount = header->vertexCount;
+    if (header->positionOffset + vertexCount * sizeof(glm::vec3) > size
+        || header->normalOffset + vertexCount * sizeof(glm::vec3) > size
+        || header->uvOffset + vertexCount * sizeof(glm::vec2) > size
+        || header->indexOffset + (uint64_t)header->indexCount * header->indexSize > size)
+        return false;
+
+    mesh.vertices = (const glm::vec3 *)(data + header->positionOffset);
+    mesh.normals = (const glm::vec3 *)(data + header->normalOffset);
+    mesh.uvs = (const glm::vec2 *)(data + header->uvOffset);
+    mesh.indices = data + header->indexOffset;
+    mesh.vertexCount = header->vertexCount;
+    mesh.indexCount = header->indexCount;
+    mesh.indexSize = header->indexSize;
+    mesh.lods = (const MeshLod *)(data + header->lodOffset);
+    mesh.lodCount = header->lodCount;
+    memcpy(&mesh.boundsMin, header->boundsMin, sizeof(header->boundsMin));
+    memcpy(&mesh.boundsMax, header->boundsMax, sizeof(header->boundsMax));
+
+    for (uint32_t i = 0; i < header->lodCount; i++)
+        if ((uint64_t)mesh.lods[i].indexOffset + mesh.lods[i].indexCount > header->indexCount)
+            return false;
+    return true;
+}
+
+static bool writeMeshImage(const char * path, const std::vector<char> & image)
+{
+    FILE * fp = fopen(path, "wb");
+    if (fp == NULL)
+        return false;
+    bool ok = fwrite(&image[0], 1, image.size(), fp) == image.size();
+    ok = fclose(fp) == 0 && ok;
+    // Never leave a truncated cache behind
+    if (!ok)
+        remove(path);
+    return ok;
+}
+
+bool writeMeshCache(
+    const char * path,
+    const std::vector<unsigned int> & indices,
+    const std::vector<glm::vec3> & vertices,
+    const std::vector<glm::vec2> & uvs,
+    const std::vector<glm::vec3> & normals)
+{
+    std::vector<char> image;
+    buildMeshImage(indices, vertices, uvs, normals, singleLod(indices.size()), 1, image);
+    return writeMeshImage(path, image);
+}
+
+bool openMeshCache(const char * path, MeshCache & cache)
+{
+    cache.memory.clear();
+    if (!mapFile(path, cache.file))
+        return false;
+
+    if (!bindMeshImage(cache.file.data, cache.file.size, cache.mesh)) {
+        printf("%s is not a valid mesh cache\n", path);
+        unmapFile(cache.file);
+        return false;
+    }
+    return true;
+}
+
+void closeMeshCache(MeshCache & cache)
+{
+    unmapFile(cache.file);
+    std::vector<char>().swap(cache.memory);
+    cache.mesh = MeshData();
+}
+
+std::string meshCachePath(const char * objPath)
+{
+    std::string path(objPath);
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of("/\\");
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+        path.erase(dot);
+    return path + ".mesh";
+}
+
+bool loadMeshCached(const char * objPath, MeshCache & cache, unsigned int lodLevels)
+{
+    if (lodLevels < 1)
+        lodLevels = 1;
+
+    std::string cachePath = meshCachePath(objPath);
+
+    struct stat objStat, cacheStat;
+    bool haveObj = stat(objPath, &objStat) == 0;
+    bool haveCache = stat(cachePath.c_str(), &cacheStat) == 0;
+
+    // Use the cache when it is at least as new as the source, or when
+    // it is all we have
+    if (haveCache && (!haveObj || cacheStat.st_mtime >= objStat.st_mtime)) {
+        if (openMeshCache(cachePath.c_str(), cache)) {
+            const MeshCacheHeader * header = (const MeshCacheHeader *)cache.file.data;
+            if (header->lodRequested == lodLevels || !haveObj)
+                return true;
+            closeMeshCache(cache);
+        }
+    }
+
+    std::vector<unsigned int> indices;
+    std::vector<glm::vec3> vertices, normals;
+    std::vector<glm::vec2> uvs;
+    if (!loadOBJIndexed(objPath, indices, vertices, uvs, normals))
+        return false;
+    optimizeMesh(indices, vertices, uvs, normals);
+    std::vector<MeshLod> lods;
+    buildLods(indices, vertices, lodLevels, lods);
+
+    // Keep the image in memory, so this run works even if the cache
+    // cannot be written
+    buildMeshImage(indices, vertices, uvs, normals, lods, lodLevels, cache.memory);
+    memset(&cache.file, 0, sizeof(cache.file));
+    bindMeshImage(&cache.memory[0], cache.memory.size(), cache.mesh);
+
+    if (!writeMeshImage(cachePath.c_str(), cache.memory))
+        printf("Could not write mesh cache %s\n", cachePath.c_str());
+
+    return true;
+}
+
+bool convertOBJToMeshCache(const char * objPath, const char * cachePath, unsigned int lodLevels)
+{
+    if (lodLevels < 1)
+        lodLevels = 1;
+
+    std::vector<unsigned int> indices;
+    std::vector<glm::vec3> vertices, normals;
+    std::vector<glm::vec2> uvs;
+    if (!loadOBJIndexed(objPath, indices, vertices, uvs, normals))
+        return false;
+    optimizeMesh(indices, vertices, uvs, normals);
+    std::vector<MeshLod> lods;
+    buildLods(indices, vertices, lodLevels, lods);
+
+    std::vector<char> image;
+    buildMeshImage(indices, vertices, uvs, normals, lods, lodLevels, image);
+    if (!writeMeshImage(cachePath, image)) {
+        printf("Could not write mesh cache %s\n", cachePath);
+        return false;
+    }
+
+    printf("%s -> %s: %u vertices\n", objPath, cachePath, (unsigned int)vertices.size());
+    for (size_t i = 0; i < lods.size(); i++)
+        printf("  LOD %u: %u triangles, error %.5f\n", (unsigned int)i, lods[i].indexCount / 3, lods[i].error);
+    return true;
+}
+
+MeshLod meshLod(const MeshData & mesh, unsigned int level)
+{
+    if (mesh.lods != NULL && mesh.lodCount > 0)
+        return mesh.lods[level < mesh.lodCount ? level : mesh.lodCount - 1];
+
+    MeshLod lod;
+    memset(&lod, 0, sizeof(lod));
+    lod.indexCount = mesh.indexCount;
+    return lod;
+}
@@ -0,0 +1,106 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "mappedfile.h"
+
+// Binary mesh container, written once from an OBJ and memory-mapped on load.
+//
+// Layout: MeshCacheHeader, then the position, normal, uv and index streams
+// and the LOD table. The index stream holds every detail level back to back.
+// Every stream starts on a MESHCACHE_ALIGNMENT boundary so it can be handed
+// to glBufferData straight from the mapping. All values are little-endian.
+
+#define MESHCACHE_MAGIC 0x4853454D // "MESH"
+#define MESHCACHE_VERSION 3
+#define MESHCACHE_ALIGNMENT 16
+
+struct MeshCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vertexCount;
+	uint32_t indexCount;        // all detail levels
+	uint32_t indexSize;         // 2 or 4 bytes
+	uint32_t lodCount;          // entries in the LOD table, at least 1
+	uint32_t lodRequested;      // levels asked for when the file was written
+	float boundsMin[3];
+	float boundsMax[3];
+	uint64_t positionOffset;    // glm::vec3 x vertexCount
+	uint64_t normalOffset;      // glm::vec3 x vertexCount
+	uint64_t uvOffset;          // glm::vec2 x vertexCount
+	uint64_t indexOffset;       // indexSize x indexCount
+	uint64_t lodOffset;         // MeshLod x lodCount
+	uint64_t fileSize;
+};
+
+// One detail level: a range of the index stream. Level 0 is the full mesh,
+// error is how far (object space) a level may deviate from it.
+struct MeshLod
+{
+	uint32_t indexOffset;
+	uint32_t indexCount;
+	float error;
+	uint32_t reserved;
+};
+
+// Pointers to the streams of one mesh. They point into the mapping (or the
+// in-memory image) of the MeshCache that produced them.
+struct MeshData
+{
+	const glm::vec3 * vertices;
+	const glm::vec3 * normals;
+	const glm::vec2 * uvs;
+	const void * indices;
+	unsigned int vertexCount;
+	unsigned int indexCount;    // all detail levels
+	unsigned int indexSize;
+	const MeshLod * lods;       // NULL when indices is a single level
+	unsigned int lodCount;
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+};
+
+struct MeshCache
+{
+	MeshData mesh;
+	MappedFile file;
+	std::vector<char> memory;   // used when the cache could not be written
+};
+
+// Writes an indexed mesh as a cache file. Indices are stored as 16-bit
+// when every vertex can be addressed that way.
+bool writeMeshCache(
+	const char * path,
+	const std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	const std::vector<glm::vec3> & normals
+);
+
+// Maps a cache file without copying it
+bool openMeshCache(const char * path, MeshCache & cache);
+
+void closeMeshCache(MeshCache & cache);
+
+// "teapot.obj" -> "teapot.mesh"
+std::string meshCachePath(const char * objPath);
+
+// Opens the cache next to objPath when it is at least as new as the OBJ
+// and was built with the same lodLevels. Otherwise the OBJ is parsed, run
+// through optimizeMesh, simplified into up to lodLevels detail levels
+// (1 = full mesh only) and the cache is (re)written for next time.
+bool loadMeshCached(const char * objPath, MeshCache & cache, unsigned int lodLevels = 1);
+
+// Offline conversion, used by the --convert command-line mode
+bool convertOBJToMeshCache(const char * objPath, const char * cachePath, unsigned int lodLevels = 1);
+
+// Detail level of a mesh; meshes without a LOD table have only level 0
+MeshLod meshLod(const MeshData & mesh, unsigned int level);
+
+#endif
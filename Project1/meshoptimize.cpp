@@ -0,0 +1,387 @@
+#include <algorithm>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "meshoptimize.h"
+
+static const unsigned int INVALID = 0xFFFFFFFFu;
+
+//------------------------------------------------------------
+// Cache models
+//------------------------------------------------------------
+
+static VertexCacheStats makeStats(unsigned int misses, size_t indexCount, const std::vector<unsigned int> & indices, size_t vertexCount)
+{
+    // ATVR counts only vertices the index buffer actually uses
+    std::vector<bool> used(vertexCount, false);
+    size_t usedCount = 0;
+    for (size_t i = 0; i < indices.size(); i++) {
+        if (!used[indices[i]]) {
+            used[indices[i]] = true;
+            usedCount++;
+        }
+    }
+
+    VertexCacheStats stats;
+    stats.misses = misses;
+    stats.acmr = indexCount ? (float)misses / (indexCount / 3) : 0.0f;
+    stats.atvr = usedCount ? (float)misses / usedCount : 0.0f;
+    return stats;
+}
+
+VertexCacheStats analyzeVertexCacheFIFO(const std::vector<unsigned int> & indices, size_t vertexCount, unsigned int cacheSize)
+{
+    // A vertex is in the FIFO when fewer than cacheSize misses happened since it entered
+    std::vector<unsigned int> entered(vertexCount, 0);
+    unsigned int misses = 0;
+
+    for (size_t i = 0; i < indices.size(); i++) {
+        unsigned int v = indices[i];
+        if (entered[v] == 0 || misses + 1 - entered[v] >= cacheSize + 1) {
+            misses++;
+            entered[v] = misses;
+        }
+    }
+
+    return makeStats(misses, indices.size(), indices, vertexCount);
+}
+
+VertexCacheStats analyzeVertexCacheLRU(const std::vector<unsigned int> & indices, size_t vertexCount, unsigned int cacheSize)
+{
+    std::vector<unsigned int> cache;
+    cache.reserve(cacheSize + 1);
+    unsigned int misses = 0;
+
+    for (size_t i = 0; i < indices.size(); i++) {
+        unsigned int v = indices[i];
+        std::vector<unsigned int>::iterator it = std::find(cache.begin(), cache.end(), v);
+        if (it == cache.end()) {
+            misses++;
+            cache.insert(cache.begin(), v);
+            if (cache.size() > cacheSize)
+                cache.pop_back();
+        }
+        else {
+            // Move to front
+            std::rotate(cache.begin(), it, it + 1);
+        }
+    }
+
+    return makeStats(misses, indices.size(), indices, vertexCount);
+}
+
+
+//------------------------------------------------------------
+// Tipsify
+//------------------------------------------------------------
+
+// Triangle lists per vertex
+struct Adjacency
+{
+    std::vector<unsigned int> counts;
+    std::vector<unsigned int> offsets;
+    std::vector<unsigned int> triangles;
+};
+
+static void buildAdjacency(const std::vector<unsigned int> & indices, size_t vertexCount, Adjacency & adjacency)
+{
+    size_t faceCount = indices.size() / 3;
+
+    adjacency.counts.assign(vertexCount, 0);
+    for (size_t i = 0; i < faceCount * 3; i++)
+        adjacency.counts[indices[i]]++;
+
+    adjacency.offsets.assign(vertexCount, 0);
+    unsigned int offset = 0;
+    for (size_t v = 0; v < vertexCount; v++) {
+        adjacency.offsets[v] = offset;
+        offset += adjacency.counts[v];
+    }
+
+    adjacency.triangles.assign(offset, 0);
+    std::vector<unsigned int> fill(adjacency.offsets);
+    for (size_t t = 0; t < faceCount; t++)
+        for (int k = 0; k < 3; k++)
+            adjacency.triangles[fill[indices[t * 3 + k]]++] = (unsigned int)t;
+}
+
+static unsigned int skipDeadEnd(const std::vector<unsigned int> & live, std::vector<unsigned int> & deadEnd, unsigned int & cursor, size_t vertexCount)
+{
+    // Most recently referenced vertices first
+    while (!deadEnd.empty()) {
+        unsigned int v = deadEnd.back();
+        deadEnd.pop_back();
+        if (live[v] > 0)
+            return v;
+    }
+
+    // Then the next vertex in input order that still has triangles
+    while (cursor < vertexCount) {
+        if (live[cursor] > 0)
+            return cursor;
+        cursor++;
+    }
+
+    return INVALID;
+}
+
+void optimizeVertexCache(std::vector<unsigned int> & indices, size_t vertexCount, unsigned int cacheSize)
+{
+    size_t faceCount = indices.size() / 3;
+    if (faceCount == 0)
+        return;
+
+    Adjacency adjacency;
+    buildAdjacency(indices, vertexCount, adjacency);
+
+    std::vector<unsigned int> live(adjacency.counts);
+    std::vector<unsigned int> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(faceCount, false);
+    std::vector<unsigned int> deadEnd;
+    std::vector<unsigned int> candidates;
+    std::vector<unsigned int> result;
+    result.reserve(faceCount * 3);
+
+    unsigned int timestamp = cacheSize + 1;
+    unsigned int cursor = 0;
+    unsigned int fan = indices[0];
+
+    while (fan != INVALID) {
+        candidates.clear();
+
+        // Emit every remaining triangle around the fanning vertex
+        const unsigned int * neighbours = &adjacency.triangles[adjacency.offsets[fan]];
+        for (unsigned int n = 0; n < adjacency.counts[fan]; n++) {
+            unsigned int t = neighbours[n];
+            if (emitted[t])
+                continue;
+
+            for (int k = 0; k < 3; k++) {
+                unsigned int v = indices[t * 3 + k];
+                result.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (timestamp - cacheTime[v] > cacheSize)
+                    cacheTime[v] = timestamp++;
+            }
+            emitted[t] = true;
+        }
+
+        // Next fan: the candidate that is still in cache and will stay there
+        // longest while its remaining triangles are emitted
+        unsigned int best = INVALID;
+        int bestPriority = -1;
+        for (size_t c = 0; c < candidates.size(); c++) {
+            unsigned int v = candidates[c];
+            if (live[v] == 0)
+                continue;
+
+            int priority = 0;
+            if (timestamp - cacheTime[v] + 2 * live[v] <= cacheSize)
+                priority = timestamp - cacheTime[v];
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                best = v;
+            }
+        }
+
+        fan = best != INVALID ? best : skipDeadEnd(live, deadEnd, cursor, vertexCount);
+    }
+
+    indices.swap(result);
+}
+
+
+//------------------------------------------------------------
+// Overdraw
+//------------------------------------------------------------
+
+// Splits the index buffer where the FIFO cache starts over (all three
+// vertices of a triangle miss); no reordering can cross such a point
+// without costing extra transforms.
+static void hardBoundaries(const std::vector<unsigned int> & indices, size_t vertexCount, unsigned int cacheSize, std::vector<unsigned int> & clusters)
+{
+    std::vector<unsigned int> entered(vertexCount, 0);
+    unsigned int misses = 0;
+    size_t faceCount = indices.size() / 3;
+
+    clusters.clear();
+    for (size_t t = 0; t < faceCount; t++) {
+        unsigned int triangleMisses = 0;
+        for (int k = 0; k < 3; k++) {
+            unsigned int v = indices[t * 3 + k];
+            if (entered[v] == 0 || misses + 1 - entered[v] >= cacheSize + 1) {
+                misses++;
+                triangleMisses++;
+                entered[v] = misses;
+            }
+        }
+        if (t == 0 || triangleMisses == 3)
+            clusters.push_back((unsigned int)t);
+    }
+}
+
+// Splits hard clusters further. Every piece is simulated with a cold
+// cache, since after sorting it may follow any other piece; a piece ends
+// once its ACMR is within threshold of the whole cluster's.
+static void softBoundaries(const std::vector<unsigned int> & indices, size_t vertexCount, const std::vector<unsigned int> & hard,
+    float threshold, unsigned int cacheSize, std::vector<unsigned int> & clusters)
+{
+    size_t faceCount = indices.size() / 3;
+
+    // Vertices that entered before 'flushed' count as evicted, so
+    // starting a cold cache is O(1)
+    std::vector<unsigned int> entered(vertexCount, 0);
+    unsigned int misses = 0, flushed = 0;
+
+    clusters.clear();
+    for (size_t c = 0; c < hard.size(); c++) {
+        unsigned int start = hard[c];
+        unsigned int end = c + 1 < hard.size() ? hard[c + 1] : (unsigned int)faceCount;
+
+        // ACMR of the whole hard cluster
+        flushed = misses;
+        unsigned int clusterMisses = 0;
+        for (unsigned int t = start; t < end; t++) {
+            for (int k = 0; k < 3; k++) {
+                unsigned int v = indices[t * 3 + k];
+                if (entered[v] <= flushed || misses - entered[v] >= cacheSize) {
+                    entered[v] = ++misses;
+                    clusterMisses++;
+                }
+            }
+        }
+        float target = threshold * clusterMisses / (end - start);
+
+        clusters.push_back(start);
+        flushed = misses;
+        unsigned int runMisses = 0, runStart = start;
+        for (unsigned int t = start; t < end; t++) {
+            for (int k = 0; k < 3; k++) {
+                unsigned int v = indices[t * 3 + k];
+                if (entered[v] <= flushed || misses - entered[v] >= cacheSize) {
+                    entered[v] = ++misses;
+                    runMisses++;
+                }
+            }
+            unsigned int runLength = t + 1 - runStart;
+            if (t + 1 < end && (float)runMisses / runLength <= target) {
+                clusters.push_back(t + 1);
+                runStart = t + 1;
+                runMisses = 0;
+                flushed = misses;
+            }
+        }
+    }
+}
+
+void optimizeOverdraw(std::vector<unsigned int> & indices, const std::vector<glm::vec3> & vertices, float threshold, unsigned int cacheSize)
+{
+    size_t faceCount = indices.size() / 3;
+    if (faceCount == 0)
+        return;
+
+    std::vector<unsigned int> hard, clusters;
+    hardBoundaries(indices, vertices.size(), cacheSize, hard);
+    softBoundaries(indices, vertices.size(), hard, threshold, cacheSize, clusters);
+
+    // Area weighted centroid of the mesh
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (size_t t = 0; t < faceCount; t++) {
+        const glm::vec3 & p0 = vertices[indices[t * 3]];
+        const glm::vec3 & p1 = vertices[indices[t * 3 + 1]];
+        const glm::vec3 & p2 = vertices[indices[t * 3 + 2]];
+        float area = glm::length(glm::cross(p1 - p0, p2 - p0));
+        meshCentroid += (p0 + p1 + p2) * (area / 3.0f);
+        meshArea += area;
+    }
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    // Clusters that face away from the centre are likely to occlude the rest
+    std::vector<std::pair<float, unsigned int> > order(clusters.size());
+    for (size_t c = 0; c < clusters.size(); c++) {
+        unsigned int start = clusters[c];
+        unsigned int end = c + 1 < clusters.size() ? clusters[c + 1] : (unsigned int)faceCount;
+
+        glm::vec3 centroid(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (unsigned int t = start; t < end; t++) {
+            const glm::vec3 & p0 = vertices[indices[t * 3]];
+            const glm::vec3 & p1 = vertices[indices[t * 3 + 1]];
+            const glm::vec3 & p2 = vertices[indices[t * 3 + 2]];
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float triangleArea = glm::length(n);
+            centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+            normal += n;
+            area += triangleArea;
+        }
+        if (area > 0.0f)
+            centroid /= area;
+        float normalLength = glm::length(normal);
+        if (normalLength > 0.0f)
+            normal /= normalLength;
+
+        order[c] = std::make_pair(-glm::dot(centroid - meshCentroid, normal), (unsigned int)c);
+    }
+    // Ties keep their original order, so the result is deterministic
+    std::stable_sort(order.begin(), order.end());
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        unsigned int c = order[i].second;
+        unsigned int start = clusters[c];
+        unsigned int end = c + 1 < clusters.size() ? clusters[c + 1] : (unsigned int)faceCount;
+        result.insert(result.end(), indices.begin() + start * 3, indices.begin() + end * 3);
+    }
+    indices.swap(result);
+}
+
+
+//------------------------------------------------------------
+// Vertex fetch
+//------------------------------------------------------------
+
+void optimizeVertexFetch(
+    std::vector<unsigned int> & indices,
+    std::vector<glm::vec3> & vertices,
+    std::vector<glm::vec2> & uvs,
+    std::vector<glm::vec3> & normals)
+{
+    std::vector<unsigned int> remap(vertices.size(), INVALID);
+    std::vector<glm::vec3> newVertices, newNormals;
+    std::vector<glm::vec2> newUvs;
+    newVertices.reserve(vertices.size());
+    newNormals.reserve(vertices.size());
+    newUvs.reserve(vertices.size());
+
+    for (size_t i = 0; i < indices.size(); i++) {
+        unsigned int v = indices[i];
+        if (remap[v] == INVALID) {
+            remap[v] = (unsigned int)newVertices.size();
+            newVertices.push_back(vertices[v]);
+            newUvs.push_back(uvs[v]);
+            newNormals.push_back(normals[v]);
+        }
+        indices[i] = remap[v];
+    }
+
+    vertices.swap(newVertices);
+    uvs.swap(newUvs);
+    normals.swap(newNormals);
+}
+
+void optimizeMesh(
+    std::vector<unsigned int> & indices,
+    std::vector<glm::vec3> & vertices,
+    std::vector<glm::vec2> & uvs,
+    std::vector<glm::vec3> & normals)
+{
+    optimizeVertexCache(indices, vertices.size());
+    optimizeOverdraw(indices, vertices);
+    optimizeVertexFetch(indices, vertices, uvs, normals);
+}
@@ -0,0 +1,50 @@
+#ifndef MESHOPTIMIZE_H
+#define MESHOPTIMIZE_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Post-load mesh optimization for indexed triangle lists.
+// Every pass is deterministic and runs on the CPU only.
+
+#define VERTEX_CACHE_SIZE 16
+
+struct VertexCacheStats
+{
+	unsigned int misses;
+	float acmr;     // average cache miss ratio: misses per triangle (0.5 - 3.0)
+	float atvr;     // average transform to vertex ratio: misses per vertex (1.0 is optimal)
+};
+
+// Simulates a post-transform cache with FIFO replacement, as found on most GPUs
+VertexCacheStats analyzeVertexCacheFIFO(const std::vector<unsigned int> & indices, size_t vertexCount, unsigned int cacheSize = VERTEX_CACHE_SIZE);
+
+// Same, with LRU replacement
+VertexCacheStats analyzeVertexCacheLRU(const std::vector<unsigned int> & indices, size_t vertexCount, unsigned int cacheSize = VERTEX_CACHE_SIZE);
+
+// Reorders triangles for the post-transform vertex cache (Tipsify,
+// Sander et al. 2007)
+void optimizeVertexCache(std::vector<unsigned int> & indices, size_t vertexCount, unsigned int cacheSize = VERTEX_CACHE_SIZE);
+
+// Reorders clusters of a cache-optimized index buffer so outward facing
+// clusters come first. threshold bounds how much ACMR may degrade (1.05 = 5%).
+void optimizeOverdraw(std::vector<unsigned int> & indices, const std::vector<glm::vec3> & vertices, float threshold = 1.05f, unsigned int cacheSize = VERTEX_CACHE_SIZE);
+
+// Reorders vertices in order of first use and drops unreferenced ones
+void optimizeVertexFetch(
+	std::vector<unsigned int> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals
+);
+
+// All three passes, in the order they should run
+void optimizeMesh(
+	std::vector<unsigned int> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals
+);
+
+#endif
@@ -0,0 +1,602 @@
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "meshoptimize.h"
+#include "meshsimplify.h"
+
+// Border and seam edges get an extra plane perpendicular to the surface,
+// weighted this much more than the faces, so they keep their shape
+static const double EDGE_WEIGHT = 10.0;
+
+// A collapse may not turn a triangle further than this (cosine of the
+// angle between the old and new normal)
+static const double MIN_NORMAL_COS = 0.25;
+
+// Levels that remove less than this fraction of the previous level's
+// triangles are not worth storing
+static const float MIN_LOD_REDUCTION = 0.1f;
+
+enum VertexKind
+{
+    KIND_MANIFOLD,  // interior vertex, may collapse onto any neighbour
+    KIND_BORDER,    // on an open border, collapses along it
+    KIND_SEAM,      // one of two vertices on an attribute seam, collapses along it
+    KIND_LOCKED     // corner of borders or seams, never moves
+};
+
+//------------------------------------------------------------
+// Quadric of squared distances to a set of weighted planes
+//------------------------------------------------------------
+
+struct Quadric
+{
+    double a00, a11, a22, a10, a20, a21;
+    double b0, b1, b2;
+    double c;
+    double w;
+};
+
+static void quadricAddPlane(Quadric & q, const glm::dvec3 & n, double d, double w)
+{
+    q.a00 += w * n.x * n.x;
+    q.a11 += w * n.y * n.y;
+    q.a22 += w * n.z * n.z;
+    q.a10 += w * n.y * n.x;
+    q.a20 += w * n.z * n.x;
+    q.a21 += w * n.z * n.y;
+    q.b0 += w * n.x * d;
+    q.b1 += w * n.y * d;
+    q.b2 += w * n.z * d;
+    q.c += w * d * d;
+    q.w += w;
+}
+
+static void quadricAdd(Quadric & q, const Quadric & r)
+{
+    q.a00 += r.a00; q.a11 += r.a11; q.a22 += r.a22;
+    q.a10 += r.a10; q.a20 += r.a20; q.a21 += r.a21;
+    q.b0 += r.b0; q.b1 += r.b1; q.b2 += r.b2;
+    q.c += r.c;
+    q.w += r.w;
+}
+
+// Weighted mean squared distance of p to the planes
+static double quadricError(const Quadric & q, const glm::dvec3 & p)
+{
+    double rx = q.a00 * p.x + q.a10 * p.y + q.a20 * p.z + 2.0 * q.b0;
+    double ry = q.a10 * p.x + q.a11 * p.y + q.a21 * p.z + 2.0 * q.b1;
+    double rz = q.a20 * p.x + q.a21 * p.y + q.a22 * p.z + 2.0 * q.b2;
+    double e = rx * p.x + ry * p.y + rz * p.z + q.c;
+    return q.w > 0.0 ? fabs(e) / q.w : 0.0;
+}
+
+static inline unsigned long long edgeKey(unsigned int a, unsigned int b)
+{
+    return (unsigned long long)a << 32 | b;
+}
+
+//------------------------------------------------------------
+// Mesh topology: vertices sharing a position form a ring of
+// wedges, every position has one representative vertex
+//------------------------------------------------------------
+
+struct Topology
+{
+    std::vector<unsigned int> position;     // representative vertex per vertex
+    std::vector<unsigned int> nextWedge;    // ring of vertices at the same position
+    std::vector<unsigned char> kind;
+    std::vector<unsigned char> used;        // still referenced by a triangle
+    std::unordered_set<unsigned long long> edges;          // directed vertex edges
+    std::unordered_set<unsigned long long> positionEdges;  // directed position edges
+    std::vector<glm::dvec3> normal;         // area weighted input normal per position
+};
+
+static void buildPositionRings(const std::vector<glm::vec3> & vertices, Topology & topology)
+{
+    size_t vertexCount = vertices.size();
+    topology.position.resize(vertexCount);
+    topology.nextWedge.resize(vertexCount);
+
+    struct PositionHash
+    {
+        size_t operator()(const glm::vec3 & v) const
+        {
+            unsigned int h[3];
+            memcpy(h, &v, sizeof(h));
+            return (h[0] * 73856093u) ^ (h[1] * 19349663u) ^ (h[2] * 83492791u);
+        }
+    };
+    struct PositionEqual
+    {
+        bool operator()(const glm::vec3 & a, const glm::vec3 & b) const
+        {
+            return memcmp(&a, &b, sizeof(glm::vec3)) == 0;
+        }
+    };
+    std::unordered_map<glm::vec3, unsigned int, PositionHash, PositionEqual> first;
+    first.reserve(vertexCount);
+
+    for (unsigned int i = 0; i < vertexCount; i++) {
+        std::pair<std::unordered_map<glm::vec3, unsigned int, PositionHash, PositionEqual>::iterator, bool> it
+            = first.insert(std::make_pair(vertices[i], i));
+        unsigned int p = it.first->second;
+        topology.position[i] = p;
+        if (p == i) {
+            topology.nextWedge[i] = i;
+        }
+        else {
+            topology.nextWedge[i] = topology.nextWedge[p];
+            topology.nextWedge[p] = i;
+        }
+    }
+}
+
+// Normals of the input surface; collapses are checked against these rather
+// than only the current triangles, which would let small turns add up
+static void buildPositionNormals(const std::vector<unsigned int> & indices, const std::vector<glm::vec3> & vertices,
+    Topology & topology)
+{
+    topology.normal.assign(vertices.size(), glm::dvec3(0.0));
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        glm::dvec3 a(vertices[indices[i]]), b(vertices[indices[i + 1]]), c(vertices[indices[i + 2]]);
+        glm::dvec3 normal = glm::cross(b - a, c - a);
+        for (int k = 0; k < 3; k++)
+            topology.normal[topology.position[indices[i + k]]] += normal;
+    }
+}
+
+// Classifies vertices by the edges of the current triangles
+static void classifyVertices(const std::vector<unsigned int> & indices, Topology & topology)
+{
+    size_t vertexCount = topology.position.size();
+    topology.edges.clear();
+    topology.positionEdges.clear();
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        for (int e = 0; e < 3; e++) {
+            unsigned int a = indices[i + e], b = indices[i + (e + 1) % 3];
+            topology.edges.insert(edgeKey(a, b));
+            topology.positionEdges.insert(edgeKey(topology.position[a], topology.position[b]));
+        }
+    }
+
+    // Open (border) and seam edges leaving and entering every vertex
+    std::vector<unsigned char> borderOut(vertexCount, 0), borderIn(vertexCount, 0);
+    std::vector<unsigned char> seamOut(vertexCount, 0), seamIn(vertexCount, 0);
+    std::vector<unsigned char> & used = topology.used;
+    used.assign(vertexCount, 0);
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        for (int e = 0; e < 3; e++) {
+            unsigned int a = indices[i + e], b = indices[i + (e + 1) % 3];
+            used[a] = 1;
+            if (topology.positionEdges.count(edgeKey(topology.position[b], topology.position[a])) == 0) {
+                borderOut[a] = (unsigned char)std::min(borderOut[a] + 1, 255);
+                borderIn[b] = (unsigned char)std::min(borderIn[b] + 1, 255);
+            }
+            else if (topology.edges.count(edgeKey(b, a)) == 0) {
+                seamOut[a] = (unsigned char)std::min(seamOut[a] + 1, 255);
+                seamIn[b] = (unsigned char)std::min(seamIn[b] + 1, 255);
+            }
+        }
+    }
+
+    topology.kind.assign(vertexCount, KIND_LOCKED);
+    for (unsigned int v = 0; v < vertexCount; v++) {
+        if (!used[v])
+            continue;
+
+        // Count the wedges still referenced by triangles
+        unsigned int wedges = 0, w = v;
+        bool border = false;
+        do {
+            if (used[w])
+                wedges++;
+            border = border || borderOut[w] || borderIn[w];
+            w = topology.nextWedge[w];
+        } while (w != v);
+
+        if (wedges == 1 && !border && !seamOut[v] && !seamIn[v])
+            topology.kind[v] = KIND_MANIFOLD;
+        else if (wedges == 1 && borderOut[v] == 1 && borderIn[v] == 1 && !seamOut[v] && !seamIn[v])
+            topology.kind[v] = KIND_BORDER;
+        else if (wedges == 2 && !border && seamOut[v] == 1 && seamIn[v] == 1)
+            topology.kind[v] = KIND_SEAM;
+    }
+}
+
+//------------------------------------------------------------
+// Face quadrics plus perpendicular planes along border and
+// seam edges, one quadric per position
+//------------------------------------------------------------
+
+static void buildQuadrics(const std::vector<unsigned int> & indices, const std::vector<glm::vec3> & vertices,
+    const Topology & topology, std::vector<Quadric> & quadrics)
+{
+    quadrics.assign(vertices.size(), Quadric());
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        glm::dvec3 p[3];
+        for (int k = 0; k < 3; k++)
+            p[k] = glm::dvec3(vertices[indices[i + k]]);
+
+        glm::dvec3 normal = glm::cross(p[1] - p[0], p[2] - p[0]);
+        double area2 = glm::length(normal);
+        if (area2 == 0.0)
+            continue;
+        normal /= area2;
+
+        Quadric face = Quadric();
+        quadricAddPlane(face, normal, -glm::dot(normal, p[0]), area2 * 0.5);
+        for (int k = 0; k < 3; k++)
+            quadricAdd(quadrics[topology.position[indices[i + k]]], face);
+
+        for (int e = 0; e < 3; e++) {
+            unsigned int a = indices[i + e], b = indices[i + (e + 1) % 3];
+            bool border = topology.positionEdges.count(edgeKey(topology.position[b], topology.position[a])) == 0;
+            bool seam = !border && topology.edges.count(edgeKey(b, a)) == 0;
+            if (!border && !seam)
+                continue;
+
+            glm::dvec3 edge = p[(e + 1) % 3] - p[e];
+            double length2 = glm::dot(edge, edge);
+            if (length2 == 0.0)
+                continue;
+            glm::dvec3 side = glm::normalize(glm::cross(edge, normal));
+            Quadric q = Quadric();
+            quadricAddPlane(q, side, -glm::dot(side, p[e]), EDGE_WEIGHT * length2);
+            quadricAdd(quadrics[topology.position[a]], q);
+            quadricAdd(quadrics[topology.position[b]], q);
+        }
+    }
+}
+
+//------------------------------------------------------------
+// Collapse candidates
+//------------------------------------------------------------
+
+struct Collapse
+{
+    unsigned int v;         // vertex that goes away
+    unsigned int t;         // vertex it is merged into
+    unsigned int v2, t2;    // the other side of a seam, or v2 == t2 == INVALID
+    double cost;
+};
+
+static const unsigned int INVALID = 0xFFFFFFFFu;
+
+static bool hasEdge(const Topology & topology, unsigned int a, unsigned int b)
+{
+    return topology.edges.count(edgeKey(a, b)) || topology.edges.count(edgeKey(b, a));
+}
+
+static bool isBorderEdge(const Topology & topology, unsigned int a, unsigned int b)
+{
+    unsigned int pa = topology.position[a], pb = topology.position[b];
+    return topology.positionEdges.count(edgeKey(pa, pb)) != topology.positionEdges.count(edgeKey(pb, pa));
+}
+
+static bool isSeamEdge(const Topology & topology, unsigned int a, unsigned int b)
+{
+    return !isBorderEdge(topology, a, b) && topology.edges.count(edgeKey(a, b)) != topology.edges.count(edgeKey(b, a));
+}
+
+// Fills in the collapse of v onto t, false when the vertex kinds forbid it
+static bool buildCollapse(const Topology & topology, unsigned int v, unsigned int t, Collapse & collapse)
+{
+    collapse.v = v;
+    collapse.t = t;
+    collapse.v2 = collapse.t2 = INVALID;
+
+    switch (topology.kind[v]) {
+    case KIND_MANIFOLD:
+        return true;
+    case KIND_BORDER:
+        return isBorderEdge(topology, v, t);
+    case KIND_SEAM:
+    {
+        if (!isSeamEdge(topology, v, t))
+            return false;
+        // The other wedge of v has to follow the seam to a wedge of t
+        unsigned int w = topology.nextWedge[v];
+        while (!topology.used[w])
+            w = topology.nextWedge[w];
+        if (topology.kind[w] != KIND_SEAM)
+            return false;
+        for (unsigned int u = topology.nextWedge[t]; u != t; u = topology.nextWedge[u]) {
+            if (hasEdge(topology, w, u) && isSeamEdge(topology, w, u)) {
+                collapse.v2 = w;
+                collapse.t2 = u;
+                return true;
+            }
+        }
+        return false;
+    }
+    default:
+        return false;
+    }
+}
+
+//------------------------------------------------------------
+// Triangles around every position, rebuilt every pass
+//------------------------------------------------------------
+
+struct Adjacency
+{
+    std::vector<unsigned int> offsets;
+    std::vector<unsigned int> triangles;
+};
+
+static void buildAdjacency(const std::vector<unsigned int> & indices, const Topology & topology, Adjacency & adjacency)
+{
+    size_t vertexCount = topology.position.size();
+    adjacency.offsets.assign(vertexCount + 1, 0);
+    for (size_t i = 0; i < indices.size(); i++)
+        adjacency.offsets[topology.position[indices[i]] + 1]++;
+    for (size_t i = 0; i < vertexCount; i++)
+        adjacency.offsets[i + 1] += adjacency.offsets[i];
+
+    adjacency.triangles.resize(indices.size());
+    std::vector<unsigned int> fill(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++)
+        adjacency.triangles[fill[topology.position[indices[i]]]++] = (unsigned int)(i / 3);
+}
+
+// True when moving position p of v onto target keeps all surrounding
+// triangles facing the same way, both compared to before the collapse and
+// to the input surface at their corners
+static bool collapseKeepsOrientation(const std::vector<unsigned int> & indices, const std::vector<glm::vec3> & vertices,
+    const Topology & topology, const Adjacency & adjacency, unsigned int v, unsigned int t)
+{
+    unsigned int pv = topology.position[v], pt = topology.position[t];
+    glm::dvec3 target(vertices[t]);
+
+    for (unsigned int k = adjacency.offsets[pv]; k < adjacency.offsets[pv + 1]; k++) {
+        const unsigned int * tri = &indices[adjacency.triangles[k] * 3];
+        unsigned int p0 = topology.position[tri[0]], p1 = topology.position[tri[1]], p2 = topology.position[tri[2]];
+        // Triangles on the collapsed edge disappear
+        if (p0 == pt || p1 == pt || p2 == pt)
+            continue;
+
+        glm::dvec3 a(vertices[tri[0]]), b(vertices[tri[1]]), c(vertices[tri[2]]);
+        glm::dvec3 before = glm::cross(b - a, c - a);
+        if (p0 == pv) a = target;
+        if (p1 == pv) b = target;
+        if (p2 == pv) c = target;
+        glm::dvec3 after = glm::cross(b - a, c - a);
+
+        double lengths = glm::length(before) * glm::length(after);
+        if (lengths == 0.0 || glm::dot(before, after) < MIN_NORMAL_COS * lengths)
+            return false;
+
+        for (int j = 0; j < 3; j++) {
+            unsigned int p = topology.position[tri[j]] == pv ? pt : topology.position[tri[j]];
+            const glm::dvec3 & normal = topology.normal[p];
+            if (glm::dot(after, normal) <= 0.0 && glm::dot(before, normal) > 0.0)
+                return false;
+        }
+    }
+    return true;
+}
+
+// Link condition: positions next to both ends of the edge may only be the
+// third corners of the triangles on it, anything else would fold the
+// surface onto itself
+static bool collapseKeepsManifold(const std::vector<unsigned int> & indices, const Topology & topology,
+    const Adjacency & adjacency, unsigned int pv, unsigned int pt)
+{
+    std::vector<unsigned int> aroundV, opposite;
+    for (unsigned int k = adjacency.offsets[pv]; k < adjacency.offsets[pv + 1]; k++) {
+        const unsigned int * tri = &indices[adjacency.triangles[k] * 3];
+        bool onEdge = false;
+        for (int j = 0; j < 3; j++)
+            onEdge = onEdge || topology.position[tri[j]] == pt;
+        for (int j = 0; j < 3; j++) {
+            unsigned int p = topology.position[tri[j]];
+            if (p == pv || p == pt)
+                continue;
+            aroundV.push_back(p);
+            if (onEdge)
+                opposite.push_back(p);
+        }
+    }
+    std::sort(aroundV.begin(), aroundV.end());
+    std::sort(opposite.begin(), opposite.end());
+
+    for (unsigned int k = adjacency.offsets[pt]; k < adjacency.offsets[pt + 1]; k++) {
+        const unsigned int * tri = &indices[adjacency.triangles[k] * 3];
+        for (int j = 0; j < 3; j++) {
+            unsigned int p = topology.position[tri[j]];
+            if (p != pv && p != pt && std::binary_search(aroundV.begin(), aroundV.end(), p)
+                && !std::binary_search(opposite.begin(), opposite.end(), p))
+                return false;
+        }
+    }
+    return true;
+}
+
+//------------------------------------------------------------
+// One pass: picks cheap, non-overlapping collapses, applies
+// them and removes the degenerate triangles
+//------------------------------------------------------------
+
+static size_t simplifyPass(std::vector<unsigned int> & indices, const std::vector<glm::vec3> & vertices,
+    Topology & topology, std::vector<Quadric> & quadrics, size_t targetIndexCount, double maxCost, double & reached)
+{
+    classifyVertices(indices, topology);
+    Adjacency adjacency;
+    buildAdjacency(indices, topology, adjacency);
+
+    // Every edge once, in its cheaper allowed direction
+    std::vector<Collapse> collapses;
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        for (int e = 0; e < 3; e++) {
+            unsigned int a = indices[i + e], b = indices[i + (e + 1) % 3];
+            unsigned int pa = topology.position[a], pb = topology.position[b];
+            if (pa == pb)
+                continue;
+            if (pa > pb && topology.positionEdges.count(edgeKey(pb, pa)))
+                continue;
+
+            Collapse ab, ba;
+            bool canAB = buildCollapse(topology, a, b, ab);
+            bool canBA = buildCollapse(topology, b, a, ba);
+            // Both sides of a seam end up at the same position, one cost covers them
+            if (canAB)
+                ab.cost = quadricError(quadrics[pa], glm::dvec3(vertices[b]));
+            if (canBA)
+                ba.cost = quadricError(quadrics[pb], glm::dvec3(vertices[a]));
+            if (canAB && (!canBA || ab.cost <= ba.cost))
+                collapses.push_back(ab);
+            else if (canBA)
+                collapses.push_back(ba);
+        }
+    }
+
+    std::sort(collapses.begin(), collapses.end(),
+        [](const Collapse & x, const Collapse & y) { return x.cost < y.cost; });
+
+    // Every collapse removes about two triangles; stop once enough are gone
+    size_t triangles = indices.size() / 3;
+    size_t targetTriangles = targetIndexCount / 3;
+    size_t removed = 0;
+
+    std::vector<unsigned int> remap(vertices.size());
+    for (size_t i = 0; i < remap.size(); i++)
+        remap[i] = (unsigned int)i;
+    std::vector<unsigned char> locked(vertices.size(), 0);
+
+    size_t applied = 0;
+    for (size_t c = 0; c < collapses.size() && triangles - removed > targetTriangles; c++) {
+        const Collapse & collapse = collapses[c];
+        if (collapse.cost > maxCost)
+            break;
+
+        unsigned int pv = topology.position[collapse.v], pt = topology.position[collapse.t];
+        if (locked[pv] || locked[pt])
+            continue;
+        if (!collapseKeepsManifold(indices, topology, adjacency, pv, pt)
+            || !collapseKeepsOrientation(indices, vertices, topology, adjacency, collapse.v, collapse.t))
+            continue;
+
+        remap[collapse.v] = collapse.t;
+        if (collapse.v2 != INVALID)
+            remap[collapse.v2] = collapse.t2;
+        quadricAdd(quadrics[pt], quadrics[pv]);
+        reached = std::max(reached, collapse.cost);
+        applied++;
+
+        // Neighbourhood of v changes shape; nothing in it may collapse this pass
+        for (unsigned int k = adjacency.offsets[pv]; k < adjacency.offsets[pv + 1]; k++) {
+            const unsigned int * tri = &indices[adjacency.triangles[k] * 3];
+            bool removedHere = false;
+            for (int j = 0; j < 3; j++) {
+                locked[topology.position[tri[j]]] = 1;
+                removedHere = removedHere || topology.position[tri[j]] == pt;
+            }
+            removed += removedHere;
+        }
+    }
+
+    if (applied == 0)
+        return 0;
+
+    // Apply the collapses and drop triangles that lost their area
+    size_t write = 0;
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        unsigned int a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+        unsigned int pa = topology.position[a], pb = topology.position[b], pc = topology.position[c];
+        if (pa == pb || pb == pc || pc == pa)
+            continue;
+        indices[write++] = a;
+        indices[write++] = b;
+        indices[write++] = c;
+    }
+    indices.resize(write);
+    return applied;
+}
+
+float simplifyMesh(
+    std::vector<unsigned int> & indices,
+    const std::vector<glm::vec3> & vertices,
+    size_t targetIndexCount,
+    float targetError)
+{
+    Topology topology;
+    buildPositionRings(vertices, topology);
+    buildPositionNormals(indices, vertices, topology);
+    classifyVertices(indices, topology);
+
+    std::vector<Quadric> quadrics;
+    buildQuadrics(indices, vertices, topology, quadrics);
+
+    double maxCost = (double)targetError * targetError;
+    double reached = 0.0;
+    while (indices.size() > targetIndexCount) {
+        if (simplifyPass(indices, vertices, topology, quadrics, targetIndexCount, maxCost, reached) == 0)
+            break;
+    }
+    return (float)sqrt(reached);
+}
+
+void generateMeshLods(
+    const std::vector<unsigned int> & indices,
+    const std::vector<glm::vec3> & vertices,
+    unsigned int levelCount,
+    float ratio,
+    float maxError,
+    std::vector<unsigned int> & lodIndices,
+    std::vector<MeshLod> & lods)
+{
+    levelCount = std::min(std::max(levelCount, 1u), (unsigned int)MESHLOD_MAX_LEVELS);
+
+    lodIndices = indices;
+    lods.clear();
+    MeshLod full;
+    memset(&full, 0, sizeof(full));
+    full.indexCount = (unsigned int)indices.size();
+    lods.push_back(full);
+
+    // Every level starts from the full mesh, so errors do not compound
+    size_t target = indices.size();
+    for (unsigned int level = 1; level < levelCount; level++) {
+        target = (size_t)(target * ratio) / 3 * 3;
+        if (target < 3)
+            break;
+
+        std::vector<unsigned int> simplified(indices);
+        float error = simplifyMesh(simplified, vertices, target, maxError);
+
+        const MeshLod & previous = lods.back();
+        if (simplified.size() > previous.indexCount * (1.0f - MIN_LOD_REDUCTION))
+            break;
+
+        optimizeVertexCache(simplified, vertices.size());
+
+        MeshLod lod;
+        memset(&lod, 0, sizeof(lod));
+        lod.indexOffset = (unsigned int)lodIndices.size();
+        lod.indexCount = (unsigned int)simplified.size();
+        lod.error = std::max(error, previous.error);
+        lods.push_back(lod);
+        lodIndices.insert(lodIndices.end(), simplified.begin(), simplified.end());
+    }
+}
+
+unsigned int selectMeshLod(const MeshLod * lods, unsigned int lodCount, float distance, float pixelsPerUnit, float thresholdPixels)
+{
+    if (lodCount == 0)
+        return 0;
+
+    distance = std::max(distance, 1e-3f);
+    unsigned int level = 0;
+    for (unsigned int i = 1; i < lodCount; i++) {
+        if (lods[i].error * pixelsPerUnit / distance > thresholdPixels)
+            break;
+        level = i;
+    }
+    return level;
+}
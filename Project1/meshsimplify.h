@@ -0,0 +1,51 @@
+#ifndef MESHSIMPLIFY_H
+#define MESHSIMPLIFY_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "meshcache.h"
+
+// Level of detail by quadric error edge collapse (Garland & Heckbert 1997).
+// Vertices are only ever collapsed onto existing vertices, so every level
+// indexes the same vertex buffer and a LOD is nothing more than another
+// index range.
+//
+// UV seams and hard edges (vertices that share a position but not their
+// attributes) only collapse along the seam, with both sides moving
+// together; open borders only collapse along the border. Corners where
+// more than two seams or borders meet never move.
+
+#define MESHLOD_MAX_LEVELS 8
+
+// Collapses edges until indices holds at most targetIndexCount entries or
+// the next collapse would move the surface more than targetError (object
+// space units). Returns the error reached.
+float simplifyMesh(
+	std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & vertices,
+	size_t targetIndexCount,
+	float targetError
+);
+
+// Builds up to levelCount levels, each with ratio times the triangles of
+// the previous one, stopping early once maxError is reached or a level no
+// longer gets meaningfully smaller. lodIndices receives every level back
+// to back, starting with the unmodified input as level 0.
+void generateMeshLods(
+	const std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & vertices,
+	unsigned int levelCount,
+	float ratio,
+	float maxError,
+	std::vector<unsigned int> & lodIndices,
+	std::vector<MeshLod> & lods
+);
+
+// Picks the coarsest level whose error, seen from distance, projects to at
+// most thresholdPixels. pixelsPerUnit is the projected size of one unit at
+// distance 1: projection[1][1] * viewport height / 2 times the object scale.
+unsigned int selectMeshLod(const MeshLod * lods, unsigned int lodCount, float distance, float pixelsPerUnit, float thresholdPixels);
+
+#endif
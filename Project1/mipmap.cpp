@@ -0,0 +1,470 @@
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define MIP_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIP_SSE2
+#endif
+
+#include "mipmap.h"
+
+using namespace std;
+
+static const double PI = 3.14159265358979323846;
+
+// Half width of the windowed sinc filters, in destination pixels
+static const double SINC_SUPPORT = 3.0;
+static const double KAISER_ALPHA = 4.0;
+
+// A 2x downsample reads source pixels 2x + offset[k]
+#define MIP_MAX_TAPS 16
+
+struct MipTaps
+{
+    int count;
+    int offset[MIP_MAX_TAPS];
+    float weight[MIP_MAX_TAPS];
+    int reach;              // largest |offset| the taps need on either side
+};
+
+
+size_t mipRowStride(unsigned int width)
+{
+    return ((size_t)width * 3 + 3) & ~(size_t)3;
+}
+
+const char* mipFilterName(MipFilter filter)
+{
+    switch (filter) {
+    case MIP_FILTER_BOX:
+        return "box";
+    case MIP_FILTER_KAISER:
+        return "kaiser";
+    default:
+        return "lanczos";
+    }
+}
+
+//------------------------------------------------------------
+// Filter kernels, t in destination pixels
+//------------------------------------------------------------
+
+static double Sinc(double x)
+{
+    if (fabs(x) < 1e-9)
+        return 1.0;
+    x *= PI;
+    return sin(x) / x;
+}
+
+// Modified Bessel function of the first kind, order 0
+static double BesselI0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 32; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12)
+            break;
+    }
+    return sum;
+}
+
+static double FilterWeight(MipFilter filter, double t)
+{
+    switch (filter) {
+    case MIP_FILTER_BOX:
+        return fabs(t) < 0.5 ? 1.0 : 0.0;
+    case MIP_FILTER_KAISER:
+    {
+        if (fabs(t) >= SINC_SUPPORT)
+            return 0.0;
+        double r = t / SINC_SUPPORT;
+        return Sinc(t) * BesselI0(KAISER_ALPHA * sqrt(1.0 - r * r)) / BesselI0(KAISER_ALPHA);
+    }
+    default:
+        if (fabs(t) >= SINC_SUPPORT)
+            return 0.0;
+        return Sinc(t) * Sinc(t / SINC_SUPPORT);
+    }
+}
+
+// Output pixel x covers source pixels 2x and 2x + 1, its center lies
+// between them; the weights are normalized so flat areas stay flat
+static void BuildTaps(MipFilter filter, MipTaps& taps)
+{
+    double support = filter == MIP_FILTER_BOX ? 0.5 : SINC_SUPPORT;
+    int reach = (int)ceil(support * 2.0);
+
+    taps.count = 0;
+    double sum = 0.0;
+    for (int o = 1 - reach; o <= reach && taps.count < MIP_MAX_TAPS; o++) {
+        double w = FilterWeight(filter, (o - 0.5) / 2.0);
+        if (w == 0.0)
+            continue;
+        taps.offset[taps.count] = o;
+        taps.weight[taps.count] = (float)w;
+        taps.count++;
+        sum += w;
+    }
+    for (int k = 0; k < taps.count; k++)
+        taps.weight[k] = (float)(taps.weight[k] / sum);
+    taps.reach = reach;
+}
+
+//------------------------------------------------------------
+// out[i] = sum over k of weights[k] * sources[k][i]. Both
+// passes come down to this; the SIMD versions add in the same
+// order as the scalar one, without fused multiply-adds.
+//------------------------------------------------------------
+
+typedef void (*WeightedSumFunc)(float* out, const float* const* sources, const float* weights, int taps, size_t count);
+
+static void WeightedSumScalar(float* out, const float* const* sources, const float* weights, int taps, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        float sum = 0.0f;
+        for (int k = 0; k < taps; k++)
+            sum += weights[k] * sources[k][i];
+        out[i] = sum;
+    }
+}
+
+#if defined(MIP_AVX)
+
+static void WeightedSumSimd(float* out, const float* const* sources, const float* weights, int taps, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 sum = _mm256_setzero_ps();
+        for (int k = 0; k < taps; k++)
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(weights[k]), _mm256_loadu_ps(sources[k] + i)));
+        _mm256_storeu_ps(out + i, sum);
+    }
+    for (; i < count; i++) {
+        float sum = 0.0f;
+        for (int k = 0; k < taps; k++)
+            sum += weights[k] * sources[k][i];
+        out[i] = sum;
+    }
+}
+
+#elif defined(MIP_SSE2)
+
+static void WeightedSumSimd(float* out, const float* const* sources, const float* weights, int taps, size_t count)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 sum = _mm_setzero_ps();
+        for (int k = 0; k < taps; k++)
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(sources[k] + i)));
+        _mm_storeu_ps(out + i, sum);
+    }
+    for (; i < count; i++) {
+        float sum = 0.0f;
+        for (int k = 0; k < taps; k++)
+            sum += weights[k] * sources[k][i];
+        out[i] = sum;
+    }
+}
+
+#else
+
+static void WeightedSumSimd(float* out, const float* const* sources, const float* weights, int taps, size_t count)
+{
+    WeightedSumScalar(out, sources, weights, taps, count);
+}
+
+#endif
+
+//------------------------------------------------------------
+// even[i] = row[2i], odd[i] = row[2i + 1] for count pairs
+//------------------------------------------------------------
+
+typedef void (*DeinterleaveFunc)(const float* row, float* even, float* odd, size_t count);
+
+static void DeinterleaveScalar(const float* row, float* even, float* odd, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        even[i] = row[2 * i];
+        odd[i] = row[2 * i + 1];
+    }
+}
+
+#if defined(MIP_AVX) || defined(MIP_SSE2)
+
+// In-lane shuffles make the 256 bit version no faster, AVX uses this too
+static void DeinterleaveSimd(const float* row, float* even, float* odd, size_t count)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 a = _mm_loadu_ps(row + 2 * i);
+        __m128 b = _mm_loadu_ps(row + 2 * i + 4);
+        _mm_storeu_ps(even + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps(odd + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+    DeinterleaveScalar(row + 2 * i, even + i, odd + i, count - i);
+}
+
+#else
+
+static void DeinterleaveSimd(const float* row, float* even, float* odd, size_t count)
+{
+    DeinterleaveScalar(row, even, odd, count);
+}
+
+#endif
+
+struct MipKernels
+{
+    WeightedSumFunc weightedSum;
+    DeinterleaveFunc deinterleave;
+};
+
+const char* mipSimdName()
+{
+#if defined(MIP_AVX)
+    return "AVX";
+#elif defined(MIP_SSE2)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
+
+//------------------------------------------------------------
+// sRGB <-> linear, both through tables
+//------------------------------------------------------------
+
+#define SRGB_ENCODE_SIZE 16384
+
+struct SrgbTables
+{
+    float decode[256];
+    unsigned char encode[SRGB_ENCODE_SIZE];
+
+    SrgbTables()
+    {
+        for (int i = 0; i < 256; i++) {
+            double c = i / 255.0;
+            decode[i] = (float)(c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4));
+        }
+        for (int i = 0; i < SRGB_ENCODE_SIZE; i++) {
+            double l = i / (double)(SRGB_ENCODE_SIZE - 1);
+            double c = l <= 0.0031308 ? l * 12.92 : 1.055 * pow(l, 1.0 / 2.4) - 0.055;
+            encode[i] = (unsigned char)min(255.0, floor(c * 255.0 + 0.5));
+        }
+    }
+};
+
+static const SrgbTables& GetSrgbTables()
+{
+    static const SrgbTables tables;
+    return tables;
+}
+
+// Planes back to interleaved bytes, one row
+static void EncodeRowLinear(const float* b, const float* g, const float* r, unsigned char* out, unsigned int width)
+{
+    for (unsigned int x = 0; x < width; x++) {
+        out[x * 3 + 0] = (unsigned char)(min(max(b[x], 0.0f), 1.0f) * 255.0f + 0.5f);
+        out[x * 3 + 1] = (unsigned char)(min(max(g[x], 0.0f), 1.0f) * 255.0f + 0.5f);
+        out[x * 3 + 2] = (unsigned char)(min(max(r[x], 0.0f), 1.0f) * 255.0f + 0.5f);
+    }
+}
+
+static void EncodeRowSrgb(const unsigned char* encode, const float* b, const float* g, const float* r,
+    unsigned char* out, unsigned int width)
+{
+    const float scale = SRGB_ENCODE_SIZE - 1;
+    for (unsigned int x = 0; x < width; x++) {
+        out[x * 3 + 0] = encode[(int)(min(max(b[x], 0.0f), 1.0f) * scale + 0.5f)];
+        out[x * 3 + 1] = encode[(int)(min(max(g[x], 0.0f), 1.0f) * scale + 0.5f)];
+        out[x * 3 + 2] = encode[(int)(min(max(r[x], 0.0f), 1.0f) * scale + 0.5f)];
+    }
+}
+
+//------------------------------------------------------------
+// Rows of the level being reduced. Later levels read the float
+// planes the previous level left behind; level 0 is decoded
+// from bytes a row at a time into a ring that holds every row
+// one output row needs, so it never exists as whole planes.
+//------------------------------------------------------------
+
+struct MipSource
+{
+    unsigned int width, height;
+    const float* planes[3];         // NULL for level 0
+
+    // Level 0
+    const unsigned char* bytes;
+    size_t stride;
+    const float* decode;            // byte to linear value
+    vector<float> ring;             // ringRows rows of 3 channels
+    vector<int> ringRow;            // source row in each slot, -1 if none
+    int ringRows;
+};
+
+static const float* SourceRow(MipSource& source, int channel, int y)
+{
+    size_t width = source.width;
+    if (source.planes[0] != NULL)
+        return source.planes[channel] + y * width;
+
+    int slot = y % source.ringRows;
+    float* row = &source.ring[slot * 3 * width];
+    if (source.ringRow[slot] != y) {
+        const unsigned char* in = source.bytes + y * source.stride;
+        const float* decode = source.decode;
+        for (size_t x = 0; x < width; x++) {
+            row[x] = decode[in[x * 3 + 0]];
+            row[width + x] = decode[in[x * 3 + 1]];
+            row[2 * width + x] = decode[in[x * 3 + 2]];
+        }
+        source.ringRow[slot] = y;
+    }
+    return row + channel * width;
+}
+
+struct MipScratch
+{
+    vector<float> row;              // vertical pass result, source width
+    vector<float> even, odd;        // row split by parity, with clamped padding
+    vector<const float*> sources;
+};
+
+// Halves the source in both directions (a side of 1 stays 1) into
+// three planes of dstWidth x dstHeight. Edges are clamped.
+static void DownsampleLevel(MipSource& source, float* const* dst, unsigned int dstWidth, unsigned int dstHeight,
+    const MipTaps& taps, const MipKernels& kernels, MipScratch& scratch)
+{
+    int width = (int)source.width, height = (int)source.height;
+
+    // Padding of the split row, even so tap parity carries over
+    int pad = (taps.reach + 1) & ~1;
+    int half = (width + 2 * pad + 1) / 2;
+    scratch.row.resize(width);
+    scratch.even.resize(half);
+    scratch.odd.resize(half);
+    scratch.sources.resize(taps.count);
+
+    for (unsigned int y = 0; y < dstHeight; y++) {
+        for (int c = 0; c < 3; c++) {
+            // Vertical: rows 2y + offset, one height means no reduction
+            for (int k = 0; k < taps.count; k++) {
+                int sy = height == 1 ? 0 : min(max(2 * (int)y + taps.offset[k], 0), height - 1);
+                scratch.sources[k] = SourceRow(source, c, sy);
+            }
+            kernels.weightedSum(&scratch.row[0], &scratch.sources[0], taps.weight, taps.count, width);
+
+            // Horizontal: columns 2x + offset read as one contiguous run of
+            // the even or odd half, shifted by the offset. Only the padding
+            // and a trailing odd column need clamping.
+            const float* row = &scratch.row[0];
+            int pairs = width / 2;
+            kernels.deinterleave(row, &scratch.even[pad / 2], &scratch.odd[pad / 2], pairs);
+            for (int m = 0; m < half; m++) {
+                if (m >= pad / 2 && m < pad / 2 + pairs)
+                    continue;
+                int e = 2 * m - pad;
+                scratch.even[m] = row[min(max(e, 0), width - 1)];
+                scratch.odd[m] = row[min(max(e + 1, 0), width - 1)];
+            }
+            for (int k = 0; k < taps.count; k++) {
+                int index = width == 1 ? pad : taps.offset[k] + pad;
+                scratch.sources[k] = (index & 1) ? &scratch.odd[index / 2] : &scratch.even[index / 2];
+            }
+            kernels.weightedSum(dst[c] + (size_t)y * dstWidth, &scratch.sources[0], taps.weight, taps.count, dstWidth);
+        }
+    }
+}
+
+static void BuildMipChain(vector<unsigned char>& pixels, vector<MipLevel>& levels, MipFilter filter, bool srgb,
+    const MipKernels& kernels)
+{
+    if (levels.empty())
+        return;
+
+    const SrgbTables& tables = GetSrgbTables();
+    MipTaps taps;
+    BuildTaps(filter, taps);
+
+    // Reserve the whole chain up front: about a third of level 0
+    MipLevel base = levels[0];
+    size_t total = pixels.size();
+    for (unsigned int w = base.width, h = base.height; w > 1 || h > 1;) {
+        w = max(w / 2, 1u);
+        h = max(h / 2, 1u);
+        total += mipRowStride(w) * h;
+    }
+    pixels.reserve(total);
+
+    float linear[256];
+    for (int i = 0; i < 256; i++)
+        linear[i] = i * (1.0f / 255.0f);
+
+    MipSource source;
+    source.width = base.width;
+    source.height = base.height;
+    source.planes[0] = source.planes[1] = source.planes[2] = NULL;
+    source.bytes = &pixels[base.offset];
+    source.stride = base.stride;
+    source.decode = srgb ? tables.decode : linear;
+    source.ringRows = 2 * taps.reach + 2;
+    source.ring.resize((size_t)source.ringRows * 3 * base.width);
+    source.ringRow.assign(source.ringRows, -1);
+
+    // Each level is filtered from the float result of the one above,
+    // not from its rounded bytes
+    vector<float> planes[3], next[3];
+    MipScratch scratch;
+    while (source.width > 1 || source.height > 1) {
+        unsigned int w = max(source.width / 2, 1u), h = max(source.height / 2, 1u);
+        float* dst[3];
+        for (int c = 0; c < 3; c++) {
+            next[c].resize((size_t)w * h);
+            dst[c] = &next[c][0];
+        }
+        DownsampleLevel(source, dst, w, h, taps, kernels, scratch);
+        for (int c = 0; c < 3; c++) {
+            planes[c].swap(next[c]);
+            source.planes[c] = &planes[c][0];
+        }
+        source.width = w;
+        source.height = h;
+
+        MipLevel level;
+        level.width = w;
+        level.height = h;
+        level.stride = mipRowStride(w);
+        level.offset = pixels.size();
+        pixels.resize(pixels.size() + level.stride * h, 0);
+        for (unsigned int y = 0; y < h; y++) {
+            unsigned char* row = &pixels[level.offset + y * level.stride];
+            const float* b = &planes[0][(size_t)y * w];
+            const float* g = &planes[1][(size_t)y * w];
+            const float* r = &planes[2][(size_t)y * w];
+            if (srgb)
+                EncodeRowSrgb(tables.encode, b, g, r, row, w);
+            else
+                EncodeRowLinear(b, g, r, row, w);
+        }
+        levels.push_back(level);
+    }
+}
+
+void buildMipChain(vector<unsigned char>& pixels, vector<MipLevel>& levels, MipFilter filter, bool srgb)
+{
+    MipKernels kernels = { WeightedSumSimd, DeinterleaveSimd };
+    BuildMipChain(pixels, levels, filter, srgb, kernels);
+}
+
+void buildMipChainScalar(vector<unsigned char>& pixels, vector<MipLevel>& levels, MipFilter filter, bool srgb)
+{
+    MipKernels kernels = { WeightedSumScalar, DeinterleaveScalar };
+    BuildMipChain(pixels, levels, filter, srgb, kernels);
+}
@@ -0,0 +1,46 @@
+#ifndef MIPMAP_H
+#define MIPMAP_H
+
+#include <stddef.h>
+#include <vector>
+
+// CPU mip chain generation for 8-bit, 3 channel images (BMP's BGR). Each
+// level is filtered from the previous one in float, separably: a vertical
+// then a horizontal pass, both a weighted sum of source rows that runs
+// 4 (SSE2) or 8 (AVX) pixels at a time. In sRGB mode texels are converted
+// to linear light before filtering and back afterwards, so dark and bright
+// texels average the way they look.
+//
+// Rows are padded to 4 bytes like in a BMP file, which is also GL's
+// default GL_UNPACK_ALIGNMENT.
+
+enum MipFilter
+{
+	MIP_FILTER_BOX,         // 2x2 average
+	MIP_FILTER_KAISER,      // Kaiser windowed sinc, 3 pixels wide, alpha 4
+	MIP_FILTER_LANCZOS      // Lanczos 3
+};
+
+struct MipLevel
+{
+	unsigned int width, height;
+	size_t offset;          // into the pixel buffer
+	size_t stride;          // bytes per row
+};
+
+// Bytes per row of a 3 channel level, padded to 4
+size_t mipRowStride(unsigned int width);
+
+// pixels holds level 0 as described by levels[0]. Every level below it,
+// down to 1x1, is appended to pixels and levels.
+void buildMipChain(std::vector<unsigned char> & pixels, std::vector<MipLevel> & levels, MipFilter filter, bool srgb);
+
+// Same filtering without SIMD, the reference for buildMipChain
+void buildMipChainScalar(std::vector<unsigned char> & pixels, std::vector<MipLevel> & levels, MipFilter filter, bool srgb);
+
+// Name of the compiled SIMD path: "AVX", "SSE2" or "scalar"
+const char * mipSimdName();
+
+const char * mipFilterName(MipFilter filter);
+
+#endif
@@ -1,11 +1,16 @@
 #include <vector>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string>
 #include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <thread>
 
 #include <glm/glm.hpp>
 
 #include "objloader.h"
+#include "mappedfile.h"
 
 // Very, VERY simple OBJ loader.
 // Here is a short list of features a real function would provide : 
@@ -17,97 +22,685 @@
 // - More secure. Change another line and you can inject code.
 // - Loading from memory, stream, etc
 
-bool loadOBJ(
-    const char * path, 
-    std::vector<glm::vec3> & out_vertices, 
-    std::vector<glm::vec2> & out_uvs,
-    std::vector<glm::vec3> & out_normals
-){
-    printf("Loading OBJ file %s...\n", path);
+// Files smaller than this are parsed on the calling thread; below it
+// the cost of starting threads outweighs the parsing itself.
+static const size_t PARALLEL_CHUNK_SIZE = 256 * 1024;
+
+// Exactly representable powers of ten for the float fast path
+static const float pow10f[] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
 
+// Everything one thread pulls out of its part of the file. Face indices
+// in OBJ are absolute, so chunks can be appended in file order afterwards.
+struct ObjChunk {
+    const char * begin;
+    const char * end;
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::vec2> uvs;
+    std::vector<glm::vec3> normals;
     std::vector<unsigned int> vertexIndices, uvIndices, normalIndices;
-    std::vector<glm::vec3> temp_vertices; 
-    std::vector<glm::vec2> temp_uvs;
-    std::vector<glm::vec3> temp_normals;
+    bool ok;
+};
 
-    FILE * file = fopen(path, "r");
-    if( file == NULL ){
-        printf("Impossible to open the file ! Are you in the right path ? See Tutorial 1 for details\n");
-        getchar();
+static inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+}
+
+static inline bool isDigit(char c)
+{
+    return (unsigned char)(c - '0') < 10;
+}
+
+static inline void skipBlanks(const char *& p, const char * end)
+{
+    while (p < end && isSpace(*p) && *p != '\n')
+        p++;
+}
+
+static inline void skipLine(const char *& p, const char * end)
+{
+    const char * nl = (const char *)memchr(p, '\n', end - p);
+    p = nl ? nl + 1 : end;
+}
+
+// Parses a float the way scanf("%f") does. Short decimals (up to 2^24 in the
+// mantissa and 10 digits of exponent) need only one correctly rounded float
+// multiply or divide, so they give the same bits as strtof. Anything else is
+// handed to strtof itself.
+static bool parseFloat(const char *& p, const char * end, float & out)
+{
+    skipBlanks(p, end);
+    const char * start = p;
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+
+    unsigned long long mantissa = 0;
+    int digits = 0, exponent = 0;
+    bool any = false;
+    while (p < end && isDigit(*p)) {
+        if (mantissa != 0 || *p != '0') {
+            mantissa = mantissa * 10 + (*p - '0');
+            digits++;
+        }
+        any = true;
+        p++;
+        if (digits > 18)
+            break;
+    }
+    if (p < end && *p == '.' && digits <= 18) {
+        p++;
+        while (p < end && isDigit(*p)) {
+            if (mantissa != 0 || *p != '0') {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits++;
+            }
+            exponent--;
+            any = true;
+            p++;
+            if (digits > 18)
+                break;
+        }
+    }
+    if (p < end && (*p == 'e' || *p == 'E') && any && digits <= 18) {
+        const char * q = p + 1;
+        bool expNegative = false;
+        if (q < end && (*q == '-' || *q == '+')) {
+            expNegative = *q == '-';
+            q++;
+        }
+        if (q < end && isDigit(*q)) {
+            int e = 0;
+            while (q < end && isDigit(*q)) {
+                if (e < 10000)
+                    e = e * 10 + (*q - '0');
+                q++;
+            }
+            exponent += expNegative ? -e : e;
+            p = q;
+        }
+    }
+
+    bool terminated = p == end || isSpace(*p) || *p == '/';
+    if (any && terminated && digits <= 18 && mantissa <= (1ull << 24)
+        && exponent >= -10 && exponent <= 10) {
+        float value = (float)mantissa;
+        if (exponent < 0)
+            value /= pow10f[-exponent];
+        else
+            value *= pow10f[exponent];
+        out = negative ? -value : value;
+        return true;
+    }
+
+    // Slow path: long mantissas, large exponents, inf/nan
+    char buffer[128];
+    const char * q = start;
+    size_t length = 0;
+    while (q < end && !isSpace(*q) && length < sizeof(buffer) - 1)
+        buffer[length++] = *q++;
+    buffer[length] = '\0';
+
+    char * stop;
+    out = strtof(buffer, &stop);
+    if (stop == buffer)
         return false;
+    p = start + (stop - buffer);
+    return true;
+}
+
+// Parses an integer the way scanf("%d") does
+static bool parseInt(const char *& p, const char * end, unsigned int & out)
+{
+    skipBlanks(p, end);
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
     }
+    if (p == end || !isDigit(*p))
+        return false;
+
+    unsigned int value = 0;
+    while (p < end && isDigit(*p))
+        value = value * 10 + (*p++ - '0');
+
+    out = negative ? 0u - value : value;
+    return true;
+}
+
+static bool parseFaceCorner(const char *& p, const char * end,
+    unsigned int & vertexIndex, unsigned int & uvIndex, unsigned int & normalIndex)
+{
+    if (!parseInt(p, end, vertexIndex) || p == end || *p++ != '/')
+        return false;
+    if (!parseInt(p, end, uvIndex) || p == end || *p++ != '/')
+        return false;
+    return parseInt(p, end, normalIndex);
+}
 
-    while( 1 ){
+static void parseChunk(ObjChunk * chunk)
+{
+    const char * p = chunk->begin;
+    const char * end = chunk->end;
+    chunk->ok = true;
 
-        char lineHeader[128];
+    while (p < end) {
         // read the first word of the line
-        int res = fscanf(file, "%s", lineHeader);
-        if (res == EOF)
-            break; // EOF = End Of File. Quit the loop.
+        while (p < end && isSpace(*p))
+            p++;
+        if (p == end)
+            break;
+        const char * word = p;
+        while (p < end && !isSpace(*p))
+            p++;
+        size_t length = p - word;
 
-        // else : parse lineHeader
-        
-        if ( strcmp( lineHeader, "v" ) == 0 ){
+        if (length == 1 && word[0] == 'v') {
             glm::vec3 vertex;
-            fscanf(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z );
-            temp_vertices.push_back(vertex);
-        }else if ( strcmp( lineHeader, "vt" ) == 0 ){
+            parseFloat(p, end, vertex.x);
+            parseFloat(p, end, vertex.y);
+            parseFloat(p, end, vertex.z);
+            chunk->vertices.push_back(vertex);
+        } else if (length == 2 && word[0] == 'v' && word[1] == 't') {
             glm::vec2 uv;
-            fscanf(file, "%f %f\n", &uv.x, &uv.y );
+            parseFloat(p, end, uv.x);
+            parseFloat(p, end, uv.y);
             uv.y = -uv.y; // Invert V coordinate since we will only use DDS texture, which are inverted. Remove if you want to use TGA or BMP loaders.
-            temp_uvs.push_back(uv);
-        }else if ( strcmp( lineHeader, "vn" ) == 0 ){
+            chunk->uvs.push_back(uv);
+        } else if (length == 2 && word[0] == 'v' && word[1] == 'n') {
             glm::vec3 normal;
-            fscanf(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z );
-            temp_normals.push_back(normal);
-        }else if ( strcmp( lineHeader, "f" ) == 0 ){
-            std::string vertex1, vertex2, vertex3;
+            parseFloat(p, end, normal.x);
+            parseFloat(p, end, normal.y);
+            parseFloat(p, end, normal.z);
+            chunk->normals.push_back(normal);
+        } else if (length == 1 && word[0] == 'f') {
             unsigned int vertexIndex[3], uvIndex[3], normalIndex[3];
-            int matches = fscanf(file, "%d/%d/%d %d/%d/%d %d/%d/%d\n", &vertexIndex[0], &uvIndex[0], &normalIndex[0], &vertexIndex[1], &uvIndex[1], &normalIndex[1], &vertexIndex[2], &uvIndex[2], &normalIndex[2] );
-            if (matches != 9){
-                printf("File can't be read by our simple parser :-( Try exporting with other options\n");
-                return false;
+            for (int i = 0; i < 3; i++) {
+                if (!parseFaceCorner(p, end, vertexIndex[i], uvIndex[i], normalIndex[i])) {
+                    chunk->ok = false;
+                    return;
+                }
             }
-            vertexIndices.push_back(vertexIndex[0]);
-            vertexIndices.push_back(vertexIndex[1]);
-            vertexIndices.push_back(vertexIndex[2]);
-            uvIndices    .push_back(uvIndex[0]);
-            uvIndices    .push_back(uvIndex[1]);
-            uvIndices    .push_back(uvIndex[2]);
-            normalIndices.push_back(normalIndex[0]);
-            normalIndices.push_back(normalIndex[1]);
-            normalIndices.push_back(normalIndex[2]);
-        }else{
-            // Probably a comment, eat up the rest of the line
-            char stupidBuffer[1000];
-            fgets(stupidBuffer, 1000, file);
+            chunk->vertexIndices.insert(chunk->vertexIndices.end(), vertexIndex, vertexIndex + 3);
+            chunk->uvIndices.insert(chunk->uvIndices.end(), uvIndex, uvIndex + 3);
+            chunk->normalIndices.insert(chunk->normalIndices.end(), normalIndex, normalIndex + 3);
+        }
+
+        // Anything left on the line (comments, a 4th component, quads) is ignored
+        if (p < end && *p != '\n')
+            skipLine(p, end);
+    }
+}
+
+// The parsed contents of an OBJ file, before faces are turned into vertices
+struct ObjData {
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::vec2> uvs;
+    std::vector<glm::vec3> normals;
+    std::vector<unsigned int> vertexIndices, uvIndices, normalIndices;
+};
+
+static bool parseOBJ(const char * path, ObjData & obj)
+{
+    printf("Loading OBJ file %s...\n", path);
+
+    MappedFile file;
+    if (!mapFile(path, file)) {
+        printf("Impossible to open the file ! Are you in the right path ? See Tutorial 1 for details\n");
+        getchar();
+        return false;
+    }
+
+    // Split the file into line-aligned chunks, one per thread
+    size_t threadCount = std::thread::hardware_concurrency();
+    if (threadCount == 0)
+        threadCount = 1;
+    size_t chunkCount = file.size / PARALLEL_CHUNK_SIZE + 1;
+    if (chunkCount > threadCount)
+        chunkCount = threadCount;
+
+    std::vector<ObjChunk> chunks(chunkCount);
+    const char * begin = file.data;
+    const char * end = file.data + file.size;
+    for (size_t i = 0; i < chunkCount; i++) {
+        const char * split = (i + 1 == chunkCount) ? end : file.data + file.size * (i + 1) / chunkCount;
+        if (split < begin)
+            split = begin;
+        if (split < end)
+            skipLine(split, end);
+        chunks[i].begin = begin;
+        chunks[i].end = split;
+        begin = split;
+    }
+
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < chunkCount; i++)
+        workers.push_back(std::thread(parseChunk, &chunks[i]));
+    parseChunk(&chunks[0]);
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+
+    unmapFile(file);
+
+    // Merge the chunks in file order
+    size_t vertexCount = 0, uvCount = 0, normalCount = 0, indexCount = 0;
+    for (size_t i = 0; i < chunkCount; i++) {
+        if (!chunks[i].ok) {
+            printf("File can't be read by our simple parser :-( Try exporting with other options\n");
+            return false;
         }
+        vertexCount += chunks[i].vertices.size();
+        uvCount += chunks[i].uvs.size();
+        normalCount += chunks[i].normals.size();
+        indexCount += chunks[i].vertexIndices.size();
+    }
 
+    obj.vertices.reserve(vertexCount);
+    obj.uvs.reserve(uvCount);
+    obj.normals.reserve(normalCount);
+    obj.vertexIndices.reserve(indexCount);
+    obj.uvIndices.reserve(indexCount);
+    obj.normalIndices.reserve(indexCount);
+    for (size_t i = 0; i < chunkCount; i++) {
+        const ObjChunk & chunk = chunks[i];
+        obj.vertices.insert(obj.vertices.end(), chunk.vertices.begin(), chunk.vertices.end());
+        obj.uvs.insert(obj.uvs.end(), chunk.uvs.begin(), chunk.uvs.end());
+        obj.normals.insert(obj.normals.end(), chunk.normals.begin(), chunk.normals.end());
+        obj.vertexIndices.insert(obj.vertexIndices.end(), chunk.vertexIndices.begin(), chunk.vertexIndices.end());
+        obj.uvIndices.insert(obj.uvIndices.end(), chunk.uvIndices.begin(), chunk.uvIndices.end());
+        obj.normalIndices.insert(obj.normalIndices.end(), chunk.normalIndices.begin(), chunk.normalIndices.end());
     }
 
+    // OBJ indices are 1-based
+    for (size_t i = 0; i < indexCount; i++) {
+        if (obj.vertexIndices[i] - 1 >= vertexCount || obj.uvIndices[i] - 1 >= uvCount || obj.normalIndices[i] - 1 >= normalCount) {
+            printf("Face refers to a vertex that does not exist\n");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool loadOBJ(
+    const char * path, 
+    std::vector<glm::vec3> & out_vertices, 
+    std::vector<glm::vec2> & out_uvs,
+    std::vector<glm::vec3> & out_normals
+){
+    ObjData obj;
+    if (!parseOBJ(path, obj))
+        return false;
+
+    size_t indexCount = obj.vertexIndices.size();
+    out_vertices.reserve(out_vertices.size() + indexCount);
+    out_uvs.reserve(out_uvs.size() + indexCount);
+    out_normals.reserve(out_normals.size() + indexCount);
+
     // For each vertex of each triangle
-    for( unsigned int i=0; i<vertexIndices.size(); i++ ){
+    for (size_t i = 0; i < indexCount; i++) {
 
         // Get the indices of its attributes
-        unsigned int vertexIndex = vertexIndices[i];
-        unsigned int uvIndex = uvIndices[i];
-        unsigned int normalIndex = normalIndices[i];
-        
-        // Get the attributes thanks to the index
-        glm::vec3 vertex = temp_vertices[ vertexIndex-1 ];
-        glm::vec2 uv = temp_uvs[ uvIndex-1 ];
-        glm::vec3 normal = temp_normals[ normalIndex-1 ];
-        
+        unsigned int vertexIndex = obj.vertexIndices[i];
+        unsigned int uvIndex = obj.uvIndices[i];
+        unsigned int normalIndex = obj.normalIndices[i];
+
         // Put the attributes in buffers
-        out_vertices.push_back(vertex);
-        out_uvs     .push_back(uv);
-        out_normals .push_back(normal);
-    
+        out_vertices.push_back(obj.vertices[vertexIndex - 1]);
+        out_uvs     .push_back(obj.uvs[uvIndex - 1]);
+        out_normals .push_back(obj.normals[normalIndex - 1]);
+    }
+
+    return true;
+}
+
+static inline unsigned int hashCorner(unsigned int v, unsigned int vt, unsigned int vn)
+{
+    unsigned int h = v * 0x9E3779B1u;
+    h ^= vt * 0x85EBCA77u + (h << 6) + (h >> 2);
+    h ^= vn * 0xC2B2AE3Du + (h << 6) + (h >> 2);
+    return h ^ (h >> 15);
+}
+
+bool loadOBJIndexed(
+    const char * path,
+    std::vector<unsigned int> & out_indices,
+    std::vector<glm::vec3> & out_vertices,
+    std::vector<glm::vec2> & out_uvs,
+    std::vector<glm::vec3> & out_normals
+){
+    ObjData obj;
+    if (!parseOBJ(path, obj))
+        return false;
+
+    size_t indexCount = obj.vertexIndices.size();
+    size_t base = out_vertices.size();
+
+    // Open addressing table from (v, vt, vn) to output vertex, at most half full
+    size_t tableSize = 16;
+    while (tableSize < indexCount * 2)
+        tableSize *= 2;
+    std::vector<unsigned int> table(tableSize, 0xFFFFFFFFu);
+    std::vector<unsigned int> keys;
+    keys.reserve(indexCount);
+
+    out_indices.reserve(out_indices.size() + indexCount);
+
+    for (size_t i = 0; i < indexCount; i++) {
+        unsigned int v = obj.vertexIndices[i];
+        unsigned int vt = obj.uvIndices[i];
+        unsigned int vn = obj.normalIndices[i];
+
+        size_t slot = hashCorner(v, vt, vn) & (tableSize - 1);
+        unsigned int unique;
+        for (;;) {
+            unique = table[slot];
+            if (unique == 0xFFFFFFFFu) {
+                // First time we see this corner: emit a new vertex
+                unique = (unsigned int)(keys.size() / 3);
+                table[slot] = unique;
+                keys.push_back(v);
+                keys.push_back(vt);
+                keys.push_back(vn);
+                break;
+            }
+            if (keys[unique * 3] == v && keys[unique * 3 + 1] == vt && keys[unique * 3 + 2] == vn)
+                break;
+            slot = (slot + 1) & (tableSize - 1);
+        }
+        out_indices.push_back((unsigned int)base + unique);
+    }
+
+    size_t uniqueCount = keys.size() / 3;
+    out_vertices.reserve(base + uniqueCount);
+    out_uvs.reserve(base + uniqueCount);
+    out_normals.reserve(base + uniqueCount);
+    for (size_t i = 0; i < uniqueCount; i++) {
+        out_vertices.push_back(obj.vertices[keys[i * 3] - 1]);
+        out_uvs     .push_back(obj.uvs[keys[i * 3 + 1] - 1]);
+        out_normals .push_back(obj.normals[keys[i * 3 + 2] - 1]);
     }
 
     return true;
 }
 
+bool loadOBJIndexed(
+    const char * path,
+    std::vector<unsigned short> & out_indices,
+    std::vector<glm::vec3> & out_vertices,
+    std::vector<glm::vec2> & out_uvs,
+    std::vector<glm::vec3> & out_normals
+){
+    std::vector<unsigned int> indices;
+    if (!loadOBJIndexed(path, indices, out_vertices, out_uvs, out_normals))
+        return false;
+
+    if (out_vertices.size() > 0x10000) {
+        printf("%s has %u vertices, too many for 16-bit indices\n", path, (unsigned int)out_vertices.size());
+        return false;
+    }
+
+    out_indices.reserve(out_indices.size() + indices.size());
+    for (size_t i = 0; i < indices.size(); i++)
+        out_indices.push_back((unsigned short)indices[i]);
+
+    return true;
+}
+
+
+// Read buffer bounds for streamOBJ; a line longer than the buffer fails
+static const size_t STREAM_MIN_BUFFER = 64 * 1024;
+static const size_t STREAM_MAX_BUFFER = 16 * 1024 * 1024;
+
+// Bytes of one expanded corner: position, uv, normal
+static const size_t STREAM_CORNER_SIZE = sizeof(glm::vec3) + sizeof(glm::vec2) + sizeof(glm::vec3);
+
+// Reads the whole file through buffer and calls lines(begin, end) with
+// every run of complete lines; a partial last line is kept for the next
+// read. False if lines does or a line does not fit in the buffer.
+template <class Lines>
+static bool readLines(FILE * file, std::vector<char> & buffer, unsigned long long & bytes, Lines lines)
+{
+    size_t capacity = buffer.size();
+    size_t kept = 0;
+    bytes = 0;
+    for (;;) {
+        size_t got = fread(&buffer[kept], 1, capacity - kept, file);
+        bytes += got;
+        size_t size = kept + got;
+        if (got == 0) {
+            // The last line may lack its newline
+            return size == 0 || lines(&buffer[0], &buffer[0] + size);
+        }
+
+        size_t complete = size;
+        while (complete > 0 && buffer[complete - 1] != '\n')
+            complete--;
+        if (complete == 0) {
+            if (size == capacity) {
+                printf("Line longer than the %u byte read buffer\n", (unsigned int)capacity);
+                return false;
+            }
+            kept = size;
+            continue;
+        }
+        if (!lines(&buffer[0], &buffer[0] + complete))
+            return false;
+        kept = size - complete;
+        memmove(&buffer[0], &buffer[complete], kept);
+    }
+}
+
+struct StreamCounts {
+    size_t vertices, uvs, normals, faces;
+    bool attributesAfterFaces;  // a face may refer to a line below it
+};
+
+static bool countLines(const char * p, const char * end, StreamCounts & counts)
+{
+    while (p < end) {
+        while (p < end && (*p == ' ' || *p == '\t'))
+            p++;
+        size_t left = end - p;
+        size_t attributes = counts.vertices + counts.uvs + counts.normals;
+        if (left >= 2 && p[0] == 'v' && isSpace(p[1]))
+            counts.vertices++;
+        else if (left >= 3 && p[0] == 'v' && p[1] == 't' && isSpace(p[2]))
+            counts.uvs++;
+        else if (left >= 3 && p[0] == 'v' && p[1] == 'n' && isSpace(p[2]))
+            counts.normals++;
+        else if (left >= 2 && p[0] == 'f' && isSpace(p[1]))
+            counts.faces++;
+        if (counts.faces > 0 && counts.vertices + counts.uvs + counts.normals != attributes)
+            counts.attributesAfterFaces = true;
+        skipLine(p, end);
+    }
+    return true;
+}
+
+// Parse state of the second pass
+struct StreamState {
+    std::vector<glm::vec3> vertices, normals;
+    std::vector<glm::vec2> uvs;
+    std::vector<glm::vec3> batchPositions, batchNormals;
+    std::vector<glm::vec2> batchUvs;
+    ObjStreamBatch batch;
+    ObjBatchCallback sink;
+    void * user;
+    size_t batches;
+    bool readTables;            // parse v/vt/vn lines
+    bool readFaces;             // parse f lines
+};
+
+static bool flushBatch(StreamState & state)
+{
+    if (state.batch.count == 0)
+        return true;
+    state.batches++;
+    if (!state.sink(state.batch, state.user))
+        return false;
+    state.batch.first += state.batch.count;
+    state.batch.count = 0;
+    return true;
+}
+
+static bool parseStreamLines(const char * p, const char * end, StreamState & state)
+{
+    while (p < end) {
+        while (p < end && isSpace(*p))
+            p++;
+        if (p == end)
+            break;
+        const char * word = p;
+        while (p < end && !isSpace(*p))
+            p++;
+        size_t length = p - word;
+
+        if (length == 1 && word[0] == 'v' && state.readTables) {
+            glm::vec3 vertex;
+            parseFloat(p, end, vertex.x);
+            parseFloat(p, end, vertex.y);
+            parseFloat(p, end, vertex.z);
+            state.vertices.push_back(vertex);
+        } else if (length == 2 && word[0] == 'v' && word[1] == 't' && state.readTables) {
+            glm::vec2 uv;
+            parseFloat(p, end, uv.x);
+            parseFloat(p, end, uv.y);
+            uv.y = -uv.y; // Same V flip as loadOBJ
+            state.uvs.push_back(uv);
+        } else if (length == 2 && word[0] == 'v' && word[1] == 'n' && state.readTables) {
+            glm::vec3 normal;
+            parseFloat(p, end, normal.x);
+            parseFloat(p, end, normal.y);
+            parseFloat(p, end, normal.z);
+            state.normals.push_back(normal);
+        } else if (length == 1 && word[0] == 'f' && state.readFaces) {
+            unsigned int vertexIndex, uvIndex, normalIndex;
+            for (int i = 0; i < 3; i++) {
+                if (!parseFaceCorner(p, end, vertexIndex, uvIndex, normalIndex)) {
+                    printf("File can't be read by our simple parser :-( Try exporting with other options\n");
+                    return false;
+                }
+                // The tables hold the whole file by now (see streamOBJ), so
+                // this accepts what loadOBJ does
+                if (vertexIndex - 1 >= state.vertices.size() || uvIndex - 1 >= state.uvs.size()
+                    || normalIndex - 1 >= state.normals.size()) {
+                    printf("Face refers to a vertex that does not exist\n");
+                    return false;
+                }
+                size_t corner = state.batch.count++;
+                state.batchPositions[corner] = state.vertices[vertexIndex - 1];
+                state.batchUvs[corner] = state.uvs[uvIndex - 1];
+                state.batchNormals[corner] = state.normals[normalIndex - 1];
+            }
+            if (state.batch.count == state.batchPositions.size() && !flushBatch(state))
+                return false;
+        }
+
+        if (p < end && *p != '\n')
+            skipLine(p, end);
+    }
+    return true;
+}
+
+bool streamOBJ(const char * path, size_t budget, ObjBatchCallback sink, void * user, ObjStreamStats & stats)
+{
+    printf("Streaming OBJ file %s...\n", path);
+    auto start = std::chrono::high_resolution_clock::now();
+    stats = ObjStreamStats();
+
+    FILE * file = fopen(path, "rb");
+    if (file == NULL) {
+        printf("Impossible to open the file ! Are you in the right path ? See Tutorial 1 for details\n");
+        return false;
+    }
+
+    // Pass 1: how large the tables get, so they are allocated exactly once
+    size_t firstBuffer = std::min(std::max(budget / 2, STREAM_MIN_BUFFER), STREAM_MAX_BUFFER);
+    StreamCounts counts = {};
+    {
+        std::vector<char> buffer(firstBuffer);
+        bool ok = readLines(file, buffer, stats.bytes, [&counts](const char * begin, const char * end) {
+            return countLines(begin, end, counts);
+        });
+        if (!ok) {
+            fclose(file);
+            return false;
+        }
+    }
+
+    // What is left after the tables goes half to reading, half to the batch
+    size_t tableBytes = counts.vertices * sizeof(glm::vec3) + counts.uvs * sizeof(glm::vec2)
+        + counts.normals * sizeof(glm::vec3);
+    if (budget < tableBytes + 2 * STREAM_MIN_BUFFER) {
+        printf("%s needs %.1f MB for its vertex tables, over the budget of %.1f MB\n", path,
+            (tableBytes + 2 * STREAM_MIN_BUFFER) / (1024.0 * 1024.0), budget / (1024.0 * 1024.0));
+        fclose(file);
+        return false;
+    }
+    size_t rest = budget - tableBytes;
+    size_t readBuffer = std::min(std::max(rest / 2, STREAM_MIN_BUFFER), STREAM_MAX_BUFFER);
+    size_t batchCorners = std::min(rest - readBuffer, STREAM_MAX_BUFFER) / STREAM_CORNER_SIZE / 3 * 3;
+    batchCorners = std::min(std::max(batchCorners, (size_t)3), std::max(counts.faces * 3, (size_t)3));
+
+    // Pass 2
+    StreamState state;
+    state.vertices.reserve(counts.vertices);
+    state.uvs.reserve(counts.uvs);
+    state.normals.reserve(counts.normals);
+    state.batchPositions.resize(batchCorners);
+    state.batchUvs.resize(batchCorners);
+    state.batchNormals.resize(batchCorners);
+    state.batch.positions = &state.batchPositions[0];
+    state.batch.uvs = &state.batchUvs[0];
+    state.batch.normals = &state.batchNormals[0];
+    state.batch.count = 0;
+    state.batch.first = 0;
+    state.batch.total = counts.faces * 3;
+    state.sink = sink;
+    state.user = user;
+    state.batches = 0;
+
+    // Faces usually come after every v/vt/vn line, and one pass fills the
+    // tables while expanding them. Otherwise the tables get a pass of
+    // their own first, so faces can refer to lines below them.
+    std::vector<char> buffer(readBuffer);
+    unsigned long long bytes;
+    auto parse = [&state](const char * begin, const char * end) {
+        return parseStreamLines(begin, end, state);
+    };
+    bool ok = true;
+    state.readTables = true;
+    state.readFaces = !counts.attributesAfterFaces;
+    if (counts.attributesAfterFaces) {
+        rewind(file);
+        ok = readLines(file, buffer, bytes, parse);
+        state.readTables = false;
+        state.readFaces = true;
+    }
+    if (ok) {
+        rewind(file);
+        ok = readLines(file, buffer, bytes, parse) && flushBatch(state);
+    }
+    fclose(file);
+
+    stats.triangles = state.batch.first / 3;
+    stats.attributes = counts.vertices + counts.uvs + counts.normals;
+    stats.batches = state.batches;
+    stats.batchCorners = batchCorners;
+    stats.readBuffer = readBuffer;
+    stats.peakBytes = std::max(firstBuffer, tableBytes + readBuffer + batchCorners * STREAM_CORNER_SIZE);
+    stats.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    return ok;
+}
+
 
 #ifdef USE_ASSIMP // don't use this #define, it's only for me (it AssImp fails to compile on your machine, at least all the other tutorials still work)
 
@@ -11,6 +11,65 @@ bool loadOBJ(
 );
 
 
+// Same as loadOBJ, but every distinct (v, vt, vn) corner becomes one vertex
+// and triangles are described by out_indices. The 16-bit version fails if
+// the mesh has more than 65536 unique vertices.
+bool loadOBJIndexed(
+	const char * path,
+	std::vector<unsigned int> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+);
+
+bool loadOBJIndexed(
+	const char * path,
+	std::vector<unsigned short> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+);
+
+// Streaming load for OBJ files whose expanded mesh is too large to keep in
+// memory. The file is read in bounded chunks: once to count its lines,
+// then to parse them, with one more pass to load the tables first when
+// v/vt/vn lines follow faces. Faces are checked against the whole file
+// and expanded into three corners like loadOBJ does, so both accept the
+// same files. Corners are handed to sink in fixed-size batches instead of
+// being collected.
+//
+// The position, UV and normal tables stay in memory for the whole load:
+// they must fit in budget bytes together with the read buffer and the
+// batch, and the load fails up front if they do not. Only the expanded
+// corners are streamed, so a file whose tables exceed the budget cannot
+// be loaded this way.
+
+struct ObjStreamBatch
+{
+	const glm::vec3 * positions;
+	const glm::vec2 * uvs;
+	const glm::vec3 * normals;
+	size_t count;               // corners in this batch, a multiple of 3
+	size_t first;               // corners handed out before it
+	size_t total;               // corners in the whole file
+};
+
+struct ObjStreamStats
+{
+	unsigned long long bytes;   // file size
+	size_t triangles;
+	size_t attributes;          // v, vt and vn lines
+	size_t batches;
+	size_t batchCorners;        // corners per full batch
+	size_t readBuffer;          // bytes
+	size_t peakBytes;           // largest the loader's own memory got
+	double seconds;
+};
+
+// Returns false to stop the load
+typedef bool (*ObjBatchCallback)(const ObjStreamBatch & batch, void * user);
+
+bool streamOBJ(const char * path, size_t budget, ObjBatchCallback sink, void * user, ObjStreamStats & stats);
 
 bool loadAssImp(
 	const char * path, 
@@ -0,0 +1,363 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#include <GL/glew.h>
+
+#include "profiler.h"
+
+using namespace std;
+
+bool gl_debug_output = false;
+
+struct ProfileEvent
+{
+    const char* name;
+    int index;
+    int frame;
+    bool gpu;
+    double start_us;
+    double duration_us;     // < 0 while a GPU result is outstanding or was dropped
+};
+
+struct PendingQuery
+{
+    size_t event;
+    GLuint begin_query;
+    GLuint end_query;
+};
+
+// Queries issued during one frame; reused PROFILER_FRAMES_IN_FLIGHT frames later
+struct FrameSlot
+{
+    vector<GLuint> queries;
+    size_t used;
+    vector<PendingQuery> pending;
+};
+
+static bool enabled = false;
+static int frame = 0;
+static chrono::high_resolution_clock::time_point epoch;
+// Events of the last PROFILER_HISTORY_FRAMES frames; scopes and queries
+// refer to them by index since the first event recorded
+static deque<ProfileEvent> events;
+static size_t events_dropped = 0;
+static vector<size_t> cpu_stack;
+static vector<PendingQuery> gpu_stack;
+static FrameSlot slots[PROFILER_FRAMES_IN_FLIGHT];
+static double gpu_to_cpu_us;
+static unsigned int gpu_dropped = 0;
+
+
+//------------------------------------------------------------
+// KHR_debug
+//------------------------------------------------------------
+
+static const char* DebugTypeName(GLenum type)
+{
+    switch (type) {
+    case GL_DEBUG_TYPE_ERROR: return "error";
+    case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated";
+    case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "undefined behavior";
+    case GL_DEBUG_TYPE_PORTABILITY: return "portability";
+    case GL_DEBUG_TYPE_PERFORMANCE: return "performance";
+    default: return "other";
+    }
+}
+
+static void GLAPIENTRY DebugCallback(GLenum, GLenum type, GLuint id, GLenum severity,
+    GLsizei, const GLchar* message, const void*)
+{
+    if (severity == GL_DEBUG_SEVERITY_NOTIFICATION)
+        return;
+
+    printf("OpenGL %s %u: %s\n", DebugTypeName(type), id, message);
+
+#ifdef _DEBUG
+    // Same behaviour as the old glGetError polling
+    if (type == GL_DEBUG_TYPE_ERROR)
+        abort();
+#endif
+}
+
+bool installDebugCallback()
+{
+    if (!GLEW_KHR_debug)
+        return false;
+
+    glEnable(GL_DEBUG_OUTPUT);
+#ifdef _DEBUG
+    // Report errors on the offending call, so the stack is useful
+    glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+#endif
+    glDebugMessageCallback(DebugCallback, NULL);
+    gl_debug_output = true;
+    return true;
+}
+
+
+//------------------------------------------------------------
+// Recording
+//------------------------------------------------------------
+
+static double NowMicroseconds()
+{
+    return chrono::duration<double, micro>(chrono::high_resolution_clock::now() - epoch).count();
+}
+
+void profilerStart()
+{
+    epoch = chrono::high_resolution_clock::now();
+    enabled = true;
+
+    // Map GPU timestamps onto the CPU timeline
+    GLint64 gpu_now = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpu_now);
+    gpu_to_cpu_us = NowMicroseconds() - gpu_now / 1000.0;
+}
+
+bool profilerEnabled()
+{
+    return enabled;
+}
+
+static GLuint NextQuery(FrameSlot& slot)
+{
+    if (slot.used == slot.queries.size()) {
+        GLuint query;
+        glGenQueries(1, &query);
+        slot.queries.push_back(query);
+    }
+    return slot.queries[slot.used++];
+}
+
+// Reads back the queries of a slot. Without wait, results that are not
+// ready yet are dropped rather than waited for.
+static void ResolveSlot(FrameSlot& slot, bool wait)
+{
+    for (size_t i = 0; i < slot.pending.size(); i++) {
+        const PendingQuery& pending = slot.pending[i];
+
+        GLint available = 0;
+        if (!wait)
+            glGetQueryObjectiv(pending.end_query, GL_QUERY_RESULT_AVAILABLE, &available);
+
+        if (wait || available) {
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(pending.begin_query, GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(pending.end_query, GL_QUERY_RESULT, &end);
+            ProfileEvent& event = events[pending.event - events_dropped];
+            event.start_us = begin / 1000.0 + gpu_to_cpu_us;
+            event.duration_us = (end - begin) / 1000.0;
+        }
+        else {
+            gpu_dropped++;
+        }
+    }
+    slot.pending.clear();
+    slot.used = 0;
+}
+
+void profilerBeginFrame()
+{
+    if (!enabled)
+        return;
+
+    // This slot was last used PROFILER_FRAMES_IN_FLIGHT frames ago
+    ResolveSlot(slots[frame % PROFILER_FRAMES_IN_FLIGHT], false);
+
+    // Older frames are finished and their queries resolved
+    while (!events.empty() && events.front().frame < frame - PROFILER_HISTORY_FRAMES) {
+        events.pop_front();
+        events_dropped++;
+    }
+}
+
+void profilerEndFrame()
+{
+    if (!enabled)
+        return;
+
+    frame++;
+}
+
+void profilerCpuBegin(const char* name, int index)
+{
+    if (!enabled)
+        return;
+
+    ProfileEvent event = { name, index, frame, false, NowMicroseconds(), -1.0 };
+    cpu_stack.push_back(events_dropped + events.size());
+    events.push_back(event);
+}
+
+void profilerCpuEnd()
+{
+    if (!enabled || cpu_stack.empty())
+        return;
+
+    ProfileEvent& event = events[cpu_stack.back() - events_dropped];
+    event.duration_us = NowMicroseconds() - event.start_us;
+    cpu_stack.pop_back();
+}
+
+void profilerGpuBegin(const char* name, int index)
+{
+    if (!enabled)
+        return;
+
+    FrameSlot& slot = slots[frame % PROFILER_FRAMES_IN_FLIGHT];
+    PendingQuery pending;
+    pending.event = events_dropped + events.size();
+    pending.begin_query = NextQuery(slot);
+    pending.end_query = NextQuery(slot);
+    glQueryCounter(pending.begin_query, GL_TIMESTAMP);
+
+    ProfileEvent event = { name, index, frame, true, 0.0, -1.0 };
+    events.push_back(event);
+    gpu_stack.push_back(pending);
+}
+
+void profilerGpuEnd()
+{
+    if (!enabled || gpu_stack.empty())
+        return;
+
+    PendingQuery pending = gpu_stack.back();
+    gpu_stack.pop_back();
+    glQueryCounter(pending.end_query, GL_TIMESTAMP);
+    slots[frame % PROFILER_FRAMES_IN_FLIGHT].pending.push_back(pending);
+}
+
+
+//------------------------------------------------------------
+// Output
+//------------------------------------------------------------
+
+static string EventName(const ProfileEvent& event)
+{
+    if (event.index < 0)
+        return event.name;
+    char buffer[128];
+    snprintf(buffer, sizeof(buffer), "%s[%d]", event.name, event.index);
+    return buffer;
+}
+
+static void ResolveAll()
+{
+    for (int i = 0; i < PROFILER_FRAMES_IN_FLIGHT; i++)
+        ResolveSlot(slots[i], true);
+}
+
+bool profilerWrite(const char* path)
+{
+    ResolveAll();
+
+    FILE* fp = fopen(path, "w");
+    if (fp == NULL)
+        return false;
+
+    size_t length = strlen(path);
+    bool json = length >= 5 && strcmp(path + length - 5, ".json") == 0;
+
+    if (json)
+        fprintf(fp, "{\"traceEvents\":[\n");
+    else
+        fprintf(fp, "frame,timeline,name,start_us,duration_us\n");
+
+    bool first = true;
+    for (size_t i = 0; i < events.size(); i++) {
+        const ProfileEvent& event = events[i];
+        if (event.duration_us < 0.0)
+            continue;
+
+        string name = EventName(event);
+        if (json) {
+            // GPU work gets its own track
+            fprintf(fp, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"frame\":%d}}",
+                first ? "" : ",\n", name.c_str(), event.gpu ? "gpu" : "cpu",
+                event.start_us, event.duration_us, event.gpu ? 2 : 1, event.frame);
+        }
+        else {
+            fprintf(fp, "%d,%s,%s,%.3f,%.3f\n", event.frame, event.gpu ? "gpu" : "cpu",
+                name.c_str(), event.start_us, event.duration_us);
+        }
+        first = false;
+    }
+
+    if (json)
+        fprintf(fp, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+    printf("Profile with %u events written to %s (%u GPU results dropped)\n",
+        (unsigned int)events.size(), path, gpu_dropped);
+    return fclose(fp) == 0;
+}
+
+void profilerPrintSummary()
+{
+    struct Total { double sum; int count; };
+    map<string, Total> totals;
+
+    ResolveAll();
+
+    for (size_t i = 0; i < events.size(); i++) {
+        const ProfileEvent& event = events[i];
+        if (event.duration_us < 0.0)
+            continue;
+        Total& total = totals[(event.gpu ? "gpu " : "cpu ") + EventName(event)];
+        total.sum += event.duration_us;
+        total.count++;
+    }
+
+    printf("%-28s %10s %8s\n", "scope", "avg (us)", "count");
+    for (map<string, Total>::const_iterator it = totals.begin(); it != totals.end(); ++it)
+        printf("%-28s %10.2f %8d\n", it->first.c_str(), it->second.sum / it->second.count, it->second.count);
+}
+
+size_t profilerResidentBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return counters.WorkingSetSize;
+#else
+    // Second field of statm is the resident page count
+    FILE* fp = fopen("/proc/self/statm", "r");
+    if (fp == NULL)
+        return 0;
+    unsigned long size = 0, resident = 0;
+    int read = fscanf(fp, "%lu %lu", &size, &resident);
+    fclose(fp);
+    return read == 2 ? resident * (size_t)sysconf(_SC_PAGESIZE) : 0;
+#endif
+}
+
+size_t profilerPeakResidentBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return counters.PeakWorkingSetSize;
+#else
+    // Kilobytes on Linux
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    return (size_t)usage.ru_maxrss * 1024;
+#endif
+}
@@ -0,0 +1,83 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stddef.h>
+
+#include <GL/glew.h>
+
+// Lightweight CPU/GPU instrumentation that also works in release builds.
+//
+// - GL errors arrive through a KHR_debug callback instead of polling
+//   glGetError after every call.
+// - CPU scopes use a high resolution clock.
+// - GPU scopes use GL_TIMESTAMP queries. Each frame has its own set in
+//   a ring of PROFILER_FRAMES_IN_FLIGHT, and results are read back only
+//   once available, so profiling never stalls the pipeline. Timestamps
+//   (not GL_TIME_ELAPSED) are used because elapsed-time queries cannot
+//   nest, and object scopes sit inside pass scopes.
+//
+// Nothing is recorded until profilerStart() is called. Only the last
+// PROFILER_HISTORY_FRAMES frames are kept, so long runs use bounded
+// memory; the trace and the summary cover those frames.
+
+#define PROFILER_FRAMES_IN_FLIGHT 4
+#define PROFILER_HISTORY_FRAMES 1000
+
+// True once the debug callback is installed; GL_CHECK stops polling then
+extern bool gl_debug_output;
+
+// Installs the KHR_debug callback if the context supports it. In _DEBUG
+// builds output is synchronous and GL errors abort, like GL_CHECK did.
+bool installDebugCallback();
+
+void profilerStart();
+bool profilerEnabled();
+
+// Frame boundaries. profilerBeginFrame reads back the GPU queries of the
+// frame that last used the same ring slot, dropping any that are not done,
+// and forgets frames older than the history.
+void profilerBeginFrame();
+void profilerEndFrame();
+
+// Scopes are identified by a static name and an optional index, which is
+// how per-object entries ("object", i) are told apart.
+void profilerCpuBegin(const char* name, int index = -1);
+void profilerCpuEnd();
+void profilerGpuBegin(const char* name, int index = -1);
+void profilerGpuEnd();
+
+// Waits for all outstanding GPU queries, then writes every event kept.
+// The format follows the extension: .json is Chrome trace (load it in
+// chrome://tracing or Perfetto), anything else is CSV.
+bool profilerWrite(const char* path);
+
+// Prints average CPU and GPU time per scope over the frames kept
+void profilerPrintSummary();
+
+// Resident memory of the process now and at its peak so far, in bytes;
+// 0 where the platform does not tell
+size_t profilerResidentBytes();
+size_t profilerPeakResidentBytes();
+
+// RAII helpers
+struct ProfileCpuScope
+{
+	ProfileCpuScope(const char* name, int index = -1) { profilerCpuBegin(name, index); }
+	~ProfileCpuScope() { profilerCpuEnd(); }
+};
+
+struct ProfileGpuScope
+{
+	ProfileGpuScope(const char* name, int index = -1) { profilerGpuBegin(name, index); }
+	~ProfileGpuScope() { profilerGpuEnd(); }
+};
+
+// Times the rest of the enclosing block on both the CPU and the GPU
+struct ProfileScope
+{
+	ProfileCpuScope cpu;
+	ProfileGpuScope gpu;
+	ProfileScope(const char* name, int index = -1) : cpu(name, index), gpu(name, index) {}
+};
+
+#endif
@@ -0,0 +1,355 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "framescheduler.h"
+#include "glsl.h"
+#include "mappedfile.h"
+#include "programcache.h"
+
+using namespace std;
+
+static bool enabled = true;
+static bool queried = false;
+static bool parallel = false;
+static vector<GLint> binaryFormats;
+static uint64_t driverHash;
+static ProgramCacheStats stats;
+
+// 64-bit FNV-1a, continued from hash
+static uint64_t HashBytes(uint64_t hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
+
+// Strings are hashed with their terminator, so "ab" + "c" and "a" + "bc"
+// give different keys
+static uint64_t HashString(uint64_t hash, const char* text)
+{
+    if (text == NULL)
+        text = "";
+    return HashBytes(hash, text, strlen(text) + 1);
+}
+
+static const uint64_t HASH_START = 0xCBF29CE484222325ull;
+
+static void QueryDriver()
+{
+    if (queried)
+        return;
+    queried = true;
+
+    driverHash = HASH_START;
+    driverHash = HashString(driverHash, (const char*)glGetString(GL_VENDOR));
+    driverHash = HashString(driverHash, (const char*)glGetString(GL_RENDERER));
+    driverHash = HashString(driverHash, (const char*)glGetString(GL_VERSION));
+
+    // Let the driver pick how many compiler threads to use
+    if (GLEW_KHR_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+        parallel = true;
+    }
+
+    if (!GLEW_ARB_get_program_binary)
+        return;
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &count);
+    if (count > 0) {
+        binaryFormats.resize(count);
+        glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, &binaryFormats[0]);
+    }
+}
+
+bool programCacheSupported()
+{
+    QueryDriver();
+    return !binaryFormats.empty();
+}
+
+bool parallelShaderCompile()
+{
+    QueryDriver();
+    return parallel;
+}
+
+static uint64_t ProgramKey(const char* vertexSource, const char* fragmentSource, const char* defines)
+{
+    uint64_t key = driverHash;
+    key = HashString(key, vertexSource);
+    key = HashString(key, fragmentSource);
+    key = HashString(key, defines);
+    return key;
+}
+
+string programCachePath(const char* vshPath, const char* fshPath, const char* defines)
+{
+    // Both names without extension, in the vertex shader's directory
+    string vsh(vshPath), fsh(fshPath);
+    size_t slash = fsh.find_last_of("/\\");
+    if (slash != string::npos)
+        fsh.erase(0, slash + 1);
+    for (string* name : { &vsh, &fsh }) {
+        size_t dot = name->find_last_of('.');
+        slash = name->find_last_of("/\\");
+        if (dot != string::npos && (slash == string::npos || dot > slash))
+            name->erase(dot);
+    }
+
+    string path = vsh + "+" + fsh;
+    if (defines != NULL && defines[0] != '\0') {
+        char suffix[24];
+        snprintf(suffix, sizeof(suffix), "-%08x", (unsigned int)HashString(HASH_START, defines));
+        path += suffix;
+    }
+    return path + ".program";
+}
+
+// 0 when the file is missing, was made from other sources or for another
+// driver, or the driver refuses it
+static GLuint LoadBinary(const string& path, uint64_t key)
+{
+    MappedFile file;
+    if (!mapFile(path.c_str(), file))
+        return 0;
+
+    GLuint program = 0;
+    const ProgramCacheHeader* header = (const ProgramCacheHeader*)file.data;
+    if (file.size >= sizeof(ProgramCacheHeader) && header->magic == PROGRAMCACHE_MAGIC &&
+        header->version == PROGRAMCACHE_VERSION && header->key == key &&
+        header->binarySize == file.size - sizeof(ProgramCacheHeader) &&
+        find(binaryFormats.begin(), binaryFormats.end(), (GLint)header->binaryFormat) != binaryFormats.end()) {
+        program = glCreateProgram();
+        glProgramBinary(program, header->binaryFormat, file.data + sizeof(ProgramCacheHeader), header->binarySize);
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked) {
+            glDeleteProgram(program);
+            program = 0;
+            stats.rejected++;
+        }
+    }
+    unmapFile(file);
+    return program;
+}
+
+static GLuint Compile(const char* vertexSource, const char* fragmentSource, const char* defines, bool retrievable)
+{
+    GLuint vsh = glsl::makeShader(GL_VERTEX_SHADER, vertexSource, defines);
+    GLuint fsh = glsl::makeShader(GL_FRAGMENT_SHADER, fragmentSource, defines);
+    GLuint program = glsl::makeShaderProgram(vsh, fsh, retrievable);
+    // The program keeps what it needs; the shaders go once detached
+    for (GLuint shader : { vsh, fsh }) {
+        if (shader == 0)
+            continue;
+        if (program != 0)
+            glDetachShader(program, shader);
+        glDeleteShader(shader);
+    }
+    return program;
+}
+
+static bool StoreBinary(const string& path, uint64_t key, GLuint program)
+{
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return false;
+
+    vector<char> image(sizeof(ProgramCacheHeader) + length);
+    GLsizei written = 0;
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &written, &format, &image[sizeof(ProgramCacheHeader)]);
+    if (written <= 0)
+        return false;
+    image.resize(sizeof(ProgramCacheHeader) + written);
+
+    ProgramCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = PROGRAMCACHE_MAGIC;
+    header.version = PROGRAMCACHE_VERSION;
+    header.key = key;
+    header.binaryFormat = format;
+    header.binarySize = (uint32_t)written;
+    memcpy(&image[0], &header, sizeof(header));
+
+    FILE* fp = fopen(path.c_str(), "wb");
+    if (fp == NULL)
+        return false;
+    bool ok = fwrite(&image[0], 1, image.size(), fp) == image.size();
+    ok = fclose(fp) == 0 && ok;
+    // Never leave a truncated binary behind
+    if (!ok)
+        remove(path.c_str());
+    return ok;
+}
+
+GLuint loadCachedProgram(const char* vshPath, const char* fshPath, const char* defines)
+{
+    double start = schedulerClock();
+    QueryDriver();
+
+    char* vertexSource = glsl::readFile(vshPath);
+    char* fragmentSource = glsl::readFile(fshPath);
+    GLuint program = 0;
+    if (vertexSource != NULL && fragmentSource != NULL) {
+        bool binaries = enabled && !binaryFormats.empty();
+        string path;
+        uint64_t key = 0;
+        if (binaries) {
+            path = programCachePath(vshPath, fshPath, defines);
+            key = ProgramKey(vertexSource, fragmentSource, defines);
+            program = LoadBinary(path, key);
+            if (program != 0)
+                stats.loaded++;
+        }
+        if (program == 0) {
+            program = Compile(vertexSource, fragmentSource, defines, binaries);
+            if (program != 0) {
+                stats.compiled++;
+                if (binaries && StoreBinary(path, key, program))
+                    stats.stored++;
+            }
+        }
+    }
+    if (program == 0) {
+        printf("Shader program %s + %s could not be built\n", vshPath, fshPath);
+        stats.failed++;
+    }
+
+    delete[] vertexSource;
+    delete[] fragmentSource;
+    stats.seconds += schedulerClock() - start;
+    return program;
+}
+
+bool startProgramBuild(const char* vshPath, const char* fshPath, const char* defines, ProgramBuild& build)
+{
+    QueryDriver();
+    build.program = 0;
+    build.shaders[0] = build.shaders[1] = 0;
+    build.step = 0;
+    build.start = schedulerClock();
+
+    char* vertexSource = glsl::readFile(vshPath);
+    char* fragmentSource = glsl::readFile(fshPath);
+    bool ok = vertexSource != NULL && fragmentSource != NULL;
+    if (ok) {
+        build.vertexSource = vertexSource;
+        build.fragmentSource = fragmentSource;
+        build.defines = defines != NULL ? defines : "";
+        build.binaries = enabled && !binaryFormats.empty();
+        build.path = build.binaries ? programCachePath(vshPath, fshPath, defines) : string();
+        build.key = ProgramKey(vertexSource, fragmentSource, defines);
+    }
+    delete[] vertexSource;
+    delete[] fragmentSource;
+    return ok;
+}
+
+static void DeleteBuildShaders(ProgramBuild& build)
+{
+    for (GLuint& shader : build.shaders) {
+        if (shader == 0)
+            continue;
+        if (build.program != 0)
+            glDetachShader(build.program, shader);
+        glDeleteShader(shader);
+        shader = 0;
+    }
+}
+
+ProgramBuildStatus pollProgramBuild(ProgramBuild& build)
+{
+    // One driver call per poll. Nothing asks for a result until the
+    // driver says it is done, so nothing waits for its compiler threads.
+    switch (build.step) {
+    case 0:
+        build.shaders[0] = glsl::compileShader(GL_VERTEX_SHADER, build.vertexSource.c_str(), build.defines.c_str());
+        build.step++;
+        return PROGRAM_BUILD_PENDING;
+    case 1:
+        build.shaders[1] = glsl::compileShader(GL_FRAGMENT_SHADER, build.fragmentSource.c_str(), build.defines.c_str());
+        build.step++;
+        return PROGRAM_BUILD_PENDING;
+    case 2:
+        build.program = glCreateProgram();
+        glAttachShader(build.program, build.shaders[0]);
+        glAttachShader(build.program, build.shaders[1]);
+        if (build.binaries)
+            glProgramParameteri(build.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(build.program);
+        build.step++;
+        return PROGRAM_BUILD_PENDING;
+    default:
+        break;
+    }
+
+    if (build.program == 0)
+        return PROGRAM_BUILD_FAILED;
+    if (parallel) {
+        GLint done = GL_FALSE;
+        glGetProgramiv(build.program, GL_COMPLETION_STATUS_KHR, &done);
+        if (!done)
+            return PROGRAM_BUILD_PENDING;
+    }
+
+    GLint linked = GL_FALSE;
+    glGetProgramiv(build.program, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        for (GLuint shader : build.shaders)
+            glsl::compiledStatus(shader);
+        glsl::linkedStatus(build.program);
+        cancelProgramBuild(build);
+        stats.failed++;
+        return PROGRAM_BUILD_FAILED;
+    }
+
+    DeleteBuildShaders(build);
+    stats.compiled++;
+    if (build.binaries && StoreBinary(build.path, build.key, build.program))
+        stats.stored++;
+    return PROGRAM_BUILD_DONE;
+}
+
+void cancelProgramBuild(ProgramBuild& build)
+{
+    DeleteBuildShaders(build);
+    if (build.program != 0)
+        glDeleteProgram(build.program);
+    build.program = 0;
+}
+
+void setProgramCacheEnabled(bool on)
+{
+    enabled = on;
+}
+
+ProgramCacheStats programCacheStats()
+{
+    return stats;
+}
+
+void resetProgramCacheStats()
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+void printProgramCacheStats()
+{
+    if (!enabled)
+        printf("Shader programs: %u compiled in %.1f ms, binary cache off\n", stats.compiled, 1000.0 * stats.seconds);
+    else if (!programCacheSupported())
+        printf("Shader programs: %u compiled in %.1f ms, driver has no program binary formats\n",
+            stats.compiled, 1000.0 * stats.seconds);
+    else
+        printf("Shader programs: %u from cache, %u compiled (%u stored, %u stale binaries rejected) in %.1f ms\n",
+            stats.loaded, stats.compiled, stats.stored, stats.rejected, 1000.0 * stats.seconds);
+}
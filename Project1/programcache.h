@@ -0,0 +1,100 @@
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include <stdint.h>
+#include <string>
+
+#include <GL/glew.h>
+
+// Linked shader programs kept on disk as glGetProgramBinary output, so a
+// later start can skip compiling and linking with glProgramBinary.
+//
+// Layout: ProgramCacheHeader, then the driver's binary. The key hashes both
+// sources, the defines and the GL vendor, renderer and version strings;
+// editing a shader or updating the driver makes the file miss and it is
+// rewritten after a normal compile. So is a file the driver refuses to
+// load. Without ARB_get_program_binary, or with no binary formats (Mesa
+// with its shader cache disabled), programs are simply compiled.
+
+#define PROGRAMCACHE_MAGIC 0x47525050 // "PPRG"
+#define PROGRAMCACHE_VERSION 1
+
+struct ProgramCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;
+	uint32_t binaryFormat;
+	uint32_t binarySize;        // bytes following the header
+};
+
+struct ProgramCacheStats
+{
+	unsigned int loaded;        // from a binary
+	unsigned int compiled;      // from source, cache missing or stale
+	unsigned int stored;        // binaries written
+	unsigned int rejected;      // binaries the driver would not load
+	unsigned int failed;        // did not compile or link at all
+	double seconds;             // in loadCachedProgram, reading files included
+};
+
+// "shaders/a.vert" + "b.frag" -> "shaders/a+b.program"; defines add their
+// hash: "shaders/a+b-1f2e3d4c.program"
+std::string programCachePath(const char * vshPath, const char * fshPath, const char * defines = NULL);
+
+// Program of a vertex and fragment shader file. defines are "#define" lines
+// inserted after #version and may be NULL. 0 if it does not compile or link.
+GLuint loadCachedProgram(const char * vshPath, const char * fshPath, const char * defines = NULL);
+
+enum ProgramBuildStatus
+{
+	PROGRAM_BUILD_PENDING,
+	PROGRAM_BUILD_DONE,
+	PROGRAM_BUILD_FAILED
+};
+
+// A program compiled and linked without waiting for it. Drivers may run
+// the GLSL front end inside glCompileShader and glLinkProgram even with
+// KHR_parallel_shader_compile (Mesa does), so each poll makes at most one
+// of those calls: vertex shader, fragment shader, link. After that,
+// polling only asks whether the driver's threads are done. Without the
+// extension the poll after the link waits for it.
+struct ProgramBuild
+{
+	GLuint program;
+	GLuint shaders[2];
+	int step;                   // next driver call to make
+	std::string vertexSource;
+	std::string fragmentSource;
+	std::string defines;
+	std::string path;           // binary written once it links
+	uint64_t key;
+	bool binaries;
+	double start;
+};
+
+// Reads both files. Never looks at the binary cache, the point is to pick
+// up changed sources. False if a file cannot be read.
+bool startProgramBuild(const char * vshPath, const char * fshPath, const char * defines, ProgramBuild & build);
+
+// DONE passes build.program to the caller and stores its binary. FAILED
+// prints the compile and link logs and deletes everything.
+ProgramBuildStatus pollProgramBuild(ProgramBuild & build);
+
+// Drops a build that is still pending
+void cancelProgramBuild(ProgramBuild & build);
+
+// True when the driver compiles on its own threads
+bool parallelShaderCompile();
+
+// Off compiles every program and leaves the files alone: --no-program-cache
+void setProgramCacheEnabled(bool enabled);
+
+// False when the driver cannot hand out program binaries
+bool programCacheSupported();
+
+ProgramCacheStats programCacheStats();
+void resetProgramCacheStats();
+void printProgramCacheStats();
+
+#endif
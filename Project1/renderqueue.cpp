@@ -0,0 +1,110 @@
+#include <string.h>
+
+#include "framescheduler.h"
+#include "renderqueue.h"
+
+using namespace std;
+
+static const unsigned int RADIX_BITS = 8;
+static const unsigned int RADIX_BUCKETS = 1 << RADIX_BITS;
+static const unsigned int RADIX_PASSES = 64 / RADIX_BITS;
+static const size_t RADIX_MIN_COUNT = 32;
+
+uint64_t makeRenderKey(unsigned int program, unsigned int texture, unsigned int material, unsigned int vao, float depth)
+{
+    if (!(depth > 0.0f))
+        depth = 0.0f;
+    if (depth > 1.0f)
+        depth = 1.0f;
+    uint64_t quantized = (uint64_t)(depth * (float)((1u << RENDERKEY_DEPTH_BITS) - 1));
+
+    uint64_t key = 0;
+    key |= (uint64_t)(program & ((1u << RENDERKEY_PROGRAM_BITS) - 1)) << RENDERKEY_PROGRAM_SHIFT;
+    key |= (uint64_t)(texture & ((1u << RENDERKEY_TEXTURE_BITS) - 1)) << RENDERKEY_TEXTURE_SHIFT;
+    key |= (uint64_t)(material & ((1u << RENDERKEY_MATERIAL_BITS) - 1)) << RENDERKEY_MATERIAL_SHIFT;
+    key |= (uint64_t)(vao & ((1u << RENDERKEY_VAO_BITS) - 1)) << RENDERKEY_VAO_SHIFT;
+    key |= quantized << RENDERKEY_DEPTH_SHIFT;
+    return key;
+}
+
+void clearRenderQueue(RenderQueue& queue)
+{
+    queue.items.clear();
+}
+
+void pushRenderItem(RenderQueue& queue, uint64_t key, uint32_t index)
+{
+    RenderItem item;
+    item.key = key;
+    item.index = index;
+    queue.items.push_back(item);
+}
+
+unsigned int radixSortRenderItems(RenderItem* items, RenderItem* scratch, size_t count)
+{
+    // A few draws, like a small scene, sort faster in place
+    if (count <= RADIX_MIN_COUNT) {
+        for (size_t i = 1; i < count; i++) {
+            RenderItem item = items[i];
+            size_t j = i;
+            for (; j > 0 && items[j - 1].key > item.key; j--)
+                items[j] = items[j - 1];
+            items[j] = item;
+        }
+        return 0;
+    }
+
+    // Histograms of every digit in one read of the keys
+    size_t counts[RADIX_PASSES][RADIX_BUCKETS];
+    memset(counts, 0, sizeof(counts));
+    for (size_t i = 0; i < count; i++) {
+        uint64_t key = items[i].key;
+        for (unsigned int pass = 0; pass < RADIX_PASSES; pass++)
+            counts[pass][(key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
+    }
+
+    RenderItem* from = items;
+    RenderItem* to = scratch;
+    unsigned int moved = 0;
+    for (unsigned int pass = 0; pass < RADIX_PASSES; pass++) {
+        size_t* bucket = counts[pass];
+        unsigned int shift = pass * RADIX_BITS;
+
+        // All keys share this digit: the order stays as it is
+        if (bucket[(from[0].key >> shift) & (RADIX_BUCKETS - 1)] == count)
+            continue;
+
+        size_t offset = 0;
+        for (unsigned int b = 0; b < RADIX_BUCKETS; b++) {
+            size_t n = bucket[b];
+            bucket[b] = offset;
+            offset += n;
+        }
+        for (size_t i = 0; i < count; i++)
+            to[bucket[(from[i].key >> shift) & (RADIX_BUCKETS - 1)]++] = from[i];
+
+        RenderItem* swap = from;
+        from = to;
+        to = swap;
+        moved++;
+    }
+
+    if (from != items)
+        memcpy(items, from, count * sizeof(RenderItem));
+    return moved;
+}
+
+void sortRenderQueue(RenderQueue& queue)
+{
+    double start = schedulerClock();
+    size_t count = queue.items.size();
+    if (queue.scratch.size() < count)
+        queue.scratch.resize(count);
+    if (count > 0)
+        radixSortRenderItems(&queue.items[0], &queue.scratch[0], count);
+
+    queue.batches = count > 0 ? 1 : 0;
+    for (size_t i = 1; i < count; i++)
+        queue.batches += renderStateChanged(queue.items[i - 1].key, queue.items[i].key);
+    queue.sortSeconds = schedulerClock() - start;
+}
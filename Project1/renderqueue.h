@@ -0,0 +1,81 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// The draws of one frame, each with a 64-bit sort key. Sorting the keys
+// puts draws that need the same state next to each other, so state
+// changes follow the number of distinct programs, textures and materials
+// instead of the number of objects.
+//
+// Key layout, most significant bits first. The most expensive change
+// comes first:
+//   program   6 bits   shader variant (feature mask)
+//   texture  12 bits
+//   material  6 bits   index into the material table
+//   vao      13 bits
+//   depth    24 bits   front to back within equal state
+//   3 bits unused
+// Texture and VAO names are masked to their field. Names that collide
+// only cost a state change, the draw itself always uses its own state.
+//
+// Keys are sorted with an LSD radix sort, 8 bits per pass. A pass is
+// skipped when every key has the same digit, which is the usual case for
+// the state fields. Up to 32 items are insertion sorted instead.
+
+#define RENDERKEY_PROGRAM_BITS 6
+#define RENDERKEY_TEXTURE_BITS 12
+#define RENDERKEY_MATERIAL_BITS 6
+#define RENDERKEY_VAO_BITS 13
+#define RENDERKEY_DEPTH_BITS 24
+
+#define RENDERKEY_DEPTH_SHIFT 3
+#define RENDERKEY_VAO_SHIFT (RENDERKEY_DEPTH_SHIFT + RENDERKEY_DEPTH_BITS)
+#define RENDERKEY_MATERIAL_SHIFT (RENDERKEY_VAO_SHIFT + RENDERKEY_VAO_BITS)
+#define RENDERKEY_TEXTURE_SHIFT (RENDERKEY_MATERIAL_SHIFT + RENDERKEY_MATERIAL_BITS)
+#define RENDERKEY_PROGRAM_SHIFT (RENDERKEY_TEXTURE_SHIFT + RENDERKEY_TEXTURE_BITS)
+
+// Everything above the depth: draws with equal state bits form a batch
+#define RENDERKEY_STATE_SHIFT RENDERKEY_VAO_SHIFT
+
+struct RenderItem
+{
+	uint64_t key;
+	uint32_t index;             // the caller's draw or object
+};
+
+struct RenderQueue
+{
+	std::vector<RenderItem> items;
+	std::vector<RenderItem> scratch;
+	double sortSeconds;         // last sortRenderQueue
+	unsigned int batches;       // runs of equal state after the last sort
+};
+
+// depth is 0 at the near and 1 at the far end, clamped
+uint64_t makeRenderKey(unsigned int program, unsigned int texture, unsigned int material, unsigned int vao, float depth);
+
+void clearRenderQueue(RenderQueue & queue);
+void pushRenderItem(RenderQueue & queue, uint64_t key, uint32_t index);
+
+// Sorts by key, equal keys keep their order, and counts the batches
+void sortRenderQueue(RenderQueue & queue);
+
+// Stable ascending sort of count items; scratch needs as many. Returns the
+// radix passes that moved data (at most 8).
+unsigned int radixSortRenderItems(RenderItem * items, RenderItem * scratch, size_t count);
+
+// True when b needs other state than a
+inline bool renderStateChanged(uint64_t a, uint64_t b)
+{
+	return ((a ^ b) >> RENDERKEY_STATE_SHIFT) != 0;
+}
+
+inline unsigned int renderKeyField(uint64_t key, unsigned int shift, unsigned int bits)
+{
+	return (unsigned int)(key >> shift) & ((1u << bits) - 1);
+}
+
+#endif
@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#include "framescheduler.h"
+#include "programcache.h"
+#include "shadervariants.h"
+
+using namespace std;
+
+// Define names, in bit order
+static const char* FEATURE_NAMES[SHADER_FEATURE_COUNT] = {
+    "DIFFUSE", "TEXTURED", "TEXTURE_ARRAY", "SPECULAR", "INSTANCED", "CLUSTERED"
+};
+
+static bool IsBlack(const glm::vec4& color)
+{
+    return color.x <= 0.0f && color.y <= 0.0f && color.z <= 0.0f;
+}
+
+void initShaderVariants(ShaderVariants& variants, const char* vshPath, const char* fshPath)
+{
+    variants.vshPath = vshPath;
+    variants.fshPath = fshPath;
+    variants.compiled = 0;
+    variants.compileSeconds = 0.0;
+    variants.reloading = false;
+    variants.reloadStart = variants.reloadSeconds = 0.0;
+    variants.reloadStallSeconds = variants.pumpStallSeconds = 0.0;
+    variants.reloads = variants.reloadsFailed = 0;
+    for (unsigned int features = 0; features < SHADER_VARIANT_COUNT; features++) {
+        ShaderVariant& variant = variants.variants[features];
+        variant = ShaderVariant();
+        shaderFeatureName(features, variant.name, sizeof(variant.name));
+        variant.modelView = variant.materialIndex = -1;
+        variant.textureLayer = variant.instanceOffset = -1;
+    }
+}
+
+void destroyShaderVariants(ShaderVariants& variants)
+{
+    for (ShaderVariant& variant : variants.variants) {
+        if (variant.rebuilding)
+            cancelProgramBuild(variant.rebuild);
+        variant.rebuilding = variant.reloadQueued = false;
+        if (variant.program != 0)
+            glDeleteProgram(variant.program);
+        variant.program = 0;
+    }
+}
+
+unsigned int normalizeShaderFeatures(unsigned int features)
+{
+    features &= SHADER_VARIANT_COUNT - 1;
+    if (!(features & SHADER_DIFFUSE))
+        features &= ~SHADER_TEXTURED;
+    if (!(features & SHADER_TEXTURED))
+        features &= ~SHADER_TEXTURE_ARRAY;
+    if (!(features & (SHADER_DIFFUSE | SHADER_SPECULAR)))
+        features &= ~SHADER_CLUSTERED;
+    return features;
+}
+
+unsigned int materialShaderFeatures(const MaterialUniforms& material, bool textured, bool textureArray)
+{
+    unsigned int features = 0;
+    if (!IsBlack(material.diffuse)) {
+        features |= SHADER_DIFFUSE;
+        if (textured)
+            features |= textureArray ? SHADER_TEXTURED | SHADER_TEXTURE_ARRAY : SHADER_TEXTURED;
+    }
+    if (!IsBlack(material.specular))
+        features |= SHADER_SPECULAR;
+    return features;
+}
+
+string shaderFeatureDefines(unsigned int features)
+{
+    string defines;
+    for (unsigned int bit = 0; bit < SHADER_FEATURE_COUNT; bit++)
+        if (features & (1u << bit))
+            defines += string("#define ") + FEATURE_NAMES[bit] + "\n";
+    return defines;
+}
+
+void shaderFeatureName(unsigned int features, char* name, size_t size)
+{
+    string text;
+    for (unsigned int bit = 0; bit < SHADER_FEATURE_COUNT; bit++) {
+        if (features & (1u << bit)) {
+            if (!text.empty())
+                text += "|";
+            text += FEATURE_NAMES[bit];
+        }
+    }
+    snprintf(name, size, "%s", text.empty() ? "AMBIENT" : text.c_str());
+}
+
+static void FindUniforms(ShaderVariant& variant)
+{
+    variant.modelView = glGetUniformLocation(variant.program, "model_view");
+    variant.materialIndex = glGetUniformLocation(variant.program, "material_index");
+    variant.textureLayer = glGetUniformLocation(variant.program, "texture_layer");
+    variant.instanceOffset = glGetUniformLocation(variant.program, "instance_offset");
+}
+
+ShaderVariant* getShaderVariant(ShaderVariants& variants, unsigned int features)
+{
+    ShaderVariant& variant = variants.variants[normalizeShaderFeatures(features)];
+    if (variant.program != 0)
+        return &variant;
+    if (variant.failed)
+        return NULL;
+
+    double start = schedulerClock();
+    string defines = shaderFeatureDefines(normalizeShaderFeatures(features));
+    variant.program = loadCachedProgram(variants.vshPath, variants.fshPath, defines.c_str());
+    variant.compileSeconds = schedulerClock() - start;
+    variants.compileSeconds += variant.compileSeconds;
+    if (variant.program == 0) {
+        printf("Shader variant %s does not build\n", variant.name);
+        variant.failed = true;
+        return NULL;
+    }
+    variants.compiled++;
+    FindUniforms(variant);
+    return &variant;
+}
+
+void reloadShaderVariants(ShaderVariants& variants)
+{
+    for (ShaderVariant& variant : variants.variants) {
+        if (variant.rebuilding)
+            cancelProgramBuild(variant.rebuild);
+        variant.rebuilding = false;
+        // Variants that did not build get another try with the new files
+        variant.reloadQueued = variant.program != 0 || variant.failed;
+    }
+    variants.reloading = true;
+    variants.reloadStart = schedulerClock();
+    variants.pumpStallSeconds = 0.0;
+}
+
+// Drops every new program, the running ones stay
+static void AbandonReload(ShaderVariants& variants)
+{
+    for (ShaderVariant& variant : variants.variants) {
+        if (variant.rebuilding)
+            cancelProgramBuild(variant.rebuild);
+        variant.rebuilding = variant.reloadQueued = false;
+    }
+    variants.reloading = false;
+    variants.reloadsFailed++;
+    printf("Shader reload failed, keeping the running programs\n");
+}
+
+bool pumpShaderVariants(ShaderVariants& variants)
+{
+    if (!variants.reloading)
+        return false;
+    double start = schedulerClock();
+
+    // One build at a time, one step of it per frame; the next starts
+    // when it is done
+    ShaderVariant* building = NULL;
+    for (ShaderVariant& variant : variants.variants)
+        if (building == NULL && variant.rebuilding && variant.rebuildStatus == PROGRAM_BUILD_PENDING)
+            building = &variant;
+    for (unsigned int features = 0; features < SHADER_VARIANT_COUNT && building == NULL; features++) {
+        ShaderVariant& variant = variants.variants[features];
+        if (!variant.reloadQueued)
+            continue;
+        variant.reloadQueued = false;
+        string defines = shaderFeatureDefines(features);
+        if (!startProgramBuild(variants.vshPath, variants.fshPath, defines.c_str(), variant.rebuild)) {
+            AbandonReload(variants);
+            return false;
+        }
+        variant.rebuilding = true;
+        building = &variant;
+    }
+    bool pending = false;
+    if (building != NULL) {
+        building->rebuildStatus = pollProgramBuild(building->rebuild);
+        if (building->rebuildStatus == PROGRAM_BUILD_FAILED) {
+            AbandonReload(variants);
+            return false;
+        }
+        pending = true;
+    }
+    variants.pumpStallSeconds = max(variants.pumpStallSeconds, schedulerClock() - start);
+    if (pending)
+        return false;
+
+    // Everything linked: swap all variants together
+    for (ShaderVariant& variant : variants.variants) {
+        if (!variant.rebuilding)
+            continue;
+        glDeleteProgram(variant.program);
+        variant.program = variant.rebuild.program;
+        variant.rebuild.program = 0;
+        variant.rebuilding = false;
+        if (variant.failed)
+            variants.compiled++;
+        variant.failed = false;
+        FindUniforms(variant);
+    }
+    variants.reloading = false;
+    variants.reloads++;
+    variants.reloadSeconds = schedulerClock() - variants.reloadStart;
+    variants.reloadStallSeconds = variants.pumpStallSeconds;
+    printf("Shaders reloaded: %.1f ms after the edit, longest frame stall %.2f ms\n",
+        1000.0 * variants.reloadSeconds, 1000.0 * variants.reloadStallSeconds);
+    return true;
+}
+
+void shaderVariantsBeginFrame(ShaderVariants& variants)
+{
+    for (ShaderVariant& variant : variants.variants) {
+        variant.lastFrameDraws = variant.draws;
+        variant.draws = 0;
+    }
+}
+
+void printShaderVariantStats(const ShaderVariants& variants)
+{
+    unsigned int used = 0;
+    for (const ShaderVariant& variant : variants.variants)
+        used += variant.lastFrameDraws > 0;
+    printf("Shader variants: %u of %u built in %.1f ms, %u used last frame\n", variants.compiled,
+        SHADER_VARIANT_COUNT, 1000.0 * variants.compileSeconds, used);
+    if (variants.reloads > 0 || variants.reloadsFailed > 0)
+        printf("  %u reloads (%u failed), last one %.1f ms, longest frame stall %.2f ms (%s)\n",
+            variants.reloads, variants.reloadsFailed, 1000.0 * variants.reloadSeconds,
+            1000.0 * variants.reloadStallSeconds, parallelShaderCompile() ? "parallel compile" : "blocking compile");
+    for (const ShaderVariant& variant : variants.variants) {
+        if (variant.program == 0)
+            continue;
+        printf("  %-40s %6.2f ms to build, %u draws last frame\n", variant.name,
+            1000.0 * variant.compileSeconds, variant.lastFrameDraws);
+    }
+}
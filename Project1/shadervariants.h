@@ -0,0 +1,114 @@
+#ifndef SHADERVARIANTS_H
+#define SHADERVARIANTS_H
+
+#include <stddef.h>
+#include <string>
+
+#include <GL/glew.h>
+
+#include "programcache.h"
+#include "uniformbuffers.h"
+
+// Specialized programs built from one vertex and fragment shader pair.
+// Every feature bit becomes a #define right after #version, so a variant
+// only does the work its materials need. The full shader is simply the
+// variant with every bit set.
+//
+// Variants are compiled the first time they are asked for, through the
+// program binary cache, and kept until destroyShaderVariants(). Bits
+// that need another one (TEXTURED without DIFFUSE) are dropped first, so
+// equivalent masks share a program.
+//
+// reloadShaderVariants() rebuilds every variant in the background after
+// the files changed. pumpShaderVariants() takes one step of one build per
+// frame (see ProgramBuild) and swaps all variants at once when the last
+// one has linked, so a frame never mixes old and new shaders. If any
+// variant fails, every new program is dropped and the running ones stay.
+
+enum ShaderFeature
+{
+	SHADER_DIFFUSE = 1 << 0,        // Lambert term with the material's diffuse color
+	SHADER_TEXTURED = 1 << 1,       // diffuse color times texsampler, needs DIFFUSE
+	SHADER_TEXTURE_ARRAY = 1 << 2,  // texsampler is a sampler2DArray, needs TEXTURED
+	SHADER_SPECULAR = 1 << 3,       // Phong highlight, specular.w is the power
+	SHADER_INSTANCED = 1 << 4,      // transform and material from the instance buffer
+	SHADER_CLUSTERED = 1 << 5       // point lights of the pixel's cluster, needs DIFFUSE or SPECULAR
+};
+
+#define SHADER_FEATURE_COUNT 6
+#define SHADER_VARIANT_COUNT (1 << SHADER_FEATURE_COUNT)
+
+struct ShaderVariant
+{
+	GLuint program;             // 0 until first asked for
+	bool failed;                // did not build, tried again on the next reload
+	char name[64];              // "DIFFUSE|SPECULAR", stays put for the profiler
+	// Uniform locations, -1 where a feature compiled them out
+	GLint modelView;
+	GLint materialIndex;
+	GLint textureLayer;
+	GLint instanceOffset;
+	double compileSeconds;
+	unsigned int draws;         // counted by the caller since the frame began
+	unsigned int lastFrameDraws;
+
+	// Hot reload
+	bool reloadQueued;          // waiting for its build to be started
+	bool rebuilding;            // rebuild holds a build in flight or done
+	ProgramBuildStatus rebuildStatus;
+	ProgramBuild rebuild;
+};
+
+struct ShaderVariants
+{
+	const char * vshPath;
+	const char * fshPath;
+	ShaderVariant variants[SHADER_VARIANT_COUNT];
+	unsigned int compiled;
+	double compileSeconds;
+
+	// Hot reload
+	bool reloading;
+	double reloadStart;
+	double reloadSeconds;       // edit seen to programs swapped, last reload
+	double reloadStallSeconds;  // longest pump call of the last reload
+	double pumpStallSeconds;    // longest pump call of the reload in progress
+	unsigned int reloads;
+	unsigned int reloadsFailed;
+};
+
+void initShaderVariants(ShaderVariants & variants, const char * vshPath, const char * fshPath);
+void destroyShaderVariants(ShaderVariants & variants);
+
+unsigned int normalizeShaderFeatures(unsigned int features);
+
+// Cheapest features that still render material exactly: terms whose color
+// is black are left out. textureArray says how the texture is bound.
+unsigned int materialShaderFeatures(const MaterialUniforms & material, bool textured, bool textureArray);
+
+// "#define DIFFUSE\n#define SPECULAR\n"
+std::string shaderFeatureDefines(unsigned int features);
+
+// "DIFFUSE|SPECULAR", "AMBIENT" when no bit is set
+void shaderFeatureName(unsigned int features, char * name, size_t size);
+
+// Compiles the variant on first use. NULL if it does not build.
+ShaderVariant * getShaderVariant(ShaderVariants & variants, unsigned int features);
+
+// Rebuilds every variant asked for so far from the current files,
+// including the ones that failed. A reload still in progress is
+// abandoned.
+void reloadShaderVariants(ShaderVariants & variants);
+
+// Call once per frame. True when new programs were swapped in; uniform
+// locations are updated, but state caches keyed by program name must be
+// reset (glstateReset).
+bool pumpShaderVariants(ShaderVariants & variants);
+
+// Moves the draw counts of the frame that ended into lastFrameDraws
+void shaderVariantsBeginFrame(ShaderVariants & variants);
+
+// Compiled variants, their compile time and last frame's draws
+void printShaderVariantStats(const ShaderVariants & variants);
+
+#endif
@@ -0,0 +1,636 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SOFT_SSE2
+#endif
+
+#include "softraster.h"
+
+using namespace std;
+
+static const int SUBPIXEL = 1 << SOFT_SUBPIXEL_BITS;
+
+// Triangles are clipped to this many pixels around the viewport center,
+// which keeps window coordinates below 2^16 subpixels and the edge
+// functions inside one tile within 32 bits
+static const float GUARD_BAND_PIXELS = 2048.0f;
+
+// Vertices per vertex stage task
+static const size_t SOFT_VERTEX_CHUNK = 8192;
+
+static double Milliseconds(chrono::high_resolution_clock::time_point start)
+{
+    return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+void initSoftRenderer(SoftRenderer& renderer, int width, int height, unsigned int threads)
+{
+    renderer.width = width;
+    renderer.height = height;
+    renderer.tilesX = (width + SOFT_TILE_SIZE - 1) / SOFT_TILE_SIZE;
+    renderer.tilesY = (height + SOFT_TILE_SIZE - 1) / SOFT_TILE_SIZE;
+    renderer.color.assign((size_t)width * height * 3, 0);
+    renderer.depth.assign((size_t)width * height, 1.0f);
+    renderer.tilePixels.assign((size_t)renderer.tilesX * renderer.tilesY, 0);
+
+    // The calling thread only waits, so the pool gets every core
+    if (threads == 0)
+        threads = max(1u, thread::hardware_concurrency());
+    renderer.threads = threads;
+    startThreadPool(renderer.pool, threads);
+    renderer.stats = SoftRasterStats();
+}
+
+void destroySoftRenderer(SoftRenderer& renderer)
+{
+    stopThreadPool(renderer.pool);
+    renderer.draws.clear();
+    renderer.vertices.clear();
+    renderer.triangles.clear();
+    renderer.bins.clear();
+    renderer.color.clear();
+    renderer.depth.clear();
+}
+
+void beginSoftFrame(SoftRenderer& renderer, const glm::mat4& view, const glm::mat4& projection,
+    const glm::vec3& lightPosition, const glm::vec3& clearColor)
+{
+    renderer.view = view;
+    renderer.projection = projection;
+    renderer.lightPosition = lightPosition;
+    renderer.draws.clear();
+
+    unsigned char clear[3] = {
+        (unsigned char)(glm::clamp(clearColor.x, 0.0f, 1.0f) * 255.0f + 0.5f),
+        (unsigned char)(glm::clamp(clearColor.y, 0.0f, 1.0f) * 255.0f + 0.5f),
+        (unsigned char)(glm::clamp(clearColor.z, 0.0f, 1.0f) * 255.0f + 0.5f)
+    };
+    for (size_t i = 0; i < renderer.color.size(); i += 3)
+        memcpy(&renderer.color[i], clear, 3);
+    fill(renderer.depth.begin(), renderer.depth.end(), 1.0f);
+}
+
+void submitSoftDraw(SoftRenderer& renderer, const SoftDraw& draw)
+{
+    renderer.draws.push_back(draw);
+}
+
+//------------------------------------------------------------
+// Clipping. Sutherland-Hodgman against near, far and the
+// guard band, all in clip space where attributes are linear.
+//------------------------------------------------------------
+
+static const int CLIP_PLANES = 6;
+static const int CLIP_MAX_VERTICES = 3 + CLIP_PLANES;
+
+// Signed distance to plane p, inside when >= 0
+static float ClipDistance(const glm::vec4& c, int p, float guard_x, float guard_y)
+{
+    switch (p) {
+    case 0: return c.z + c.w;               // near
+    case 1: return c.w - c.z;               // far
+    case 2: return guard_x * c.w + c.x;
+    case 3: return guard_x * c.w - c.x;
+    case 4: return guard_y * c.w + c.y;
+    default: return guard_y * c.w - c.y;
+    }
+}
+
+static SoftVertex LerpVertex(const SoftVertex& a, const SoftVertex& b, float t)
+{
+    SoftVertex v;
+    v.clip = a.clip + (b.clip - a.clip) * t;
+    v.view = a.view + (b.view - a.view) * t;
+    v.normal = a.normal + (b.normal - a.normal) * t;
+    v.uv = a.uv + (b.uv - a.uv) * t;
+    v.outside = 0;
+    return v;
+}
+
+// Returns the vertex count of the clipped polygon in poly, 0 if nothing is left
+static int ClipPolygon(SoftVertex* poly, int count, unsigned int planes, float guard_x, float guard_y)
+{
+    SoftVertex scratch[CLIP_MAX_VERTICES];
+    for (int p = 0; p < CLIP_PLANES && count > 0; p++) {
+        if (!(planes & (1u << p)))
+            continue;
+        int out = 0;
+        for (int i = 0; i < count; i++) {
+            const SoftVertex& a = poly[i];
+            const SoftVertex& b = poly[(i + 1) % count];
+            float da = ClipDistance(a.clip, p, guard_x, guard_y);
+            float db = ClipDistance(b.clip, p, guard_x, guard_y);
+            if (da >= 0.0f)
+                scratch[out++] = a;
+            if ((da >= 0.0f) != (db >= 0.0f))
+                scratch[out++] = LerpVertex(a, b, da / (da - db));
+        }
+        count = out;
+        memcpy(poly, scratch, count * sizeof(SoftVertex));
+    }
+    return count;
+}
+
+//------------------------------------------------------------
+// Vertex stage, what vertexshader.vert does, plus the clip
+// planes each vertex is outside of
+//------------------------------------------------------------
+
+static void TransformVertices(const SoftRenderer& renderer, const SoftDraw& draw, SoftVertex* out, size_t begin, size_t end)
+{
+    const SoftMesh& mesh = *draw.mesh;
+    glm::mat4 mv = renderer.view * draw.model;
+    glm::mat3 normal_matrix(mv);
+    float guard_x = GUARD_BAND_PIXELS / (renderer.width * 0.5f);
+    float guard_y = GUARD_BAND_PIXELS / (renderer.height * 0.5f);
+    for (size_t i = begin; i < end; i++) {
+        glm::vec4 p = mv * glm::vec4(mesh.positions[i], 1.0f);
+        out[i].view = glm::vec3(p);
+        out[i].normal = normal_matrix * mesh.normals[i];
+        out[i].clip = renderer.projection * p;
+        out[i].uv = mesh.uvs != NULL ? mesh.uvs[i] : glm::vec2(0.0f);
+        out[i].outside = 0;
+        for (int p = 0; p < CLIP_PLANES; p++)
+            if (ClipDistance(out[i].clip, p, guard_x, guard_y) < 0.0f)
+                out[i].outside |= 1u << p;
+    }
+}
+
+//------------------------------------------------------------
+// Setup and binning of one clipped triangle. Returns false if
+// it covers no pixel center.
+//------------------------------------------------------------
+
+struct TileRect
+{
+    int x0, y0, x1, y1;     // pixels, inclusive
+};
+
+static bool SetupTriangle(const SoftRenderer& renderer, const SoftVertex& a, const SoftVertex& b, const SoftVertex& c,
+    unsigned int draw, SoftTriangle& tri, TileRect& rect)
+{
+    const SoftVertex* v[3] = { &a, &b, &c };
+    float half_w = renderer.width * 0.5f, half_h = renderer.height * 0.5f;
+    for (int i = 0; i < 3; i++) {
+        float inv_w = 1.0f / v[i]->clip.w;
+        float x = (v[i]->clip.x * inv_w + 1.0f) * half_w;
+        float y = (v[i]->clip.y * inv_w + 1.0f) * half_h;
+        tri.x[i] = (int)floorf(x * SUBPIXEL + 0.5f);
+        tri.y[i] = (int)floorf(y * SUBPIXEL + 0.5f);
+        tri.z[i] = v[i]->clip.z * inv_w * 0.5f + 0.5f;
+        tri.w[i] = inv_w;
+    }
+
+    // Counter-clockwise from here on; GL_CULL_FACE is off, both sides draw
+    long long area = (long long)(tri.x[1] - tri.x[0]) * (tri.y[2] - tri.y[0])
+        - (long long)(tri.x[2] - tri.x[0]) * (tri.y[1] - tri.y[0]);
+    if (area == 0)
+        return false;
+    if (area < 0) {
+        swap(tri.x[1], tri.x[2]);
+        swap(tri.y[1], tri.y[2]);
+        swap(tri.z[1], tri.z[2]);
+        swap(tri.w[1], tri.w[2]);
+        swap(v[1], v[2]);
+    }
+
+    // Pixels whose center (x * 16 + 8) lies inside the bounds
+    int min_x = min(tri.x[0], min(tri.x[1], tri.x[2])), max_x = max(tri.x[0], max(tri.x[1], tri.x[2]));
+    int min_y = min(tri.y[0], min(tri.y[1], tri.y[2])), max_y = max(tri.y[0], max(tri.y[1], tri.y[2]));
+    const int half = SUBPIXEL / 2;
+    rect.x0 = max(0, (min_x - half + SUBPIXEL - 1) >> SOFT_SUBPIXEL_BITS);
+    rect.y0 = max(0, (min_y - half + SUBPIXEL - 1) >> SOFT_SUBPIXEL_BITS);
+    rect.x1 = min(renderer.width - 1, (max_x - half) >> SOFT_SUBPIXEL_BITS);
+    rect.y1 = min(renderer.height - 1, (max_y - half) >> SOFT_SUBPIXEL_BITS);
+    if (rect.x0 > rect.x1 || rect.y0 > rect.y1)
+        return false;
+
+    // Attributes are only copied for triangles that get binned
+    for (int i = 0; i < 3; i++)
+        tri.v[i] = *v[i];
+    tri.draw = draw;
+    return true;
+}
+
+static void BinTriangles(SoftRenderer& renderer, size_t chunk, size_t first, size_t last,
+    const vector<size_t>& drawFirst, size_t* rasterized)
+{
+    vector<SoftTriangle>& triangles = renderer.triangles[chunk];
+    vector<vector<unsigned int> >& bins = renderer.bins[chunk];
+    triangles.clear();
+    for (vector<unsigned int>& bin : bins)
+        bin.clear();
+
+    float guard_x = GUARD_BAND_PIXELS / (renderer.width * 0.5f);
+    float guard_y = GUARD_BAND_PIXELS / (renderer.height * 0.5f);
+
+    size_t d = upper_bound(drawFirst.begin(), drawFirst.end(), first) - drawFirst.begin() - 1;
+    for (size_t t = first; t < last; t++) {
+        while (t >= drawFirst[d + 1])
+            d++;
+        const SoftDraw& draw = renderer.draws[d];
+        const unsigned int* index = draw.mesh->indices + (t - drawFirst[d]) * 3;
+        const vector<SoftVertex>& vertices = renderer.vertices[d];
+        const SoftVertex* corner[3] = { &vertices[index[0]], &vertices[index[1]], &vertices[index[2]] };
+
+        // All vertices outside one plane is a reject
+        unsigned int outside_any = corner[0]->outside | corner[1]->outside | corner[2]->outside;
+        unsigned int outside_all = corner[0]->outside & corner[1]->outside & corner[2]->outside;
+        if (outside_all != 0)
+            continue;
+
+        // Only triangles crossing a plane are copied and clipped, the rest
+        // is set up from the vertex stage output directly
+        SoftVertex poly[CLIP_MAX_VERTICES];
+        const SoftVertex* fan[CLIP_MAX_VERTICES] = { corner[0], corner[1], corner[2] };
+        int count = 3;
+        if (outside_any != 0) {
+            for (int i = 0; i < 3; i++)
+                poly[i] = *corner[i];
+            count = ClipPolygon(poly, 3, outside_any, guard_x, guard_y);
+            for (int i = 0; i < count; i++)
+                fan[i] = &poly[i];
+        }
+
+        // Fan of the clipped polygon
+        for (int i = 1; i + 1 < count; i++) {
+            SoftTriangle tri;
+            TileRect rect;
+            if (!SetupTriangle(renderer, *fan[0], *fan[i], *fan[i + 1], (unsigned int)d, tri, rect))
+                continue;
+            unsigned int slot = (unsigned int)triangles.size();
+            triangles.push_back(tri);
+            (*rasterized)++;
+            for (int ty = rect.y0 / SOFT_TILE_SIZE; ty <= rect.y1 / SOFT_TILE_SIZE; ty++)
+                for (int tx = rect.x0 / SOFT_TILE_SIZE; tx <= rect.x1 / SOFT_TILE_SIZE; tx++)
+                    bins[(size_t)ty * renderer.tilesX + tx].push_back(slot);
+        }
+    }
+}
+
+//------------------------------------------------------------
+// Texture sampling like GL_LINEAR_MIPMAP_LINEAR with repeat.
+// BMP pixels are BGR, rows bottom-up as GL has them.
+//------------------------------------------------------------
+
+static glm::vec3 SampleLevel(const ImageData& image, unsigned int level, float u, float v)
+{
+    unsigned int width = image.width, height = image.height;
+    size_t offset = 0, stride = mipRowStride(image.width);
+    if (!image.levels.empty()) {
+        const MipLevel& l = image.levels[level];
+        width = l.width;
+        height = l.height;
+        offset = l.offset;
+        stride = l.stride;
+    }
+
+    float s = u * width - 0.5f, t = v * height - 0.5f;
+    float fs = floorf(s), ft = floorf(t);
+    float ax = s - fs, ay = t - ft;
+    int i0 = (int)fs % (int)width, j0 = (int)ft % (int)height;
+    if (i0 < 0)
+        i0 += width;
+    if (j0 < 0)
+        j0 += height;
+    int i1 = (i0 + 1) % (int)width, j1 = (j0 + 1) % (int)height;
+
+    const unsigned char* base = &image.pixels[offset];
+    const unsigned char* p00 = base + j0 * stride + i0 * 3;
+    const unsigned char* p10 = base + j0 * stride + i1 * 3;
+    const unsigned char* p01 = base + j1 * stride + i0 * 3;
+    const unsigned char* p11 = base + j1 * stride + i1 * 3;
+    glm::vec3 texel;
+    float* out = &texel.x;
+    for (int c = 0; c < 3; c++) {
+        // BGR in memory, RGB out
+        int k = 2 - c;
+        float top = p00[k] + (p10[k] - p00[k]) * ax;
+        float bottom = p01[k] + (p11[k] - p01[k]) * ax;
+        out[c] = (top + (bottom - top) * ay) * (1.0f / 255.0f);
+    }
+    return texel;
+}
+
+static glm::vec3 SampleTexture(const ImageData& image, glm::vec2 uv, glm::vec2 ddx, glm::vec2 ddy)
+{
+    unsigned int levels = image.levels.empty() ? 1 : (unsigned int)image.levels.size();
+    float rho = max(sqrtf(ddx.x * ddx.x * image.width * image.width + ddx.y * ddx.y * image.height * image.height),
+        sqrtf(ddy.x * ddy.x * image.width * image.width + ddy.y * ddy.y * image.height * image.height));
+    float lod = rho > 0.0f ? log2f(rho) : 0.0f;
+    if (lod <= 0.0f || levels == 1)
+        return SampleLevel(image, 0, uv.x, uv.y);
+    lod = min(lod, (float)(levels - 1));
+    unsigned int level = (unsigned int)lod;
+    float blend = lod - level;
+    glm::vec3 a = SampleLevel(image, level, uv.x, uv.y);
+    if (level + 1 >= levels || blend == 0.0f)
+        return a;
+    glm::vec3 b = SampleLevel(image, level + 1, uv.x, uv.y);
+    return a + (b - a) * blend;
+}
+
+//------------------------------------------------------------
+// Tile stage
+//------------------------------------------------------------
+
+// Edge a -> b of a counter-clockwise triangle as A * x + B * y + C in
+// subpixels, >= 0 inside. Pixels exactly on an edge belong to it only if
+// it is a top or left edge, the others get a bias of -1.
+struct Edge
+{
+    long long a, b, c;
+    int bias;
+};
+
+static Edge MakeEdge(int ax, int ay, int bx, int by)
+{
+    Edge e;
+    e.a = (long long)ay - by;
+    e.b = (long long)bx - ax;
+    e.c = -(e.a * ax + e.b * ay);
+    bool top_left = e.a > 0 || (e.a == 0 && e.b < 0);
+    e.bias = top_left ? 0 : -1;
+    return e;
+}
+
+// Value at the center of pixel (x, y), bias included
+static long long EdgeAt(const Edge& e, int x, int y)
+{
+    return e.a * (x * SUBPIXEL + SUBPIXEL / 2) + e.b * (y * SUBPIXEL + SUBPIXEL / 2) + e.c + e.bias;
+}
+
+static void ShadePixel(SoftRenderer& renderer, const SoftTriangle& tri, const float* l, const float* lx, const float* ly,
+    size_t pixel)
+{
+    const SoftDraw& draw = renderer.draws[tri.draw];
+    const SoftVertex* v = tri.v;
+
+    // Perspective correct weights at the pixel and its right and upper
+    // neighbors, the latter only for texture derivatives
+    float pw[3], inv = 0.0f;
+    for (int i = 0; i < 3; i++) {
+        pw[i] = l[i] * tri.w[i];
+        inv += pw[i];
+    }
+    inv = 1.0f / inv;
+    for (int i = 0; i < 3; i++)
+        pw[i] *= inv;
+
+    glm::vec3 P = v[0].view * pw[0] + v[1].view * pw[1] + v[2].view * pw[2];
+    glm::vec3 N = glm::normalize(v[0].normal * pw[0] + v[1].normal * pw[1] + v[2].normal * pw[2]);
+    glm::vec3 L = glm::normalize(renderer.lightPosition - P);
+    glm::vec3 V = glm::normalize(-P);
+    const MaterialUniforms& material = draw.material;
+
+    glm::vec3 diffuse_color(material.diffuse);
+    if (draw.texture != NULL) {
+        glm::vec2 uv = v[0].uv * pw[0] + v[1].uv * pw[1] + v[2].uv * pw[2];
+        glm::vec2 uv_x(0.0f), uv_y(0.0f);
+        float inv_x = 0.0f, inv_y = 0.0f;
+        for (int i = 0; i < 3; i++) {
+            inv_x += lx[i] * tri.w[i];
+            inv_y += ly[i] * tri.w[i];
+        }
+        for (int i = 0; i < 3; i++) {
+            uv_x = uv_x + v[i].uv * (lx[i] * tri.w[i] / inv_x);
+            uv_y = uv_y + v[i].uv * (ly[i] * tri.w[i] / inv_y);
+        }
+        glm::vec3 texel = SampleTexture(*draw.texture, uv, uv_x - uv, uv_y - uv);
+        diffuse_color = diffuse_color * texel;
+    }
+
+    float n_dot_l = glm::dot(N, L);
+    glm::vec3 color = glm::vec3(material.ambient) + diffuse_color * max(n_dot_l, 0.0f);
+    glm::vec3 R = N * (2.0f * n_dot_l) - L;
+    color = color + glm::vec3(material.specular) * powf(max(glm::dot(R, V), 0.0f), material.specular.w);
+
+    unsigned char* out = &renderer.color[pixel * 3];
+    out[0] = (unsigned char)(glm::clamp(color.x, 0.0f, 1.0f) * 255.0f + 0.5f);
+    out[1] = (unsigned char)(glm::clamp(color.y, 0.0f, 1.0f) * 255.0f + 0.5f);
+    out[2] = (unsigned char)(glm::clamp(color.z, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+static size_t RasterTriangle(SoftRenderer& renderer, const SoftTriangle& tri, int tx0, int ty0, int tx1, int ty1)
+{
+    Edge edges[3] = {
+        MakeEdge(tri.x[1], tri.y[1], tri.x[2], tri.y[2]),  // opposite vertex 0
+        MakeEdge(tri.x[2], tri.y[2], tri.x[0], tri.y[0]),  // opposite vertex 1
+        MakeEdge(tri.x[0], tri.y[0], tri.x[1], tri.y[1])   // opposite vertex 2
+    };
+
+    // Pixel rectangle of the triangle within the tile
+    int min_x = min(tri.x[0], min(tri.x[1], tri.x[2])), max_x = max(tri.x[0], max(tri.x[1], tri.x[2]));
+    int min_y = min(tri.y[0], min(tri.y[1], tri.y[2])), max_y = max(tri.y[0], max(tri.y[1], tri.y[2]));
+    const int half = SUBPIXEL / 2;
+    int x0 = max(tx0, (min_x - half + SUBPIXEL - 1) >> SOFT_SUBPIXEL_BITS);
+    int y0 = max(ty0, (min_y - half + SUBPIXEL - 1) >> SOFT_SUBPIXEL_BITS);
+    int x1 = min(tx1, (max_x - half) >> SOFT_SUBPIXEL_BITS);
+    int y1 = min(ty1, (max_y - half) >> SOFT_SUBPIXEL_BITS);
+    if (x0 > x1 || y0 > y1)
+        return 0;
+
+    // Per edge: outside at every corner rejects the triangle, inside at
+    // every corner drops the edge. What is left crosses the rectangle, so
+    // its values there fit in 32 bits.
+    int start[3], step_x[3], step_y[3];
+    for (int i = 0; i < 3; i++) {
+        long long c00 = EdgeAt(edges[i], x0, y0), c10 = EdgeAt(edges[i], x1, y0);
+        long long c01 = EdgeAt(edges[i], x0, y1), c11 = EdgeAt(edges[i], x1, y1);
+        if (c00 < 0 && c10 < 0 && c01 < 0 && c11 < 0)
+            return 0;
+        if (c00 >= 0 && c10 >= 0 && c01 >= 0 && c11 >= 0) {
+            start[i] = 0;
+            step_x[i] = step_y[i] = 0;
+        }
+        else {
+            start[i] = (int)c00;
+            step_x[i] = (int)(edges[i].a * SUBPIXEL);
+            step_y[i] = (int)(edges[i].b * SUBPIXEL);
+        }
+    }
+
+    // Barycentrics from the exact edge values, without the bias
+    long long area = (long long)(tri.x[1] - tri.x[0]) * (tri.y[2] - tri.y[0])
+        - (long long)(tri.x[2] - tri.x[0]) * (tri.y[1] - tri.y[0]);
+    float inv_area = 1.0f / (float)area;
+    float lambda_dx[3], lambda_dy[3];
+    for (int i = 0; i < 3; i++) {
+        lambda_dx[i] = (float)(edges[i].a * SUBPIXEL) * inv_area;
+        lambda_dy[i] = (float)(edges[i].b * SUBPIXEL) * inv_area;
+    }
+    float lambda0[3];
+    for (int i = 0; i < 3; i++)
+        lambda0[i] = (float)(EdgeAt(edges[i], x0, y0) - edges[i].bias) * inv_area;
+    float z_dx = 0.0f, z_dy = 0.0f, z0 = 0.0f;
+    for (int i = 0; i < 3; i++) {
+        z0 += lambda0[i] * tri.z[i];
+        z_dx += lambda_dx[i] * tri.z[i];
+        z_dy += lambda_dy[i] * tri.z[i];
+    }
+
+    size_t shaded = 0;
+    int width = renderer.width;
+    for (int y = y0; y <= y1; y++) {
+        int dy = y - y0;
+        int row[3];
+        for (int i = 0; i < 3; i++)
+            row[i] = start[i] + step_y[i] * dy;
+
+        for (int x = x0; x <= x1; x += 4) {
+            int dx = x - x0;
+            unsigned int mask;
+#if defined(SOFT_SSE2)
+            __m128i e0 = _mm_add_epi32(_mm_set1_epi32(row[0] + step_x[0] * dx),
+                _mm_set_epi32(3 * step_x[0], 2 * step_x[0], step_x[0], 0));
+            __m128i e1 = _mm_add_epi32(_mm_set1_epi32(row[1] + step_x[1] * dx),
+                _mm_set_epi32(3 * step_x[1], 2 * step_x[1], step_x[1], 0));
+            __m128i e2 = _mm_add_epi32(_mm_set1_epi32(row[2] + step_x[2] * dx),
+                _mm_set_epi32(3 * step_x[2], 2 * step_x[2], step_x[2], 0));
+            __m128i any_negative = _mm_or_si128(_mm_or_si128(e0, e1), e2);
+            mask = ~_mm_movemask_ps(_mm_castsi128_ps(any_negative)) & 0xF;
+#else
+            mask = 0;
+            for (int k = 0; k < 4; k++) {
+                int e0 = row[0] + step_x[0] * (dx + k);
+                int e1 = row[1] + step_x[1] * (dx + k);
+                int e2 = row[2] + step_x[2] * (dx + k);
+                if ((e0 | e1 | e2) >= 0)
+                    mask |= 1u << k;
+            }
+#endif
+            if (x1 - x < 3)
+                mask &= (1u << (x1 - x + 1)) - 1;
+
+            while (mask != 0) {
+                int k = 0;
+                while (!(mask & (1u << k)))
+                    k++;
+                mask &= mask - 1;
+
+                int px = x + k, ddx = dx + k;
+                float z = z0 + z_dx * ddx + z_dy * dy;
+                size_t pixel = (size_t)y * width + px;
+                if (!(z < renderer.depth[pixel]))
+                    continue;
+                renderer.depth[pixel] = z;
+
+                float l[3], lx[3], ly[3];
+                for (int i = 0; i < 3; i++) {
+                    l[i] = lambda0[i] + lambda_dx[i] * ddx + lambda_dy[i] * dy;
+                    lx[i] = l[i] + lambda_dx[i];
+                    ly[i] = l[i] + lambda_dy[i];
+                }
+                ShadePixel(renderer, tri, l, lx, ly, pixel);
+                shaded++;
+            }
+        }
+    }
+    return shaded;
+}
+
+static void RasterTile(SoftRenderer& renderer, size_t tile)
+{
+    int tx = (int)(tile % renderer.tilesX), ty = (int)(tile / renderer.tilesX);
+    int x0 = tx * SOFT_TILE_SIZE, y0 = ty * SOFT_TILE_SIZE;
+    int x1 = min(renderer.width, x0 + SOFT_TILE_SIZE) - 1, y1 = min(renderer.height, y0 + SOFT_TILE_SIZE) - 1;
+
+    size_t shaded = 0;
+    for (size_t chunk = 0; chunk < renderer.bins.size(); chunk++) {
+        const vector<SoftTriangle>& triangles = renderer.triangles[chunk];
+        for (unsigned int slot : renderer.bins[chunk][tile])
+            shaded += RasterTriangle(renderer, triangles[slot], x0, y0, x1, y1);
+    }
+    renderer.tilePixels[tile] = shaded;
+}
+
+void endSoftFrame(SoftRenderer& renderer)
+{
+    auto start = chrono::high_resolution_clock::now();
+    SoftRasterStats& stats = renderer.stats;
+    stats = SoftRasterStats();
+
+    // Vertices, in chunks so one large mesh still spreads over the pool
+    size_t draw_count = renderer.draws.size();
+    renderer.vertices.resize(draw_count);
+    vector<size_t> draw_first(draw_count + 1, 0);
+    for (size_t d = 0; d < draw_count; d++) {
+        const SoftMesh& mesh = *renderer.draws[d].mesh;
+        renderer.vertices[d].resize(mesh.vertexCount);
+        draw_first[d + 1] = draw_first[d] + mesh.indexCount / 3;
+        for (size_t begin = 0; begin < mesh.vertexCount; begin += SOFT_VERTEX_CHUNK) {
+            size_t end = min(mesh.vertexCount, begin + SOFT_VERTEX_CHUNK);
+            submitTask(renderer.pool, [&renderer, d, begin, end]() {
+                TransformVertices(renderer, renderer.draws[d], &renderer.vertices[d][0], begin, end);
+            });
+        }
+    }
+    waitThreadPool(renderer.pool);
+    stats.vertexMs = Milliseconds(start);
+
+    // Binning, chunks of a fixed size so the result does not depend on
+    // the thread count
+    auto bin_start = chrono::high_resolution_clock::now();
+    size_t triangle_count = draw_first[draw_count];
+    size_t chunks = (triangle_count + SOFT_BIN_CHUNK - 1) / SOFT_BIN_CHUNK;
+    size_t tiles = (size_t)renderer.tilesX * renderer.tilesY;
+    renderer.triangles.resize(chunks);
+    renderer.bins.resize(chunks);
+    vector<size_t> rasterized(chunks, 0);
+    for (size_t c = 0; c < chunks; c++) {
+        renderer.bins[c].resize(tiles);
+        size_t first = c * SOFT_BIN_CHUNK, last = min(triangle_count, first + SOFT_BIN_CHUNK);
+        submitTask(renderer.pool, [&renderer, &draw_first, &rasterized, c, first, last]() {
+            BinTriangles(renderer, c, first, last, draw_first, &rasterized[c]);
+        });
+    }
+    waitThreadPool(renderer.pool);
+    stats.binMs = Milliseconds(bin_start);
+
+    // Tiles
+    auto tile_start = chrono::high_resolution_clock::now();
+    for (size_t t = 0; t < tiles; t++)
+        submitTask(renderer.pool, [&renderer, t]() { RasterTile(renderer, t); });
+    waitThreadPool(renderer.pool);
+    stats.tileMs = Milliseconds(tile_start);
+
+    stats.triangles = triangle_count;
+    for (size_t c = 0; c < chunks; c++) {
+        stats.rasterized += rasterized[c];
+        for (size_t t = 0; t < tiles; t++)
+            stats.binned += renderer.bins[c][t].size();
+    }
+    for (size_t t = 0; t < tiles; t++)
+        stats.pixels += renderer.tilePixels[t];
+    stats.totalMs = Milliseconds(start);
+}
+
+bool writeSoftFramePPM(const SoftRenderer& renderer, const char* path)
+{
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        printf("Cannot write %s\n", path);
+        return false;
+    }
+    fprintf(file, "P6\n%d %d\n255\n", renderer.width, renderer.height);
+    size_t row = (size_t)renderer.width * 3;
+    for (int y = renderer.height - 1; y >= 0; y--)
+        fwrite(&renderer.color[y * row], 1, row, file);
+    fclose(file);
+    return true;
+}
+
+const char* softRasterSimdName()
+{
+#if defined(SOFT_SSE2)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
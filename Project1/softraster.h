@@ -0,0 +1,131 @@
+#ifndef SOFTRASTER_H
+#define SOFTRASTER_H
+
+#include <stddef.h>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "texture.h"
+#include "threadpool.h"
+#include "uniformbuffers.h"
+
+// CPU renderer for machines without a GPU and for golden images. It draws
+// indexed meshes (as loadOBJIndexed returns them) with the lighting of
+// vertexshader.vert/fragmentshader.frag: view-space Phong with one light,
+// the material's ambient, diffuse and specular terms, and the diffuse
+// color multiplied by a decoded BMP (trilinear, repeat).
+//
+// A frame runs in three stages, each split over a thread pool:
+//   vertices  transformed to clip space per draw
+//   binning   triangles are clipped against the near plane and a guard
+//             band, culled when empty, and appended to the bins of the
+//             64x64 tiles they overlap. Each chunk of triangles has its
+//             own bins, so no locks are needed.
+//   tiles     every tile walks its bins in submission order, tests 4
+//             pixels at a time with fixed point edge functions (1/16
+//             pixel, top-left rule) and shades what passes the depth
+//             test (GL_LESS).
+// Chunks and tiles do not depend on the thread count and a pixel is only
+// ever written by its tile, so the image is the same for any number of
+// threads. Nothing here touches GL.
+
+#define SOFT_TILE_SIZE 64
+#define SOFT_SUBPIXEL_BITS 4
+
+// Triangles per binning chunk
+#define SOFT_BIN_CHUNK 2048
+
+struct SoftMesh
+{
+	const glm::vec3 * positions;
+	const glm::vec3 * normals;
+	const glm::vec2 * uvs;          // may be NULL
+	const unsigned int * indices;
+	size_t vertexCount;
+	size_t indexCount;
+};
+
+struct SoftDraw
+{
+	const SoftMesh * mesh;
+	glm::mat4 model;
+	MaterialUniforms material;
+	const ImageData * texture;      // 3 channel, mipmapped or not; NULL for none
+};
+
+// Vertex after the vertex stage
+struct SoftVertex
+{
+	glm::vec4 clip;
+	glm::vec3 view;                 // view-space position
+	glm::vec3 normal;               // view space, not normalized
+	glm::vec2 uv;
+	unsigned int outside;           // clip planes the vertex is outside of
+};
+
+// Set up triangle, what the tile stage needs
+struct SoftTriangle
+{
+	int x[3], y[3];                 // window coordinates in 1/16 pixels
+	float z[3];                     // window depth
+	float w[3];                     // 1 / clip w
+	unsigned int draw;
+	SoftVertex v[3];
+};
+
+struct SoftRasterStats
+{
+	size_t triangles;               // submitted
+	size_t rasterized;              // left after clipping and culling
+	size_t binned;                  // triangle and tile pairs
+	size_t pixels;                  // shaded, after the depth test
+	double vertexMs, binMs, tileMs, totalMs;
+};
+
+struct SoftRenderer
+{
+	int width, height;
+	int tilesX, tilesY;
+	ThreadPool pool;
+	unsigned int threads;
+
+	glm::mat4 view, projection;
+	glm::vec3 lightPosition;        // view space, like FrameData.light_pos
+	std::vector<SoftDraw> draws;
+	std::vector<std::vector<SoftVertex> > vertices;   // per draw
+
+	// Bins per chunk, tilesX * tilesY lists of triangle indices each
+	std::vector<std::vector<SoftTriangle> > triangles; // per chunk
+	std::vector<std::vector<std::vector<unsigned int> > > bins;
+
+	// Bottom row first, like the GL framebuffer
+	std::vector<unsigned char> color;   // RGB
+	std::vector<float> depth;
+	std::vector<size_t> tilePixels;
+
+	SoftRasterStats stats;
+};
+
+// threads 0 uses one per core
+void initSoftRenderer(SoftRenderer & renderer, int width, int height, unsigned int threads = 0);
+void destroySoftRenderer(SoftRenderer & renderer);
+
+// Starts a frame: the color buffer is cleared to clearColor, depth to 1
+void beginSoftFrame(SoftRenderer & renderer, const glm::mat4 & view, const glm::mat4 & projection,
+	const glm::vec3 & lightPosition, const glm::vec3 & clearColor);
+
+// The mesh, texture and draw must stay valid until endSoftFrame
+void submitSoftDraw(SoftRenderer & renderer, const SoftDraw & draw);
+
+// Renders everything submitted since beginSoftFrame
+void endSoftFrame(SoftRenderer & renderer);
+
+// Binary PPM, top row first
+bool writeSoftFramePPM(const SoftRenderer & renderer, const char * path);
+
+// Name of the compiled edge function path: "SSE2" or "scalar"
+const char * softRasterSimdName();
+
+#endif
@@ -0,0 +1,624 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BC_SSE2
+#endif
+
+#include <GL/glew.h>
+
+#include "texcompress.h"
+#include "texture.h"
+
+using namespace std;
+
+// Least squares passes of BC_QUALITY_HIGH
+#define BC_REFINE_PASSES 2
+
+// Power iterations for the principal axis
+#define BC_AXIS_ITERATIONS 8
+
+// Blocks of one 4x4 tile, channels as floats in RGB order so the SIMD
+// index search can load 4 texels of a channel at once
+struct BCBlock
+{
+    float r[16], g[16], b[16];
+    unsigned char a[16];
+};
+
+struct BCColor
+{
+    float r, g, b;
+};
+
+
+size_t bcBlockSize(BCFormat format)
+{
+    return format == BC_FORMAT_BC1 ? 8 : 16;
+}
+
+size_t bcLevelSize(unsigned int width, unsigned int height, BCFormat format)
+{
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * bcBlockSize(format);
+}
+
+const char* bcFormatName(BCFormat format)
+{
+    return format == BC_FORMAT_BC1 ? "BC1" : "BC3";
+}
+
+const char* bcQualityName(BCQuality quality)
+{
+    switch (quality) {
+    case BC_QUALITY_FAST:
+        return "fast";
+    case BC_QUALITY_NORMAL:
+        return "normal";
+    default:
+        return "high";
+    }
+}
+
+bool parseBCQuality(const char* name, BCQuality& quality)
+{
+    for (int q = BC_QUALITY_FAST; q <= BC_QUALITY_HIGH; q++) {
+        if (strcmp(name, bcQualityName((BCQuality)q)) == 0) {
+            quality = (BCQuality)q;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* bcSimdName()
+{
+#if defined(BC_SSE2)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
+
+//------------------------------------------------------------
+// RGB565 endpoints
+//------------------------------------------------------------
+
+static uint16_t PackColor(const BCColor& c)
+{
+    int r = (int)(min(max(c.r, 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+    int g = (int)(min(max(c.g, 0.0f), 255.0f) * 63.0f / 255.0f + 0.5f);
+    int b = (int)(min(max(c.b, 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static BCColor UnpackColor(uint16_t c)
+{
+    int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+    BCColor color;
+    color.r = (float)((r << 3) | (r >> 2));
+    color.g = (float)((g << 2) | (g >> 4));
+    color.b = (float)((b << 3) | (b >> 2));
+    return color;
+}
+
+// The four colors of a block in 4 color mode (c0 > c1), rounded the way
+// the decoder below and most hardware do
+static void BuildPalette(uint16_t c0, uint16_t c1, BCColor palette[4])
+{
+    palette[0] = UnpackColor(c0);
+    palette[1] = UnpackColor(c1);
+    palette[2].r = floorf((2.0f * palette[0].r + palette[1].r) / 3.0f);
+    palette[2].g = floorf((2.0f * palette[0].g + palette[1].g) / 3.0f);
+    palette[2].b = floorf((2.0f * palette[0].b + palette[1].b) / 3.0f);
+    palette[3].r = floorf((palette[0].r + 2.0f * palette[1].r) / 3.0f);
+    palette[3].g = floorf((palette[0].g + 2.0f * palette[1].g) / 3.0f);
+    palette[3].b = floorf((palette[0].b + 2.0f * palette[1].b) / 3.0f);
+}
+
+//------------------------------------------------------------
+// Nearest palette entry of every texel; returns the squared
+// error. Ties go to the lower index in both versions.
+//------------------------------------------------------------
+
+#if defined(BC_SSE2)
+
+static float SelectIndices(const BCBlock& block, const BCColor palette[4], unsigned char indices[16])
+{
+    __m128 total = _mm_setzero_ps();
+    for (int i = 0; i < 16; i += 4) {
+        __m128 r = _mm_loadu_ps(block.r + i);
+        __m128 g = _mm_loadu_ps(block.g + i);
+        __m128 b = _mm_loadu_ps(block.b + i);
+
+        __m128 best = _mm_set1_ps(1e30f);
+        __m128i index = _mm_setzero_si128();
+        for (int p = 0; p < 4; p++) {
+            __m128 dr = _mm_sub_ps(r, _mm_set1_ps(palette[p].r));
+            __m128 dg = _mm_sub_ps(g, _mm_set1_ps(palette[p].g));
+            __m128 db = _mm_sub_ps(b, _mm_set1_ps(palette[p].b));
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+            __m128i closer = _mm_castps_si128(_mm_cmplt_ps(d, best));
+            best = _mm_min_ps(d, best);
+            index = _mm_or_si128(_mm_andnot_si128(closer, index), _mm_and_si128(closer, _mm_set1_epi32(p)));
+        }
+        total = _mm_add_ps(total, best);
+
+        int lanes[4];
+        _mm_storeu_si128((__m128i*)lanes, index);
+        for (int k = 0; k < 4; k++)
+            indices[i + k] = (unsigned char)lanes[k];
+    }
+    float sums[4];
+    _mm_storeu_ps(sums, total);
+    return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+}
+
+#else
+
+static float SelectIndices(const BCBlock& block, const BCColor palette[4], unsigned char indices[16])
+{
+    float sums[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; i++) {
+        float best = 1e30f;
+        int index = 0;
+        for (int p = 0; p < 4; p++) {
+            float dr = block.r[i] - palette[p].r;
+            float dg = block.g[i] - palette[p].g;
+            float db = block.b[i] - palette[p].b;
+            float d = dr * dr + dg * dg + db * db;
+            if (d < best) {
+                best = d;
+                index = p;
+            }
+        }
+        indices[i] = (unsigned char)index;
+        sums[i & 3] += best;
+    }
+    return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+}
+
+#endif
+
+//------------------------------------------------------------
+// Color endpoints
+//------------------------------------------------------------
+
+// Corners of the bounding box, the diagonal picked by the sign of the
+// red/green and blue/green covariance, pulled in by 1/16 of the extent
+static void BoundingBoxEndpoints(const BCBlock& block, BCColor& e0, BCColor& e1)
+{
+    BCColor lo = { 255.0f, 255.0f, 255.0f }, hi = { 0.0f, 0.0f, 0.0f };
+    BCColor mean = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; i++) {
+        lo.r = min(lo.r, block.r[i]); hi.r = max(hi.r, block.r[i]);
+        lo.g = min(lo.g, block.g[i]); hi.g = max(hi.g, block.g[i]);
+        lo.b = min(lo.b, block.b[i]); hi.b = max(hi.b, block.b[i]);
+        mean.r += block.r[i]; mean.g += block.g[i]; mean.b += block.b[i];
+    }
+    mean.r /= 16.0f; mean.g /= 16.0f; mean.b /= 16.0f;
+
+    float rg = 0.0f, bg = 0.0f;
+    for (int i = 0; i < 16; i++) {
+        rg += (block.r[i] - mean.r) * (block.g[i] - mean.g);
+        bg += (block.b[i] - mean.b) * (block.g[i] - mean.g);
+    }
+
+    BCColor inset = { (hi.r - lo.r) / 16.0f, (hi.g - lo.g) / 16.0f, (hi.b - lo.b) / 16.0f };
+    e0.r = hi.r - inset.r; e1.r = lo.r + inset.r;
+    e0.g = hi.g - inset.g; e1.g = lo.g + inset.g;
+    e0.b = hi.b - inset.b; e1.b = lo.b + inset.b;
+    if (rg < 0.0f)
+        swap(e0.r, e1.r);
+    if (bg < 0.0f)
+        swap(e0.b, e1.b);
+}
+
+// Endpoints on the principal axis of the block
+static void PrincipalAxisEndpoints(const BCBlock& block, BCColor& e0, BCColor& e1)
+{
+    BCColor mean = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; i++) {
+        mean.r += block.r[i]; mean.g += block.g[i]; mean.b += block.b[i];
+    }
+    mean.r /= 16.0f; mean.g /= 16.0f; mean.b /= 16.0f;
+
+    float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; i++) {
+        float r = block.r[i] - mean.r, g = block.g[i] - mean.g, b = block.b[i] - mean.b;
+        cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+        cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+    }
+
+    // Power iteration, starting from the luminance direction
+    float axis[3] = { 0.299f, 0.587f, 0.114f };
+    for (int k = 0; k < BC_AXIS_ITERATIONS; k++) {
+        float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+        float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+        float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+        float length = max(max(fabsf(x), fabsf(y)), fabsf(z));
+        if (length < 1e-6f)
+            break;
+        axis[0] = x / length; axis[1] = y / length; axis[2] = z / length;
+    }
+
+    // Extent of the block along the axis through the mean, pulled in by
+    // 1/16 like the bounding box
+    float norm = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+    float lo = 0.0f, hi = 0.0f;
+    for (int i = 0; i < 16; i++) {
+        float d = ((block.r[i] - mean.r) * axis[0] + (block.g[i] - mean.g) * axis[1] + (block.b[i] - mean.b) * axis[2]) / norm;
+        lo = min(lo, d);
+        hi = max(hi, d);
+    }
+    float inset = (hi - lo) / 16.0f;
+    hi -= inset;
+    lo += inset;
+    e0.r = mean.r + axis[0] * hi; e0.g = mean.g + axis[1] * hi; e0.b = mean.b + axis[2] * hi;
+    e1.r = mean.r + axis[0] * lo; e1.g = mean.g + axis[1] * lo; e1.b = mean.b + axis[2] * lo;
+}
+
+// Endpoints that minimize the squared error for the given indices;
+// false when the indices leave them undetermined
+static bool RefineEndpoints(const BCBlock& block, const unsigned char indices[16], BCColor& e0, BCColor& e1)
+{
+    static const float weight[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    BCColor ax = { 0.0f, 0.0f, 0.0f }, bx = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; i++) {
+        float t = weight[indices[i]], s = 1.0f - t;
+        aa += s * s; ab += s * t; bb += t * t;
+        ax.r += s * block.r[i]; ax.g += s * block.g[i]; ax.b += s * block.b[i];
+        bx.r += t * block.r[i]; bx.g += t * block.g[i]; bx.b += t * block.b[i];
+    }
+    float det = aa * bb - ab * ab;
+    if (fabsf(det) < 1e-6f)
+        return false;
+    float inv = 1.0f / det;
+    e0.r = (bb * ax.r - ab * bx.r) * inv; e1.r = (aa * bx.r - ab * ax.r) * inv;
+    e0.g = (bb * ax.g - ab * bx.g) * inv; e1.g = (aa * bx.g - ab * ax.g) * inv;
+    e0.b = (bb * ax.b - ab * bx.b) * inv; e1.b = (aa * bx.b - ab * ax.b) * inv;
+    return true;
+}
+
+struct BCColorFit
+{
+    uint16_t c0, c1;
+    unsigned char indices[16];
+    float error;
+};
+
+// Quantizes a pair of endpoints into 4 color mode and indexes the block
+static void FitEndpoints(const BCBlock& block, const BCColor& e0, const BCColor& e1, BCColorFit& fit)
+{
+    fit.c0 = PackColor(e0);
+    fit.c1 = PackColor(e1);
+    if (fit.c0 < fit.c1)
+        swap(fit.c0, fit.c1);
+
+    BCColor palette[4];
+    BuildPalette(fit.c0, fit.c1, palette);
+    fit.error = SelectIndices(block, palette, fit.indices);
+
+    // Equal endpoints would mean 3 color mode; index 0 decodes the same there
+    if (fit.c0 == fit.c1)
+        memset(fit.indices, 0, sizeof(fit.indices));
+}
+
+static void EncodeColorBlock(const BCBlock& block, BCQuality quality, unsigned char* out)
+{
+    BCColor e0, e1;
+    BCColorFit best;
+    if (quality == BC_QUALITY_FAST) {
+        BoundingBoxEndpoints(block, e0, e1);
+        FitEndpoints(block, e0, e1, best);
+    }
+    else {
+        PrincipalAxisEndpoints(block, e0, e1);
+        FitEndpoints(block, e0, e1, best);
+    }
+
+    if (quality == BC_QUALITY_HIGH) {
+        BCColorFit fit;
+        BoundingBoxEndpoints(block, e0, e1);
+        FitEndpoints(block, e0, e1, fit);
+        if (fit.error < best.error)
+            best = fit;
+
+        for (int pass = 0; pass < BC_REFINE_PASSES && best.error > 0.0f; pass++) {
+            if (!RefineEndpoints(block, best.indices, e0, e1))
+                break;
+            FitEndpoints(block, e0, e1, fit);
+            if (fit.error >= best.error)
+                break;
+            best = fit;
+        }
+    }
+
+    uint32_t bits = 0;
+    for (int i = 0; i < 16; i++)
+        bits |= (uint32_t)best.indices[i] << (2 * i);
+    out[0] = (unsigned char)(best.c0 & 0xFF);
+    out[1] = (unsigned char)(best.c0 >> 8);
+    out[2] = (unsigned char)(best.c1 & 0xFF);
+    out[3] = (unsigned char)(best.c1 >> 8);
+    out[4] = (unsigned char)(bits & 0xFF);
+    out[5] = (unsigned char)((bits >> 8) & 0xFF);
+    out[6] = (unsigned char)((bits >> 16) & 0xFF);
+    out[7] = (unsigned char)(bits >> 24);
+}
+
+// BC3 alpha: min and max as endpoints with the 6 values between them
+static void EncodeAlphaBlock(const BCBlock& block, unsigned char* out)
+{
+    int lo = 255, hi = 0;
+    for (int i = 0; i < 16; i++) {
+        lo = min(lo, (int)block.a[i]);
+        hi = max(hi, (int)block.a[i]);
+    }
+
+    int palette[8];
+    palette[0] = hi;
+    palette[1] = lo;
+    for (int i = 2; i < 8; i++)
+        palette[i] = ((8 - i) * hi + (i - 1) * lo) / 7;
+
+    uint64_t bits = 0;
+    if (hi != lo) {
+        for (int i = 0; i < 16; i++) {
+            int best = 0, bestError = 256;
+            for (int p = 0; p < 8; p++) {
+                int error = abs((int)block.a[i] - palette[p]);
+                if (error < bestError) {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            bits |= (uint64_t)best << (3 * i);
+        }
+    }
+
+    out[0] = (unsigned char)hi;
+    out[1] = (unsigned char)lo;
+    for (int i = 0; i < 6; i++)
+        out[2 + i] = (unsigned char)((bits >> (8 * i)) & 0xFF);
+}
+
+//------------------------------------------------------------
+// Whole levels
+//------------------------------------------------------------
+
+static void LoadBlock(const unsigned char* pixels, unsigned int width, unsigned int height, size_t stride,
+    unsigned int channels, unsigned int bx, unsigned int by, BCBlock& block)
+{
+    for (int y = 0; y < 4; y++) {
+        unsigned int sy = min(by * 4 + y, height - 1);
+        const unsigned char* row = pixels + sy * stride;
+        for (int x = 0; x < 4; x++) {
+            const unsigned char* texel = row + min(bx * 4 + x, width - 1) * channels;
+            int i = y * 4 + x;
+            block.b[i] = texel[0];
+            block.g[i] = texel[1];
+            block.r[i] = texel[2];
+            block.a[i] = channels == 4 ? texel[3] : 255;
+        }
+    }
+}
+
+static void CompressRows(const unsigned char* pixels, unsigned int width, unsigned int height, size_t stride,
+    unsigned int channels, BCFormat format, BCQuality quality, unsigned char* out,
+    unsigned int firstRow, unsigned int lastRow)
+{
+    unsigned int blocksWide = (width + 3) / 4;
+    size_t blockSize = bcBlockSize(format);
+    BCBlock block;
+    for (unsigned int by = firstRow; by < lastRow; by++) {
+        unsigned char* dst = out + (size_t)by * blocksWide * blockSize;
+        for (unsigned int bx = 0; bx < blocksWide; bx++, dst += blockSize) {
+            LoadBlock(pixels, width, height, stride, channels, bx, by, block);
+            if (format == BC_FORMAT_BC3) {
+                EncodeAlphaBlock(block, dst);
+                EncodeColorBlock(block, quality, dst + 8);
+            }
+            else {
+                EncodeColorBlock(block, quality, dst);
+            }
+        }
+    }
+}
+
+void compressBC(const unsigned char* pixels, unsigned int width, unsigned int height, size_t stride,
+    unsigned int channels, BCFormat format, BCQuality quality, vector<unsigned char>& out, int threads)
+{
+    size_t begin = out.size();
+    out.resize(begin + bcLevelSize(width, height, format));
+    unsigned char* dst = &out[begin];
+
+    unsigned int blockRows = (height + 3) / 4;
+    if (threads <= 0)
+        threads = (int)max(1u, thread::hardware_concurrency());
+    threads = (int)min((unsigned int)threads, blockRows);
+    if (threads <= 1) {
+        CompressRows(pixels, width, height, stride, channels, format, quality, dst, 0, blockRows);
+        return;
+    }
+
+    // Bands of block rows, the calling thread takes the first one
+    unsigned int perThread = (blockRows + threads - 1) / threads;
+    vector<thread> workers;
+    for (int t = 1; t < threads; t++) {
+        unsigned int first = t * perThread;
+        unsigned int last = min(blockRows, first + perThread);
+        if (first >= last)
+            break;
+        workers.push_back(thread(CompressRows, pixels, width, height, stride, channels, format, quality, dst, first, last));
+    }
+    CompressRows(pixels, width, height, stride, channels, format, quality, dst, 0, min(blockRows, perThread));
+    for (thread& worker : workers)
+        worker.join();
+}
+
+void decompressBC(const unsigned char* blocks, unsigned int width, unsigned int height, BCFormat format,
+    unsigned char* pixels, size_t stride)
+{
+    unsigned int blocksWide = (width + 3) / 4, blocksHigh = (height + 3) / 4;
+    size_t blockSize = bcBlockSize(format);
+    for (unsigned int by = 0; by < blocksHigh; by++) {
+        for (unsigned int bx = 0; bx < blocksWide; bx++) {
+            const unsigned char* block = blocks + ((size_t)by * blocksWide + bx) * blockSize;
+            if (format == BC_FORMAT_BC3)
+                block += 8;
+
+            uint16_t c0 = (uint16_t)(block[0] | (block[1] << 8));
+            uint16_t c1 = (uint16_t)(block[2] | (block[3] << 8));
+            uint32_t bits = block[4] | (block[5] << 8) | (block[6] << 16) | ((uint32_t)block[7] << 24);
+
+            // BC1 with c0 <= c1 is 3 color mode plus black; BC3 is always 4 color
+            BCColor palette[4];
+            BuildPalette(c0, c1, palette);
+            if (format == BC_FORMAT_BC1 && c0 <= c1) {
+                palette[2].r = floorf((palette[0].r + palette[1].r) / 2.0f);
+                palette[2].g = floorf((palette[0].g + palette[1].g) / 2.0f);
+                palette[2].b = floorf((palette[0].b + palette[1].b) / 2.0f);
+                palette[3].r = palette[3].g = palette[3].b = 0.0f;
+            }
+
+            for (unsigned int y = 0; y < 4 && by * 4 + y < height; y++) {
+                unsigned char* row = pixels + (by * 4 + y) * stride;
+                for (unsigned int x = 0; x < 4 && bx * 4 + x < width; x++) {
+                    const BCColor& c = palette[(bits >> (2 * (y * 4 + x))) & 3];
+                    unsigned char* texel = row + (bx * 4 + x) * 3;
+                    texel[0] = (unsigned char)c.b;
+                    texel[1] = (unsigned char)c.g;
+                    texel[2] = (unsigned char)c.r;
+                }
+            }
+        }
+    }
+}
+
+static double SquaredError(const unsigned char* a, const unsigned char* b, unsigned int width, unsigned int height, size_t stride)
+{
+    double sum = 0.0;
+    for (unsigned int y = 0; y < height; y++) {
+        const unsigned char* ra = a + y * stride;
+        const unsigned char* rb = b + y * stride;
+        for (unsigned int x = 0; x < width * 3; x++) {
+            int d = (int)ra[x] - (int)rb[x];
+            sum += d * d;
+        }
+    }
+    return sum;
+}
+
+static double PSNR(double squaredError, double samples)
+{
+    if (squaredError <= 0.0)
+        return 99.0;
+    return 10.0 * log10(255.0 * 255.0 * samples / squaredError);
+}
+
+double measurePSNR(const unsigned char* a, const unsigned char* b, unsigned int width, unsigned int height, size_t stride)
+{
+    return PSNR(SquaredError(a, b, width, height, stride), (double)width * height * 3);
+}
+
+//------------------------------------------------------------
+// BMP -> DDS
+//------------------------------------------------------------
+
+#define DDSD_CAPS 0x1
+#define DDSD_HEIGHT 0x2
+#define DDSD_WIDTH 0x4
+#define DDSD_PIXELFORMAT 0x1000
+#define DDSD_MIPMAPCOUNT 0x20000
+#define DDSD_LINEARSIZE 0x80000
+#define DDPF_FOURCC 0x4
+#define DDSCAPS_COMPLEX 0x8
+#define DDSCAPS_TEXTURE 0x1000
+#define DDSCAPS_MIPMAP 0x400000
+
+static bool WriteDDS(const char* path, BCFormat format, const vector<MipLevel>& levels, const vector<unsigned char>& data)
+{
+    uint32_t header[DDS_HEADER_SIZE / 4];
+    memset(header, 0, sizeof(header));
+    header[0] = DDS_HEADER_SIZE;
+    header[1] = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+    header[2] = levels[0].height;
+    header[3] = levels[0].width;
+    header[4] = (uint32_t)bcLevelSize(levels[0].width, levels[0].height, format);
+    header[6] = (uint32_t)levels.size();
+    header[18] = 32;                    // pixel format size
+    header[19] = DDPF_FOURCC;
+    header[20] = format == BC_FORMAT_BC1 ? FOURCC_DXT1 : FOURCC_DXT5;
+    header[26] = DDSCAPS_TEXTURE | (levels.size() > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0);
+
+    FILE* fp = fopen(path, "wb");
+    if (fp == NULL)
+        return false;
+    bool ok = fwrite("DDS ", 1, 4, fp) == 4 &&
+        fwrite(header, 1, sizeof(header), fp) == sizeof(header) &&
+        fwrite(&data[0], 1, data.size(), fp) == data.size();
+    return fclose(fp) == 0 && ok;
+}
+
+bool compressBMPToDDS(const char* bmpPath, const char* ddsPath, BCFormat format, BCQuality quality,
+    BCStats* stats, int threads)
+{
+    ImageData image;
+    if (!decodeBMP(bmpPath, image))
+        return false;
+    generateMipmaps(image);
+
+    BCStats s;
+    memset(&s, 0, sizeof(s));
+    s.width = image.width;
+    s.height = image.height;
+    s.levels = (unsigned int)image.levels.size();
+
+    vector<unsigned char> data;
+    size_t total = 0;
+    for (const MipLevel& l : image.levels)
+        total += bcLevelSize(l.width, l.height, format);
+    data.reserve(total);
+
+    auto start = chrono::high_resolution_clock::now();
+    for (const MipLevel& l : image.levels)
+        compressBC(&image.pixels[l.offset], l.width, l.height, l.stride, 3, format, quality, data, threads);
+    s.seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+
+    // Decode again to see what was lost
+    vector<unsigned char> decoded(image.pixels.size());
+    double error = 0.0, samples = 0.0;
+    size_t offset = 0;
+    for (size_t i = 0; i < image.levels.size(); i++) {
+        const MipLevel& l = image.levels[i];
+        decompressBC(&data[offset], l.width, l.height, format, &decoded[l.offset], l.stride);
+        double levelError = SquaredError(&image.pixels[l.offset], &decoded[l.offset], l.width, l.height, l.stride);
+        if (i == 0)
+            s.psnr = PSNR(levelError, (double)l.width * l.height * 3);
+        error += levelError;
+        samples += (double)l.width * l.height * 3;
+        s.inputBytes += (size_t)l.width * l.height * 3;
+        offset += bcLevelSize(l.width, l.height, format);
+    }
+    s.psnrAllLevels = PSNR(error, samples);
+    s.outputBytes = data.size();
+
+    if (!WriteDDS(ddsPath, format, image.levels, data)) {
+        printf("Could not write %s\n", ddsPath);
+        return false;
+    }
+
+    printf("%s -> %s: %ux%u, %u levels, %s %s, %.1f KB -> %.1f KB in %.1f ms, PSNR %.2f dB (%.2f dB all levels)\n",
+        bmpPath, ddsPath, s.width, s.height, s.levels, bcFormatName(format), bcQualityName(quality),
+        s.inputBytes / 1024.0, s.outputBytes / 1024.0, s.seconds * 1000.0, s.psnr, s.psnrAllLevels);
+    if (stats != NULL)
+        *stats = s;
+    return true;
+}
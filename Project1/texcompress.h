@@ -0,0 +1,73 @@
+#ifndef TEXCOMPRESS_H
+#define TEXCOMPRESS_H
+
+#include <stddef.h>
+#include <vector>
+
+// BC1 (DXT1) and BC3 (DXT5) block compression of 8-bit BGR(A) images, and
+// the offline BMP -> DDS conversion built on it.
+//
+// Every 4x4 block is fitted independently: two RGB565 endpoints and a 2 bit
+// index per texel, BC3 adds an 8 byte alpha block in front. Blocks are
+// spread over threads a band of block rows at a time; matching texels to
+// the palette runs 4 texels at a time with SSE2. Blocks hanging over the
+// image edge repeat the last row and column.
+//
+// Written DDS files keep the BMP's bottom-up row order, so they sample
+// exactly like the BMP they came from.
+
+enum BCFormat
+{
+	BC_FORMAT_BC1,          // 8 bytes per block, RGB
+	BC_FORMAT_BC3           // 16 bytes per block, BC1 color plus alpha
+};
+
+enum BCQuality
+{
+	BC_QUALITY_FAST,        // endpoints from the bounding box
+	BC_QUALITY_NORMAL,      // endpoints along the principal axis
+	BC_QUALITY_HIGH         // principal axis plus least squares refinement
+};
+
+// Totals of one compressBMPToDDS call
+struct BCStats
+{
+	unsigned int width, height;
+	unsigned int levels;
+	size_t inputBytes;      // 24-bit texels of every level
+	size_t outputBytes;     // compressed blocks of every level
+	double seconds;         // compression only
+	double psnr;            // level 0, RGB, in dB
+	double psnrAllLevels;   // every texel of the chain
+};
+
+size_t bcBlockSize(BCFormat format);
+
+// Size of a width x height level in blocks
+size_t bcLevelSize(unsigned int width, unsigned int height, BCFormat format);
+
+// Compresses one level and appends its blocks, row by row, to out.
+// channels is 3 (BGR, opaque) or 4 (BGRA). threads 0 picks the core count.
+void compressBC(const unsigned char * pixels, unsigned int width, unsigned int height, size_t stride,
+	unsigned int channels, BCFormat format, BCQuality quality, std::vector<unsigned char> & out, int threads = 0);
+
+// Decodes a level back to BGR, stride bytes per row
+void decompressBC(const unsigned char * blocks, unsigned int width, unsigned int height, BCFormat format,
+	unsigned char * pixels, size_t stride);
+
+// Peak signal to noise ratio of two BGR images in dB, 99 when identical
+double measurePSNR(const unsigned char * a, const unsigned char * b, unsigned int width, unsigned int height, size_t stride);
+
+// Decodes a BMP, builds its mip chain and writes every level compressed to
+// a DDS file. stats may be NULL.
+bool compressBMPToDDS(const char * bmpPath, const char * ddsPath, BCFormat format, BCQuality quality,
+	BCStats * stats = NULL, int threads = 0);
+
+bool parseBCQuality(const char * name, BCQuality & quality);
+const char * bcQualityName(BCQuality quality);
+const char * bcFormatName(BCFormat format);
+
+// Name of the compiled SIMD path: "SSE2" or "scalar"
+const char * bcSimdName();
+
+#endif
@@ -4,8 +4,11 @@
 
 #include <GL/glew.h>
 
+#include "mappedfile.h"
+#include "texture.h"
 
-GLuint loadBMP(const char * imagepath) {
+
+bool decodeBMP(const char * imagepath, ImageData & image) {
 
     printf("Reading image %s\n", imagepath);
 
@@ -14,28 +17,28 @@ GLuint loadBMP(const char * imagepath) {
     unsigned int dataPos;
     unsigned int imageSize;
     unsigned int width, height;
-    // Actual RGB data
-    unsigned char * data;
 
     // Open the file
     FILE * file = fopen(imagepath, "rb");
-    if (!file) { printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", imagepath); getchar(); return 0; }
+    if (!file) { printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", imagepath); return false; }
 
     // Read the header, i.e. the 54 first bytes
 
     // If less than 54 bytes are read, problem
     if (fread(header, 1, 54, file) != 54) {
         printf("Not a correct BMP file\n");
-        return 0;
+        fclose(file);
+        return false;
     }
     // A BMP files always begins with "BM"
     if (header[0] != 'B' || header[1] != 'M') {
         printf("Not a correct BMP file\n");
-        return 0;
+        fclose(file);
+        return false;
     }
     // Make sure this is a 24bpp file
-    if (*(int*)&(header[0x1E]) != 0) { printf("Not a correct BMP file\n");    return 0; }
-    if (*(int*)&(header[0x1C]) != 24) { printf("Not a correct BMP file\n");    return 0; }
+    if (*(int*)&(header[0x1E]) != 0) { printf("Not a correct BMP file\n"); fclose(file); return false; }
+    if (*(int*)&(header[0x1C]) != 24) { printf("Not a correct BMP file\n"); fclose(file); return false; }
 
     // Read the information about the image
     dataPos = *(int*)&(header[0x0A]);
@@ -47,15 +50,61 @@ GLuint loadBMP(const char * imagepath) {
     if (imageSize == 0)    imageSize = width*height * 3; // 3 : one byte for each Red, Green and Blue component
     if (dataPos == 0)      dataPos = 54; // The BMP header is done that way
 
-    // Create a buffer
-    data = new unsigned char[imageSize];
+    // Rows are padded to 4 bytes, GL unpacks them the same way
+    MipLevel base;
+    base.width = width;
+    base.height = height;
+    base.offset = 0;
+    base.stride = mipRowStride(width);
+    if (imageSize < base.stride * height) {
+        printf("%s has a bad image size\n", imagepath);
+        fclose(file);
+        return false;
+    }
 
     // Read the actual data from the file into the buffer
-    fread(data, 1, imageSize, file);
+    image.width = width;
+    image.height = height;
+    image.format = GL_BGR;
+    image.pixels.resize(imageSize);
+    image.levels.assign(1, base);
+    fseek(file, dataPos, SEEK_SET);
+    size_t read = fread(image.pixels.data(), 1, imageSize, file);
 
     // Everything is in memory now, the file wan be closed
     fclose(file);
 
+    if (read != imageSize) {
+        printf("%s is truncated\n", imagepath);
+        return false;
+    }
+    return true;
+}
+
+void generateMipmaps(ImageData & image, MipFilter filter, bool srgb) {
+
+    if (image.levels.size() == 1)
+        buildMipChain(image.pixels, image.levels, filter, srgb);
+}
+
+void setTextureFiltering(GLenum target, unsigned int levelCount) {
+
+    glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+
+    // Trilinear when there is a chain to blend between
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, levelCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    if (levelCount > 1 && GLEW_EXT_texture_filter_anisotropic) {
+        GLfloat maxAnisotropy = 1.0f;
+        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxAnisotropy);
+        glTexParameterf(target, GL_TEXTURE_MAX_ANISOTROPY_EXT,
+            maxAnisotropy < TEXTURE_MAX_ANISOTROPY ? maxAnisotropy : TEXTURE_MAX_ANISOTROPY);
+    }
+}
+
+GLuint createImageTexture(const ImageData & image, const void * pixels) {
+
     // Create one OpenGL texture
     GLuint textureID;
     glGenTextures(1, &textureID);
@@ -63,19 +112,34 @@ GLuint loadBMP(const char * imagepath) {
     // "Bind" the newly created texture : all future texture functions will modify this texture
     glBindTexture(GL_TEXTURE_2D, textureID);
 
-    // Give the image to OpenGL
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_BGR, GL_UNSIGNED_BYTE, data);
-
-    // OpenGL has now copied the data. Free our own version
-    delete[] data;
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    // Give the image to OpenGL, every level we have
+    unsigned int levelCount = image.levels.empty() ? 1 : (unsigned int)image.levels.size();
+    for (unsigned int level = 0; level < levelCount; ++level) {
+        if (image.levels.empty()) {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, image.width, image.height, 0, image.format, GL_UNSIGNED_BYTE, pixels);
+            break;
+        }
+        const MipLevel & l = image.levels[level];
+        glTexImage2D(GL_TEXTURE_2D, level, GL_RGB, l.width, l.height, 0, image.format, GL_UNSIGNED_BYTE,
+            (const unsigned char *)pixels + l.offset);
+    }
+    setTextureFiltering(GL_TEXTURE_2D, levelCount);
 
     // Return the ID of the texture we just created
     return textureID;
 }
 
+GLuint loadBMP(const char * imagepath) {
+
+    ImageData image;
+    if (!decodeBMP(imagepath, image))
+        return 0;
+    generateMipmaps(image);
+
+    // OpenGL copies the data, our version goes away with image
+    return createImageTexture(image, image.pixels.data());
+}
+
 // Since GLFW 3, glfwLoadTexture2D() has been removed. You have to use another texture loading library, 
 // or do it yourself (just like loadBMP_custom and loadDDS)
 //GLuint loadTGA_glfw(const char * imagepath){
@@ -103,99 +167,184 @@ GLuint loadBMP(const char * imagepath) {
 
 
 
-#define FOURCC_DXT1 0x31545844 // Equivalent to "DXT1" in ASCII
-#define FOURCC_DXT3 0x33545844 // Equivalent to "DXT3" in ASCII
-#define FOURCC_DXT5 0x35545844 // Equivalent to "DXT5" in ASCII
-
-GLuint loadDDS(const char * imagepath) {
-
-    unsigned char header[124];
+bool openDDS(const char * imagepath, DDSImage & image) {
 
-    FILE *fp;
+    memset(&image, 0, sizeof(image));
 
-    /* try to open the file */
-    fp = fopen(imagepath, "rb");
-    if (fp == NULL) {
-        printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", imagepath); getchar();
-        return 0;
+    /* try to map the file */
+    if (!mapFile(imagepath, image.file)) {
+        printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", imagepath);
+        return false;
     }
 
     /* verify the type of file */
-    char filecode[4];
-    fread(filecode, 1, 4, fp);
-    if (strncmp(filecode, "DDS ", 4) != 0) {
-        fclose(fp);
-        return 0;
+    const unsigned char * file = (const unsigned char *)image.file.data;
+    if (image.file.size < DDS_DATA_OFFSET || strncmp((const char *)file, "DDS ", 4) != 0) {
+        printf("%s is not a DDS file\n", imagepath);
+        closeDDS(image);
+        return false;
     }
 
     /* get the surface desc */
-    fread(&header, 124, 1, fp);
-
+    const unsigned char * header = file + 4;
     unsigned int height = *(unsigned int*)&(header[8]);
     unsigned int width = *(unsigned int*)&(header[12]);
-    unsigned int linearSize = *(unsigned int*)&(header[16]);
     unsigned int mipMapCount = *(unsigned int*)&(header[24]);
     unsigned int fourCC = *(unsigned int*)&(header[80]);
 
-
-    unsigned char * buffer;
-    unsigned int bufsize;
-    /* how big is it going to be including all mipmaps? */
-    bufsize = mipMapCount > 1 ? linearSize * 2 : linearSize;
-    buffer = (unsigned char*)malloc(bufsize * sizeof(unsigned char));
-    fread(buffer, 1, bufsize, fp);
-    /* close the file pointer */
-    fclose(fp);
-
-    unsigned int components = (fourCC == FOURCC_DXT1) ? 3 : 4;
-    unsigned int format;
     switch (fourCC)
     {
     case FOURCC_DXT1:
-        format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+        image.format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+        image.blockSize = 8;
         break;
     case FOURCC_DXT3:
-        format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+        image.format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+        image.blockSize = 16;
         break;
     case FOURCC_DXT5:
-        format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        image.format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        image.blockSize = 16;
         break;
     default:
-        free(buffer);
-        return 0;
+        printf("%s is not DXT1, DXT3 or DXT5 compressed\n", imagepath);
+        closeDDS(image);
+        return false;
+    }
+    if (width == 0 || height == 0) {
+        printf("%s has no pixels\n", imagepath);
+        closeDDS(image);
+        return false;
     }
 
+    /* lay out the mip chain; files without mipmaps say 0 or 1 */
+    image.width = width;
+    image.height = height;
+    if (mipMapCount == 0)
+        mipMapCount = 1;
+    size_t offset = DDS_DATA_OFFSET;
+    for (unsigned int level = 0; level < mipMapCount && level < DDS_MAX_LEVELS; ++level)
+    {
+        DDSLevel & l = image.levels[level];
+        l.width = width;
+        l.height = height;
+        l.offset = offset;
+        l.size = (size_t)((width + 3) / 4) * ((height + 3) / 4) * image.blockSize;
+        if (offset + l.size > image.file.size) {
+            printf("%s is truncated, using %u of %u mip levels\n", imagepath, level, mipMapCount);
+            break;
+        }
+        offset += l.size;
+        image.levelCount++;
+
+        if (width == 1 && height == 1)
+            break;
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+
+    if (image.levelCount == 0) {
+        closeDDS(image);
+        return false;
+    }
+    return true;
+}
+
+void closeDDS(DDSImage & image) {
+    unmapFile(image.file);
+}
+
+GLuint loadDDS(const char * imagepath) {
+
+    DDSImage image;
+    if (!openDDS(imagepath, image))
+        return 0;
+
     // Create one OpenGL texture
     GLuint textureID;
     glGenTextures(1, &textureID);
 
     // "Bind" the newly created texture : all future texture functions will modify this texture
     glBindTexture(GL_TEXTURE_2D, textureID);
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
-    unsigned int blockSize = (format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT) ? 8 : 16;
-    unsigned int offset = 0;
+    // A chain that stops before 1x1 is still complete
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image.levelCount - 1);
 
-    /* load the mipmaps */
-    for (unsigned int level = 0; level < mipMapCount && (width || height); ++level)
+    /* load the mipmaps straight from the mapping */
+    for (unsigned int level = 0; level < image.levelCount; ++level)
     {
-        unsigned int size = ((width + 3) / 4)*((height + 3) / 4)*blockSize;
-        glCompressedTexImage2D(GL_TEXTURE_2D, level, format, width, height,
-            0, size, buffer + offset);
+        const DDSLevel & l = image.levels[level];
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, image.format, l.width, l.height,
+            0, (GLsizei)l.size, image.file.data + l.offset);
+    }
 
-        offset += size;
-        width /= 2;
-        height /= 2;
+    closeDDS(image);
 
-        // Deal with Non-Power-Of-Two textures. This code is not included in the webpage to reduce clutter.
-        if (width < 1) width = 1;
-        if (height < 1) height = 1;
+    return textureID;
+}
 
-    }
+//------------------------------------------------------------
+// Progressive DDS upload
+//------------------------------------------------------------
 
-    free(buffer);
+static size_t UploadNextDDSLevel(DDSStream & stream) {
 
-    return textureID;
+    const DDSImage & image = stream.image;
+    const DDSLevel & l = image.levels[stream.nextLevel];
+    glCompressedTexSubImage2D(GL_TEXTURE_2D, stream.nextLevel, 0, 0, l.width, l.height,
+        image.format, (GLsizei)l.size, image.file.data + l.offset);
+    stream.nextLevel--;
+    return l.size;
+}
+
+GLuint beginDDSStream(DDSImage & image, DDSStream & stream) {
+
+    // The stream owns the mapping from here on
+    stream.image = image;
+    memset(&image.file, 0, sizeof(image.file));
+    stream.nextLevel = (int)stream.image.levelCount - 1;
+
+    // Storage for the whole chain now, contents level by level
+    glGenTextures(1, &stream.texture);
+    glBindTexture(GL_TEXTURE_2D, stream.texture);
+    glTexStorage2D(GL_TEXTURE_2D, stream.image.levelCount, stream.image.format,
+        stream.image.width, stream.image.height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, stream.nextLevel);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, stream.nextLevel);
+
+    // The smallest level is a few bytes; uploading it here means the
+    // texture never gets sampled before it has contents
+    UploadNextDDSLevel(stream);
+    if (stream.nextLevel < 0)
+        closeDDS(stream.image);
 
+    return stream.texture;
+}
+
+size_t streamDDS(DDSStream & stream, size_t budgetBytes) {
+
+    if (stream.nextLevel < 0)
+        return 0;
 
-}
\ No newline at end of file
+    const DDSImage & image = stream.image;
+    glBindTexture(GL_TEXTURE_2D, stream.texture);
+
+    // At least one level per call so big levels still arrive
+    size_t uploaded = 0;
+    int finest = stream.nextLevel + 1;
+    while (stream.nextLevel >= 0) {
+        if (uploaded > 0 && uploaded + image.levels[stream.nextLevel].size > budgetBytes)
+            break;
+        finest = stream.nextLevel;
+        uploaded += UploadNextDDSLevel(stream);
+    }
+
+    // Sample only what has arrived
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, finest);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image.levelCount - 1);
+
+    if (stream.nextLevel < 0)
+        closeDDS(stream.image);
+    return uploaded;
+}
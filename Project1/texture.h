@@ -1,16 +1,104 @@
 #ifndef TEXTURE_HPP
 #define TEXTURE_HPP
 
+#include <stddef.h>
+#include <vector>
+
+#include "mappedfile.h"
+#include "mipmap.h"
+
+// Decoded pixels of an image, rows bottom-up as GL expects them. levels
+// describes where each mip level sits in pixels; empty means pixels is a
+// single tightly packed level.
+struct ImageData
+{
+	unsigned int width, height;
+	GLenum format;                      // GL_BGR for BMP
+	std::vector<unsigned char> pixels;
+	std::vector<MipLevel> levels;
+};
+
+// Filter used for BMP mip chains; BMP texels are sRGB encoded
+#define TEXTURE_MIP_FILTER MIP_FILTER_KAISER
+#define TEXTURE_MIP_SRGB true
+
+// Anisotropic filtering is capped at this many samples
+#define TEXTURE_MAX_ANISOTROPY 8.0f
+
 // Load a .BMP file using our custom loader
 GLuint loadBMP(const char * imagepath);
 
+// The two halves of loadBMP: decoding and building the mip chain only
+// touch memory and may run on any thread, creating the texture needs the
+// GL context. pixels is either image.pixels or an offset into the bound
+// GL_PIXEL_UNPACK_BUFFER; every level in image.levels is uploaded and
+// sampled trilinearly, anisotropically where the driver allows.
+bool decodeBMP(const char * imagepath, ImageData & image);
+void generateMipmaps(ImageData & image, MipFilter filter = TEXTURE_MIP_FILTER, bool srgb = TEXTURE_MIP_SRGB);
+GLuint createImageTexture(const ImageData & image, const void * pixels);
+
+// Levels 0 to levelCount - 1 of the texture bound to target, sampled
+// trilinearly and anisotropically
+void setTextureFiltering(GLenum target, unsigned int levelCount);
+
 //// Since GLFW 3, glfwLoadTexture2D() has been removed. You have to use another texture loading library, 
 //// or do it yourself (just like loadBMP_custom and loadDDS)
 //// Load a .TGA file using GLFW's own loader
 //GLuint loadTGA_glfw(const char * imagepath);
 
-// Load a .DDS file using GLFW's own loader
+// Load a .DDS file (DXT1/3/5) using our custom loader. The file is mapped
+// and every mip level goes to GL straight from the mapping.
 GLuint loadDDS(const char * imagepath);
 
+#define FOURCC_DXT1 0x31545844 // Equivalent to "DXT1" in ASCII
+#define FOURCC_DXT3 0x33545844 // Equivalent to "DXT3" in ASCII
+#define FOURCC_DXT5 0x35545844 // Equivalent to "DXT5" in ASCII
+
+// "DDS " magic, then the header, then the mip levels back to back
+#define DDS_HEADER_SIZE 124
+#define DDS_DATA_OFFSET (4 + DDS_HEADER_SIZE)
+
+// A mapped DDS file and where each mip level sits in it. Level sizes come
+// from the 4x4 block layout: 8 bytes per block for DXT1, 16 for DXT3/5.
+#define DDS_MAX_LEVELS 16
+
+struct DDSLevel
+{
+	unsigned int width, height;
+	size_t offset, size;
+};
+
+struct DDSImage
+{
+	MappedFile file;
+	GLenum format;
+	unsigned int blockSize;
+	unsigned int width, height;
+	unsigned int levelCount;            // levels actually present in the file
+	DDSLevel levels[DDS_MAX_LEVELS];
+};
+
+bool openDDS(const char * imagepath, DDSImage & image);
+void closeDDS(DDSImage & image);
+
+// Uploads a DDS over several frames, smallest level first, so a large
+// texture can be sampled right away and sharpens as the finer levels come
+// in. GL_TEXTURE_BASE_LEVEL always points at the finest level uploaded.
+struct DDSStream
+{
+	GLuint texture;
+	DDSImage image;
+	int nextLevel;                      // -1 once everything is uploaded
+};
+
+// Takes over the mapping of image, allocates the texture storage and
+// uploads the smallest level, so the texture can be sampled right away
+GLuint beginDDSStream(DDSImage & image, DDSStream & stream);
+
+// Uploads levels, finest last, until the next one would go over
+// budgetBytes; always at least one. Returns the bytes uploaded. The
+// mapping is closed after the last level.
+size_t streamDDS(DDSStream & stream, size_t budgetBytes);
+
 
 #endif
\ No newline at end of file
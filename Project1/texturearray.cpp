@@ -0,0 +1,253 @@
+#include <stdio.h>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#include "texture.h"
+#include "texturearray.h"
+
+using namespace std;
+
+// Longest mip chain looked at, enough for 32k textures
+static const unsigned int MAX_LEVELS = 16;
+
+// What packing needs to know about a 2D texture
+struct SourceTexture
+{
+    GLuint texture;
+    GLenum internalFormat;
+    bool compressed;
+    unsigned int width, height;
+    unsigned int levels;
+    int array, layer;
+};
+
+
+static unsigned int LevelSize(unsigned int size, unsigned int level)
+{
+    return max(size >> level, 1u);
+}
+
+// False for textures still being streamed or without a usable level 0
+static bool DescribeTexture(GLuint texture, SourceTexture& source)
+{
+    glBindTexture(GL_TEXTURE_2D, texture);
+
+    GLint base = 0, maxLevel = 0, immutable = GL_FALSE, immutableLevels = 0;
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, &base);
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_IMMUTABLE_FORMAT, &immutable);
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_IMMUTABLE_LEVELS, &immutableLevels);
+    if (base != 0)
+        return false;
+
+    GLint width = 0, height = 0, format = 0, compressed = GL_FALSE;
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &format);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+    if (width <= 0 || height <= 0)
+        return false;
+
+    source.texture = texture;
+    source.internalFormat = (GLenum)format;
+    source.compressed = compressed != GL_FALSE;
+    source.width = (unsigned int)width;
+    source.height = (unsigned int)height;
+
+    // Levels that are actually there, in the sizes a chain should have
+    unsigned int limit = immutable ? (unsigned int)immutableLevels : (unsigned int)maxLevel + 1;
+    limit = min(limit, MAX_LEVELS);
+    source.levels = 1;
+    while (source.levels < limit) {
+        GLint w = 0, h = 0;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, source.levels, GL_TEXTURE_WIDTH, &w);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, source.levels, GL_TEXTURE_HEIGHT, &h);
+        if ((unsigned int)w != LevelSize(source.width, source.levels) || (unsigned int)h != LevelSize(source.height, source.levels))
+            break;
+        source.levels++;
+    }
+    return true;
+}
+
+static unsigned int FullChainLevels(unsigned int width, unsigned int height)
+{
+    unsigned int levels = 1;
+    while ((width >> levels) > 0 || (height >> levels) > 0)
+        levels++;
+    return min(levels, MAX_LEVELS);
+}
+
+// Array a source can join, -1 if none
+static int FindArray(const vector<TextureArray>& arrays, const SourceTexture& source, unsigned int maxLayers)
+{
+    for (size_t a = 0; a < arrays.size(); a++) {
+        const TextureArray& array = arrays[a];
+        if (array.layers >= maxLayers || array.compressed != source.compressed)
+            continue;
+        if (source.compressed) {
+            if (array.internalFormat == source.internalFormat && array.width == source.width &&
+                array.height == source.height && array.levels == source.levels)
+                return (int)a;
+        }
+        else if (array.width >= source.width && array.height >= source.height &&
+            (double)source.width * source.height >= TEXTURE_ARRAY_MIN_FILL * array.width * array.height) {
+            return (int)a;
+        }
+    }
+    return -1;
+}
+
+// Uncompressed layers are filled by blitting each level; false when the
+// source level cannot be attached for reading
+static bool BlitLayer(const SourceTexture& source, const TextureArray& array, int layer, GLuint readFbo, GLuint drawFbo)
+{
+    for (unsigned int level = 0; level < array.levels; level++) {
+        unsigned int from = min(level, source.levels - 1);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, readFbo);
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, source.texture, from);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFbo);
+        glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, array.texture, level, layer);
+        if (glCheckFramebufferStatus(GL_READ_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE ||
+            glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            return false;
+
+        unsigned int sw = LevelSize(source.width, from), sh = LevelSize(source.height, from);
+        unsigned int dw = LevelSize(array.width, level), dh = LevelSize(array.height, level);
+        glBlitFramebuffer(0, 0, sw, sh, 0, 0, dw, dh, GL_COLOR_BUFFER_BIT,
+            sw == dw && sh == dh ? GL_NEAREST : GL_LINEAR);
+    }
+    return true;
+}
+
+static void CopyCompressedLayer(const SourceTexture& source, const TextureArray& array, int layer)
+{
+    for (unsigned int level = 0; level < array.levels; level++)
+        glCopyImageSubData(source.texture, GL_TEXTURE_2D, level, 0, 0, 0,
+            array.texture, GL_TEXTURE_2D_ARRAY, level, 0, 0, layer,
+            LevelSize(source.width, level), LevelSize(source.height, level), 1);
+}
+
+void packTextures(const GLuint* textures, unsigned int count, TexturePacking& packing)
+{
+    packing.arrays.clear();
+    packing.layers.assign(count, TextureLayer());
+    packing.texelsUsed = packing.texelsAllocated = packing.bytes = 0;
+    packing.resampled = 0;
+
+    GLint maxLayers = 256;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+
+    // Each texture once, largest first so every group is sized by its
+    // first member
+    vector<SourceTexture> sources;
+    for (unsigned int i = 0; i < count; i++) {
+        packing.layers[i].array = -1;
+        packing.layers[i].layer = 0;
+        bool seen = false;
+        for (const SourceTexture& s : sources)
+            seen = seen || s.texture == textures[i];
+        SourceTexture source;
+        if (textures[i] != 0 && !seen && DescribeTexture(textures[i], source))
+            sources.push_back(source);
+    }
+    stable_sort(sources.begin(), sources.end(), [](const SourceTexture& a, const SourceTexture& b) {
+        return (size_t)a.width * a.height > (size_t)b.width * b.height;
+    });
+
+    for (SourceTexture& source : sources) {
+        int a = FindArray(packing.arrays, source, (unsigned int)maxLayers);
+        if (a < 0) {
+            TextureArray array;
+            array.texture = 0;
+            array.compressed = source.compressed;
+            array.internalFormat = source.compressed ? source.internalFormat : GL_RGBA8;
+            array.width = source.width;
+            array.height = source.height;
+            array.levels = source.compressed ? source.levels : FullChainLevels(source.width, source.height);
+            array.layers = 0;
+            packing.arrays.push_back(array);
+            a = (int)packing.arrays.size() - 1;
+        }
+        source.array = a;
+        source.layer = (int)packing.arrays[a].layers++;
+    }
+
+    // Keep whatever framebuffers the caller had bound
+    GLint drawBinding = 0, readBinding = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawBinding);
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readBinding);
+    GLuint fbos[2];
+    glGenFramebuffers(2, fbos);
+
+    for (TextureArray& array : packing.arrays) {
+        glGenTextures(1, &array.texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array.texture);
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, array.levels, array.internalFormat, array.width, array.height, array.layers);
+        setTextureFiltering(GL_TEXTURE_2D_ARRAY, array.levels);
+    }
+
+    for (SourceTexture& source : sources) {
+        const TextureArray& array = packing.arrays[source.array];
+        if (array.compressed) {
+            CopyCompressedLayer(source, array, source.layer);
+        }
+        else if (!BlitLayer(source, array, source.layer, fbos[0], fbos[1])) {
+            printf("Texture %u cannot be read through a framebuffer, leaving it unpacked\n", source.texture);
+            source.array = -1;
+            continue;
+        }
+        if (source.width != array.width || source.height != array.height)
+            packing.resampled++;
+        packing.texelsUsed += (size_t)source.width * source.height;
+    }
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawBinding);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, readBinding);
+    glDeleteFramebuffers(2, fbos);
+
+    for (unsigned int i = 0; i < count; i++) {
+        for (const SourceTexture& source : sources) {
+            if (source.texture == textures[i] && source.array >= 0) {
+                packing.layers[i].array = source.array;
+                packing.layers[i].layer = source.layer;
+            }
+        }
+    }
+    for (const SourceTexture& source : sources)
+        if (source.array >= 0)
+            glDeleteTextures(1, &source.texture);
+
+    for (const TextureArray& array : packing.arrays) {
+        packing.texelsAllocated += (size_t)array.width * array.height * array.layers;
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array.texture);
+        for (unsigned int level = 0; level < array.levels; level++) {
+            if (array.compressed) {
+                GLint size = 0;
+                glGetTexLevelParameteriv(GL_TEXTURE_2D_ARRAY, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+                packing.bytes += size;
+            }
+            else {
+                packing.bytes += (size_t)LevelSize(array.width, level) * LevelSize(array.height, level) * 4 * array.layers;
+            }
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void printTexturePackingStats(const TexturePacking& packing)
+{
+    unsigned int packed = 0;
+    for (const TextureLayer& layer : packing.layers)
+        packed += layer.array >= 0;
+    printf("Texture arrays: %u of %u textures in %u arrays (%u scaled to fit), %.1f%% of layer texels used, %.1f MB\n",
+        packed, (unsigned int)packing.layers.size(), (unsigned int)packing.arrays.size(), packing.resampled,
+        packing.texelsAllocated > 0 ? 100.0 * packing.texelsUsed / packing.texelsAllocated : 0.0,
+        packing.bytes / (1024.0 * 1024.0));
+    for (size_t a = 0; a < packing.arrays.size(); a++) {
+        const TextureArray& array = packing.arrays[a];
+        printf("  array %u: %ux%u, %u levels, %u layers, %s\n", (unsigned int)a, array.width, array.height,
+            array.levels, array.layers, array.compressed ? "compressed" : "RGBA8");
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef TEXTUREARRAY_H
+#define TEXTUREARRAY_H
+
+#include <stddef.h>
+#include <vector>
+
+#include <GL/glew.h>
+
+// Packs finished 2D textures into GL_TEXTURE_2D_ARRAYs, so objects with
+// different textures can be drawn without rebinding: they bind the array
+// once and pass the layer with the draw.
+//
+// All copies stay on the GPU. Compressed textures (DDS) only share an
+// array when format, size and mip count match, and are copied block for
+// block. Uncompressed textures go into RGBA8 arrays whose layers have the
+// size of the largest texture in the group; smaller ones are scaled up
+// with a linear blit, mip level by mip level. Since UVs are normalized,
+// scaling does not change how an object maps its texture.
+
+// A texture only joins a larger layer if it covers at least this much of it
+#define TEXTURE_ARRAY_MIN_FILL 0.25
+
+struct TextureArray
+{
+	GLuint texture;
+	GLenum internalFormat;
+	unsigned int width, height;
+	unsigned int levels;
+	unsigned int layers;
+	bool compressed;
+};
+
+// Where a packed texture ended up
+struct TextureLayer
+{
+	int array;              // into TexturePacking::arrays, -1 if not packed
+	int layer;
+};
+
+struct TexturePacking
+{
+	std::vector<TextureArray> arrays;
+	std::vector<TextureLayer> layers;       // one per texture passed in
+	size_t texelsUsed;                      // level 0 texels of the sources
+	size_t texelsAllocated;                 // level 0 texels of every layer
+	size_t bytes;                           // all levels of all arrays
+	unsigned int resampled;                 // sources scaled to a layer
+};
+
+// Packs textures[0..count). Repeated names share a layer. Textures that
+// cannot be packed (not complete, unusual format) keep array -1 and stay
+// alive; the others are deleted. Changes bindings behind glstate.
+void packTextures(const GLuint * textures, unsigned int count, TexturePacking & packing);
+
+// Fill efficiency and memory of the arrays
+void printTexturePackingStats(const TexturePacking & packing);
+
+#endif
@@ -0,0 +1,68 @@
+#include <algorithm>
+
+#include "threadpool.h"
+
+using namespace std;
+
+
+static void WorkerLoop(ThreadPool* pool)
+{
+    unique_lock<mutex> lock(pool->mutex);
+    for (;;) {
+        pool->wake.wait(lock, [pool]() { return pool->stopping || !pool->tasks.empty(); });
+        if (pool->tasks.empty())
+            return;
+
+        function<void()> task = move(pool->tasks.front());
+        pool->tasks.pop_front();
+        pool->busy++;
+
+        lock.unlock();
+        task();
+        lock.lock();
+
+        pool->busy--;
+        if (pool->busy == 0 && pool->tasks.empty())
+            pool->idle.notify_all();
+    }
+}
+
+void startThreadPool(ThreadPool& pool, unsigned int threads)
+{
+    if (threads == 0) {
+        unsigned int cores = thread::hardware_concurrency();
+        threads = max(cores, 2u) - 1;
+    }
+
+    pool.busy = 0;
+    pool.stopping = false;
+    for (unsigned int i = 0; i < threads; i++)
+        pool.workers.push_back(thread(WorkerLoop, &pool));
+}
+
+void submitTask(ThreadPool& pool, function<void()> task)
+{
+    {
+        lock_guard<mutex> lock(pool.mutex);
+        pool.tasks.push_back(move(task));
+    }
+    pool.wake.notify_one();
+}
+
+void waitThreadPool(ThreadPool& pool)
+{
+    unique_lock<mutex> lock(pool.mutex);
+    pool.idle.wait(lock, [&pool]() { return pool.busy == 0 && pool.tasks.empty(); });
+}
+
+void stopThreadPool(ThreadPool& pool)
+{
+    {
+        lock_guard<mutex> lock(pool.mutex);
+        pool.stopping = true;
+    }
+    pool.wake.notify_all();
+    for (thread& worker : pool.workers)
+        worker.join();
+    pool.workers.clear();
+}
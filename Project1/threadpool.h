@@ -0,0 +1,37 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads pulling tasks from one FIFO queue. Meant for
+// coarse jobs such as parsing a whole file; anything that needs the GL
+// context has to be handed back to the main thread.
+
+struct ThreadPool
+{
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()> > tasks;
+	std::mutex mutex;
+	std::condition_variable wake;       // a task was queued or the pool stops
+	std::condition_variable idle;       // queue ran empty and nothing runs
+	unsigned int busy;
+	bool stopping;
+};
+
+// threads 0 uses one less than the number of cores, but at least one
+void startThreadPool(ThreadPool & pool, unsigned int threads = 0);
+
+void submitTask(ThreadPool & pool, std::function<void()> task);
+
+// Blocks until every queued task has finished
+void waitThreadPool(ThreadPool & pool);
+
+// Runs what is still queued, then joins the workers
+void stopThreadPool(ThreadPool & pool);
+
+#endif
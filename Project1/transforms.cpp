@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define TRANSFORM_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TRANSFORM_SSE2
+#endif
+
+#include "transforms.h"
+
+using namespace std;
+
+
+//------------------------------------------------------------
+// Column-major like glm: column j of the result is a times
+// column j of b, summed in glm's order so both agree exactly
+//------------------------------------------------------------
+
+void multiplyTransform(const glm::mat4& a, const glm::mat4& b, glm::mat4& out)
+{
+    const float* pa = &a[0][0];
+    const float* pb = &b[0][0];
+    float* po = &out[0][0];
+#if defined(TRANSFORM_AVX)
+    __m256 a0 = _mm256_broadcast_ps((const __m128*)(pa + 0));
+    __m256 a1 = _mm256_broadcast_ps((const __m128*)(pa + 4));
+    __m256 a2 = _mm256_broadcast_ps((const __m128*)(pa + 8));
+    __m256 a3 = _mm256_broadcast_ps((const __m128*)(pa + 12));
+    for (int j = 0; j < 4; j += 2) {
+        __m256 col = _mm256_loadu_ps(pb + 4 * j);
+        __m256 r = _mm256_mul_ps(a0, _mm256_shuffle_ps(col, col, 0x00));
+        r = _mm256_add_ps(r, _mm256_mul_ps(a1, _mm256_shuffle_ps(col, col, 0x55)));
+        r = _mm256_add_ps(r, _mm256_mul_ps(a2, _mm256_shuffle_ps(col, col, 0xAA)));
+        r = _mm256_add_ps(r, _mm256_mul_ps(a3, _mm256_shuffle_ps(col, col, 0xFF)));
+        _mm256_storeu_ps(po + 4 * j, r);
+    }
+#elif defined(TRANSFORM_SSE2)
+    __m128 a0 = _mm_loadu_ps(pa + 0);
+    __m128 a1 = _mm_loadu_ps(pa + 4);
+    __m128 a2 = _mm_loadu_ps(pa + 8);
+    __m128 a3 = _mm_loadu_ps(pa + 12);
+    for (int j = 0; j < 4; j++) {
+        __m128 col = _mm_loadu_ps(pb + 4 * j);
+        __m128 r = _mm_mul_ps(a0, _mm_shuffle_ps(col, col, 0x00));
+        r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_shuffle_ps(col, col, 0x55)));
+        r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_shuffle_ps(col, col, 0xAA)));
+        r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_shuffle_ps(col, col, 0xFF)));
+        _mm_storeu_ps(po + 4 * j, r);
+    }
+#else
+    out = a * b;
+#endif
+}
+
+bool buildTransformHierarchy(TransformHierarchy& hierarchy, const int* parents, const glm::mat4* locals,
+    size_t count, vector<unsigned int>& slots)
+{
+    // Depth of every node; a walk longer than count is a cycle
+    vector<int> depth(count, -1);
+    vector<size_t> path;
+    int max_depth = -1;
+    for (size_t i = 0; i < count; i++) {
+        path.clear();
+        size_t n = i;
+        while (depth[n] < 0) {
+            if (parents[n] >= (int)count || path.size() > count) {
+                printf("Transform hierarchy: node %u has an invalid parent or is in a cycle\n", (unsigned int)n);
+                return false;
+            }
+            path.push_back(n);
+            if (parents[n] < 0)
+                break;
+            n = parents[n];
+        }
+        int d = depth[n] >= 0 ? depth[n] + 1 : 0;
+        for (size_t k = path.size(); k-- > 0;)
+            depth[path[k]] = d++;
+        max_depth = max(max_depth, depth[i]);
+    }
+
+    // Stable counting sort by depth
+    hierarchy.levels.assign(max_depth + 2, 0);
+    for (size_t i = 0; i < count; i++)
+        hierarchy.levels[depth[i] + 1]++;
+    for (int d = 0; d <= max_depth; d++)
+        hierarchy.levels[d + 1] += hierarchy.levels[d];
+    vector<size_t> fill(hierarchy.levels.begin(), hierarchy.levels.end() - 1);
+    slots.resize(count);
+    for (size_t i = 0; i < count; i++)
+        slots[i] = (unsigned int)fill[depth[i]]++;
+
+    hierarchy.parent.resize(count);
+    hierarchy.local.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        hierarchy.parent[slots[i]] = parents[i] >= 0 ? (int)slots[parents[i]] : -1;
+        hierarchy.local[slots[i]] = locals[i];
+    }
+    hierarchy.world.resize(count);
+    hierarchy.modelView.resize(count);
+    hierarchy.dirty.assign(count, 1);
+    hierarchy.changed.assign(count, 0);
+    hierarchy.viewValid = false;
+    hierarchy.stats = TransformStats();
+    hierarchy.stats.nodes = count;
+    hierarchy.stats.levels = (unsigned int)(max_depth + 1);
+    return true;
+}
+
+void setLocalTransform(TransformHierarchy& hierarchy, unsigned int slot, const glm::mat4& local)
+{
+    hierarchy.local[slot] = local;
+    hierarchy.dirty[slot] = 1;
+}
+
+//------------------------------------------------------------
+// One batch of one depth level. The parents live in earlier
+// levels, which are finished.
+//------------------------------------------------------------
+
+static size_t UpdateRange(TransformHierarchy& hierarchy, size_t begin, size_t end, const glm::mat4* view, bool allViews)
+{
+    size_t updated = 0;
+    for (size_t i = begin; i < end; i++) {
+        int p = hierarchy.parent[i];
+        bool changed = hierarchy.dirty[i] || (p >= 0 && hierarchy.changed[p]);
+        hierarchy.changed[i] = changed;
+        if (changed) {
+            if (p >= 0)
+                multiplyTransform(hierarchy.world[p], hierarchy.local[i], hierarchy.world[i]);
+            else
+                hierarchy.world[i] = hierarchy.local[i];
+            hierarchy.dirty[i] = 0;
+            updated++;
+        }
+        if (view != NULL && (changed || allViews))
+            multiplyTransform(*view, hierarchy.world[i], hierarchy.modelView[i]);
+    }
+    return updated;
+}
+
+void updateTransforms(TransformHierarchy& hierarchy, const glm::mat4* view, JobPool* pool)
+{
+    auto start = chrono::high_resolution_clock::now();
+    bool all_views = false;
+    if (view != NULL) {
+        all_views = !hierarchy.viewValid || !(hierarchy.view == *view);
+        hierarchy.view = *view;
+        hierarchy.viewValid = true;
+    }
+
+    atomic<size_t> updated(0);
+    for (size_t level = 0; level + 1 < hierarchy.levels.size(); level++) {
+        size_t first = hierarchy.levels[level];
+        size_t count = hierarchy.levels[level + 1] - first;
+        if (pool == NULL) {
+            updated += UpdateRange(hierarchy, first, first + count, view, all_views);
+            continue;
+        }
+        parallelFor(*pool, count, TRANSFORM_BATCH, [&](size_t begin, size_t end) {
+            updated += UpdateRange(hierarchy, first + begin, first + end, view, all_views);
+        });
+    }
+
+    hierarchy.stats.updated = updated;
+    hierarchy.stats.milliseconds = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+void updateTransformsReference(TransformHierarchy& hierarchy, const glm::mat4* view)
+{
+    size_t count = hierarchy.parent.size();
+    for (size_t i = 0; i < count; i++) {
+        int p = hierarchy.parent[i];
+        hierarchy.world[i] = p >= 0 ? hierarchy.world[p] * hierarchy.local[i] : hierarchy.local[i];
+        if (view != NULL)
+            hierarchy.modelView[i] = *view * hierarchy.world[i];
+        hierarchy.dirty[i] = 0;
+    }
+    hierarchy.stats.updated = count;
+}
+
+const char* transformSimdName()
+{
+#if defined(TRANSFORM_AVX)
+    return "AVX";
+#elif defined(TRANSFORM_SSE2)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,71 @@
+#ifndef TRANSFORMS_H
+#define TRANSFORMS_H
+
+#include <stddef.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "jobpool.h"
+
+// Parent/child transforms for large scenes, kept structure-of-arrays and
+// sorted by depth: every node of depth d sits before the nodes of depth
+// d + 1, so one pass per depth level finds the parent's world matrix
+// already final. Each level is split into batches over a JobPool, and the
+// matrices are multiplied with SSE (4 floats per column) or AVX (two
+// columns at once).
+//
+// Only what moved is recomputed: a node's world matrix is rebuilt when its
+// local matrix was set since the last update or its parent's was rebuilt.
+// Model-view matrices follow the world matrices, and all of them are
+// rebuilt when the view changes.
+
+// Nodes per job
+#define TRANSFORM_BATCH 2048
+
+struct TransformStats
+{
+	size_t nodes;
+	size_t updated;             // world matrices rebuilt by the last update
+	unsigned int levels;
+	double milliseconds;
+};
+
+struct TransformHierarchy
+{
+	std::vector<int> parent;            // slot, -1 for roots
+	std::vector<size_t> levels;         // first slot of every depth, then the node count
+	std::vector<glm::mat4> local;
+	std::vector<glm::mat4> world;
+	std::vector<glm::mat4> modelView;
+	std::vector<unsigned char> dirty;   // local set since the last update
+	std::vector<unsigned char> changed; // world rebuilt by the last update
+	glm::mat4 view;
+	bool viewValid;
+	TransformStats stats;
+};
+
+// Sorts count nodes by depth; parents[i] is the node i hangs under, or -1.
+// slots receives the slot every node ended up in, the sort is stable so a
+// forest of roots keeps its order. False if a parent is out of range or
+// the parents form a cycle. Every node starts dirty.
+bool buildTransformHierarchy(TransformHierarchy & hierarchy, const int * parents, const glm::mat4 * locals,
+	size_t count, std::vector<unsigned int> & slots);
+
+void setLocalTransform(TransformHierarchy & hierarchy, unsigned int slot, const glm::mat4 & local);
+
+// Rebuilds the dirty subtrees. view NULL skips the model-view matrices;
+// pool NULL runs on the calling thread.
+void updateTransforms(TransformHierarchy & hierarchy, const glm::mat4 * view, JobPool * pool);
+
+// Every node with glm, one after another, the way per-object code does it;
+// the reference for the SIMD path
+void updateTransformsReference(TransformHierarchy & hierarchy, const glm::mat4 * view);
+
+// out = a * b with the compiled SIMD path; out may be a or b
+void multiplyTransform(const glm::mat4 & a, const glm::mat4 & b, glm::mat4 & out);
+
+// Name of the compiled SIMD path: "AVX", "SSE2" or "scalar"
+const char * transformSimdName();
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef UNIFORMBUFFERS_H
+#define UNIFORMBUFFERS_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// std140 uniform blocks shared by all scene shaders. Frame data changes
+// once per frame, materials only when they are edited; draws select a
+// material with the `material_index` uniform.
+
+#define FRAME_UBO_BINDING 0
+#define MATERIAL_UBO_BINDING 1
+#define MAX_MATERIALS 64
+
+// FrameData in the shaders
+struct FrameUniforms
+{
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::vec4 light_pos;	// view space, w unused
+};
+
+// Material in the shaders
+struct MaterialUniforms
+{
+	glm::vec4 ambient;
+	glm::vec4 diffuse;
+	glm::vec4 specular;		// w = specular power
+};
+
+// Allocates a buffer of size bytes for GL_UNIFORM_BUFFER use
+GLuint createUniformBuffer(GLsizeiptr size);
+
+// Replaces the first size bytes; the old storage is orphaned so the
+// update never waits on draws of the previous frame
+void updateUniformBuffer(GLuint buffer, const void * data, GLsizeiptr size, GLsizeiptr capacity);
+
+#endif
@@ -0,0 +1,248 @@
+#include <math.h>
+#include <string.h>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include "vertexformat.h"
+
+//------------------------------------------------------------
+// Encoders and the matching GL decoders
+//------------------------------------------------------------
+
+static unsigned int packNormal(glm::vec3 n)
+{
+    // Signed normalized 10 bits per component, w unused
+    int x = (int)floorf(glm::clamp(n.x, -1.0f, 1.0f) * 511.0f + 0.5f);
+    int y = (int)floorf(glm::clamp(n.y, -1.0f, 1.0f) * 511.0f + 0.5f);
+    int z = (int)floorf(glm::clamp(n.z, -1.0f, 1.0f) * 511.0f + 0.5f);
+    return (x & 0x3FF) | ((y & 0x3FF) << 10) | ((z & 0x3FF) << 20);
+}
+
+static float decodeSigned10(unsigned int bits)
+{
+    int value = (int)(bits & 0x3FF);
+    if (value & 0x200)
+        value -= 0x400;
+    return glm::max(value / 511.0f, -1.0f);
+}
+
+static glm::vec3 unpackNormal(unsigned int packed)
+{
+    return glm::vec3(decodeSigned10(packed), decodeSigned10(packed >> 10), decodeSigned10(packed >> 20));
+}
+
+static short packSnorm16(float value)
+{
+    return (short)floorf(glm::clamp(value, -1.0f, 1.0f) * 32767.0f + 0.5f);
+}
+
+static float unpackSnorm16(short value)
+{
+    return glm::max(value / 32767.0f, -1.0f);
+}
+
+static unsigned short packUnorm16(float value)
+{
+    return (unsigned short)floorf(glm::clamp(value, 0.0f, 1.0f) * 65535.0f + 0.5f);
+}
+
+
+//------------------------------------------------------------
+// Layout
+//------------------------------------------------------------
+
+static VertexAttribute makeAttribute(GLint size, GLenum type, GLboolean normalized, GLuint offset)
+{
+    VertexAttribute attribute;
+    attribute.size = size;
+    attribute.type = type;
+    attribute.normalized = normalized;
+    attribute.offset = offset;
+    return attribute;
+}
+
+void buildVertexLayout(const MeshData & mesh, unsigned int flags, VertexLayout & layout)
+{
+    // Normalized shorts only work when every uv fits
+    if (flags & VERTEX_UV_SHORT) {
+        for (unsigned int i = 0; i < mesh.vertexCount; i++) {
+            if (fabsf(mesh.uvs[i].x) > 1.0f || fabsf(mesh.uvs[i].y) > 1.0f) {
+                flags = (flags & ~VERTEX_UV_SHORT) | VERTEX_UV_HALF;
+                break;
+            }
+        }
+    }
+    if (flags & VERTEX_UV_SHORT)
+        flags &= ~VERTEX_UV_HALF;
+
+    GLuint offset = 0;
+
+    // Attributes stay 4-byte aligned, hence the padded ushort3
+    if (flags & VERTEX_POSITION_SHORT) {
+        layout.position = makeAttribute(3, GL_UNSIGNED_SHORT, GL_TRUE, offset);
+        offset += 4 * sizeof(unsigned short);
+    }
+    else {
+        layout.position = makeAttribute(3, GL_FLOAT, GL_FALSE, offset);
+        offset += 3 * sizeof(float);
+    }
+
+    if (flags & VERTEX_NORMAL_PACKED) {
+        layout.normal = makeAttribute(4, GL_INT_2_10_10_10_REV, GL_TRUE, offset);
+        offset += sizeof(unsigned int);
+    }
+    else {
+        layout.normal = makeAttribute(3, GL_FLOAT, GL_FALSE, offset);
+        offset += 3 * sizeof(float);
+    }
+
+    if (flags & VERTEX_UV_SHORT) {
+        layout.uv = makeAttribute(2, GL_SHORT, GL_TRUE, offset);
+        offset += 2 * sizeof(short);
+    }
+    else if (flags & VERTEX_UV_HALF) {
+        layout.uv = makeAttribute(2, GL_HALF_FLOAT, GL_FALSE, offset);
+        offset += 2 * sizeof(unsigned short);
+    }
+    else {
+        layout.uv = makeAttribute(2, GL_FLOAT, GL_FALSE, offset);
+        offset += 2 * sizeof(float);
+    }
+
+    layout.flags = flags;
+    layout.stride = offset;
+
+    // Uniform scale over the largest extent of the bounds
+    layout.dequantize = glm::mat4(1.0f);
+    if (flags & VERTEX_POSITION_SHORT) {
+        glm::vec3 extent = mesh.boundsMax - mesh.boundsMin;
+        float scale = glm::max(extent.x, glm::max(extent.y, extent.z));
+        if (scale <= 0.0f)
+            scale = 1.0f;
+        layout.dequantize = glm::translate(glm::mat4(1.0f), mesh.boundsMin);
+        layout.dequantize = glm::scale(layout.dequantize, glm::vec3(scale));
+    }
+}
+
+//------------------------------------------------------------
+// Public functions
+//------------------------------------------------------------
+
+void packVertices(const MeshData & mesh, const VertexLayout & layout, void * out)
+{
+    // Padding bytes are written too, so the buffer is fully defined
+    memset(out, 0, (size_t)mesh.vertexCount * layout.stride);
+
+    // Uniform scale of the bounds, 1 when positions stay float
+    float scale = layout.dequantize[0][0];
+
+    for (unsigned int i = 0; i < mesh.vertexCount; i++) {
+        unsigned char * vertex = (unsigned char *)out + (size_t)i * layout.stride;
+
+        if (layout.flags & VERTEX_POSITION_SHORT) {
+            glm::vec3 p = (mesh.vertices[i] - mesh.boundsMin) / scale;
+            unsigned short q[4] = { packUnorm16(p.x), packUnorm16(p.y), packUnorm16(p.z), 0 };
+            memcpy(vertex + layout.position.offset, q, sizeof(q));
+        }
+        else {
+            memcpy(vertex + layout.position.offset, &mesh.vertices[i], sizeof(glm::vec3));
+        }
+
+        if (layout.flags & VERTEX_NORMAL_PACKED) {
+            unsigned int q = packNormal(mesh.normals[i]);
+            memcpy(vertex + layout.normal.offset, &q, sizeof(q));
+        }
+        else {
+            memcpy(vertex + layout.normal.offset, &mesh.normals[i], sizeof(glm::vec3));
+        }
+
+        if (layout.flags & VERTEX_UV_SHORT) {
+            short q[2] = { packSnorm16(mesh.uvs[i].x), packSnorm16(mesh.uvs[i].y) };
+            memcpy(vertex + layout.uv.offset, q, sizeof(q));
+        }
+        else if (layout.flags & VERTEX_UV_HALF) {
+            unsigned short q[2] = { glm::packHalf1x16(mesh.uvs[i].x), glm::packHalf1x16(mesh.uvs[i].y) };
+            memcpy(vertex + layout.uv.offset, q, sizeof(q));
+        }
+        else {
+            memcpy(vertex + layout.uv.offset, &mesh.uvs[i], sizeof(glm::vec2));
+        }
+    }
+}
+
+static void setAttribute(GLuint id, const VertexAttribute & attribute, GLsizei stride)
+{
+    glVertexAttribPointer(id, attribute.size, attribute.type, attribute.normalized,
+        stride, (const void *)(size_t)attribute.offset);
+    glEnableVertexAttribArray(id);
+}
+
+void setVertexAttributes(const VertexLayout & layout)
+{
+    setAttribute(POSITION_ATTRIBUTE, layout.position, layout.stride);
+    setAttribute(NORMAL_ATTRIBUTE, layout.normal, layout.stride);
+    setAttribute(UV_ATTRIBUTE, layout.uv, layout.stride);
+}
+
+VertexErrorReport measureVertexError(const MeshData & mesh, const VertexLayout & layout, const void * data)
+{
+    VertexErrorReport report;
+    report.maxPositionError = 0.0f;
+    report.maxNormalError = 0.0f;
+    report.maxUvError = 0.0f;
+
+    for (unsigned int i = 0; i < mesh.vertexCount; i++) {
+        const unsigned char * vertex = (const unsigned char *)data + (size_t)i * layout.stride;
+
+        glm::vec3 position;
+        if (layout.flags & VERTEX_POSITION_SHORT) {
+            unsigned short q[4];
+            memcpy(q, vertex + layout.position.offset, sizeof(q));
+            glm::vec4 p = layout.dequantize * glm::vec4(q[0] / 65535.0f, q[1] / 65535.0f, q[2] / 65535.0f, 1.0f);
+            position = glm::vec3(p.x, p.y, p.z);
+        }
+        else {
+            memcpy(&position, vertex + layout.position.offset, sizeof(position));
+        }
+
+        glm::vec3 normal;
+        if (layout.flags & VERTEX_NORMAL_PACKED) {
+            unsigned int q;
+            memcpy(&q, vertex + layout.normal.offset, sizeof(q));
+            normal = unpackNormal(q);
+        }
+        else {
+            memcpy(&normal, vertex + layout.normal.offset, sizeof(normal));
+        }
+
+        glm::vec2 uv;
+        if (layout.flags & VERTEX_UV_SHORT) {
+            short q[2];
+            memcpy(q, vertex + layout.uv.offset, sizeof(q));
+            uv = glm::vec2(unpackSnorm16(q[0]), unpackSnorm16(q[1]));
+        }
+        else if (layout.flags & VERTEX_UV_HALF) {
+            unsigned short q[2];
+            memcpy(q, vertex + layout.uv.offset, sizeof(q));
+            uv = glm::vec2(glm::unpackHalf1x16(q[0]), glm::unpackHalf1x16(q[1]));
+        }
+        else {
+            memcpy(&uv, vertex + layout.uv.offset, sizeof(uv));
+        }
+
+        report.maxPositionError = glm::max(report.maxPositionError, glm::length(position - mesh.vertices[i]));
+        report.maxUvError = glm::max(report.maxUvError, glm::length(uv - mesh.uvs[i]));
+
+        // The fragment shader renormalizes, so only the direction matters
+        float a = glm::length(normal), b = glm::length(mesh.normals[i]);
+        if (a > 0.0f && b > 0.0f) {
+            float cosine = glm::clamp(glm::dot(normal, mesh.normals[i]) / (a * b), -1.0f, 1.0f);
+            report.maxNormalError = glm::max(report.maxNormalError, acosf(cosine) * 57.2957795f);
+        }
+    }
+
+    return report;
+}
@@ -0,0 +1,66 @@
+#ifndef VERTEXFORMAT_H
+#define VERTEXFORMAT_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "meshcache.h"
+
+// Interleaved vertex stream with optional quantization. Flags can be
+// combined; without any the layout is 32 bytes of plain floats.
+#define VERTEX_NORMAL_PACKED    0x1 // normals as GL_INT_2_10_10_10_REV
+#define VERTEX_UV_HALF          0x2 // uvs as half floats
+#define VERTEX_UV_SHORT         0x4 // uvs as normalized shorts, falls back to half when uvs leave [-1, 1]
+#define VERTEX_POSITION_SHORT   0x8 // positions as normalized unsigned shorts inside the bounds
+
+// Attribute locations, fixed by the layout qualifiers of vertexshader.vert
+// so every variant can draw with the same vertex arrays
+#define POSITION_ATTRIBUTE  0
+#define NORMAL_ATTRIBUTE    1
+#define UV_ATTRIBUTE        2
+
+struct VertexAttribute
+{
+	GLint size;
+	GLenum type;
+	GLboolean normalized;
+	GLuint offset;
+};
+
+struct VertexLayout
+{
+	unsigned int flags;         // what was actually applied
+	GLsizei stride;
+	VertexAttribute position;
+	VertexAttribute normal;
+	VertexAttribute uv;
+
+	// Maps decoded positions back to object space. Quantized positions
+	// land in [0, 1]; multiply this into the model matrix so the shaders
+	// never need to know. The scale is uniform, so normals stay correct.
+	glm::mat4 dequantize;
+};
+
+struct VertexErrorReport
+{
+	float maxPositionError;     // object space units
+	float maxNormalError;       // degrees
+	float maxUvError;
+};
+
+// Picks offsets and types for the requested flags. Flags the mesh cannot
+// honour are dropped from layout.flags.
+void buildVertexLayout(const MeshData & mesh, unsigned int flags, VertexLayout & layout);
+
+// Interleaves (and quantizes) the streams of a mesh into out, which holds
+// vertexCount * layout.stride bytes; typically a mapped GL buffer
+void packVertices(const MeshData & mesh, const VertexLayout & layout, void * out);
+
+// Points the attributes of the bound vao at the bound GL_ARRAY_BUFFER,
+// at the locations vertexshader.vert fixes for every variant
+void setVertexAttributes(const VertexLayout & layout);
+
+// Decodes a packed buffer the way GL does and compares it to the source
+VertexErrorReport measureVertexError(const MeshData & mesh, const VertexLayout & layout, const void * data);
+
+#endif
@@ -1,16 +1,54 @@
 #version 430 core
 
-// Uniform matrices
-uniform mat4 mv;
-uniform mat4 projection;
-uniform vec3 light_pos;
+// Built in variants, see shadervariants.h. Features used here:
+// INSTANCED  model-view matrix and material come from the instance
+//            buffer instead of uniforms
+// TEXTURED   UVs are passed on
 
-// Per-vertex inputs
-in vec3 position;
-in vec3 normal;
+// Per-frame data, updated once per frame
+layout(std140, binding = 0) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec4 light_pos;
+};
+
+#ifdef INSTANCED
+struct Instance
+{
+    mat4 model_view;    // includes the vertex dequantization
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;      // w = power
+};
+
+layout(std430, binding = 0) readonly buffer Instances
+{
+    Instance instances[];
+};
 
-in vec2 uv;
+// First instance of the range being drawn, gl_InstanceID restarts at 0
+uniform int instance_offset;
+
+// Material of this instance for the fragment shader
+flat out vec3 mat_ambient;
+flat out vec3 mat_diffuse;
+flat out vec4 mat_specular;
+#else
+// Object to view, including the vertex dequantization; view itself
+// is only used for the light
+uniform mat4 model_view;
+#endif
+
+// Per-vertex inputs, at fixed locations so every program built from this
+// shader can use the same vertex arrays
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+
+#ifdef TEXTURED
+layout(location = 2) in vec2 uv;
 out vec2 UV;
+#endif
 
 out VS_OUT
 {
@@ -21,6 +59,13 @@ out VS_OUT
 
 void main()
 {
+#ifdef INSTANCED
+    Instance instance = instances[instance_offset + gl_InstanceID];
+    mat4 mv = instance.model_view;
+#else
+    mat4 mv = model_view;
+#endif
+
     // Calculate view-space coordinate
     vec4 P = mv * vec4(position, 1.0);
 
@@ -28,7 +73,7 @@ void main()
     vs_out.N = mat3(mv) * normal;
 
     // Calculate light vector
-    vs_out.L = light_pos - P.xyz;
+    vs_out.L = light_pos.xyz - P.xyz;
 
     // Calculate view vector;
     vs_out.V = -P.xyz;
@@ -36,5 +81,13 @@ void main()
     // Calculate the clip-space position of each vertex
     gl_Position = projection * P;
 
+#ifdef TEXTURED
     UV = uv;
+#endif
+
+#ifdef INSTANCED
+    mat_ambient = instance.ambient.rgb;
+    mat_diffuse = instance.diffuse.rgb;
+    mat_specular = instance.specular;
+#endif
 }